@@ -49,6 +49,9 @@ public:
 
 	std::string name () const;
 	std::string json_name () const;
+	Resource resource () const {
+		return RESOURCE_IO;
+	}
 	void run ();
 
 	boost::shared_ptr<const Playlist> playlist () const {
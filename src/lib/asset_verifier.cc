@@ -0,0 +1,163 @@
+/*
+    Copyright (C) 2018 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/** @file  src/lib/asset_verifier.cc
+ *  @brief AssetVerifier class.
+ */
+
+#include "asset_verifier.h"
+#include "digester.h"
+#include "cross.h"
+#include "exceptions.h"
+#include <nettle/sha1.h>
+#include <nettle/base64.h>
+#include <boost/scoped_ptr.hpp>
+#include <boost/scoped_array.hpp>
+#include <algorithm>
+#include <cerrno>
+
+using std::string;
+using std::vector;
+using std::pair;
+using std::make_pair;
+using std::min;
+using std::sort;
+using boost::function;
+using boost::scoped_ptr;
+using boost::scoped_array;
+
+/** Size of the blocks in which we read the asset file */
+#define BLOCK_SIZE (1024 * 1024)
+
+/** @param file Asset file.
+ *  @param frames Details of the frames that should be in the file.
+ */
+AssetVerifier::AssetVerifier (boost::filesystem::path file, vector<dcp::FrameInfo> frames)
+	: _file (file)
+	, _frames (frames)
+{
+
+}
+
+/** Read the whole asset, checking its frames.
+ *  @param set_progress Function to report progress from 0 to 1, or 0.
+ *  @return Digest of the file, in the same form as dcp::make_digest.
+ */
+string
+AssetVerifier::run (function<void (float)> set_progress)
+{
+	_bad_frames.clear ();
+
+	/* Frame offsets and indices into _frames, in the order that the frames are in the file */
+	vector<pair<uint64_t, size_t> > order;
+	for (size_t i = 0; i < _frames.size(); ++i) {
+		order.push_back (make_pair (_frames[i].offset, i));
+	}
+	sort (order.begin(), order.end());
+
+	FILE* f = fopen_boost (_file, "rb");
+	if (!f) {
+		throw OpenFileError (_file, errno, true);
+	}
+
+	boost::uintmax_t const size = boost::filesystem::file_size (_file);
+
+	sha1_ctx sha;
+	sha1_init (&sha);
+
+	scoped_array<uint8_t> buffer (new uint8_t[BLOCK_SIZE]);
+	/* Next entry in order that we have not yet started to check */
+	size_t next = 0;
+	/* Digester for the frame that we are part-way through, if any */
+	scoped_ptr<Digester> current;
+	/* Number of bytes of the current frame that we have yet to see */
+	uint64_t remaining = 0;
+	/* Offset in the file of the start of buffer */
+	uint64_t position = 0;
+
+	while (true) {
+		size_t const n = fread (buffer.get(), 1, BLOCK_SIZE, f);
+		if (n == 0) {
+			break;
+		}
+
+		sha1_update (&sha, n, buffer.get());
+
+		uint64_t const end = position + n;
+		uint64_t p = position;
+		while (p < end) {
+			if (!current) {
+				if (next == order.size() || order[next].first >= end) {
+					break;
+				}
+				if (order[next].first < p) {
+					/* This frame overlaps the previous one, so something is wrong */
+					_bad_frames.push_back (order[next].second);
+					++next;
+					continue;
+				}
+				p = order[next].first;
+				current.reset (new Digester);
+				remaining = _frames[order[next].second].size;
+			}
+
+			uint64_t const this_time = min (remaining, end - p);
+			current->add (buffer.get() + p - position, this_time);
+			p += this_time;
+			remaining -= this_time;
+
+			if (remaining == 0) {
+				size_t const index = order[next].second;
+				if (current->get() != _frames[index].hash) {
+					_bad_frames.push_back (index);
+				}
+				current.reset ();
+				++next;
+			}
+		}
+
+		position = end;
+
+		if (set_progress && size > 0) {
+			set_progress (float (position) / size);
+		}
+	}
+
+	bool const error = ferror (f);
+	fclose (f);
+	if (error) {
+		throw ReadFileError (_file);
+	}
+
+	/* Anything that we did not get to the end of is missing or incomplete */
+	for (; next < order.size(); ++next) {
+		_bad_frames.push_back (order[next].second);
+	}
+
+	sort (_bad_frames.begin(), _bad_frames.end());
+
+	uint8_t digest[SHA1_DIGEST_SIZE];
+	sha1_digest (&sha, SHA1_DIGEST_SIZE, digest);
+
+	char base64[BASE64_ENCODE_RAW_LENGTH (SHA1_DIGEST_SIZE) + 1];
+	base64_encode_raw (base64, SHA1_DIGEST_SIZE, digest);
+	base64[BASE64_ENCODE_RAW_LENGTH (SHA1_DIGEST_SIZE)] = '\0';
+	return base64;
+}
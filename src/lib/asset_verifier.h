@@ -0,0 +1,62 @@
+/*
+    Copyright (C) 2018 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/** @file  src/lib/asset_verifier.h
+ *  @brief AssetVerifier class.
+ */
+
+#ifndef DCPOMATIC_ASSET_VERIFIER_H
+#define DCPOMATIC_ASSET_VERIFIER_H
+
+#include <dcp/picture_asset_writer.h>
+#include <boost/filesystem.hpp>
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+#include <vector>
+
+/** @class AssetVerifier
+ *  @brief Compute the digest of an asset file (as it should appear in a PKL) and, in the
+ *  same pass through the file, check each of its frames against the hash that was recorded
+ *  when the frame was written.
+ *
+ *  The file is read sequentially a block at a time, so memory use does not depend on
+ *  the size of the asset or its frames.
+ */
+class AssetVerifier : public boost::noncopyable
+{
+public:
+	AssetVerifier (boost::filesystem::path file, std::vector<dcp::FrameInfo> frames);
+
+	std::string run (boost::function<void (float)> set_progress);
+
+	/** @return indices into the list of frames given to the constructor of those frames
+	 *  which were missing, incomplete or did not match their hashes; only valid after run().
+	 */
+	std::vector<size_t> bad_frames () const {
+		return _bad_frames;
+	}
+
+private:
+	boost::filesystem::path _file;
+	std::vector<dcp::FrameInfo> _frames;
+	std::vector<size_t> _bad_frames;
+};
+
+#endif
@@ -20,12 +20,21 @@
 
 #include "audio_buffers.h"
 #include "dcpomatic_assert.h"
+#include <boost/thread/mutex.hpp>
 #include <cassert>
 #include <cstring>
 #include <cmath>
 #include <stdexcept>
+#include <map>
+#include <limits>
+#include <vector>
 
 using std::bad_alloc;
+using std::max;
+using std::min;
+using std::numeric_limits;
+using std::map;
+using std::vector;
 using boost::shared_ptr;
 
 /** Construct an AudioBuffers.  Audio data is undefined after this constructor.
@@ -72,36 +81,148 @@ AudioBuffers::~AudioBuffers ()
 	deallocate ();
 }
 
+/** Largest amount of sample memory that we will keep for re-use when AudioBuffers are destroyed */
+#define MAXIMUM_POOL_BYTES (64 * 1024 * 1024)
+
+/** Blocks of sample memory which are not being used but which we are keeping to
+ *  save calls to malloc() and free(), since AudioBuffers are created and destroyed
+ *  for nearly every block of audio.
+ */
+class AudioPool
+{
+public:
+	AudioPool ()
+		: _bytes (0)
+	{}
+
+	/** @param size Number of floats, which will usually be a power of 2 */
+	float* get (size_t size)
+	{
+		{
+			boost::mutex::scoped_lock lm (_mutex);
+			vector<float*>& free = _free[size];
+			if (!free.empty ()) {
+				float* p = free.back ();
+				free.pop_back ();
+				_bytes -= size * sizeof (float);
+				return p;
+			}
+		}
+
+		float* p = static_cast<float*> (malloc (size * sizeof (float)));
+		if (!p) {
+			throw bad_alloc ();
+		}
+		return p;
+	}
+
+	void put (float* p, size_t size)
+	{
+		{
+			boost::mutex::scoped_lock lm (_mutex);
+			if (_bytes + size * sizeof (float) <= MAXIMUM_POOL_BYTES) {
+				_free[size].push_back (p);
+				_bytes += size * sizeof (float);
+				return;
+			}
+		}
+
+		free (p);
+	}
+
+	static AudioPool* instance ()
+	{
+		/* This is never deleted, so that it outlives any static AudioBuffers */
+		static AudioPool* pool = new AudioPool ();
+		return pool;
+	}
+
+private:
+	/** mutex to protect _free and _bytes */
+	boost::mutex _mutex;
+	/** Unused blocks indexed by their size in floats */
+	map<size_t, vector<float*> > _free;
+	/** Total size of the blocks in _free */
+	size_t _bytes;
+};
+
+/** Deleter which gives memory back to the pool rather than freeing it */
+class AudioPoolDeleter
+{
+public:
+	explicit AudioPoolDeleter (size_t size)
+		: _size (size)
+	{}
+
+	void operator() (float* p) const
+	{
+		AudioPool::instance()->put (p, _size);
+	}
+
+private:
+	size_t _size;
+};
+
+static int64_t
+round_up_to_power_of_2 (int64_t n)
+{
+	n--;
+	n |= n >> 1;
+	n |= n >> 2;
+	n |= n >> 4;
+	n |= n >> 8;
+	n |= n >> 16;
+	n |= n >> 32;
+	n++;
+	return n;
+}
+
+/** Set up _data to have space for at least `frames' frames of `channels' channels,
+ *  all in one block of memory taken from the pool.  _frames is set to `frames',
+ *  but _allocated_frames may be larger; any such extra space is silenced.
+ */
 void
 AudioBuffers::allocate (int channels, int32_t frames)
 {
 	DCPOMATIC_ASSERT (frames >= 0);
 	DCPOMATIC_ASSERT (channels >= 0);
 
+	/* Round the block up to a power of 2 so that the pool does not end up with too
+	   many different sizes, and give any spare to the channels.  Do the sums in
+	   64 bits as channels * frames can overflow an int.
+	*/
+	int64_t const needed = max (int64_t (1), int64_t (channels) * frames);
+	int64_t size = round_up_to_power_of_2 (needed);
+	if (channels > 0 && size / channels > numeric_limits<int32_t>::max()) {
+		/* Rounding up would give us more frames than we can count */
+		size = needed;
+	}
+	if (uint64_t (size) > numeric_limits<size_t>::max() / sizeof (float)) {
+		throw bad_alloc ();
+	}
+
 	_channels = channels;
 	_frames = frames;
-	_allocated_frames = frames;
 
-	_data = static_cast<float**> (malloc (_channels * sizeof (float *)));
+	_data = static_cast<float**> (malloc (max (1, _channels) * sizeof (float *)));
 	if (!_data) {
 		throw bad_alloc ();
 	}
 
+	_allocated_frames = _channels > 0 ? size / _channels : frames;
+	_storage.reset (AudioPool::instance()->get (size), AudioPoolDeleter (size));
+
 	for (int i = 0; i < _channels; ++i) {
-		_data[i] = static_cast<float*> (malloc (frames * sizeof (float)));
-		if (!_data[i]) {
-			throw bad_alloc ();
-		}
+		_data[i] = _storage.get() + size_t (i) * _allocated_frames;
+		/* Space after _frames must be silent, as it would be if ensure_size() were used to get it */
+		memset (_data[i] + _frames, 0, (_allocated_frames - _frames) * sizeof (float));
 	}
 }
 
 void
 AudioBuffers::deallocate ()
 {
-	for (int i = 0; i < _channels; ++i) {
-		free (_data[i]);
-	}
-
+	_storage.reset ();
 	free (_data);
 }
 
@@ -255,27 +376,26 @@ AudioBuffers::ensure_size (int32_t frames)
 	}
 
 	/* Round up frames to the next power of 2 to reduce the number
-	   of realloc()s that are necessary.
+	   of re-allocations that are necessary.
 	*/
-	frames--;
-	frames |= frames >> 1;
-	frames |= frames >> 2;
-	frames |= frames >> 4;
-	frames |= frames >> 8;
-	frames |= frames >> 16;
-	frames++;
+	frames = min (int64_t (numeric_limits<int32_t>::max()), round_up_to_power_of_2 (frames));
+
+	float** old_data = _data;
+	shared_ptr<float> old_storage = _storage;
+	int32_t const old_frames = _frames;
+	int32_t const old_allocated_frames = _allocated_frames;
+
+	allocate (_channels, frames);
 
 	for (int i = 0; i < _channels; ++i) {
-		_data[i] = static_cast<float*> (realloc (_data[i], frames * sizeof (float)));
-		if (!_data[i]) {
-			throw bad_alloc ();
-		}
-		for (int j = _allocated_frames; j < frames; ++j) {
+		memcpy (_data[i], old_data[i], old_allocated_frames * sizeof (float));
+		for (int j = old_allocated_frames; j < _allocated_frames; ++j) {
 			_data[i][j] = 0;
 		}
 	}
 
-	_allocated_frames = frames;
+	_frames = old_frames;
+	free (old_data);
 }
 
 /** Mix some other buffers with these ones.  The AudioBuffers must have the same number of channels.
@@ -354,11 +474,70 @@ AudioBuffers::append (shared_ptr<const AudioBuffers> other)
 	_frames += other->frames();
 }
 
-/** Remove some frames from the start of these AudioBuffers */
+/** Remove some frames from the start of these AudioBuffers.  No audio data
+ *  is moved; we just start using our memory from further along.
+ */
 void
 AudioBuffers::trim_start (int32_t frames)
 {
 	DCPOMATIC_ASSERT (frames <= _frames);
-	move (_frames - frames, frames, 0);
-	set_frames (_frames - frames);
+
+	for (int i = 0; i < _channels; ++i) {
+		_data[i] += frames;
+	}
+
+	_frames -= frames;
+	_allocated_frames -= frames;
+}
+
+/** Construct an AudioBuffers which uses some of the memory of another, without copying.
+ *  @param other AudioBuffers whose memory to use.
+ *  @param offset Offset of our first frame within other.
+ *  @param frames Number of frames.
+ */
+AudioBuffers::AudioBuffers (AudioBuffers const & other, int32_t offset, int32_t frames)
+	: _channels (other._channels)
+	, _frames (frames)
+	, _allocated_frames (frames)
+	, _storage (other._storage)
+{
+	_data = static_cast<float**> (malloc (max (1, _channels) * sizeof (float *)));
+	if (!_data) {
+		throw bad_alloc ();
+	}
+
+	for (int i = 0; i < _channels; ++i) {
+		_data[i] = other._data[i] + offset;
+	}
+}
+
+/** Remove some frames from the start of these AudioBuffers and return them.
+ *  No audio data is copied; the returned AudioBuffers use the same memory as
+ *  these, but the two never use the same parts of it, so each can be modified
+ *  without affecting the other.
+ *  @param frames Number of frames to remove.
+ *  @return AudioBuffers containing the removed frames.
+ */
+shared_ptr<AudioBuffers>
+AudioBuffers::split (int32_t frames)
+{
+	DCPOMATIC_ASSERT (frames <= _frames);
+	shared_ptr<AudioBuffers> start (new AudioBuffers (*this, 0, frames));
+	trim_start (frames);
+	return start;
+}
+
+/** @return A view of some of our frames which shares our memory, so no audio data
+ *  is copied.  The caller must not change these frames in this AudioBuffers while
+ *  the view is in use.
+ *  @param offset Offset of the first frame in the view.
+ *  @param frames Number of frames in the view.
+ */
+shared_ptr<const AudioBuffers>
+AudioBuffers::slice (int32_t offset, int32_t frames) const
+{
+	DCPOMATIC_ASSERT (offset >= 0);
+	DCPOMATIC_ASSERT ((offset + frames) <= _frames);
+
+	return shared_ptr<const AudioBuffers> (new AudioBuffers (*this, offset, frames));
 }
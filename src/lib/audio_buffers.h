@@ -79,8 +79,12 @@ public:
 	void accumulate_frames (AudioBuffers const * from, int32_t frames, int32_t read_offset, int32_t write_offset);
 	void append (boost::shared_ptr<const AudioBuffers> other);
 	void trim_start (int32_t frames);
+	boost::shared_ptr<AudioBuffers> split (int32_t frames);
+	boost::shared_ptr<const AudioBuffers> slice (int32_t offset, int32_t frames) const;
 
 private:
+	AudioBuffers (AudioBuffers const & other, int32_t offset, int32_t frames);
+
 	void allocate (int channels, int32_t frames);
 	void deallocate ();
 
@@ -92,6 +96,10 @@ private:
 	int32_t _allocated_frames;
 	/** Audio data (so that, e.g. _data[2][6] is channel 2, sample 6) */
 	float** _data;
+	/** Memory that _data points into; this may also be used by other AudioBuffers
+	 *  (see split() and slice()).
+	 */
+	boost::shared_ptr<float> _storage;
 };
 
 #endif
@@ -21,10 +21,13 @@
 #include "audio_mapping.h"
 #include "util.h"
 #include "digester.h"
+#include "audio_buffers.h"
+#include "dcpomatic_assert.h"
 #include <dcp/raw_convert.h>
 #include <libcxml/cxml.h>
 #include <libxml++/libxml++.h>
 #include <iostream>
+#include <cstring>
 
 using std::list;
 using std::cout;
@@ -190,3 +193,112 @@ AudioMapping::unmap_all ()
 		}
 	}
 }
+
+SparseAudioMapping::SparseAudioMapping ()
+	: _identity (true)
+{
+
+}
+
+/** @param mapping Mapping to use.
+ *  @param output_channels Number of channels that the output of apply() will have;
+ *  any that are not in mapping will be silent.
+ */
+SparseAudioMapping::SparseAudioMapping (AudioMapping const & mapping, int output_channels)
+	: _sources (output_channels)
+	, _identity (mapping.input_channels() == output_channels)
+{
+	for (int i = 0; i < output_channels; ++i) {
+		for (int j = 0; j < mapping.input_channels(); ++j) {
+			if (i < mapping.output_channels() && mapping.get (j, i) > 0) {
+				_sources[i].push_back (Source (j, mapping.get (j, i)));
+			}
+		}
+
+		if (_sources[i].size() != 1 || _sources[i].front().input != i || _sources[i].front().gain != 1) {
+			_identity = false;
+		}
+	}
+}
+
+/** Apply this mapping.
+ *  @param in Input audio.
+ *  @param out Buffers to write the mapped audio to, which must have output_channels() channels.
+ *  These will be made big enough for the frames in in.
+ */
+void
+SparseAudioMapping::apply (AudioBuffers const * in, AudioBuffers* out) const
+{
+	DCPOMATIC_ASSERT (out->channels() == output_channels ());
+
+	int const N = in->frames ();
+	out->ensure_size (N);
+	out->set_frames (N);
+
+	for (int i = 0; i < output_channels(); ++i) {
+		vector<Source> const & sources = _sources[i];
+		float* d = out->data (i);
+
+		if (sources.empty ()) {
+			memset (d, 0, N * sizeof (float));
+			continue;
+		}
+
+		/* The first source initialises the output, so that it need not be made silent first */
+		float const * s = in->data (sources.front().input);
+		float const g = sources.front().gain;
+		if (g == 1) {
+			memcpy (d, s, N * sizeof (float));
+		} else {
+			for (int j = 0; j < N; ++j) {
+				d[j] = s[j] * g;
+			}
+		}
+
+		for (size_t k = 1; k < sources.size(); ++k) {
+			float const * s = in->data (sources[k].input);
+			float const g = sources[k].gain;
+			for (int j = 0; j < N; ++j) {
+				d[j] += s[j] * g;
+			}
+		}
+	}
+}
+
+/** Apply the mapping to some audio, writing the result as interleaved samples.
+ *  @param in Input audio.
+ *  @param offset Offset of the first frame to use from in.
+ *  @param frames Number of frames to map.
+ *  @param out Output, which must have space for frames * output_channels() samples.
+ */
+void
+SparseAudioMapping::apply_interleaved (AudioBuffers const * in, int offset, int frames, float* out) const
+{
+	int const stride = output_channels ();
+
+	for (int i = 0; i < stride; ++i) {
+		vector<Source> const & sources = _sources[i];
+		float* d = out + i;
+
+		if (sources.empty ()) {
+			for (int j = 0; j < frames; ++j) {
+				d[j * stride] = 0;
+			}
+			continue;
+		}
+
+		float const * s = in->data (sources.front().input) + offset;
+		float const g = sources.front().gain;
+		for (int j = 0; j < frames; ++j) {
+			d[j * stride] = s[j] * g;
+		}
+
+		for (size_t k = 1; k < sources.size(); ++k) {
+			float const * s = in->data (sources[k].input) + offset;
+			float const g = sources[k].gain;
+			for (int j = 0; j < frames; ++j) {
+				d[j * stride] += s[j] * g;
+			}
+		}
+	}
+}
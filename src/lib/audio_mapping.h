@@ -32,6 +32,8 @@ namespace xmlpp {
 	class Node;
 }
 
+class AudioBuffers;
+
 /** @class AudioMapping.
  *  @brief A many-to-many mapping of audio channels.
  */
@@ -72,4 +74,45 @@ private:
 	std::vector<std::vector<float> > _gain;
 };
 
+/** @class SparseAudioMapping.
+ *  @brief An AudioMapping reduced to its non-zero gains for a particular number
+ *  of output channels, so that it can be applied quickly to many blocks of audio.
+ */
+class SparseAudioMapping
+{
+public:
+	SparseAudioMapping ();
+	SparseAudioMapping (AudioMapping const & mapping, int output_channels);
+
+	void apply (AudioBuffers const * in, AudioBuffers* out) const;
+	void apply_interleaved (AudioBuffers const * in, int offset, int frames, float* out) const;
+
+	int output_channels () const {
+		return _sources.size ();
+	}
+
+	/** @return true if applying this mapping to audio with output_channels() channels
+	 *  would leave it unchanged.
+	 */
+	bool identity () const {
+		return _identity;
+	}
+
+private:
+	struct Source
+	{
+		Source (int input_, float gain_)
+			: input (input_)
+			, gain (gain_)
+		{}
+
+		int input;
+		float gain;
+	};
+
+	/** Input channels (with their gains) to mix into each output channel */
+	std::vector<std::vector<Source> > _sources;
+	bool _identity;
+};
+
 #endif
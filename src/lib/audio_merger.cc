@@ -23,12 +23,16 @@
 
 #include "audio_merger.h"
 #include "dcpomatic_time.h"
+#include <boost/foreach.hpp>
 #include <iostream>
+#include <algorithm>
 
 using std::pair;
 using std::min;
 using std::max;
 using std::list;
+using std::vector;
+using std::find;
 using std::cout;
 using std::make_pair;
 using boost::shared_ptr;
@@ -56,39 +60,31 @@ AudioMerger::pull (DCPTime time)
 {
 	list<pair<shared_ptr<AudioBuffers>, DCPTime> > out;
 
-	list<Buffer> new_buffers;
-
-	_buffers.sort (AudioMerger::BufferComparator());
-	BOOST_FOREACH (Buffer i, _buffers) {
+	/* _buffers are in time order so we only need to look at the start of the list */
+	while (!_buffers.empty ()) {
+		Buffer& i = _buffers.front ();
 		if (i.period().to <= time) {
 			/* Completely within the pull period */
 			DCPOMATIC_ASSERT (i.audio->frames() > 0);
 			out.push_back (make_pair (i.audio, i.time));
+			_buffers.pop_front ();
 		} else if (i.time < time) {
 			/* Overlaps the end of the pull period */
-			shared_ptr<AudioBuffers> audio (new AudioBuffers (i.audio->channels(), frames(DCPTime(time - i.time))));
-			/* Though time > i.time, audio->frames() could be 0 if the difference in time is less than one frame */
-			if (audio->frames() > 0) {
-				audio->copy_from (i.audio.get(), audio->frames(), 0, 0);
-				out.push_back (make_pair (audio, i.time));
-				i.audio->trim_start (audio->frames ());
-				i.time += DCPTime::from_frames(audio->frames(), _frame_rate);
+			int32_t const n = frames (DCPTime (time - i.time));
+			/* Though time > i.time, n could be 0 if the difference in time is less than one frame */
+			if (n > 0) {
+				/* Give out the start of the buffer without copying it */
+				out.push_back (make_pair (i.audio->split (n), i.time));
+				i.time += DCPTime::from_frames (n, _frame_rate);
 				DCPOMATIC_ASSERT (i.audio->frames() > 0);
-				new_buffers.push_back (i);
 			}
+			break;
 		} else {
-			/* Not involved */
-			DCPOMATIC_ASSERT (i.audio->frames() > 0);
-			new_buffers.push_back (i);
+			/* Not involved, and neither is anything after it */
+			break;
 		}
 	}
 
-	_buffers = new_buffers;
-
-	for (list<pair<shared_ptr<AudioBuffers>, DCPTime> >::const_iterator i = out.begin(); i != out.end(); ++i) {
-		DCPOMATIC_ASSERT (i->first->frames() > 0);
-	}
-
 	return out;
 }
 
@@ -100,58 +96,99 @@ AudioMerger::push (boost::shared_ptr<const AudioBuffers> audio, DCPTime time)
 
 	DCPTimePeriod period (time, time + DCPTime::from_frames (audio->frames(), _frame_rate));
 
-	/* Mix any overlapping parts of this new block with existing ones */
-	BOOST_FOREACH (Buffer i, _buffers) {
-		optional<DCPTimePeriod> overlap = i.period().overlap (period);
+	/* Find the buffers which overlap or touch the new data.  New data usually goes at
+	   or near the end, so search backwards from there.
+	*/
+	list<Buffer>::iterator last = _buffers.end ();
+	while (last != _buffers.begin ()) {
+		list<Buffer>::iterator j = last;
+		--j;
+		if (j->time <= period.to) {
+			break;
+		}
+		last = j;
+	}
+
+	list<Buffer>::iterator first = last;
+	while (first != _buffers.begin ()) {
+		list<Buffer>::iterator j = first;
+		--j;
+		if (j->period().to < period.from) {
+			break;
+		}
+		first = j;
+	}
+
+	/* Mix any overlapping parts of this new block with existing ones, and find the gaps
+	   between the existing buffers which the new block must fill.
+	*/
+	vector<list<Buffer>::iterator> involved;
+	list<DCPTimePeriod> gaps;
+	DCPTime done = period.from;
+	for (list<Buffer>::iterator i = first; i != last; ++i) {
+		involved.push_back (i);
+		optional<DCPTimePeriod> overlap = i->period().overlap (period);
 		if (overlap) {
-			int32_t const offset = frames(DCPTime(overlap->from - i.time));
-			int32_t const frames_to_mix = frames(overlap->duration());
-			if (i.time < time) {
-				i.audio->accumulate_frames(audio.get(), frames_to_mix, 0, offset);
-			} else {
-				i.audio->accumulate_frames(audio.get(), frames_to_mix, offset, 0);
-			}
+			i->audio->accumulate_frames (
+				audio.get(),
+				frames (overlap->duration ()),
+				frames (DCPTime (overlap->from - time)),
+				frames (DCPTime (overlap->from - i->time))
+				);
+		}
+		if (i->time > done) {
+			gaps.push_back (DCPTimePeriod (done, i->time));
 		}
+		done = max (done, i->period().to);
 	}
 
-	list<DCPTimePeriod> periods;
-	BOOST_FOREACH (Buffer i, _buffers) {
-		periods.push_back (i.period ());
+	if (done < period.to) {
+		gaps.push_back (DCPTimePeriod (done, period.to));
 	}
 
-	/* Add the non-overlapping parts */
-	BOOST_FOREACH (DCPTimePeriod i, subtract (period, periods)) {
+	/* Add the non-overlapping parts.  Go backwards so that merging a gap's neighbours
+	   does not affect the neighbours of the gaps which are still to be done.
+	*/
+	for (list<DCPTimePeriod>::reverse_iterator i = gaps.rbegin(); i != gaps.rend(); ++i) {
 		list<Buffer>::iterator before = _buffers.end();
 		list<Buffer>::iterator after = _buffers.end();
-		for (list<Buffer>::iterator j = _buffers.begin(); j != _buffers.end(); ++j) {
-			if (j->period().to == i.from) {
+		BOOST_FOREACH (list<Buffer>::iterator j, involved) {
+			if (j->period().to == i->from) {
 				before = j;
 			}
-			if (j->period().from == i.to) {
+			if (j->time == i->to) {
 				after = j;
 			}
 		}
 
 		/* Get the part of audio that we want to use */
-		shared_ptr<AudioBuffers> part (new AudioBuffers (audio->channels(), frames(i.to) - frames(i.from)));
-		part->copy_from (audio.get(), part->frames(), frames(DCPTime(i.from - time)), 0);
+		shared_ptr<AudioBuffers> part (new AudioBuffers (audio->channels(), frames(i->to) - frames(i->from)));
+		part->copy_from (audio.get(), part->frames(), frames(DCPTime(i->from - time)), 0);
 
 		if (before == _buffers.end() && after == _buffers.end()) {
-			/* New buffer */
+			/* New buffer; it goes before the first involved buffer which is after it */
 			DCPOMATIC_ASSERT (part->frames() > 0);
-			_buffers.push_back (Buffer (part, time, _frame_rate));
+			list<Buffer>::iterator position = last;
+			BOOST_FOREACH (list<Buffer>::iterator j, involved) {
+				if (j->time >= i->to) {
+					position = j;
+					break;
+				}
+			}
+			_buffers.insert (position, Buffer (part, i->from, _frame_rate));
 		} else if (before != _buffers.end() && after == _buffers.end()) {
 			/* We have an existing buffer before this one; append new data to it */
 			before->audio->append (part);
-		} else if (before ==_buffers.end() && after != _buffers.end()) {
+		} else if (before == _buffers.end() && after != _buffers.end()) {
 			/* We have an existing buffer after this one; append it to the new data and replace */
 			part->append (after->audio);
 			after->audio = part;
-			after->time = time;
+			after->time = i->from;
 		} else {
 			/* We have existing buffers both before and after; coalesce them all */
 			before->audio->append (part);
 			before->audio->append (after->audio);
+			involved.erase (find (involved.begin(), involved.end(), after));
 			_buffers.erase (after);
 		}
 	}
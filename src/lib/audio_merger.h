@@ -43,17 +43,10 @@ private:
 	class Buffer
 	{
 	public:
-		/** @param c Channels
-		 *  @param f Frames
+		/** @param a Audio
 		 *  @param t Time
 		 *  @param r Frame rate.
 		 */
-		Buffer (int c, int32_t f, DCPTime t, int r)
-			: audio (new AudioBuffers (c, f))
-			, time (t)
-			, frame_rate (r)
-		{}
-
 		Buffer (boost::shared_ptr<AudioBuffers> a, DCPTime t, int r)
 			: audio (a)
 			, time (t)
@@ -69,15 +62,7 @@ private:
 		}
 	};
 
-	class BufferComparator
-	{
-	public:
-		bool operator() (AudioMerger::Buffer const & a, AudioMerger::Buffer const & b)
-		{
-			return a.time < b.time;
-		}
-	};
-
+	/** Our audio, in time order, with no overlaps between buffers */
 	std::list<Buffer> _buffers;
 	int _frame_rate;
 };
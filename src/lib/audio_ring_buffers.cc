@@ -1,5 +1,5 @@
 /*
-    Copyright (C) 2016-2017 Carl Hetherington <cth@carlh.net>
+    Copyright (C) 2016-2018 Carl Hetherington <cth@carlh.net>
 
     This file is part of DCP-o-matic.
 
@@ -19,90 +19,173 @@
 */
 
 #include "audio_ring_buffers.h"
+#include "audio_mapping.h"
 #include "dcpomatic_assert.h"
-#include "exceptions.h"
-#include <boost/foreach.hpp>
-#include <iostream>
+#include <algorithm>
+#include <cstring>
 
 using std::min;
-using std::cout;
+using std::max;
 using boost::shared_ptr;
 
-AudioRingBuffers::AudioRingBuffers ()
-	: _used_in_head (0)
+/** @param channels Number of channels to store; audio with fewer channels is padded with silence,
+ *  and audio with more is truncated.
+ *  @param capacity Maximum number of frames that can be stored.
+ */
+AudioRingBuffers::AudioRingBuffers (int channels, Frame capacity)
+	: _channels (channels)
+	, _capacity (capacity)
+	, _data (new float[channels * capacity])
+	, _write (0)
+	, _read (0)
+	, _discard (0)
+	, _underruns (0)
 {
+	DCPOMATIC_ASSERT (channels > 0);
+	DCPOMATIC_ASSERT (capacity > 0);
+}
 
+AudioRingBuffers::~AudioRingBuffers ()
+{
+	delete[] _data;
 }
 
-void
+Frame
 AudioRingBuffers::put (shared_ptr<const AudioBuffers> data)
 {
-	boost::mutex::scoped_lock lm (_mutex);
+	return put (data.get ());
+}
 
-	if (!_buffers.empty ()) {
-		DCPOMATIC_ASSERT (_buffers.front()->channels() == data->channels());
+/** Add some audio to the buffer.  This must not be called at the same time as another put() or clear().
+ *  @param data Audio to add.
+ *  @param offset Offset of the first frame of data to add.
+ *  @param mapping Mapping to apply to the audio as it is written, or 0; if it is given its
+ *  output_channels() must be the same as our channel count.
+ *  @return Number of frames that were added, which will be less than data->frames() - offset
+ *  if the buffer is full.
+ */
+Frame
+AudioRingBuffers::put (AudioBuffers const * data, Frame offset, SparseAudioMapping const * mapping)
+{
+	DCPOMATIC_ASSERT (!mapping || mapping->output_channels() == _channels);
+
+	uint64_t const write = _write.load (boost::memory_order_relaxed);
+	/* Space which has been discarded by clear() can be reused even if the consumer has
+	   not caught up with it yet; get() checks for that.
+	*/
+	uint64_t const read = max (_read.load (boost::memory_order_acquire), _discard.load (boost::memory_order_relaxed));
+
+	Frame const frames = min (Frame (_capacity - (write - read)), Frame (data->frames() - offset));
+
+	/* Write in (at most) two parts, either side of the end of _data */
+	Frame done = 0;
+	while (done < frames) {
+		Frame const position = (write + done) % _capacity;
+		Frame const to_do = min (frames - done, _capacity - position);
+		float* out = _data + position * _channels;
+
+		if (mapping) {
+			mapping->apply_interleaved (data, offset + done, to_do, out);
+		} else {
+			int const c = min (data->channels(), _channels);
+			for (Frame i = 0; i < to_do; ++i) {
+				for (int j = 0; j < c; ++j) {
+					*out++ = data->data(j)[offset + done + i];
+				}
+				for (int j = c; j < _channels; ++j) {
+					*out++ = 0;
+				}
+			}
+		}
+
+		done += to_do;
 	}
 
-	_buffers.push_back (data);
+	_write.store (write + frames, boost::memory_order_release);
+	return frames;
 }
 
-/** @return true if there was an underrun, otherwise false */
-bool
-AudioRingBuffers::get (float* out, int channels, int frames)
+/** Copy some frames from _data, starting at a given position, into interleaved output */
+void
+AudioRingBuffers::copy_out (float* out, int channels, uint64_t from, Frame frames) const
 {
-	boost::mutex::scoped_lock lm (_mutex);
-
-	while (frames > 0) {
-		if (_buffers.empty ()) {
-			for (int i = 0; i < frames; ++i) {
-				for (int j = 0; j < channels; ++j) {
+	Frame done = 0;
+	while (done < frames) {
+		Frame const position = (from + done) % _capacity;
+		Frame const to_do = min (frames - done, _capacity - position);
+		float const * in = _data + position * _channels;
+
+		if (channels == _channels) {
+			memcpy (out, in, to_do * _channels * sizeof (float));
+			out += to_do * _channels;
+		} else {
+			int const c = min (channels, _channels);
+			for (Frame i = 0; i < to_do; ++i) {
+				for (int j = 0; j < c; ++j) {
+					*out++ = in[j];
+				}
+				for (int j = c; j < channels; ++j) {
 					*out++ = 0;
 				}
+				in += _channels;
 			}
-			cout << "audio underrun; missing " << frames << "!\n";
-			return true;
 		}
 
-		shared_ptr<const AudioBuffers> front = _buffers.front ();
+		done += to_do;
+	}
+}
 
-		int const to_do = min (frames, front->frames() - _used_in_head);
-		float** p = front->data();
-		int const c = min (front->channels(), channels);
-		for (int i = 0; i < to_do; ++i) {
-			for (int j = 0; j < c; ++j) {
-				*out++ = p[j][i + _used_in_head];
-			}
-			for (int j = c; j < channels; ++j) {
-				*out++ = 0;
-			}
-		}
-		_used_in_head += to_do;
-		frames -= to_do;
+/** Take some audio from the buffer.  This must only be called from the consumer thread;
+ *  it takes no locks and does not allocate memory.
+ *  @param out Buffer to write interleaved audio to; any frames that we do not have will be silent.
+ *  @param channels Number of channels to write to out.
+ *  @param frames Number of frames to write to out.
+ *  @return true if there was an underrun, otherwise false.
+ */
+bool
+AudioRingBuffers::get (float* out, int channels, int frames)
+{
+	uint64_t const write = _write.load (boost::memory_order_acquire);
+	uint64_t read = max (_read.load (boost::memory_order_relaxed), _discard.load (boost::memory_order_acquire));
+
+	Frame const available = min (Frame (write - read), Frame (frames));
+	copy_out (out, channels, read, available);
+
+	if (_discard.load (boost::memory_order_acquire) > read) {
+		/* clear() was called while we were copying, so what we have copied should not be
+		   played (and the producer may have started to overwrite it).
+		*/
+		memset (out, 0, available * channels * sizeof (float));
+		_read.store (_discard.load (boost::memory_order_acquire), boost::memory_order_release);
+		_underruns.fetch_add (1, boost::memory_order_relaxed);
+		return true;
+	}
 
-		if (_used_in_head == front->frames()) {
-			_buffers.pop_front ();
-			_used_in_head = 0;
-		}
+	read += available;
+	_read.store (read, boost::memory_order_release);
+
+	if (available < frames) {
+		memset (out + available * channels, 0, (frames - available) * channels * sizeof (float));
+		_underruns.fetch_add (1, boost::memory_order_relaxed);
+		return true;
 	}
 
 	return false;
 }
 
+/** Discard everything in the buffer.  This must not be called at the same time as put() or another clear() */
 void
 AudioRingBuffers::clear ()
 {
-	boost::mutex::scoped_lock lm (_mutex);
-	_buffers.clear ();
-	_used_in_head = 0;
+	_discard.store (_write.load (boost::memory_order_relaxed), boost::memory_order_release);
 }
 
+/** @return Number of frames in the buffer */
 Frame
 AudioRingBuffers::size () const
 {
-	boost::mutex::scoped_lock lm (_mutex);
-	Frame s = 0;
-	BOOST_FOREACH (shared_ptr<const AudioBuffers> i, _buffers) {
-		s += i->frames ();
-	}
-	return s - _used_in_head;
+	uint64_t const read = max (_read.load (boost::memory_order_acquire), _discard.load (boost::memory_order_acquire));
+	uint64_t const write = _write.load (boost::memory_order_acquire);
+	/* We might see a _read which is ahead of the _write that we saw if the consumer has just read */
+	return write > read ? Frame (write - read) : 0;
 }
@@ -1,5 +1,5 @@
 /*
-    Copyright (C) 2016-2017 Carl Hetherington <cth@carlh.net>
+    Copyright (C) 2016-2018 Carl Hetherington <cth@carlh.net>
 
     This file is part of DCP-o-matic.
 
@@ -23,26 +23,61 @@
 
 #include "audio_buffers.h"
 #include "types.h"
+#include "util.h"
 #include "dcpomatic_time.h"
 #include <boost/shared_ptr.hpp>
-#include <boost/thread.hpp>
-#include <list>
+#include <boost/noncopyable.hpp>
+#include <boost/atomic.hpp>
+#include <stdint.h>
 
+class SparseAudioMapping;
+
+/** @class AudioRingBuffers
+ *  @brief A fixed-size buffer of interleaved audio, written by one thread and read by another.
+ *
+ *  Neither put() nor get() takes a lock, so get() can safely be called from a real-time
+ *  audio callback.  get() must only be called from one thread (the consumer); put()
+ *  and clear() may be called from other threads (producers) but the caller must make
+ *  sure that no two calls to put() or clear() run at the same time.
+ */
 class AudioRingBuffers : public boost::noncopyable
 {
 public:
-	AudioRingBuffers ();
+	explicit AudioRingBuffers (int channels = MAX_DCP_AUDIO_CHANNELS, Frame capacity = 96000);
+	~AudioRingBuffers ();
 
-	void put (boost::shared_ptr<const AudioBuffers> data);
+	Frame put (AudioBuffers const * data, Frame offset = 0, SparseAudioMapping const * mapping = 0);
+	Frame put (boost::shared_ptr<const AudioBuffers> data);
 	bool get (float* out, int channels, int frames);
 
 	void clear ();
 	Frame size () const;
 
+	Frame capacity () const {
+		return _capacity;
+	}
+
+	/** @return Number of times that get() has been unable to supply all the audio that was asked for */
+	uint64_t underruns () const {
+		return _underruns.load (boost::memory_order_relaxed);
+	}
+
 private:
-	mutable boost::mutex _mutex;
-	std::list<boost::shared_ptr<const AudioBuffers> > _buffers;
-	int _used_in_head;
+	void copy_out (float* out, int channels, uint64_t from, Frame frames) const;
+
+	int _channels;
+	Frame _capacity;
+	/** _capacity frames of interleaved audio */
+	float* _data;
+	/** total number of frames that have ever been written; only changed by the producer */
+	boost::atomic<uint64_t> _write;
+	/** total number of frames that have ever been read; only changed by the consumer */
+	boost::atomic<uint64_t> _read;
+	/** everything before this position (in the same units as _write) has been discarded
+	    by clear(); only changed by the producer.
+	*/
+	boost::atomic<uint64_t> _discard;
+	boost::atomic<uint64_t> _underruns;
 };
 
 #endif
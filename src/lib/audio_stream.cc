@@ -43,6 +43,18 @@ AudioStream::set_mapping (AudioMapping mapping)
 {
 	boost::mutex::scoped_lock lm (_mutex);
 	_mapping = mapping;
+	_sparse_mapping.reset ();
+}
+
+/** @return Our mapping prepared for applying to audio, with a given number of output channels */
+boost::shared_ptr<const SparseAudioMapping>
+AudioStream::sparse_mapping (int output_channels) const
+{
+	boost::mutex::scoped_lock lm (_mutex);
+	if (!_sparse_mapping || _sparse_mapping->output_channels() != output_channels) {
+		_sparse_mapping.reset (new SparseAudioMapping (_mapping, output_channels));
+	}
+	return _sparse_mapping;
 }
 
 int
@@ -24,6 +24,7 @@
 #include "audio_mapping.h"
 #include "types.h"
 #include <boost/thread/mutex.hpp>
+#include <boost/shared_ptr.hpp>
 
 struct audio_sampling_rate_test;
 
@@ -51,6 +52,8 @@ public:
 		return _length;
 	}
 
+	boost::shared_ptr<const SparseAudioMapping> sparse_mapping (int output_channels) const;
+
 	int channels () const;
 
 protected:
@@ -63,6 +66,8 @@ private:
 	int _frame_rate;
 	Frame _length;
 	AudioMapping _mapping;
+	/** _mapping prepared for applying to audio, or 0 if it has not been asked for since _mapping last changed */
+	mutable boost::shared_ptr<const SparseAudioMapping> _sparse_mapping;
 };
 
 typedef boost::shared_ptr<AudioStream> AudioStreamPtr;
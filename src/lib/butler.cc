@@ -20,9 +20,11 @@
 
 #include "butler.h"
 #include "player.h"
+#include "audio_buffers.h"
 #include "util.h"
 #include "log.h"
 #include "compose.hpp"
+#include "metrics.h"
 #include <boost/weak_ptr.hpp>
 #include <boost/shared_ptr.hpp>
 
@@ -49,12 +51,14 @@ using boost::optional;
 Butler::Butler (shared_ptr<Player> player, shared_ptr<Log> log, AudioMapping audio_mapping, int audio_channels)
 	: _player (player)
 	, _log (log)
+	, _audio (audio_channels, MAXIMUM_AUDIO_READAHEAD * 2)
 	, _prepare_work (new boost::asio::io_service::work (_prepare_service))
+	, _waiting_for_audio_space (false)
 	, _pending_seek_accurate (false)
 	, _finished (false)
 	, _died (false)
 	, _stop_thread (false)
-	, _audio_mapping (audio_mapping)
+	, _audio_mapping (audio_mapping, audio_channels)
 	, _audio_channels (audio_channels)
 	, _disable_audio (false)
 {
@@ -143,6 +147,7 @@ try
 			lm.unlock ();
 			bool const r = _player->pass ();
 			lm.lock ();
+			update_metrics ();
 			if (r) {
 				_finished = true;
 				_arrived.notify_all ();
@@ -178,10 +183,20 @@ Butler::get_video ()
 	}
 
 	pair<shared_ptr<PlayerVideo>, DCPTime> const r = _video.get ();
+	update_metrics ();
 	_summon.notify_all ();
 	return r;
 }
 
+/** Record how full our buffers are.  Caller must hold a lock on _mutex */
+void
+Butler::update_metrics () const
+{
+	Metrics::instance()->set ("dcpomatic_butler_video_frames", "", _video.size ());
+	Metrics::instance()->set ("dcpomatic_butler_audio_frames", "", _audio.size ());
+	Metrics::instance()->set ("dcpomatic_butler_audio_underruns", "", _audio.underruns ());
+}
+
 void
 Butler::seek (DCPTime position, bool accurate)
 {
@@ -191,11 +206,13 @@ Butler::seek (DCPTime position, bool accurate)
 	}
 
 	_video.clear ();
+	/* We hold _mutex, so audio() cannot be writing to _audio at the same time */
 	_audio.clear ();
 	_finished = false;
 	_pending_seek_position = position;
 	_pending_seek_accurate = accurate;
 	_summon.notify_all ();
+	_audio_space.notify_all ();
 }
 
 void
@@ -226,26 +243,50 @@ Butler::video (shared_ptr<PlayerVideo> video, DCPTime time)
 void
 Butler::audio (shared_ptr<AudioBuffers> audio)
 {
-	{
-		boost::mutex::scoped_lock lm (_mutex);
-		if (_pending_seek_position || _disable_audio) {
+	/* Map the audio as it is written into the ring buffer */
+	SparseAudioMapping const * mapping = _audio_mapping.identity() ? 0 : &_audio_mapping;
+
+	boost::mutex::scoped_lock lm (_mutex);
+
+	Frame done = 0;
+	while (true) {
+		if (_pending_seek_position || _disable_audio || _stop_thread) {
 			/* Don't store any audio while a seek is pending, or if audio is disabled */
-			return;
+			break;
 		}
-	}
 
-	_audio.put (remap (audio, _audio_channels, _audio_mapping));
+		done += _audio.put (audio.get(), done, mapping);
+		if (done == audio->frames ()) {
+			break;
+		}
+
+		/* The ring buffer is full (which should not happen unless the Player gives us a
+		   lot of audio in one go) so wait for the consumer to take some.  get_audio()
+		   cannot take _mutex, so it may notify between our put() and our wait; the
+		   timeout stops us from missing that altogether.
+		*/
+		_waiting_for_audio_space = true;
+		_audio_space.timed_wait (lm, boost::posix_time::milliseconds (10));
+		_waiting_for_audio_space = false;
+	}
 }
 
 /** Try to get `frames' frames of audio and copy it into `out'.  Silence
- *  will be filled if no audio is available.
+ *  will be filled if no audio is available.  This takes no locks, so it can be
+ *  called from a real-time audio callback.
  *  @return true if there was a buffer underrun, otherwise false.
  */
 bool
 Butler::get_audio (float* out, Frame frames)
 {
 	bool const underrun = _audio.get (out, _audio_channels, frames);
-	_summon.notify_all ();
+	if (_waiting_for_audio_space) {
+		_audio_space.notify_all ();
+	}
+	if (_audio.size() < MINIMUM_AUDIO_READAHEAD) {
+		/* Only wake the butler if it has work to do, as this may be called from a real-time thread */
+		_summon.notify_all ();
+	}
 	return underrun;
 }
 
@@ -28,6 +28,7 @@
 #include <boost/thread/condition.hpp>
 #include <boost/signals2.hpp>
 #include <boost/asio.hpp>
+#include <boost/atomic.hpp>
 
 class Player;
 class PlayerVideo;
@@ -52,6 +53,7 @@ private:
 	void video (boost::shared_ptr<PlayerVideo> video, DCPTime time);
 	void audio (boost::shared_ptr<AudioBuffers> audio);
 	bool should_run () const;
+	void update_metrics () const;
 	void prepare (boost::weak_ptr<PlayerVideo> video) const;
 
 	boost::shared_ptr<Player> _player;
@@ -65,17 +67,23 @@ private:
 	boost::asio::io_service _prepare_service;
 	boost::shared_ptr<boost::asio::io_service::work> _prepare_work;
 
-	/** mutex to protect _pending_seek_position, _pending_seek_acurate, _finished, _died, _stop_thread */
+	/** mutex to protect _pending_seek_position, _pending_seek_acurate, _finished, _died, _stop_thread
+	 *  and to serialise calls to _audio.put() and _audio.clear()
+	 */
 	boost::mutex _mutex;
 	boost::condition _summon;
 	boost::condition _arrived;
+	/** condition to wake audio() when get_audio() has made space in _audio */
+	boost::condition _audio_space;
+	/** true if audio() is waiting on _audio_space */
+	boost::atomic<bool> _waiting_for_audio_space;
 	boost::optional<DCPTime> _pending_seek_position;
 	bool _pending_seek_accurate;
 	bool _finished;
 	bool _died;
 	bool _stop_thread;
 
-	AudioMapping _audio_mapping;
+	SparseAudioMapping _audio_mapping;
 	int _audio_channels;
 
 	bool _disable_audio;
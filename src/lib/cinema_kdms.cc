@@ -27,8 +27,14 @@
 #include "emailer.h"
 #include "compose.hpp"
 #include "log.h"
+#include "email_outbox.h"
+#include "exception_store.h"
 #include <zip.h>
 #include <boost/foreach.hpp>
+#include <boost/asio.hpp>
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
+#include <boost/algorithm/string.hpp>
 
 #include "i18n.h"
 
@@ -36,6 +42,7 @@ using std::list;
 using std::cout;
 using std::string;
 using std::runtime_error;
+using std::max;
 using boost::shared_ptr;
 using boost::function;
 
@@ -183,7 +190,108 @@ CinemaKDMs::write_zip_files (
 	return written;
 }
 
-/** Email one ZIP file per cinema to the cinema.
+/** @class KDMEmailMaker
+ *  @brief Helper for CinemaKDMs::email() which makes the emails for several cinemas
+ *  at once and puts them in an outbox.
+ */
+class KDMEmailMaker : public ExceptionStore
+{
+public:
+	KDMEmailMaker (
+		EmailOutbox* outbox,
+		dcp::NameFormat container_name_format,
+		dcp::NameFormat filename_format,
+		dcp::NameFormat::Map name_values,
+		string cpl_name
+		)
+		: _outbox (outbox)
+		, _container_name_format (container_name_format)
+		, _filename_format (filename_format)
+		, _name_values (name_values)
+		, _cpl_name (cpl_name)
+	{}
+
+	/** Make one cinema's ZIP file and email, and add the email to the outbox */
+	void make (CinemaKDMs const * kdms)
+	{
+		boost::filesystem::path zip_file;
+
+		try {
+			Config* config = Config::instance ();
+
+			dcp::NameFormat::Map name_values = _name_values;
+			name_values['c'] = kdms->cinema->name;
+
+			zip_file = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+			boost::filesystem::create_directories (zip_file);
+			zip_file /= _container_name_format.get(name_values, ".zip");
+			kdms->make_zip_file (zip_file, _filename_format, name_values);
+
+			string subject = config->kdm_subject();
+			boost::algorithm::replace_all (subject, "$CPL_NAME", _cpl_name);
+			boost::algorithm::replace_all (subject, "$START_TIME", name_values['b']);
+			boost::algorithm::replace_all (subject, "$END_TIME", name_values['e']);
+			boost::algorithm::replace_all (subject, "$CINEMA_NAME", kdms->cinema->name);
+
+			string body = config->kdm_email().c_str();
+			boost::algorithm::replace_all (body, "$CPL_NAME", _cpl_name);
+			boost::algorithm::replace_all (body, "$START_TIME", name_values['b']);
+			boost::algorithm::replace_all (body, "$END_TIME", name_values['e']);
+			boost::algorithm::replace_all (body, "$CINEMA_NAME", kdms->cinema->name);
+
+			string screens;
+			BOOST_FOREACH (ScreenKDM const & j, kdms->screen_kdms) {
+				screens += j.screen->name + ", ";
+			}
+			boost::algorithm::replace_all (body, "$SCREENS", screens.substr (0, screens.length() - 2));
+
+			Emailer email (config->kdm_from(), kdms->cinema->emails, subject, body);
+
+			BOOST_FOREACH (string i, config->kdm_cc()) {
+				email.add_cc (i);
+			}
+			if (!config->kdm_bcc().empty ()) {
+				email.add_bcc (config->kdm_bcc ());
+			}
+
+			email.add_attachment (zip_file, _container_name_format.get(name_values, ".zip"), "application/zip");
+			email.create_email ();
+
+			string const id = _outbox->add (email.from(), email.recipients(), email.email());
+			boost::mutex::scoped_lock lm (_mutex);
+			_ids.push_back (id);
+		} catch (...) {
+			store_current ();
+		}
+
+		if (!zip_file.empty ()) {
+			boost::system::error_code ec;
+			boost::filesystem::remove_all (zip_file.parent_path(), ec);
+		}
+	}
+
+	/** @return IDs of the emails that make() has added to the outbox */
+	list<string> ids () const {
+		boost::mutex::scoped_lock lm (_mutex);
+		return _ids;
+	}
+
+private:
+	EmailOutbox* _outbox;
+	dcp::NameFormat _container_name_format;
+	dcp::NameFormat _filename_format;
+	dcp::NameFormat::Map _name_values;
+	string _cpl_name;
+	/** mutex to protect _ids */
+	mutable boost::mutex _mutex;
+	list<string> _ids;
+};
+
+/** Email one ZIP file per cinema to the cinema.  The emails are made on several threads
+ *  and put into the outbox in our configuration directory, which is then sent using a few
+ *  connections to the mail server.  Only the emails made by this call are sent; if any of them
+ *  cannot be made, none are sent.  Emails which could not be sent are left in the outbox for
+ *  send_outbox() to try again.
  *  @param cinema_kdms KDMS to email.
  *  @param container_name_format Format of folder / ZIP to use.
  *  @param filename_format Format of filenames to use.
@@ -210,66 +318,54 @@ CinemaKDMs::email (
 	/* No specific screen */
 	name_values['s'] = "";
 
-	BOOST_FOREACH (CinemaKDMs const & i, cinema_kdms) {
+	EmailOutbox outbox (EmailOutbox::default_directory ());
+	KDMEmailMaker maker (&outbox, container_name_format, filename_format, name_values, cpl_name);
 
-		name_values['c'] = i.cinema->name;
+	boost::asio::io_service service;
+	boost::thread_group pool;
 
-		boost::filesystem::path zip_file = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
-		boost::filesystem::create_directories (zip_file);
-		zip_file /= container_name_format.get(name_values, ".zip");
-		i.make_zip_file (zip_file, filename_format, name_values);
-
-		string subject = config->kdm_subject();
-		boost::algorithm::replace_all (subject, "$CPL_NAME", cpl_name);
-		boost::algorithm::replace_all (subject, "$START_TIME", name_values['b']);
-		boost::algorithm::replace_all (subject, "$END_TIME", name_values['e']);
-		boost::algorithm::replace_all (subject, "$CINEMA_NAME", i.cinema->name);
-
-		string body = config->kdm_email().c_str();
-		boost::algorithm::replace_all (body, "$CPL_NAME", cpl_name);
-		boost::algorithm::replace_all (body, "$START_TIME", name_values['b']);
-		boost::algorithm::replace_all (body, "$END_TIME", name_values['e']);
-		boost::algorithm::replace_all (body, "$CINEMA_NAME", i.cinema->name);
-
-		string screens;
-		BOOST_FOREACH (ScreenKDM const & j, i.screen_kdms) {
-			screens += j.screen->name + ", ";
-		}
-		boost::algorithm::replace_all (body, "$SCREENS", screens.substr (0, screens.length() - 2));
+	shared_ptr<boost::asio::io_service::work> work (new boost::asio::io_service::work (service));
 
-		Emailer email (config->kdm_from(), i.cinema->emails, subject, body);
-
-		BOOST_FOREACH (string i, config->kdm_cc()) {
-			email.add_cc (i);
-		}
-		if (!config->kdm_bcc().empty ()) {
-			email.add_bcc (config->kdm_bcc ());
-		}
+	int const threads = max (1U, boost::thread::hardware_concurrency ());
+	for (int i = 0; i < threads; ++i) {
+		pool.create_thread (boost::bind (&boost::asio::io_service::run, &service));
+	}
 
-		email.add_attachment (zip_file, container_name_format.get(name_values, ".zip"), "application/zip");
+	BOOST_FOREACH (CinemaKDMs const & i, cinema_kdms) {
+		service.post (boost::bind (&KDMEmailMaker::make, &maker, &i));
+	}
 
-		Config* c = Config::instance ();
+	work.reset ();
+	pool.join_all ();
+	service.stop ();
 
-		try {
-			email.send (c->mail_server(), c->mail_port(), c->mail_user(), c->mail_password());
-		} catch (...) {
-			boost::filesystem::remove (zip_file);
-			if (log) {
-				log->log ("Email content follows", LogEntry::TYPE_DEBUG_EMAIL);
-				log->log (email.email(), LogEntry::TYPE_DEBUG_EMAIL);
-				log->log ("Email session follows", LogEntry::TYPE_DEBUG_EMAIL);
-				log->log (email.notes(), LogEntry::TYPE_DEBUG_EMAIL);
-			}
-			throw;
+	try {
+		maker.rethrow ();
+	} catch (...) {
+		/* Don't leave half a set of KDMs waiting to be sent */
+		BOOST_FOREACH (string i, maker.ids()) {
+			outbox.remove (i);
 		}
+		throw;
+	}
 
-		boost::filesystem::remove (zip_file);
+	outbox.send (maker.ids(), config->mail_server(), config->mail_port(), config->mail_user(), config->mail_password(), config->mail_connections(), log);
+}
 
-		if (log) {
-			log->log ("Email content follows", LogEntry::TYPE_DEBUG_EMAIL);
-			log->log (email.email(), LogEntry::TYPE_DEBUG_EMAIL);
-			log->log ("Email session follows", LogEntry::TYPE_DEBUG_EMAIL);
-			log->log (email.notes(), LogEntry::TYPE_DEBUG_EMAIL);
-		}
+/** Send any emails which were left in the outbox by earlier calls to email() because they could
+ *  not be sent at the time.
+ *  @param log Log to write email session transcript to, or 0.
+ *  @return Number of emails that were sent.
+ */
+int
+CinemaKDMs::send_outbox (shared_ptr<Log> log)
+{
+	Config* config = Config::instance ();
+
+	if (config->mail_server().empty()) {
+		throw NetworkError (_("No mail server configured in preferences"));
 	}
+
+	EmailOutbox outbox (EmailOutbox::default_directory ());
+	return outbox.send (outbox.pending(), config->mail_server(), config->mail_port(), config->mail_user(), config->mail_password(), config->mail_connections(), log);
 }
@@ -58,6 +58,8 @@ public:
 		boost::shared_ptr<Log> log
 		);
 
+	static int send_outbox (boost::shared_ptr<Log> log);
+
 	boost::shared_ptr<Cinema> cinema;
 	std::list<ScreenKDM> screen_kdms;
 };
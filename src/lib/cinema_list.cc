@@ -0,0 +1,429 @@
+/*
+    Copyright (C) 2018 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/** @file  src/lib/cinema_list.cc
+ *  @brief CinemaList class.
+ */
+
+#include "cinema_list.h"
+#include "cinema.h"
+#include "screen.h"
+#include "exceptions.h"
+#include "dcpomatic_assert.h"
+#include <libxml++/libxml++.h>
+#include <boost/algorithm/string.hpp>
+#include <boost/foreach.hpp>
+#include <algorithm>
+#include <set>
+
+using std::list;
+using std::map;
+using std::set;
+using std::string;
+using std::pair;
+using std::make_pair;
+using boost::shared_ptr;
+
+static string
+lower (string s)
+{
+	return boost::algorithm::to_lower_copy (s);
+}
+
+static bool
+name_less_than (shared_ptr<Cinema> a, shared_ptr<Cinema> b)
+{
+	return lower (a->name) < lower (b->name);
+}
+
+/** Remove the entries for a cinema from one of our cinema indices */
+static void
+erase (std::multimap<string, shared_ptr<Cinema> >& index, string key, shared_ptr<Cinema> cinema)
+{
+	pair<std::multimap<string, shared_ptr<Cinema> >::iterator, std::multimap<string, shared_ptr<Cinema> >::iterator> r = index.equal_range (key);
+	while (r.first != r.second) {
+		if (r.first->second == cinema) {
+			index.erase (r.first++);
+		} else {
+			++r.first;
+		}
+	}
+}
+
+/** Remove the entries for a cinema's screens from one of our screen indices */
+static void
+erase (std::multimap<string, shared_ptr<Screen> >& index, string key, shared_ptr<Cinema> cinema)
+{
+	pair<std::multimap<string, shared_ptr<Screen> >::iterator, std::multimap<string, shared_ptr<Screen> >::iterator> r = index.equal_range (key);
+	while (r.first != r.second) {
+		if (r.first->second->cinema == cinema) {
+			index.erase (r.first++);
+		} else {
+			++r.first;
+		}
+	}
+}
+
+/** @param directory Directory to keep the cinemas in; it will be created when
+ *  the first cinema is added, if it does not already exist.
+ */
+CinemaList::CinemaList (boost::filesystem::path directory)
+	: _directory (directory)
+	, _loaded (false)
+{
+
+}
+
+boost::filesystem::path
+CinemaList::file (string id) const
+{
+	return _directory / (id + ".xml");
+}
+
+/** Read our cinemas from _directory if we have not already done so.
+ *  _mutex must be held by the caller.
+ */
+void
+CinemaList::load () const
+{
+	if (_loaded) {
+		return;
+	}
+
+	list<boost::filesystem::path> files;
+	if (boost::filesystem::is_directory (_directory)) {
+		for (boost::filesystem::directory_iterator i = boost::filesystem::directory_iterator (_directory); i != boost::filesystem::directory_iterator(); ++i) {
+			if (i->path().extension() == ".xml") {
+				files.push_back (i->path ());
+			}
+		}
+	}
+
+	/* Sort so that cinemas with the same name always come out in the same order */
+	files.sort ();
+
+	BOOST_FOREACH (boost::filesystem::path i, files) {
+		shared_ptr<Cinema> cinema;
+		try {
+			shared_ptr<cxml::Document> doc (new cxml::Document ("Cinema"));
+			doc->read_file (i);
+			/* Slightly grotty two-part construction of Cinema here so that we can use
+			   shared_from_this.
+			*/
+			cinema.reset (new Cinema (doc));
+			cinema->read_screens (doc);
+		} catch (std::exception& e) {
+			string s = e.what ();
+			boost::algorithm::trim (s);
+			throw FileError (s, i);
+		}
+
+		_ids[cinema] = i.stem().string();
+		index (cinema);
+	}
+
+	_loaded = true;
+}
+
+/** Add a cinema to our indices.  _mutex must be held by the caller */
+void
+CinemaList::index (shared_ptr<Cinema> cinema) const
+{
+	Keys keys;
+
+	string const name = lower (cinema->name);
+	for (size_t i = 0; i < name.length(); ++i) {
+		/* Index the name from the start of each word so that searches can match any of them */
+		if (!isspace (name[i]) && (i == 0 || isspace (name[i - 1]))) {
+			keys.names.push_back (name.substr (i));
+		}
+	}
+
+	BOOST_FOREACH (string i, cinema->emails) {
+		keys.emails.push_back (lower (i));
+	}
+
+	BOOST_FOREACH (string i, keys.names) {
+		_names.insert (make_pair (i, cinema));
+	}
+
+	BOOST_FOREACH (string i, keys.emails) {
+		_emails.insert (make_pair (i, cinema));
+	}
+
+	BOOST_FOREACH (shared_ptr<Screen> i, cinema->screens ()) {
+		if (i->recipient) {
+			/* Thumbprints are base64 so we keep their case */
+			string const t = i->recipient->thumbprint ();
+			keys.thumbprints.push_back (t);
+			_thumbprints.insert (make_pair (t, i));
+		}
+	}
+
+	_keys[cinema] = keys;
+}
+
+/** Remove a cinema from our indices.  _mutex must be held by the caller */
+void
+CinemaList::unindex (shared_ptr<Cinema> cinema) const
+{
+	map<shared_ptr<Cinema>, Keys>::iterator k = _keys.find (cinema);
+	if (k == _keys.end ()) {
+		return;
+	}
+
+	BOOST_FOREACH (string i, k->second.names) {
+		erase (_names, i, cinema);
+	}
+
+	BOOST_FOREACH (string i, k->second.emails) {
+		erase (_emails, i, cinema);
+	}
+
+	BOOST_FOREACH (string i, k->second.thumbprints) {
+		erase (_thumbprints, i, cinema);
+	}
+
+	_keys.erase (k);
+}
+
+/** @return ID of a cinema that we know about.  _mutex must be held by the caller */
+string
+CinemaList::id (shared_ptr<Cinema> cinema) const
+{
+	map<shared_ptr<Cinema>, string>::const_iterator i = _ids.find (cinema);
+	DCPOMATIC_ASSERT (i != _ids.end ());
+	return i->second;
+}
+
+/** Write one cinema's file.  _mutex must be held by the caller */
+void
+CinemaList::write (string id, shared_ptr<Cinema> cinema) const
+{
+	boost::filesystem::create_directories (_directory);
+
+	xmlpp::Document doc;
+	cinema->as_xml (doc.create_root_node ("Cinema"));
+
+	/* Write via a temporary file so that a partly-written cinema is never seen */
+	boost::filesystem::path tmp = file (id);
+	tmp += ".tmp";
+
+	try {
+		doc.write_to_file_formatted (tmp.string ());
+	} catch (xmlpp::exception& e) {
+		string s = e.what ();
+		boost::algorithm::trim (s);
+		throw FileError (s, tmp);
+	}
+
+	boost::filesystem::rename (tmp, file (id));
+}
+
+/** @return All our cinemas, sorted by name */
+list<shared_ptr<Cinema> >
+CinemaList::cinemas () const
+{
+	boost::mutex::scoped_lock lm (_mutex);
+	load ();
+
+	list<shared_ptr<Cinema> > c;
+	for (map<shared_ptr<Cinema>, string>::const_iterator i = _ids.begin(); i != _ids.end(); ++i) {
+		c.push_back (i->first);
+	}
+
+	c.sort (name_less_than);
+	return c;
+}
+
+/** @param term Text to search for.
+ *  @return Cinemas, sorted by name, which have a word in their name or an email address
+ *  starting with term (ignoring case), or which have a screen whose certificate's
+ *  thumbprint starts with term.  All cinemas are returned if term is empty.
+ */
+list<shared_ptr<Cinema> >
+CinemaList::search (string term) const
+{
+	boost::algorithm::trim (term);
+	if (term.empty ()) {
+		return cinemas ();
+	}
+
+	boost::mutex::scoped_lock lm (_mutex);
+	load ();
+
+	string const lower_term = lower (term);
+	set<shared_ptr<Cinema> > found;
+
+	for (CinemaIndex::const_iterator i = _names.lower_bound (lower_term); i != _names.end() && boost::algorithm::starts_with (i->first, lower_term); ++i) {
+		found.insert (i->second);
+	}
+
+	for (CinemaIndex::const_iterator i = _emails.lower_bound (lower_term); i != _emails.end() && boost::algorithm::starts_with (i->first, lower_term); ++i) {
+		found.insert (i->second);
+	}
+
+	for (ScreenIndex::const_iterator i = _thumbprints.lower_bound (term); i != _thumbprints.end() && boost::algorithm::starts_with (i->first, term); ++i) {
+		found.insert (i->second->cinema);
+	}
+
+	list<shared_ptr<Cinema> > c (found.begin(), found.end());
+	c.sort (name_less_than);
+	return c;
+}
+
+/** @return A cinema whose name, or one of whose email addresses, is exactly the given string,
+ *  or 0 if there is none.
+ */
+shared_ptr<Cinema>
+CinemaList::find_by_name_or_email (string name) const
+{
+	boost::mutex::scoped_lock lm (_mutex);
+	load ();
+
+	string const key = lower (name);
+
+	pair<CinemaIndex::const_iterator, CinemaIndex::const_iterator> r = _names.equal_range (key);
+	for (CinemaIndex::const_iterator i = r.first; i != r.second; ++i) {
+		if (i->second->name == name) {
+			return i->second;
+		}
+	}
+
+	r = _emails.equal_range (key);
+	for (CinemaIndex::const_iterator i = r.first; i != r.second; ++i) {
+		if (find (i->second->emails.begin(), i->second->emails.end(), name) != i->second->emails.end()) {
+			return i->second;
+		}
+	}
+
+	return shared_ptr<Cinema> ();
+}
+
+/** @return A screen whose recipient certificate has the given thumbprint, or 0 if there is none */
+shared_ptr<Screen>
+CinemaList::find_by_thumbprint (string thumbprint) const
+{
+	boost::mutex::scoped_lock lm (_mutex);
+	load ();
+
+	ScreenIndex::const_iterator i = _thumbprints.find (thumbprint);
+	if (i == _thumbprints.end ()) {
+		return shared_ptr<Screen> ();
+	}
+
+	return i->second;
+}
+
+/** Add a cinema and write it to disk */
+void
+CinemaList::add (shared_ptr<Cinema> cinema)
+{
+	boost::mutex::scoped_lock lm (_mutex);
+	load ();
+
+	string const id = boost::filesystem::unique_path("%%%%%%%%%%%%%%%%").string();
+	write (id, cinema);
+	_ids[cinema] = id;
+	index (cinema);
+}
+
+/** Remove a cinema and its file */
+void
+CinemaList::remove (shared_ptr<Cinema> cinema)
+{
+	boost::mutex::scoped_lock lm (_mutex);
+	load ();
+
+	map<shared_ptr<Cinema>, string>::iterator i = _ids.find (cinema);
+	if (i == _ids.end ()) {
+		return;
+	}
+
+	boost::filesystem::remove (file (i->second));
+	unindex (cinema);
+	_ids.erase (i);
+}
+
+/** Re-index and re-write a cinema after its details, or those of
+ *  one of its screens, have been changed.
+ */
+void
+CinemaList::update (shared_ptr<Cinema> cinema)
+{
+	boost::mutex::scoped_lock lm (_mutex);
+	load ();
+
+	write (id (cinema), cinema);
+	unindex (cinema);
+	index (cinema);
+}
+
+/** Replace all our cinemas with those in a cinemas XML document (or config.xml
+ *  from versions which kept the cinemas in there).
+ */
+void
+CinemaList::read_xml (cxml::Document const & document)
+{
+	boost::mutex::scoped_lock lm (_mutex);
+	load ();
+
+	for (map<shared_ptr<Cinema>, string>::const_iterator i = _ids.begin(); i != _ids.end(); ++i) {
+		boost::filesystem::remove (file (i->second));
+	}
+
+	_ids.clear ();
+	_keys.clear ();
+	_names.clear ();
+	_emails.clear ();
+	_thumbprints.clear ();
+
+	BOOST_FOREACH (cxml::ConstNodePtr i, document.node_children ("Cinema")) {
+		shared_ptr<Cinema> cinema (new Cinema (i));
+		cinema->read_screens (i);
+		string const id = boost::filesystem::unique_path("%%%%%%%%%%%%%%%%").string();
+		write (id, cinema);
+		_ids[cinema] = id;
+		index (cinema);
+	}
+}
+
+/** Write all our cinemas to a single cinemas XML file */
+void
+CinemaList::write_xml (boost::filesystem::path file) const
+{
+	list<shared_ptr<Cinema> > all = cinemas ();
+
+	xmlpp::Document doc;
+	xmlpp::Element* root = doc.create_root_node ("Cinemas");
+	root->add_child("Version")->add_child_text ("1");
+
+	BOOST_FOREACH (shared_ptr<Cinema> i, all) {
+		i->as_xml (root->add_child ("Cinema"));
+	}
+
+	try {
+		doc.write_to_file_formatted (file.string ());
+	} catch (xmlpp::exception& e) {
+		string s = e.what ();
+		boost::algorithm::trim (s);
+		throw FileError (s, file);
+	}
+}
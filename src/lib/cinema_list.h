@@ -0,0 +1,112 @@
+/*
+    Copyright (C) 2018 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/** @file  src/lib/cinema_list.h
+ *  @brief CinemaList class.
+ */
+
+#ifndef DCPOMATIC_CINEMA_LIST_H
+#define DCPOMATIC_CINEMA_LIST_H
+
+#include <libcxml/cxml.h>
+#include <boost/filesystem.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/noncopyable.hpp>
+#include <list>
+#include <map>
+#include <string>
+
+class Cinema;
+class Screen;
+
+/** @class CinemaList
+ *  @brief The cinemas (and their screens) that we know about, kept in a directory
+ *  with one file per cinema.
+ *
+ *  Adding, changing or removing a cinema only writes (or removes) that cinema's file,
+ *  and nothing is read from disk until the list is first used.  Once it has been read
+ *  the cinemas are indexed by the words of their names, their email addresses and the
+ *  thumbprints of their screens' certificates so that they can be found quickly.
+ *
+ *  The old single-file cinemas XML can still be imported with read_xml() and exported
+ *  with write_xml().
+ */
+class CinemaList : public boost::noncopyable
+{
+public:
+	explicit CinemaList (boost::filesystem::path directory);
+
+	boost::filesystem::path directory () const {
+		return _directory;
+	}
+
+	std::list<boost::shared_ptr<Cinema> > cinemas () const;
+	std::list<boost::shared_ptr<Cinema> > search (std::string term) const;
+	boost::shared_ptr<Cinema> find_by_name_or_email (std::string name) const;
+	boost::shared_ptr<Screen> find_by_thumbprint (std::string thumbprint) const;
+
+	void add (boost::shared_ptr<Cinema> cinema);
+	void remove (boost::shared_ptr<Cinema> cinema);
+	void update (boost::shared_ptr<Cinema> cinema);
+
+	void read_xml (cxml::Document const & document);
+	void write_xml (boost::filesystem::path file) const;
+
+private:
+	/** Keys under which a cinema has been put into our indices */
+	struct Keys
+	{
+		std::list<std::string> names;
+		std::list<std::string> emails;
+		std::list<std::string> thumbprints;
+	};
+
+	typedef std::multimap<std::string, boost::shared_ptr<Cinema> > CinemaIndex;
+	typedef std::multimap<std::string, boost::shared_ptr<Screen> > ScreenIndex;
+
+	void load () const;
+	void index (boost::shared_ptr<Cinema> cinema) const;
+	void unindex (boost::shared_ptr<Cinema> cinema) const;
+	void write (std::string id, boost::shared_ptr<Cinema> cinema) const;
+	boost::filesystem::path file (std::string id) const;
+	std::string id (boost::shared_ptr<Cinema> cinema) const;
+
+	boost::filesystem::path _directory;
+
+	/** mutex to protect everything below */
+	mutable boost::mutex _mutex;
+	/** true if we have read the cinemas from _directory */
+	mutable bool _loaded;
+	/** ID (which is also the file name stem) of each cinema */
+	mutable std::map<boost::shared_ptr<Cinema>, std::string> _ids;
+	/** Keys under which each cinema is in the indices, so that it can be taken out
+	    again after its details have changed.
+	*/
+	mutable std::map<boost::shared_ptr<Cinema>, Keys> _keys;
+	/** Cinemas indexed by the lower-cased tail of their name starting at each word */
+	mutable CinemaIndex _names;
+	/** Cinemas indexed by lower-cased email address */
+	mutable CinemaIndex _emails;
+	/** Screens indexed by the lower-cased thumbprint of their recipient certificate */
+	mutable ScreenIndex _thumbprints;
+};
+
+#endif
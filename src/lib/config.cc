@@ -27,6 +27,7 @@
 #include "cinema_sound_processor.h"
 #include "colour_conversion.h"
 #include "cinema.h"
+#include "cinema_list.h"
 #include "util.h"
 #include "cross.h"
 #include "film.h"
@@ -85,13 +86,17 @@ Config::set_defaults ()
 	_use_any_servers = true;
 	_servers.clear ();
 	_only_servers_encode = false;
+	_servers_encode_reels = false;
+	_local_reel_encoders = 1;
 	_tms_protocol = PROTOCOL_SCP;
 	_tms_ip = "";
 	_tms_path = ".";
 	_tms_user = "";
 	_tms_password = "";
+	_tms_connections = 4;
 	_cinema_sound_processor = CinemaSoundProcessor::from_id (N_("dolby_cp750"));
 	_allow_any_dcp_frame_rate = false;
+	_verify_dcp = false;
 	_language = optional<string> ();
 	_default_still_length = 10;
 	_default_container = Ratio::from_id ("185");
@@ -106,6 +111,7 @@ Config::set_defaults ()
 	_mail_port = 25;
 	_mail_user = "";
 	_mail_password = "";
+	_mail_connections = 4;
 	_kdm_from = "";
 	_kdm_cc.clear ();
 	_kdm_bcc = "";
@@ -113,12 +119,15 @@ Config::set_defaults ()
 	_check_for_test_updates = false;
 	_maximum_j2k_bandwidth = 250000000;
 	_log_types = LogEntry::TYPE_GENERAL | LogEntry::TYPE_WARNING | LogEntry::TYPE_ERROR;
+	_j2k_frame_cache_directory = boost::none;
+	_j2k_frame_cache_size = 64;
 	_analyse_ebur128 = true;
 	_automatic_audio_analysis = false;
 #ifdef DCPOMATIC_WINDOWS
 	_win32_console = false;
 #endif
 	_cinemas_file = path ("cinemas.xml");
+	_cinemas.reset (new CinemaList (cinemas_directory ()));
 	_show_hints_before_make_dcp = true;
 	_confirm_kdm_email = true;
 	_kdm_container_name_format = dcp::NameFormat ("KDM %f %c");
@@ -144,6 +153,9 @@ Config::set_defaults ()
 	   use about 240Mb with 72 encoding threads.
 	*/
 	_frames_in_memory_multiplier = 3;
+	_maximum_encode_jobs = 1;
+	_maximum_io_jobs = 2;
+	_maximum_light_jobs = 4;
 
 	_allowed_dcp_frame_rates.clear ();
 	_allowed_dcp_frame_rates.push_back (24);
@@ -219,11 +231,14 @@ try
 	}
 
 	_only_servers_encode = f.optional_bool_child ("OnlyServersEncode").get_value_or (false);
+	_servers_encode_reels = f.optional_bool_child ("ServersEncodeReels").get_value_or (false);
+	_local_reel_encoders = f.optional_number_child<int> ("LocalReelEncoders").get_value_or (1);
 	_tms_protocol = static_cast<Protocol> (f.optional_number_child<int> ("TMSProtocol").get_value_or (static_cast<int> (PROTOCOL_SCP)));
 	_tms_ip = f.string_child ("TMSIP");
 	_tms_path = f.string_child ("TMSPath");
 	_tms_user = f.string_child ("TMSUser");
 	_tms_password = f.string_child ("TMSPassword");
+	_tms_connections = f.optional_number_child<int>("TMSConnections").get_value_or (4);
 
 	optional<string> c;
 	c = f.optional_string_child ("SoundProcessor");
@@ -280,13 +295,11 @@ try
 	_default_interop = f.optional_bool_child("DefaultInterop").get_value_or (false);
 	_default_kdm_directory = f.optional_string_child("DefaultKDMDirectory");
 
-	/* Load any cinemas from config.xml */
-	read_cinemas (f);
-
 	_mail_server = f.string_child ("MailServer");
 	_mail_port = f.optional_number_child<int> ("MailPort").get_value_or (25);
 	_mail_user = f.optional_string_child("MailUser").get_value_or ("");
 	_mail_password = f.optional_string_child("MailPassword").get_value_or ("");
+	_mail_connections = f.optional_number_child<int>("MailConnections").get_value_or (4);
 	_kdm_subject = f.optional_string_child ("KDMSubject").get_value_or (_("KDM delivery: $CPL_NAME"));
 	_kdm_from = f.string_child ("KDMFrom");
 	BOOST_FOREACH (cxml::ConstNodePtr i, f.node_children("KDMCC")) {
@@ -302,8 +315,11 @@ try
 
 	_maximum_j2k_bandwidth = f.optional_number_child<int> ("MaximumJ2KBandwidth").get_value_or (250000000);
 	_allow_any_dcp_frame_rate = f.optional_bool_child ("AllowAnyDCPFrameRate").get_value_or (false);
+	_verify_dcp = f.optional_bool_child ("VerifyDCP").get_value_or (false);
 
 	_log_types = f.optional_number_child<int> ("LogTypes").get_value_or (LogEntry::TYPE_GENERAL | LogEntry::TYPE_WARNING | LogEntry::TYPE_ERROR);
+	_j2k_frame_cache_directory = f.optional_string_child ("J2KFrameCacheDirectory");
+	_j2k_frame_cache_size = f.optional_number_child<int> ("J2KFrameCacheSize").get_value_or (64);
 	_analyse_ebur128 = f.optional_bool_child("AnalyseEBUR128").get_value_or (true);
 	_automatic_audio_analysis = f.optional_bool_child ("AutomaticAudioAnalysis").get_value_or (false);
 #ifdef DCPOMATIC_WINDOWS
@@ -392,12 +408,14 @@ try
 		}
 	}
 	_frames_in_memory_multiplier = f.optional_number_child<int>("FramesInMemoryMultiplier").get_value_or(3);
-
-	/* Replace any cinemas from config.xml with those from the configured file */
-	if (boost::filesystem::exists (_cinemas_file)) {
-		cxml::Document f ("Cinemas");
-		f.read_file (_cinemas_file);
-		read_cinemas (f);
+	_maximum_encode_jobs = max (1, f.optional_number_child<int>("MaximumEncodeJobs").get_value_or(1));
+	_maximum_io_jobs = max (1, f.optional_number_child<int>("MaximumIOJobs").get_value_or(2));
+	_maximum_light_jobs = max (1, f.optional_number_child<int>("MaximumLightJobs").get_value_or(4));
+
+	open_cinemas ();
+	if (!boost::filesystem::exists (cinemas_directory ())) {
+		/* Load any cinemas from config.xml, where old versions kept them */
+		_cinemas->read_xml (f);
 	}
 }
 catch (...) {
@@ -464,12 +482,13 @@ Config::instance ()
 	return _instance;
 }
 
-/** Write our configuration to disk */
+/** Write our configuration to disk.  Cinemas are not written here as each one
+ *  is saved as soon as it is changed.
+ */
 void
 Config::write () const
 {
 	write_config ();
-	write_cinemas ();
 }
 
 void
@@ -507,6 +526,15 @@ Config::write_config () const
 	   is done by the encoding servers.  0 to set the master to do some encoding as well as coordinating the job.
 	*/
 	root->add_child("OnlyServersEncode")->add_child_text (_only_servers_encode ? "1" : "0");
+	/* [XML] ServersEncodeReels 1 to send whole reels to encoding servers, which decode and encode them
+	   and write the JPEG2000 data to the film's directory; this must be on storage shared between the master
+	   and the servers, with the film and its content at the same paths.  0 to send the servers single frames.
+	*/
+	root->add_child("ServersEncodeReels")->add_child_text (_servers_encode_reels ? "1" : "0");
+	/* [XML] LocalReelEncoders Number of reels to decode and encode at the same time on the master, each with
+	   its own share of the master's encoding threads.  1 to decode the whole film in one pass.
+	*/
+	root->add_child("LocalReelEncoders")->add_child_text (raw_convert<string> (_local_reel_encoders));
 	/* [XML] TMSProtocol Protocol to use to copy files to a TMS; 0 to use SCP, 1 for FTP. */
 	root->add_child("TMSProtocol")->add_child_text (raw_convert<string> (static_cast<int> (_tms_protocol)));
 	/* [XML] TMSIP IP address of TMS */
@@ -517,6 +545,8 @@ Config::write_config () const
 	root->add_child("TMSUser")->add_child_text (_tms_user);
 	/* [XML] TMSPassword Password to log into the TMS with */
 	root->add_child("TMSPassword")->add_child_text (_tms_password);
+	/* [XML] TMSConnections Maximum number of connections to make to the TMS at the same time when copying a DCP */
+	root->add_child("TMSConnections")->add_child_text (raw_convert<string> (_tms_connections));
 	if (_cinema_sound_processor) {
 		/* [XML:opt] CinemaSoundProcessor Identifier of the type of cinema sound processor to use when calculating
 		   gain changes from fader positions.  Currently can only be <code>dolby_cp750</code>.
@@ -582,6 +612,10 @@ Config::write_config () const
 	root->add_child("MailUser")->add_child_text (_mail_user);
 	/* [XML] MailPassword Password to use on SMTP server. */
 	root->add_child("MailPassword")->add_child_text (_mail_password);
+	/* [XML] MailConnections Maximum number of connections to make to the SMTP server at the same time
+	   when sending several emails.
+	*/
+	root->add_child("MailConnections")->add_child_text (raw_convert<string> (_mail_connections));
 	/* [XML] KDMSubject Subject to use for KDM emails. */
 	root->add_child("KDMSubject")->add_child_text (_kdm_subject);
 	/* [XML] KDMFrom From address to use for KDM emails. */
@@ -604,11 +638,21 @@ Config::write_config () const
 	root->add_child("MaximumJ2KBandwidth")->add_child_text (raw_convert<string> (_maximum_j2k_bandwidth));
 	/* [XML] AllowAnyDCPFrameRate 1 to allow users to specify any frame rate when creating DCPs, 0 to limit the GUI to standard rates */
 	root->add_child("AllowAnyDCPFrameRate")->add_child_text (_allow_any_dcp_frame_rate ? "1" : "0");
+	/* [XML] VerifyDCP 1 to check each picture frame of a DCP against the hash recorded when it was written, 0 to just compute digests */
+	root->add_child("VerifyDCP")->add_child_text (_verify_dcp ? "1" : "0");
 	/* [XML] LogTypes Types of logging to write; a bitfield where 1 is general notes, 2 warnings, 4 errors, 8 debug information related
 	   to encoding, 16 debug information related to encoding, 32 debug information for timing purposes, 64 debug information related
 	   to sending email.
 	*/
 	root->add_child("LogTypes")->add_child_text (raw_convert<string> (_log_types));
+	if (_j2k_frame_cache_directory) {
+		/* [XML:opt] J2KFrameCacheDirectory Directory in which to keep encoded JPEG2000 frames so that they can be
+		   re-used by later encodes; if this is not present, no such cache is kept.
+		*/
+		root->add_child("J2KFrameCacheDirectory")->add_child_text (_j2k_frame_cache_directory->string ());
+	}
+	/* [XML] J2KFrameCacheSize Maximum size of the JPEG2000 frame cache in GB. */
+	root->add_child("J2KFrameCacheSize")->add_child_text (raw_convert<string> (_j2k_frame_cache_size));
 	/* [XML] AnalyseEBUR128 1 to do EBUR128 analyses when analysing audio, otherwise 0. */
 	root->add_child("AnalyseEBUR128")->add_child_text (_analyse_ebur128 ? "1" : "0");
 	/* [XML] AutomaticAudioAnalysis 1 to run audio analysis automatically when audio content is added to the film, otherwise 0. */
@@ -653,7 +697,9 @@ Config::write_config () const
 	/* [XML] DKDM A DKDM as XML */
 	_dkdms->as_xml (root);
 
-	/* [XML] CinemasFile Filename of cinemas list file */
+	/* [XML] CinemasFile Filename of cinemas list file; the cinemas are kept in a directory next to it, and
+	   the file is only read if that directory does not exist.
+	*/
 	root->add_child("CinemasFile")->add_child_text (_cinemas_file.string());
 	/* [XML] ShowHintsBeforeMakeDCP 1 to show hints in the GUI before making a DCP, otherwise 0 */
 	root->add_child("ShowHintsBeforeMakeDCP")->add_child_text (_show_hints_before_make_dcp ? "1" : "0");
@@ -713,6 +759,12 @@ Config::write_config () const
 	   frames to be held in memory at once.
 	*/
 	root->add_child("FramesInMemoryMultiplier")->add_child_text(raw_convert<string>(_frames_in_memory_multiplier));
+	/* [XML] MaximumEncodeJobs Maximum number of encoding jobs (such as DCP transcodes) to run at the same time. */
+	root->add_child("MaximumEncodeJobs")->add_child_text(raw_convert<string>(_maximum_encode_jobs));
+	/* [XML] MaximumIOJobs Maximum number of file or network-bound jobs (such as content examinations and uploads) to run at the same time. */
+	root->add_child("MaximumIOJobs")->add_child_text(raw_convert<string>(_maximum_io_jobs));
+	/* [XML] MaximumLightJobs Maximum number of light jobs (such as KDM emails) to run at the same time. */
+	root->add_child("MaximumLightJobs")->add_child_text(raw_convert<string>(_maximum_light_jobs));
 
 	try {
 		doc.write_to_file_formatted(config_file().string());
@@ -723,24 +775,11 @@ Config::write_config () const
 	}
 }
 
+/** Export all our cinemas to the cinemas file */
 void
 Config::write_cinemas () const
 {
-	xmlpp::Document doc;
-	xmlpp::Element* root = doc.create_root_node ("Cinemas");
-	root->add_child("Version")->add_child_text ("1");
-
-	BOOST_FOREACH (shared_ptr<Cinema> i, _cinemas) {
-		i->as_xml (root->add_child ("Cinema"));
-	}
-
-	try {
-		doc.write_to_file_formatted (_cinemas_file.string ());
-	} catch (xmlpp::exception& e) {
-		string s = e.what ();
-		trim (s);
-		throw FileError (s, _cinemas_file);
-	}
+	_cinemas->write_xml (_cinemas_file);
 }
 
 boost::filesystem::path
@@ -853,36 +892,79 @@ Config::have_existing (string file)
 	return boost::filesystem::exists (path (file, false));
 }
 
+/** @return Directory in which our cinemas are kept, one file per cinema; it is next
+ *  to the cinemas file and named after it.
+ */
+boost::filesystem::path
+Config::cinemas_directory () const
+{
+	boost::filesystem::path p = _cinemas_file.parent_path ();
+	p /= _cinemas_file.stem().string() + ".d";
+	return p;
+}
+
+/** Set up _cinemas to use cinemas_directory().  If that directory does not exist yet
+ *  any cinemas in the cinemas file are imported into it.
+ */
 void
-Config::read_cinemas (cxml::Document const & f)
+Config::open_cinemas ()
 {
-	_cinemas.clear ();
-	list<cxml::NodePtr> cin = f.node_children ("Cinema");
-	BOOST_FOREACH (cxml::ConstNodePtr i, f.node_children("Cinema")) {
-		/* Slightly grotty two-part construction of Cinema here so that we can use
-		   shared_from_this.
-		*/
-		shared_ptr<Cinema> cinema (new Cinema (i));
-		cinema->read_screens (i);
-		_cinemas.push_back (cinema);
+	bool const existing = boost::filesystem::exists (cinemas_directory ());
+	_cinemas.reset (new CinemaList (cinemas_directory ()));
+
+	if (!existing && boost::filesystem::exists (_cinemas_file)) {
+		cxml::Document f ("Cinemas");
+		f.read_file (_cinemas_file);
+		_cinemas->read_xml (f);
 	}
 }
 
 void
 Config::set_cinemas_file (boost::filesystem::path file)
 {
+	list<shared_ptr<Cinema> > old = _cinemas->cinemas ();
+
 	_cinemas_file = file;
+	open_cinemas ();
 
-	if (boost::filesystem::exists (_cinemas_file)) {
-		/* Existing file; read it in */
-		cxml::Document f ("Cinemas");
-		f.read_file (_cinemas_file);
-		read_cinemas (f);
+	if (!boost::filesystem::exists (cinemas_directory ())) {
+		/* Nothing at the new location, so keep the cinemas that we had */
+		BOOST_FOREACH (shared_ptr<Cinema> i, old) {
+			_cinemas->add (i);
+		}
 	}
 
 	changed (OTHER);
 }
 
+list<shared_ptr<Cinema> >
+Config::cinemas () const
+{
+	return _cinemas->cinemas ();
+}
+
+void
+Config::add_cinema (shared_ptr<Cinema> c)
+{
+	_cinemas->add (c);
+	changed (CINEMAS);
+}
+
+void
+Config::remove_cinema (shared_ptr<Cinema> c)
+{
+	_cinemas->remove (c);
+	changed (CINEMAS);
+}
+
+/** Save a cinema after it, or one of its screens, has been changed */
+void
+Config::update_cinema (shared_ptr<Cinema> c)
+{
+	_cinemas->update (c);
+	changed (CINEMAS);
+}
+
 void
 Config::save_template (shared_ptr<const Film> film, string name) const
 {
@@ -915,6 +997,13 @@ Config::template_path (string name) const
 	return path("templates") / tidy_for_filename (name);
 }
 
+/** @return File in which to cache the results of examining content with a given digest */
+boost::filesystem::path
+Config::examination_cache_path (string digest) const
+{
+	return path("examination") / (digest + ".xml");
+}
+
 void
 Config::rename_template (string old_name, string new_name) const
 {
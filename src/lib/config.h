@@ -39,6 +39,7 @@ class CinemaSoundProcessor;
 class DCPContentType;
 class Ratio;
 class Cinema;
+class CinemaList;
 class Film;
 class DKDMGroup;
 
@@ -107,6 +108,14 @@ public:
 		return _only_servers_encode;
 	}
 
+	bool servers_encode_reels () const {
+		return _servers_encode_reels;
+	}
+
+	int local_reel_encoders () const {
+		return _local_reel_encoders;
+	}
+
 	Protocol tms_protocol () const {
 		return _tms_protocol;
 	}
@@ -131,12 +140,19 @@ public:
 		return _tms_password;
 	}
 
+	/** @return Number of connections to make to the TMS when copying a DCP */
+	int tms_connections () const {
+		return _tms_connections;
+	}
+
 	/** @return The cinema sound processor that we are using */
 	CinemaSoundProcessor const * cinema_sound_processor () const {
 		return _cinema_sound_processor;
 	}
 
-	std::list<boost::shared_ptr<Cinema> > cinemas () const {
+	std::list<boost::shared_ptr<Cinema> > cinemas () const;
+
+	boost::shared_ptr<const CinemaList> cinema_list () const {
 		return _cinemas;
 	}
 
@@ -148,6 +164,10 @@ public:
 		return _allow_any_dcp_frame_rate;
 	}
 
+	bool verify_dcp () const {
+		return _verify_dcp;
+	}
+
 	ISDCFMetadata default_isdcf_metadata () const {
 		return _default_isdcf_metadata;
 	}
@@ -224,6 +244,10 @@ public:
 		return _mail_password;
 	}
 
+	int mail_connections () const {
+		return _mail_connections;
+	}
+
 	std::string kdm_subject () const {
 		return _kdm_subject;
 	}
@@ -268,6 +292,15 @@ public:
 		return _log_types;
 	}
 
+	boost::optional<boost::filesystem::path> j2k_frame_cache_directory () const {
+		return _j2k_frame_cache_directory;
+	}
+
+	/** @return maximum size of the JPEG2000 frame cache in GB */
+	int j2k_frame_cache_size () const {
+		return _j2k_frame_cache_size;
+	}
+
 	bool analyse_ebur128 () const {
 		return _analyse_ebur128;
 	}
@@ -298,6 +331,8 @@ public:
 		return _cinemas_file;
 	}
 
+	boost::filesystem::path cinemas_directory () const;
+
 	bool show_hints_before_make_dcp () const {
 		return _show_hints_before_make_dcp;
 	}
@@ -376,6 +411,18 @@ public:
 		return _frames_in_memory_multiplier;
 	}
 
+	int maximum_encode_jobs () const {
+		return _maximum_encode_jobs;
+	}
+
+	int maximum_io_jobs () const {
+		return _maximum_io_jobs;
+	}
+
+	int maximum_light_jobs () const {
+		return _maximum_light_jobs;
+	}
+
 	void set_master_encoding_threads (int n) {
 		maybe_set (_master_encoding_threads, n);
 	}
@@ -401,6 +448,14 @@ public:
 		maybe_set (_only_servers_encode, o);
 	}
 
+	void set_servers_encode_reels (bool e) {
+		maybe_set (_servers_encode_reels, e);
+	}
+
+	void set_local_reel_encoders (int n) {
+		maybe_set (_local_reel_encoders, n);
+	}
+
 	void set_tms_protocol (Protocol p) {
 		maybe_set (_tms_protocol, p);
 	}
@@ -425,15 +480,13 @@ public:
 		maybe_set (_tms_password, p);
 	}
 
-	void add_cinema (boost::shared_ptr<Cinema> c) {
-		_cinemas.push_back (c);
-		changed (CINEMAS);
+	void set_tms_connections (int c) {
+		maybe_set (_tms_connections, c);
 	}
 
-	void remove_cinema (boost::shared_ptr<Cinema> c) {
-		_cinemas.remove (c);
-		changed (CINEMAS);
-	}
+	void add_cinema (boost::shared_ptr<Cinema> c);
+	void remove_cinema (boost::shared_ptr<Cinema> c);
+	void update_cinema (boost::shared_ptr<Cinema> c);
 
 	void set_allowed_dcp_frame_rates (std::list<int> const & r) {
 		maybe_set (_allowed_dcp_frame_rates, r);
@@ -443,6 +496,10 @@ public:
 		maybe_set (_allow_any_dcp_frame_rate, a);
 	}
 
+	void set_verify_dcp (bool v) {
+		maybe_set (_verify_dcp, v);
+	}
+
 	void set_default_isdcf_metadata (ISDCFMetadata d) {
 		maybe_set (_default_isdcf_metadata, d);
 	}
@@ -524,6 +581,10 @@ public:
 		maybe_set (_mail_password, p);
 	}
 
+	void set_mail_connections (int c) {
+		maybe_set (_mail_connections, c);
+	}
+
 	void set_kdm_subject (std::string s) {
 		maybe_set (_kdm_subject, s);
 	}
@@ -573,6 +634,26 @@ public:
 		maybe_set (_log_types, t);
 	}
 
+	void set_j2k_frame_cache_directory (boost::filesystem::path d) {
+		if (_j2k_frame_cache_directory && _j2k_frame_cache_directory.get() == d) {
+			return;
+		}
+		_j2k_frame_cache_directory = d;
+		changed ();
+	}
+
+	void unset_j2k_frame_cache_directory () {
+		if (!_j2k_frame_cache_directory) {
+			return;
+		}
+		_j2k_frame_cache_directory = boost::none;
+		changed ();
+	}
+
+	void set_j2k_frame_cache_size (int s) {
+		maybe_set (_j2k_frame_cache_size, s);
+	}
+
 	void set_analyse_ebur128 (bool a) {
 		maybe_set (_analyse_ebur128, a);
 	}
@@ -651,6 +732,18 @@ public:
 		maybe_set (_frames_in_memory_multiplier, m);
 	}
 
+	void set_maximum_encode_jobs (int m) {
+		maybe_set (_maximum_encode_jobs, m);
+	}
+
+	void set_maximum_io_jobs (int m) {
+		maybe_set (_maximum_io_jobs, m);
+	}
+
+	void set_maximum_light_jobs (int m) {
+		maybe_set (_maximum_light_jobs, m);
+	}
+
 	void clear_history () {
 		_history.clear ();
 		changed ();
@@ -697,6 +790,7 @@ public:
 	bool existing_template (std::string name) const;
 	std::list<std::string> templates () const;
 	boost::filesystem::path template_path (std::string name) const;
+	boost::filesystem::path examination_cache_path (std::string digest) const;
 	void rename_template (std::string old_name, std::string new_name) const;
 	void delete_template (std::string name) const;
 
@@ -715,7 +809,7 @@ private:
 	void set_defaults ();
 	void set_kdm_email_to_default ();
 	void set_cover_sheet_to_default ();
-	void read_cinemas (cxml::Document const & f);
+	void open_cinemas ();
 	boost::shared_ptr<dcp::CertificateChain> create_certificate_chain ();
 	boost::filesystem::path directory_or (boost::optional<boost::filesystem::path> dir, boost::filesystem::path a) const;
 	void add_to_history_internal (std::vector<boost::filesystem::path>& h, boost::filesystem::path p);
@@ -753,6 +847,14 @@ private:
 	/** J2K encoding servers that should definitely be used */
 	std::vector<std::string> _servers;
 	bool _only_servers_encode;
+	/** true to give encoding servers whole reels to decode and encode, writing the
+	    results to storage shared with the master, rather than sending them single frames.
+	*/
+	bool _servers_encode_reels;
+	/** number of reels to decode and encode at the same time on this machine; if this is
+	    more than 1 each reel gets its own player, and some of the master encoding threads.
+	*/
+	int _local_reel_encoders;
 	Protocol _tms_protocol;
 	/** The IP address of a TMS that we can copy DCPs to */
 	std::string _tms_ip;
@@ -762,11 +864,17 @@ private:
 	std::string _tms_user;
 	/** Password to log into the TMS with */
 	std::string _tms_password;
+	/** maximum number of connections to make to the TMS at once when copying a DCP */
+	int _tms_connections;
 	/** Our cinema sound processor */
 	CinemaSoundProcessor const * _cinema_sound_processor;
 	std::list<int> _allowed_dcp_frame_rates;
 	/** Allow any video frame rate for the DCP; if true, overrides _allowed_dcp_frame_rates */
 	bool _allow_any_dcp_frame_rate;
+	/** true to check each picture frame against the hash that was recorded when it was written,
+	 *  while computing the digests of a newly-written DCP.
+	 */
+	bool _verify_dcp;
 	/** Default ISDCF metadata for newly-created Films */
 	ISDCFMetadata _default_isdcf_metadata;
 	boost::optional<std::string> _language;
@@ -786,11 +894,14 @@ private:
 	*/
 	boost::optional<boost::filesystem::path> _default_kdm_directory;
 	bool _default_upload_after_make_dcp;
-	std::list<boost::shared_ptr<Cinema> > _cinemas;
+	/** Our cinemas, which are kept in cinemas_directory() */
+	boost::shared_ptr<CinemaList> _cinemas;
 	std::string _mail_server;
 	int _mail_port;
 	std::string _mail_user;
 	std::string _mail_password;
+	/** maximum number of connections to make to the SMTP server at once */
+	int _mail_connections;
 	std::string _kdm_subject;
 	std::string _kdm_from;
 	std::vector<std::string> _kdm_cc;
@@ -807,6 +918,10 @@ private:
 	/** maximum allowed J2K bandwidth in bits per second */
 	int _maximum_j2k_bandwidth;
 	int _log_types;
+	/** directory to keep encoded JPEG2000 frames in for re-use, or empty to not do so */
+	boost::optional<boost::filesystem::path> _j2k_frame_cache_directory;
+	/** maximum size of the JPEG2000 frame cache in GB */
+	int _j2k_frame_cache_size;
 	bool _analyse_ebur128;
 	bool _automatic_audio_analysis;
 #ifdef DCPOMATIC_WINDOWS
@@ -832,6 +947,12 @@ private:
 	boost::optional<KDMWriteType> _last_kdm_write_type;
 	boost::optional<DKDMWriteType> _last_dkdm_write_type;
 	int _frames_in_memory_multiplier;
+	/** maximum number of encoding jobs (e.g. DCP transcodes) to run at once */
+	int _maximum_encode_jobs;
+	/** maximum number of file or network-bound jobs (e.g. examinations, uploads) to run at once */
+	int _maximum_io_jobs;
+	/** maximum number of light jobs (e.g. KDM emails) to run at once */
+	int _maximum_light_jobs;
 
 	/** Singleton instance, or 0 */
 	static Config* _instance;
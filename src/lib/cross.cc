@@ -30,6 +30,11 @@ extern "C" {
 #ifdef DCPOMATIC_LINUX
 #include <unistd.h>
 #include <mntent.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/fs.h>
 #endif
 #ifdef DCPOMATIC_WINDOWS
 #include <windows.h>
@@ -50,6 +55,7 @@ extern "C" {
 #include <arpa/inet.h>
 #endif
 #include <fstream>
+#include <algorithm>
 
 #include "i18n.h"
 
@@ -64,6 +70,7 @@ using std::string;
 using std::wstring;
 using std::make_pair;
 using std::runtime_error;
+using std::min;
 using boost::shared_ptr;
 
 /** @param s Number of seconds to sleep for */
@@ -336,6 +343,129 @@ dcpomatic_fseek (FILE* stream, int64_t offset, int whence)
 #endif
 }
 
+#ifdef DCPOMATIC_LINUX
+/** Open a source and a (new) destination file for a copy, giving the destination
+ *  the same permissions as the source.
+ *  @return true on success, in which case the caller must close both descriptors.
+ */
+static bool
+open_for_copy (boost::filesystem::path from, boost::filesystem::path to, int& in, int& out, struct stat& info)
+{
+	in = open (from.c_str(), O_RDONLY);
+	if (in < 0) {
+		return false;
+	}
+
+	if (fstat (in, &info) < 0) {
+		close (in);
+		return false;
+	}
+
+	out = open (to.c_str(), O_WRONLY | O_CREAT | O_EXCL, info.st_mode & 07777);
+	if (out < 0) {
+		close (in);
+		return false;
+	}
+
+	return true;
+}
+#endif
+
+/** Try to make a copy-on-write clone of a file, so that the copy shares storage with
+ *  the original until one of them is modified.  This needs support from the filesystem
+ *  (e.g. Btrfs, or XFS with reflinks enabled).
+ *  @return true if the clone was made, false if not (in which case `to' will not exist).
+ */
+bool
+clone_file (boost::filesystem::path from, boost::filesystem::path to)
+{
+#if defined(DCPOMATIC_LINUX) && defined(FICLONE)
+	int in;
+	int out;
+	struct stat info;
+	if (!open_for_copy (from, to, in, out, info)) {
+		return false;
+	}
+
+	bool const ok = ioctl (out, FICLONE, in) == 0;
+	close (in);
+	close (out);
+
+	if (!ok) {
+		boost::system::error_code ec;
+		boost::filesystem::remove (to, ec);
+	}
+
+	return ok;
+#else
+	return false;
+#endif
+}
+
+#if defined(DCPOMATIC_LINUX) && defined(SYS_copy_file_range)
+/** Copy a file using copy_file_range(), which keeps the data in the kernel and lets
+ *  the filesystem share or offload the copy if it can.
+ *  @return true if the copy was made, false if not (in which case `to' will not exist).
+ */
+static bool
+copy_file_in_kernel (boost::filesystem::path from, boost::filesystem::path to)
+{
+	int in;
+	int out;
+	struct stat info;
+	if (!open_for_copy (from, to, in, out, info)) {
+		return false;
+	}
+
+	boost::uintmax_t remaining = info.st_size;
+	while (remaining > 0) {
+		/* Stay well within what a ssize_t can report on 32-bit systems */
+		size_t const chunk = min (remaining, boost::uintmax_t (1024 * 1024 * 1024));
+		long const n = syscall (SYS_copy_file_range, in, 0, out, 0, chunk, 0);
+		if (n <= 0) {
+			/* Not supported between these files, or some other error; the caller will copy another way */
+			break;
+		}
+		remaining -= n;
+	}
+
+	close (in);
+	close (out);
+
+	if (remaining > 0) {
+		boost::system::error_code ec;
+		boost::filesystem::remove (to, ec);
+		return false;
+	}
+
+	return true;
+}
+#endif
+
+/** Copy a file, making a copy-on-write clone if the filesystem supports it and otherwise
+ *  copying in the kernel where possible, falling back to a normal copy.
+ *  @param ec Set to the error if the copy fails.
+ *  @return true if the copy shares storage with the original.
+ */
+bool
+dcpomatic_copy_file (boost::filesystem::path from, boost::filesystem::path to, boost::system::error_code& ec)
+{
+	ec.clear ();
+
+	if (clone_file (from, to)) {
+		return true;
+	}
+
+#if defined(DCPOMATIC_LINUX) && defined(SYS_copy_file_range)
+	if (copy_file_in_kernel (from, to)) {
+		return false;
+	}
+#endif
+
+	boost::filesystem::copy_file (from, to, ec);
+	return false;
+}
+
 void
 Waker::nudge ()
 {
@@ -51,6 +51,8 @@ extern void maybe_open_console ();
 extern boost::filesystem::path shared_path ();
 extern FILE * fopen_boost (boost::filesystem::path, std::string);
 extern int dcpomatic_fseek (FILE *, int64_t, int);
+extern bool clone_file (boost::filesystem::path from, boost::filesystem::path to);
+extern bool dcpomatic_copy_file (boost::filesystem::path from, boost::filesystem::path to, boost::system::error_code& ec);
 extern void start_batch_converter (boost::filesystem::path dcpomatic);
 extern uint64_t thread_id ();
 extern int avio_open_boost (AVIOContext** s, boost::filesystem::path file, int flags);
@@ -1,5 +1,5 @@
 /*
-    Copyright (C) 2015 Carl Hetherington <cth@carlh.net>
+    Copyright (C) 2015-2018 Carl Hetherington <cth@carlh.net>
 
     This file is part of DCP-o-matic.
 
@@ -19,93 +19,240 @@
 */
 
 #include "curl_uploader.h"
+#include "upload_source.h"
+#include "exception_store.h"
 #include "exceptions.h"
 #include "config.h"
-#include "cross.h"
 #include "compose.hpp"
-#include <iostream>
+#include <curl/curl.h>
+#include <boost/foreach.hpp>
+#include <boost/algorithm/string.hpp>
+#include <list>
+#include <vector>
+#include <cstring>
 
 #include "i18n.h"
 
 using std::string;
-using std::cout;
+using std::min;
+using std::list;
+using std::vector;
+using boost::shared_ptr;
 using boost::function;
+using boost::optional;
 
-static size_t
-read_callback (void* ptr, size_t size, size_t nmemb, void* object)
+/** @class FTPConnection
+ *  @brief A libcurl handle, which keeps its connection to the server open between transfers.
+ */
+class FTPConnection : public Uploader::Connection, public ExceptionStore
 {
-	CurlUploader* u = reinterpret_cast<CurlUploader*> (object);
-	return u->read_callback (ptr, size, nmemb);
-}
+public:
+	FTPConnection ()
+		: _curl (curl_easy_init ())
+		, _source (0)
+		, _read_data (0)
+		, _read_size (0)
+	{
+		if (!_curl) {
+			throw NetworkError (_("Could not start transfer"));
+		}
 
-CurlUploader::CurlUploader (function<void (string)> set_status, function<void (float)> set_progress)
-	: Uploader (set_status, set_progress)
-	, _file (0)
-	, _transferred (0)
-	, _total_size (0)
-{
-	_curl = curl_easy_init ();
-	if (!_curl) {
-		throw NetworkError (_("Could not start transfer"));
+		curl_easy_setopt (_curl, CURLOPT_FTP_CREATE_MISSING_DIRS, 1L);
+		curl_easy_setopt (_curl, CURLOPT_USERNAME, Config::instance()->tms_user().c_str ());
+		curl_easy_setopt (_curl, CURLOPT_PASSWORD, Config::instance()->tms_password().c_str ());
 	}
 
-	curl_easy_setopt (_curl, CURLOPT_READFUNCTION, ::read_callback);
-	curl_easy_setopt (_curl, CURLOPT_READDATA, this);
-	curl_easy_setopt (_curl, CURLOPT_UPLOAD, 1L);
-	curl_easy_setopt (_curl, CURLOPT_FTP_CREATE_MISSING_DIRS, 1L);
-	curl_easy_setopt (_curl, CURLOPT_READDATA, this);
-	curl_easy_setopt (_curl, CURLOPT_USERNAME, Config::instance()->tms_user().c_str ());
-	curl_easy_setopt (_curl, CURLOPT_PASSWORD, Config::instance()->tms_password().c_str ());
-}
+	~FTPConnection ()
+	{
+		curl_easy_cleanup (_curl);
+	}
 
-CurlUploader::~CurlUploader ()
-{
-	if (_file) {
-		fclose (_file);
+	void create_directory (boost::filesystem::path)
+	{
+		/* this is done by libcurl */
 	}
-	curl_easy_cleanup (_curl);
-}
 
-void
-CurlUploader::create_directory (boost::filesystem::path)
-{
-	/* this is done by libcurl */
-}
+	boost::uintmax_t remote_size (boost::filesystem::path file)
+	{
+		start (file);
+		curl_easy_setopt (_curl, CURLOPT_NOBODY, 1L);
+		if (curl_easy_perform (_curl) != CURLE_OK) {
+			/* Most likely the file isn't there */
+			return 0;
+		}
 
-void
-CurlUploader::upload_file (boost::filesystem::path from, boost::filesystem::path to, boost::uintmax_t& transferred, boost::uintmax_t total_size)
-{
-	curl_easy_setopt (
-		_curl, CURLOPT_URL,
-		/* Use generic_string so that we get forward-slashes in the path, even on Windows */
-		String::compose ("ftp://%1/%2/%3", Config::instance()->tms_ip(), Config::instance()->tms_path(), to.generic_string ()).c_str ()
-		);
-
-	_file = fopen_boost (from, "rb");
-	if (!_file) {
-		throw NetworkError (String::compose (_("Could not open %1 to send"), from));
+		double size = 0;
+		curl_easy_getinfo (_curl, CURLINFO_CONTENT_LENGTH_DOWNLOAD, &size);
+		return size > 0 ? boost::uintmax_t (size) : 0;
 	}
-	_transferred = &transferred;
-	_total_size = total_size;
 
-	CURLcode const r = curl_easy_perform (_curl);
-	if (r != CURLE_OK) {
-		throw NetworkError (String::compose (_("Could not write to remote file (%1)"), curl_easy_strerror (r)));
+	void read (boost::filesystem::path file, boost::uintmax_t offset, uint8_t* data, size_t size)
+	{
+		start (file);
+		string const range = String::compose ("%1-%2", offset, offset + size - 1);
+		curl_easy_setopt (_curl, CURLOPT_RANGE, range.c_str ());
+		curl_easy_setopt (_curl, CURLOPT_WRITEFUNCTION, write_callback);
+		curl_easy_setopt (_curl, CURLOPT_WRITEDATA, this);
+		_read_data = data;
+		_read_size = size;
+
+		CURLcode const r = curl_easy_perform (_curl);
+		if (r != CURLE_OK) {
+			throw NetworkError (String::compose (_("Could not read from remote file (%1)"), curl_easy_strerror (r)));
+		}
+
+		if (_read_size > 0) {
+			throw NetworkError (String::compose (_("Could not read from remote file (%1)"), file));
+		}
 	}
 
-	fclose (_file);
-	_file = 0;
-}
+	/** Ask the server for a digest using HASH (from draft-bryan-ftpext-hash) or,
+	 *  failing that, the older XMD5.
+	 */
+	optional<string> remote_md5 (boost::filesystem::path file)
+	{
+		/* Quote commands are sent before libcurl changes directory, so give the full path */
+		string const path = String::compose ("%1/%2", Config::instance()->tms_path(), file.generic_string ());
 
-size_t
-CurlUploader::read_callback (void* ptr, size_t size, size_t nmemb)
-{
-	size_t const r = fread (ptr, size, nmemb, _file);
-	*_transferred += size * nmemb;
+		list<string> hash;
+		hash.push_back ("OPTS HASH MD5");
+		hash.push_back ("HASH " + path);
+		optional<string> md5 = quote (file, hash);
+		if (!md5) {
+			md5 = quote (file, list<string> (1, "XMD5 " + path));
+		}
+		return md5;
+	}
+
+	void upload_file (UploadSource& source, boost::filesystem::path to)
+	{
+		start (to);
+		curl_easy_setopt (_curl, CURLOPT_UPLOAD, 1L);
+		/* Send the rest of a partly-uploaded file with APPE */
+		curl_easy_setopt (_curl, CURLOPT_APPEND, source.offset() > 0 ? 1L : 0L);
+		curl_easy_setopt (_curl, CURLOPT_INFILESIZE_LARGE, static_cast<curl_off_t> (source.length ()));
+		curl_easy_setopt (_curl, CURLOPT_READFUNCTION, read_callback);
+		curl_easy_setopt (_curl, CURLOPT_READDATA, this);
+		_source = &source;
+
+		CURLcode const r = curl_easy_perform (_curl);
+		_source = 0;
+		if (r != CURLE_OK) {
+			/* Throw whatever went wrong in read_callback, if anything did */
+			rethrow ();
+			throw NetworkError (String::compose (_("Could not write to remote file (%1)"), curl_easy_strerror (r)));
+		}
+	}
+
+private:
+	/** Set up _curl for a new transfer to or from a file */
+	void start (boost::filesystem::path file)
+	{
+		curl_easy_setopt (
+			_curl, CURLOPT_URL,
+			/* Use generic_string so that we get forward-slashes in the path, even on Windows */
+			String::compose ("ftp://%1/%2/%3", Config::instance()->tms_ip(), Config::instance()->tms_path(), file.generic_string ()).c_str ()
+			);
 
-	if (_total_size > 0) {
-		_set_progress ((double) *_transferred / _total_size);
+		curl_easy_setopt (_curl, CURLOPT_NOBODY, 0L);
+		curl_easy_setopt (_curl, CURLOPT_UPLOAD, 0L);
+		curl_easy_setopt (_curl, CURLOPT_APPEND, 0L);
+		curl_easy_setopt (_curl, CURLOPT_RANGE, static_cast<char *> (0));
+		curl_easy_setopt (_curl, CURLOPT_QUOTE, static_cast<curl_slist *> (0));
+		curl_easy_setopt (_curl, CURLOPT_HEADERFUNCTION, static_cast<curl_write_callback> (0));
 	}
 
-	return r;
+	/** Send some commands to the server before looking at a file, and look for an
+	 *  MD5 digest in the replies.
+	 */
+	optional<string> quote (boost::filesystem::path file, list<string> commands)
+	{
+		curl_slist* slist = 0;
+		BOOST_FOREACH (string i, commands) {
+			slist = curl_slist_append (slist, i.c_str ());
+		}
+
+		start (file);
+		curl_easy_setopt (_curl, CURLOPT_NOBODY, 1L);
+		curl_easy_setopt (_curl, CURLOPT_QUOTE, slist);
+		curl_easy_setopt (_curl, CURLOPT_HEADERFUNCTION, header_callback);
+		curl_easy_setopt (_curl, CURLOPT_HEADERDATA, this);
+		_replies.clear ();
+
+		CURLcode const r = curl_easy_perform (_curl);
+		curl_easy_setopt (_curl, CURLOPT_QUOTE, static_cast<curl_slist *> (0));
+		curl_easy_setopt (_curl, CURLOPT_HEADERFUNCTION, static_cast<curl_write_callback> (0));
+		curl_slist_free_all (slist);
+		if (r != CURLE_OK) {
+			/* The server probably does not know the command */
+			return optional<string> ();
+		}
+
+		/* Replies look like "213 MD5 0-1234 <digest> <file>" (HASH) or "250 <digest>" (XMD5) */
+		BOOST_FOREACH (string i, _replies) {
+			if (!boost::algorithm::starts_with (i, "213 ") && !boost::algorithm::starts_with (i, "250 ")) {
+				continue;
+			}
+			vector<string> words;
+			boost::algorithm::split (words, i, boost::algorithm::is_space (), boost::algorithm::token_compress_on);
+			BOOST_FOREACH (string j, words) {
+				if (j.length() == 32 && boost::algorithm::all (j, boost::algorithm::is_xdigit ())) {
+					return j;
+				}
+			}
+		}
+
+		return optional<string> ();
+	}
+
+	static size_t header_callback (char* ptr, size_t size, size_t nmemb, void* object)
+	{
+		FTPConnection* c = reinterpret_cast<FTPConnection*> (object);
+		c->_replies.push_back (string (ptr, size * nmemb));
+		return size * nmemb;
+	}
+
+	static size_t read_callback (void* ptr, size_t size, size_t nmemb, void* object)
+	{
+		FTPConnection* c = reinterpret_cast<FTPConnection*> (object);
+		try {
+			return c->_source->read (reinterpret_cast<uint8_t*> (ptr), size * nmemb);
+		} catch (...) {
+			c->store_current ();
+			return CURL_READFUNC_ABORT;
+		}
+	}
+
+	static size_t write_callback (void* ptr, size_t size, size_t nmemb, void* object)
+	{
+		FTPConnection* c = reinterpret_cast<FTPConnection*> (object);
+		size_t const n = min (size * nmemb, c->_read_size);
+		memcpy (c->_read_data, ptr, n);
+		c->_read_data += n;
+		c->_read_size -= n;
+		/* Ignore anything more than we asked for rather than failing the transfer */
+		return size * nmemb;
+	}
+
+	CURL* _curl;
+	/** source that we are uploading from, during upload_file() */
+	UploadSource* _source;
+	/** where to put the next data that we read, during read() */
+	uint8_t* _read_data;
+	/** amount of data that we still want, during read() */
+	size_t _read_size;
+	/** replies from the server, during quote() */
+	list<string> _replies;
+};
+
+CurlUploader::CurlUploader (function<void (string)> set_status, function<void (float)> set_progress, int connections)
+	: Uploader (set_status, set_progress, connections)
+{
+
+}
+
+shared_ptr<Uploader::Connection>
+CurlUploader::connect ()
+{
+	return shared_ptr<Connection> (new FTPConnection ());
 }
@@ -1,5 +1,5 @@
 /*
-    Copyright (C) 2015 Carl Hetherington <cth@carlh.net>
+    Copyright (C) 2015-2018 Carl Hetherington <cth@carlh.net>
 
     This file is part of DCP-o-matic.
 
@@ -19,24 +19,15 @@
 */
 
 #include "uploader.h"
-#include <curl/curl.h>
 
+/** @class CurlUploader
+ *  @brief Uploader which copies files to a server over FTP using libcurl.
+ */
 class CurlUploader : public Uploader
 {
 public:
-	CurlUploader (boost::function<void (std::string)> set_status, boost::function<void (float)> set_progress);
-	~CurlUploader ();
-
-	size_t read_callback (void* ptr, size_t size, size_t nmemb);
+	CurlUploader (boost::function<void (std::string)> set_status, boost::function<void (float)> set_progress, int connections);
 
 protected:
-	virtual void create_directory (boost::filesystem::path directory);
-	virtual void upload_file (boost::filesystem::path from, boost::filesystem::path to, boost::uintmax_t& transferred, boost::uintmax_t total_size);
-
-private:
-	CURL* _curl;
-
-	FILE* _file;
-	boost::uintmax_t* _transferred;
-	boost::uintmax_t _total_size;
+	boost::shared_ptr<Connection> connect ();
 };
@@ -37,6 +37,9 @@
 #include "referenced_reel_asset.h"
 #include "subtitle_content.h"
 #include "player_video.h"
+#include "encode_farm.h"
+#include "encode_server_finder.h"
+#include "config.h"
 #include <boost/signals2.hpp>
 #include <boost/foreach.hpp>
 #include <iostream>
@@ -60,6 +63,8 @@ DCPEncoder::DCPEncoder (shared_ptr<const Film> film, weak_ptr<Job> job)
 	, _job (job)
 	, _finishing (false)
 	, _non_burnt_subtitles (false)
+	, _reels (film->reels ())
+	, _next_from_disk (0)
 {
 	_player_video_connection = _player->Video.connect (bind (&DCPEncoder::video, this, _1, _2));
 	_player_audio_connection = _player->Audio.connect (bind (&DCPEncoder::audio, this, _1, _2));
@@ -92,6 +97,27 @@ DCPEncoder::go ()
 	{
 		shared_ptr<Job> job = _job.lock ();
 		DCPOMATIC_ASSERT (job);
+
+		Config* config = Config::instance ();
+		if (config->servers_encode_reels() || (config->local_reel_encoders() > 1 && _reels.size() > 1)) {
+			list<EncodeServerDescription> servers;
+			int local = config->local_reel_encoders ();
+			if (config->servers_encode_reels ()) {
+				servers = EncodeServerFinder::instance()->servers ();
+				if (config->only_servers_encode ()) {
+					local = 0;
+				}
+			}
+
+			job->sub (_("Encoding reels"));
+			shared_ptr<EncodeFarm> farm (new EncodeFarm (_film, servers, local));
+			_from_disk = farm->go (job);
+			if (_from_disk.size() == _reels.size()) {
+				/* We don't need to decode any video */
+				_player->set_ignore_video ();
+			}
+		}
+
 		job->sub (_("Encoding"));
 	}
 
@@ -100,6 +126,7 @@ DCPEncoder::go ()
 	}
 
 	while (!_player->pass ()) {}
+	write_from_disk (_film->length ());
 
 	BOOST_FOREACH (ReferencedReelAsset i, _player->get_reel_assets ()) {
 		_writer->write (i);
@@ -118,6 +145,11 @@ DCPEncoder::video (shared_ptr<PlayerVideo> data, DCPTime time)
 		data->set_eyes (EYES_BOTH);
 	}
 
+	if (_from_disk.find (reel_index (time)) != _from_disk.end ()) {
+		/* This frame has already been encoded; write_from_disk() will deal with it */
+		return;
+	}
+
 	_j2k_encoder->encode (data, time);
 }
 
@@ -126,11 +158,71 @@ DCPEncoder::audio (shared_ptr<AudioBuffers> data, DCPTime time)
 {
 	_writer->write (data, time);
 
+	/* Keep the video that we already have in step with the audio */
+	write_from_disk (time + DCPTime::from_frames (data->frames(), _film->audio_frame_rate()));
+
 	shared_ptr<Job> job = _job.lock ();
 	DCPOMATIC_ASSERT (job);
 	job->set_progress (float(time.get()) / _film->length().get());
 }
 
+/** @return Index of the reel which contains a given time */
+int
+DCPEncoder::reel_index (DCPTime time) const
+{
+	int n = 0;
+	BOOST_FOREACH (DCPTimePeriod i, _reels) {
+		if (time < i.to) {
+			return n;
+		}
+		++n;
+	}
+
+	return n - 1;
+}
+
+/** Give the writer any frames up to some time which are in reels that have already
+ *  been encoded to the film's j2c directory.
+ */
+void
+DCPEncoder::write_from_disk (DCPTime to)
+{
+	if (_from_disk.empty ()) {
+		return;
+	}
+
+	int const vfr = _film->video_frame_rate ();
+	DCPTime const length = _film->length ();
+
+	list<Eyes> eyes;
+	if (_film->three_d ()) {
+		eyes.push_back (EYES_LEFT);
+		eyes.push_back (EYES_RIGHT);
+	} else {
+		eyes.push_back (EYES_BOTH);
+	}
+
+	while (true) {
+		DCPTime const t = DCPTime::from_frames (_next_from_disk, vfr);
+		if (t >= to || t >= length) {
+			break;
+		}
+
+		if (_from_disk.find (reel_index (t)) != _from_disk.end ()) {
+			BOOST_FOREACH (Eyes i, eyes) {
+				if (_writer->can_fake_write (_next_from_disk)) {
+					/* This frame is already in the reel's MXF from a previous run */
+					_writer->fake_write (_next_from_disk, i);
+				} else {
+					_writer->write_from_disk (_next_from_disk, i);
+				}
+			}
+		}
+
+		++_next_from_disk;
+	}
+}
+
 void
 DCPEncoder::subtitle (PlayerSubtitles data, DCPTimePeriod period)
 {
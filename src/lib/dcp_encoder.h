@@ -22,6 +22,8 @@
 #include "player_subtitles.h"
 #include "encoder.h"
 #include <boost/weak_ptr.hpp>
+#include <list>
+#include <set>
 
 class Film;
 class J2KEncoder;
@@ -53,6 +55,8 @@ private:
 	void video (boost::shared_ptr<PlayerVideo>, DCPTime);
 	void audio (boost::shared_ptr<AudioBuffers>, DCPTime);
 	void subtitle (PlayerSubtitles, DCPTimePeriod);
+	int reel_index (DCPTime time) const;
+	void write_from_disk (DCPTime to);
 
 	boost::shared_ptr<const Film> _film;
 	boost::weak_ptr<Job> _job;
@@ -60,6 +64,11 @@ private:
 	boost::shared_ptr<J2KEncoder> _j2k_encoder;
 	bool _finishing;
 	bool _non_burnt_subtitles;
+	std::list<DCPTimePeriod> _reels;
+	/** indices of reels whose video has already been encoded to the j2c directory */
+	std::set<int> _from_disk;
+	/** index of the next frame to consider giving to the writer from the j2c directory */
+	Frame _next_from_disk;
 
 	boost::signals2::scoped_connection _player_video_connection;
 	boost::signals2::scoped_connection _player_audio_connection;
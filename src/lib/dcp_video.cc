@@ -37,7 +37,9 @@
 #include "log.h"
 #include "cross.h"
 #include "player_video.h"
+#include "digester.h"
 #include "compose.hpp"
+#include "metrics.h"
 #include <libcxml/cxml.h>
 #include <dcp/raw_convert.h>
 #include <dcp/openjpeg_image.h>
@@ -59,6 +61,7 @@
 using std::string;
 using std::cout;
 using boost::shared_ptr;
+using boost::optional;
 using dcp::Size;
 using dcp::Data;
 using dcp::raw_convert;
@@ -189,6 +192,10 @@ DCPVideo::encode_remotely (EncodeServerDescription serv, int timeout)
 	socket->read (e.data().get(), e.size());
 	LOG_TIMING("finish-remote-receive thread=%1", thread_id ());
 
+	string const server_label = Metrics::label ("server", serv.host_name ());
+	Metrics::instance()->increment ("dcpomatic_encoder_remote_sent_bytes_total", server_label, socket->bytes_written ());
+	Metrics::instance()->increment ("dcpomatic_encoder_remote_received_bytes_total", server_label, socket->bytes_read ());
+
 	LOG_DEBUG_ENCODE (N_("Finished remotely-encoded frame %1"), _index);
 
 	return e;
@@ -210,6 +217,13 @@ DCPVideo::eyes () const
 	return _frame->eyes ();
 }
 
+/** @return true if our frame is just black */
+bool
+DCPVideo::black () const
+{
+	return _frame->black ();
+}
+
 /** @return true if this DCPVideo is definitely the same as another;
  *  (apart from the frame index), false if it is probably not.
  */
@@ -224,3 +238,47 @@ DCPVideo::same (shared_ptr<const DCPVideo> other) const
 
 	return _frame->same (other->_frame);
 }
+
+/** @return A digest of everything that goes into the encoded data for this frame
+ *  (apart from the frame index), or an empty optional if this cannot be found.
+ *  This must first be called before the DCPVideo is shared with other threads.
+ */
+optional<string>
+DCPVideo::digest () const
+{
+	if (!_digest) {
+		optional<string> frame = _frame->digest ();
+		if (!frame) {
+			return optional<string> ();
+		}
+
+		Digester digester;
+		digester.add (frame.get ());
+		digester.add (_frames_per_second);
+		digester.add (_j2k_bandwidth);
+		digester.add (static_cast<int> (_resolution));
+		_digest = digester.get ();
+	}
+
+	return _digest;
+}
+
+/** @return A digest of our image data and everything that goes into the encoded data, so
+ *  that two DCPVideos with the same image digest will encode to the same data (apart from
+ *  the frame index) wherever their images came from.  This may take a while the first time
+ *  it is called, and must not be called from two threads at once.
+ */
+string
+DCPVideo::image_digest () const
+{
+	if (!_image_digest) {
+		Digester digester;
+		digester.add (_frame->image_digest ());
+		digester.add (_frames_per_second);
+		digester.add (_j2k_bandwidth);
+		digester.add (static_cast<int> (_resolution));
+		_image_digest = digester.get ();
+	}
+
+	return _image_digest.get ();
+}
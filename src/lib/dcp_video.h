@@ -22,6 +22,7 @@
 #include "encode_server_description.h"
 #include <libcxml/cxml.h>
 #include <dcp/data.h>
+#include <boost/optional.hpp>
 
 /** @file  src/dcp_video_frame.h
  *  @brief A single frame of video destined for a DCP.
@@ -53,8 +54,11 @@ public:
 	}
 
 	Eyes eyes () const;
+	bool black () const;
 
 	bool same (boost::shared_ptr<const DCPVideo> other) const;
+	boost::optional<std::string> digest () const;
+	std::string image_digest () const;
 
 	static boost::shared_ptr<dcp::OpenJPEGImage> convert_to_xyz (boost::shared_ptr<const PlayerVideo> frame, dcp::NoteHandler note);
 
@@ -67,6 +71,14 @@ private:
 	int _frames_per_second;		 ///< Frames per second that we will use for the DCP
 	int _j2k_bandwidth;		 ///< J2K bandwidth to use
 	Resolution _resolution;          ///< Resolution (2K or 4K)
+	/** digest of everything that goes into our encoded data; worked out the first time
+	 *  that digest() is called, as _frame's subtitle may be changed after that.
+	 */
+	mutable boost::optional<std::string> _digest;
+	/** digest of our image data and everything that goes into our encoded data; worked
+	 *  out the first time that image_digest() is called.
+	 */
+	mutable boost::optional<std::string> _image_digest;
 
 	boost::shared_ptr<Log> _log; ///< log
 };
@@ -45,8 +45,21 @@ public:
 	void read (uint8_t* data, int size);
 	uint32_t read_uint32 ();
 
+	void cancel ();
+
+	/** @return Number of bytes successfully read from this socket so far */
+	uint64_t bytes_read () const {
+		return _bytes_read;
+	}
+
+	/** @return Number of bytes successfully written to this socket so far */
+	uint64_t bytes_written () const {
+		return _bytes_written;
+	}
+
 private:
 	void check ();
+	void close ();
 
 	Socket (Socket const &);
 
@@ -54,4 +67,6 @@ private:
 	boost::asio::deadline_timer _deadline;
 	boost::asio::ip::tcp::socket _socket;
 	int _timeout;
+	uint64_t _bytes_read;
+	uint64_t _bytes_written;
 };
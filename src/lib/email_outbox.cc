@@ -0,0 +1,300 @@
+/*
+    Copyright (C) 2018 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/** @file  src/lib/email_outbox.cc
+ *  @brief EmailOutbox class.
+ */
+
+#include "email_outbox.h"
+#include "email_session.h"
+#include "config.h"
+#include "log.h"
+#include "exceptions.h"
+#include "compose.hpp"
+#include <dcp/data.h>
+#include <libcxml/cxml.h>
+#include <libxml++/libxml++.h>
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
+#include <boost/foreach.hpp>
+#include <algorithm>
+
+#include "i18n.h"
+
+using std::string;
+using std::list;
+using std::min;
+using std::max;
+using boost::shared_ptr;
+using dcp::Data;
+
+/** @param directory Directory to keep the emails in; it will be created if it does not exist.
+ *  @param attempts Number of times to try to send each email.
+ *  @param retry_delay Delay in milliseconds before trying to send an email for the second time;
+ *  subsequent delays are doubled each time.
+ */
+EmailOutbox::EmailOutbox (boost::filesystem::path directory, int attempts, int retry_delay)
+	: _directory (directory)
+	, _attempts (attempts)
+	, _retry_delay (retry_delay)
+	, _port (0)
+	, _sent (0)
+	, _failed (0)
+	, _rejected (0)
+{
+	boost::filesystem::create_directories (_directory);
+}
+
+/** @return The outbox directory in our configuration directory */
+boost::filesystem::path
+EmailOutbox::default_directory ()
+{
+	return Config::path ("outbox");
+}
+
+boost::filesystem::path
+EmailOutbox::email_file (string id) const
+{
+	return _directory / (id + ".eml");
+}
+
+boost::filesystem::path
+EmailOutbox::metadata_file (string id) const
+{
+	return _directory / (id + ".xml");
+}
+
+/** Add an email to the outbox; this may be called from any thread.
+ *  @param from Envelope sender.
+ *  @param recipients Envelope recipients.
+ *  @param email Full email, including headers.
+ *  @return ID of the email within the outbox.
+ */
+string
+EmailOutbox::add (string from, list<string> recipients, string const & email)
+{
+	string const id = boost::filesystem::unique_path("%%%%%%%%%%%%%%%%").string();
+
+	Data (reinterpret_cast<uint8_t const *> (email.c_str()), email.length()).write (email_file (id));
+
+	xmlpp::Document doc;
+	xmlpp::Element* root = doc.create_root_node ("Email");
+	root->add_child("From")->add_child_text (from);
+	BOOST_FOREACH (string i, recipients) {
+		root->add_child("Recipient")->add_child_text (i);
+	}
+
+	/* The metadata file is what marks the email as being in the outbox, so write it
+	   last, and via a temporary file, so that a partly-added email is never seen.
+	*/
+	boost::filesystem::path tmp = metadata_file (id);
+	tmp += ".tmp";
+	doc.write_to_file_formatted (tmp.string ());
+	boost::filesystem::rename (tmp, metadata_file (id));
+
+	return id;
+}
+
+/** Remove an email from the outbox without sending it; this may be called from any thread.
+ *  @param id ID of the email, as returned from add().
+ */
+void
+EmailOutbox::remove (string id)
+{
+	/* Remove the metadata first so that the email stops being pending() straight away */
+	boost::system::error_code ec;
+	boost::filesystem::remove (metadata_file (id), ec);
+	boost::filesystem::remove (email_file (id), ec);
+}
+
+/** @return IDs of the emails in the outbox, sorted so that the order is always the same */
+list<string>
+EmailOutbox::pending () const
+{
+	list<string> ids;
+	for (boost::filesystem::directory_iterator i = boost::filesystem::directory_iterator (_directory); i != boost::filesystem::directory_iterator(); ++i) {
+		if (i->path().extension() == ".xml" && boost::filesystem::exists (email_file (i->path().stem().string()))) {
+			ids.push_back (i->path().stem().string());
+		}
+	}
+
+	ids.sort ();
+	return ids;
+}
+
+/** Send some emails from the outbox, blocking until it is all done.  Emails which
+ *  are refused permanently by the server are removed from the outbox; others which
+ *  cannot be sent are left there.
+ *  @param ids IDs of the emails to send, as returned by add() or pending().
+ *  @param connections Maximum number of connections to make to the server at the same time.
+ *  @param log Log to write email session transcripts to, or 0.
+ *  @return Number of emails that were sent.
+ *  Throws KDMError if any emails could not be sent.
+ */
+int
+EmailOutbox::send (list<string> ids, string server, int port, string user, string password, int connections, shared_ptr<Log> log)
+{
+	_server = server;
+	_port = port;
+	_user = user;
+	_password = password;
+	_log = log;
+
+	{
+		boost::mutex::scoped_lock lm (_mutex);
+		_queue = ids;
+		_sent = 0;
+		_failed = 0;
+		_rejected = 0;
+		_error = "";
+		_rejected_error = "";
+	}
+
+	boost::thread_group threads;
+	int const N = min (max (1, connections), int (_queue.size ()));
+	for (int i = 0; i < N; ++i) {
+		threads.create_thread (boost::bind (&EmailOutbox::send_thread, this));
+	}
+	threads.join_all ();
+
+	boost::mutex::scoped_lock lm (_mutex);
+	int const total = _sent + _failed + _rejected;
+	if (_failed && _rejected) {
+		throw KDMError (
+			String::compose (
+				_("Failed to send %1 of %2 emails; they have been kept in the outbox (%3).  %4 more were rejected by the mail server and have been discarded (%5)"),
+				_failed, total, _error, _rejected, _rejected_error
+				)
+			);
+	} else if (_failed) {
+		throw KDMError (
+			String::compose (
+				_("Failed to send %1 of %2 emails; they have been kept in the outbox (%3)"), _failed, total, _error
+				)
+			);
+	} else if (_rejected) {
+		throw KDMError (
+			String::compose (
+				_("%1 of %2 emails were rejected by the mail server and have been discarded (%3)"), _rejected, total, _rejected_error
+				)
+			);
+	}
+
+	return _sent;
+}
+
+/** Send one email from the outbox and then remove it */
+void
+EmailOutbox::send_one (shared_ptr<EmailSession> session, string id) const
+{
+	cxml::Document metadata ("Email");
+	metadata.read_file (metadata_file (id));
+
+	Data data (email_file (id));
+	string const email (reinterpret_cast<char const *> (data.data().get()), data.size());
+
+	list<string> recipients;
+	BOOST_FOREACH (cxml::ConstNodePtr i, metadata.node_children ("Recipient")) {
+		recipients.push_back (i->content ());
+	}
+
+	try {
+		session->send (metadata.string_child ("From"), recipients, email);
+	} catch (...) {
+		if (_log) {
+			_log->log ("Email content follows", LogEntry::TYPE_DEBUG_EMAIL);
+			_log->log (email, LogEntry::TYPE_DEBUG_EMAIL);
+			_log->log ("Email session follows", LogEntry::TYPE_DEBUG_EMAIL);
+			_log->log (session->notes(), LogEntry::TYPE_DEBUG_EMAIL);
+		}
+		throw;
+	}
+
+	if (_log) {
+		_log->log ("Email content follows", LogEntry::TYPE_DEBUG_EMAIL);
+		_log->log (email, LogEntry::TYPE_DEBUG_EMAIL);
+		_log->log ("Email session follows", LogEntry::TYPE_DEBUG_EMAIL);
+		_log->log (session->notes(), LogEntry::TYPE_DEBUG_EMAIL);
+	}
+
+	boost::filesystem::remove (metadata_file (id));
+	boost::filesystem::remove (email_file (id));
+}
+
+void
+EmailOutbox::send_thread ()
+{
+	/* Our connection to the server, which we keep for as long as it works */
+	shared_ptr<EmailSession> session;
+
+	while (true) {
+		string id;
+		{
+			boost::mutex::scoped_lock lm (_mutex);
+			if (_queue.empty ()) {
+				return;
+			}
+			id = _queue.front ();
+			_queue.pop_front ();
+		}
+
+		string error;
+		bool rejected = false;
+		for (int i = 0; i < _attempts; ++i) {
+			if (i > 0) {
+				boost::this_thread::sleep (boost::posix_time::milliseconds (_retry_delay << (i - 1)));
+			}
+
+			try {
+				if (!session) {
+					session.reset (new EmailSession (_server, _port, _user, _password));
+				}
+				session->clear_notes ();
+				send_one (session, id);
+				error = "";
+				break;
+			} catch (EmailRejectedError& e) {
+				/* No point in trying again, or in keeping it for later */
+				error = e.what ();
+				rejected = true;
+				remove (id);
+				break;
+			} catch (std::exception& e) {
+				error = e.what ();
+			} catch (...) {
+				error = _("Unknown error");
+			}
+
+			/* The connection may be in a bad state, so make a new one for the next try */
+			session.reset ();
+		}
+
+		boost::mutex::scoped_lock lm (_mutex);
+		if (error.empty ()) {
+			++_sent;
+		} else if (rejected) {
+			++_rejected;
+			_rejected_error = error;
+		} else {
+			++_failed;
+			_error = error;
+		}
+	}
+}
@@ -0,0 +1,96 @@
+/*
+    Copyright (C) 2018 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/** @file  src/lib/email_outbox.h
+ *  @brief EmailOutbox class.
+ */
+
+#ifndef DCPOMATIC_EMAIL_OUTBOX_H
+#define DCPOMATIC_EMAIL_OUTBOX_H
+
+#include <boost/filesystem.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/noncopyable.hpp>
+#include <list>
+#include <string>
+
+class Log;
+class EmailSession;
+
+/** @class EmailOutbox
+ *  @brief A directory of emails which are waiting to be sent, and a way to send them.
+ *
+ *  Emails are written to the outbox by add() and only removed from it once they have been
+ *  sent, or once the SMTP server has refused them permanently.  send() only sends the emails
+ *  that it is given, so anything left behind by an earlier run (because of a crash, or because
+ *  the SMTP server was temporarily unavailable) stays in the outbox until someone explicitly
+ *  sends pending() or remove()s it.
+ *
+ *  send() uses a few threads, each with its own connection to the SMTP server which is
+ *  re-used for all the emails that the thread sends.  Emails which fail to send are
+ *  retried a few times, with an increasing delay between tries.
+ */
+class EmailOutbox : public boost::noncopyable
+{
+public:
+	explicit EmailOutbox (boost::filesystem::path directory, int attempts = 4, int retry_delay = 2000);
+
+	std::string add (std::string from, std::list<std::string> recipients, std::string const & email);
+	void remove (std::string id);
+	std::list<std::string> pending () const;
+	int send (std::list<std::string> ids, std::string server, int port, std::string user, std::string password, int connections, boost::shared_ptr<Log> log);
+
+	static boost::filesystem::path default_directory ();
+
+private:
+	void send_thread ();
+	void send_one (boost::shared_ptr<EmailSession> session, std::string id) const;
+	boost::filesystem::path email_file (std::string id) const;
+	boost::filesystem::path metadata_file (std::string id) const;
+
+	boost::filesystem::path _directory;
+	/** number of times to try to send each email */
+	int _attempts;
+	/** delay in milliseconds before the first retry of an email; this doubles for each subsequent retry */
+	int _retry_delay;
+
+	/* These are set up by send() for the sending threads */
+	std::string _server;
+	int _port;
+	std::string _user;
+	std::string _password;
+	boost::shared_ptr<Log> _log;
+
+	/** mutex to protect _queue, _sent, _failed, _rejected, _error and _rejected_error */
+	boost::mutex _mutex;
+	/** IDs of emails which are waiting for a sending thread to pick them up */
+	std::list<std::string> _queue;
+	int _sent;
+	int _failed;
+	/** number of emails that the server refused permanently, and which have been removed from the outbox */
+	int _rejected;
+	/** error from the last email that could not be sent */
+	std::string _error;
+	/** error from the last email that the server refused */
+	std::string _rejected_error;
+};
+
+#endif
@@ -0,0 +1,155 @@
+/*
+    Copyright (C) 2018 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/** @file  src/lib/email_session.cc
+ *  @brief EmailSession class.
+ */
+
+#include "email_session.h"
+#include "exceptions.h"
+#include "compose.hpp"
+#include <boost/foreach.hpp>
+#include <algorithm>
+
+#include "i18n.h"
+
+using std::string;
+using std::list;
+using std::min;
+
+/** Time in seconds after which we give up on a server which is sending or accepting less than a byte per second */
+#define LOW_SPEED_TIME 60
+
+static size_t
+curl_data_shim (void* ptr, size_t size, size_t nmemb, void* userp)
+{
+	return reinterpret_cast<EmailSession*>(userp)->get_data (ptr, size, nmemb);
+}
+
+static int
+curl_debug_shim (CURL* curl, curl_infotype type, char* data, size_t size, void* userp)
+{
+	return reinterpret_cast<EmailSession*>(userp)->debug (curl, type, data, size);
+}
+
+EmailSession::EmailSession (string server, int port, string user, string password)
+	: _email (0)
+	, _offset (0)
+{
+	_curl = curl_easy_init ();
+	if (!_curl) {
+		throw NetworkError ("Could not initialise libcurl");
+	}
+
+	if (port == 465) {
+		/* "Implicit TLS"; I think curl wants us to use smtps here */
+		curl_easy_setopt (_curl, CURLOPT_URL, String::compose ("smtps://%1:465", server).c_str());
+	} else {
+		curl_easy_setopt (_curl, CURLOPT_URL, String::compose ("smtp://%1:%2", server, port).c_str());
+	}
+
+	if (!user.empty ()) {
+		curl_easy_setopt (_curl, CURLOPT_USERNAME, user.c_str ());
+	}
+	if (!password.empty ()) {
+		curl_easy_setopt (_curl, CURLOPT_PASSWORD, password.c_str());
+	}
+
+	curl_easy_setopt (_curl, CURLOPT_READFUNCTION, curl_data_shim);
+	curl_easy_setopt (_curl, CURLOPT_READDATA, this);
+	curl_easy_setopt (_curl, CURLOPT_UPLOAD, 1L);
+
+	curl_easy_setopt (_curl, CURLOPT_USE_SSL, (long) CURLUSESSL_TRY);
+	curl_easy_setopt (_curl, CURLOPT_SSL_VERIFYPEER, 0L);
+	curl_easy_setopt (_curl, CURLOPT_SSL_VERIFYHOST, 0L);
+	curl_easy_setopt (_curl, CURLOPT_VERBOSE, 1L);
+	curl_easy_setopt (_curl, CURLOPT_DEBUGFUNCTION, curl_debug_shim);
+	curl_easy_setopt (_curl, CURLOPT_DEBUGDATA, this);
+
+	/* Don't let a stalled server hold us up for ever */
+	curl_easy_setopt (_curl, CURLOPT_LOW_SPEED_LIMIT, 1L);
+	curl_easy_setopt (_curl, CURLOPT_LOW_SPEED_TIME, (long) LOW_SPEED_TIME);
+	curl_easy_setopt (_curl, CURLOPT_NOSIGNAL, 1L);
+}
+
+EmailSession::~EmailSession ()
+{
+	curl_easy_cleanup (_curl);
+}
+
+/** Send an email, re-using this session's connection to the server if it is still open.
+ *  @param from Envelope sender.
+ *  @param recipients Envelope recipients (including any Cc and Bcc recipients).
+ *  @param email Full email, including headers.
+ *  Throws EmailRejectedError if the server refused the email permanently, or KDMError on any other failure.
+ */
+void
+EmailSession::send (string from, list<string> recipients, string const & email)
+{
+	_email = &email;
+	_offset = 0;
+
+	curl_easy_setopt (_curl, CURLOPT_MAIL_FROM, from.c_str());
+
+	struct curl_slist* rcpt = 0;
+	BOOST_FOREACH (string i, recipients) {
+		rcpt = curl_slist_append (rcpt, i.c_str());
+	}
+
+	curl_easy_setopt (_curl, CURLOPT_MAIL_RCPT, rcpt);
+
+	CURLcode const r = curl_easy_perform (_curl);
+
+	curl_easy_setopt (_curl, CURLOPT_MAIL_RCPT, 0);
+	curl_slist_free_all (rcpt);
+	_email = 0;
+
+	if (r != CURLE_OK) {
+		long code = 0;
+		curl_easy_getinfo (_curl, CURLINFO_RESPONSE_CODE, &code);
+		if (code >= 500 && code < 600) {
+			/* A 5xx reply from the server is permanent; the same email will never be accepted */
+			throw EmailRejectedError (String::compose (_("Email rejected by server (%1)"), curl_easy_strerror (r)));
+		}
+		throw KDMError (String::compose (_("Failed to send email (%1)"), curl_easy_strerror (r)));
+	}
+}
+
+size_t
+EmailSession::get_data (void* ptr, size_t size, size_t nmemb)
+{
+	size_t const t = min (_email->length() - _offset, size * nmemb);
+	memcpy (ptr, _email->c_str() + _offset, t);
+	_offset += t;
+	return t;
+}
+
+int
+EmailSession::debug (CURL *, curl_infotype type, char* data, size_t size)
+{
+	if (type == CURLINFO_TEXT) {
+		_notes += string (data, size);
+	} else if (type == CURLINFO_HEADER_IN) {
+		_notes += "<- " + string (data, size);
+	} else if (type == CURLINFO_HEADER_OUT) {
+		_notes += "-> " + string (data, size);
+	}
+	return 0;
+}
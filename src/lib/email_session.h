@@ -0,0 +1,69 @@
+/*
+    Copyright (C) 2018 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/** @file  src/lib/email_session.h
+ *  @brief EmailSession class.
+ */
+
+#ifndef DCPOMATIC_EMAIL_SESSION_H
+#define DCPOMATIC_EMAIL_SESSION_H
+
+#include <curl/curl.h>
+#include <boost/noncopyable.hpp>
+#include <list>
+#include <string>
+
+/** @class EmailSession
+ *  @brief A connection to an SMTP server which can be used to send any number of emails.
+ *
+ *  libcurl keeps the connection (and any authentication) open between calls to send(),
+ *  so sending several emails through one EmailSession is much quicker than making a
+ *  new connection for each.  An EmailSession must only be used by one thread at a time.
+ */
+class EmailSession : public boost::noncopyable
+{
+public:
+	EmailSession (std::string server, int port, std::string user = "", std::string password = "");
+	~EmailSession ();
+
+	void send (std::string from, std::list<std::string> recipients, std::string const & email);
+
+	/** @return transcript of the SMTP conversations that this session has had */
+	std::string notes () const {
+		return _notes;
+	}
+
+	void clear_notes () {
+		_notes = "";
+	}
+
+	size_t get_data (void* ptr, size_t size, size_t nmemb);
+	int debug (CURL* curl, curl_infotype type, char* data, size_t size);
+
+private:
+	CURL* _curl;
+	/** email that is currently being sent */
+	std::string const * _email;
+	/** offset into _email of the next data to send */
+	size_t _offset;
+	std::string _notes;
+};
+
+#endif
@@ -21,11 +21,15 @@
 #include "compose.hpp"
 #include "config.h"
 #include "emailer.h"
+#include "email_session.h"
 #include "exceptions.h"
-#include <curl/curl.h>
 #include <boost/algorithm/string.hpp>
 #include <boost/date_time/c_local_time_adjustor.hpp>
 #include <boost/foreach.hpp>
+#include <openssl/bio.h>
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+#include <iterator>
 
 #include "i18n.h"
 
@@ -34,6 +38,8 @@ using std::min;
 using std::list;
 using std::cout;
 using std::pair;
+using std::copy;
+using std::back_inserter;
 using boost::shared_ptr;
 using dcp::Data;
 
@@ -42,7 +48,6 @@ Emailer::Emailer (string from, list<string> to, string subject, string body)
 	, _to (to)
 	, _subject (subject)
 	, _body (fix (body))
-	, _offset (0)
 {
 
 }
@@ -77,33 +82,21 @@ Emailer::add_attachment (boost::filesystem::path file, string name, string mime_
 	_attachments.push_back (a);
 }
 
-static size_t
-curl_data_shim (void* ptr, size_t size, size_t nmemb, void* userp)
-{
-	return reinterpret_cast<Emailer*>(userp)->get_data (ptr, size, nmemb);
-}
-
-static int
-curl_debug_shim (CURL* curl, curl_infotype type, char* data, size_t size, void* userp)
-{
-	return reinterpret_cast<Emailer*>(userp)->debug (curl, type, data, size);
-}
-
-size_t
-Emailer::get_data (void* ptr, size_t size, size_t nmemb)
-{
-	size_t const t = min (_email.length() - _offset, size * nmemb);
-	memcpy (ptr, _email.substr (_offset, t).c_str(), t);
-	_offset += t;
-	return t;
-}
-
+/** Build the full email (headers, body and attachments), which can then be obtained from email().
+ *  This may be called for different Emailers in several threads at once.
+ */
 void
-Emailer::send (string server, int port, string user, string password)
+Emailer::create_email ()
 {
 	char date_buffer[128];
 	time_t now = time (0);
-	strftime (date_buffer, sizeof(date_buffer), "%a, %d %b %Y %H:%M:%S ", localtime (&now));
+	struct tm local;
+#ifdef DCPOMATIC_WINDOWS
+	localtime_s (&local, &now);
+#else
+	localtime_r (&now, &local);
+#endif
+	strftime (date_buffer, sizeof(date_buffer), "%a, %d %b %Y %H:%M:%S ", &local);
 
 	boost::posix_time::ptime const utc_now = boost::posix_time::second_clock::universal_time ();
 	boost::posix_time::ptime const local_now = boost::date_time::c_local_adjustor<boost::posix_time::ptime>::utc_to_local (utc_now);
@@ -122,10 +115,15 @@ Emailer::send (string server, int port, string user, string password)
 		_email += "Bcc: " + address_list (_bcc) + "\r\n";
 	}
 
+	/* OpenSSL's generator is safe to use from several threads, unlike rand() */
 	string const chars = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ1234567890";
+	unsigned char random[32];
+	if (RAND_bytes (random, sizeof (random)) != 1) {
+		throw KDMError (_("Could not get random data to make email"));
+	}
 	string boundary;
-	for (int i = 0; i < 32; ++i) {
-		boundary += chars[rand() % chars.length()];
+	for (size_t i = 0; i < sizeof (random); ++i) {
+		boundary += chars[random[i] % chars.length()];
 	}
 
 	if (!_attachments.empty ()) {
@@ -169,62 +167,32 @@ Emailer::send (string server, int port, string user, string password)
 	if (!_attachments.empty ()) {
 		_email += "\r\n--" + boundary + "--\r\n";
 	}
+}
 
-	curl_global_init (CURL_GLOBAL_DEFAULT);
-
-	CURL* curl = curl_easy_init ();
-	if (!curl) {
-		throw NetworkError ("Could not initialise libcurl");
-	}
-
-	if (port == 465) {
-		/* "Implicit TLS"; I think curl wants us to use smtps here */
-		curl_easy_setopt (curl, CURLOPT_URL, String::compose ("smtps://%1:465", server).c_str());
-	} else {
-		curl_easy_setopt (curl, CURLOPT_URL, String::compose ("smtp://%1:%2", server, port).c_str());
-	}
-
-	if (!user.empty ()) {
-		curl_easy_setopt (curl, CURLOPT_USERNAME, user.c_str ());
-	}
-	if (!password.empty ()) {
-		curl_easy_setopt (curl, CURLOPT_PASSWORD, password.c_str());
-	}
-
-	curl_easy_setopt (curl, CURLOPT_MAIL_FROM, _from.c_str());
-
-	struct curl_slist* recipients = 0;
-	BOOST_FOREACH (string i, _to) {
-		recipients = curl_slist_append (recipients, i.c_str());
-	}
-	BOOST_FOREACH (string i, _cc) {
-		recipients = curl_slist_append (recipients, i.c_str());
-	}
-	BOOST_FOREACH (string i, _bcc) {
-		recipients = curl_slist_append (recipients, i.c_str());
-	}
-
-	curl_easy_setopt (curl, CURLOPT_MAIL_RCPT, recipients);
-
-	curl_easy_setopt (curl, CURLOPT_READFUNCTION, curl_data_shim);
-	curl_easy_setopt (curl, CURLOPT_READDATA, this);
-	curl_easy_setopt (curl, CURLOPT_UPLOAD, 1L);
+/** @return Everybody that the email should be sent to (including Cc and Bcc recipients) */
+list<string>
+Emailer::recipients () const
+{
+	list<string> r = _to;
+	copy (_cc.begin(), _cc.end(), back_inserter (r));
+	copy (_bcc.begin(), _bcc.end(), back_inserter (r));
+	return r;
+}
 
-	curl_easy_setopt (curl, CURLOPT_USE_SSL, (long) CURLUSESSL_TRY);
-	curl_easy_setopt (curl, CURLOPT_SSL_VERIFYPEER, 0L);
-	curl_easy_setopt (curl, CURLOPT_SSL_VERIFYHOST, 0L);
-	curl_easy_setopt (curl, CURLOPT_VERBOSE, 1L);
-	curl_easy_setopt (curl, CURLOPT_DEBUGFUNCTION, curl_debug_shim);
-	curl_easy_setopt (curl, CURLOPT_DEBUGDATA, this);
+void
+Emailer::send (string server, int port, string user, string password)
+{
+	create_email ();
 
-	CURLcode const r = curl_easy_perform (curl);
-	if (r != CURLE_OK) {
-		throw KDMError (String::compose (_("Failed to send email (%1)"), curl_easy_strerror (r)));
+	EmailSession session (server, port, user, password);
+	try {
+		session.send (_from, recipients (), _email);
+	} catch (...) {
+		_notes = session.notes ();
+		throw;
 	}
 
-	curl_slist_free_all (recipients);
-	curl_easy_cleanup (curl);
-	curl_global_cleanup ();
+	_notes = session.notes ();
 }
 
 string
@@ -237,16 +205,3 @@ Emailer::address_list (list<string> addresses)
 
 	return o.substr (0, o.length() - 2);
 }
-
-int
-Emailer::debug (CURL *, curl_infotype type, char* data, size_t size)
-{
-	if (type == CURLINFO_TEXT) {
-		_notes += string (data, size);
-	} else if (type == CURLINFO_HEADER_IN) {
-		_notes += "<- " + string (data, size);
-	} else if (type == CURLINFO_HEADER_OUT) {
-		_notes += "-> " + string (data, size);
-	}
-	return 0;
-}
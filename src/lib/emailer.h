@@ -18,8 +18,9 @@
 
 */
 
-#include <curl/curl.h>
-#include <boost/scoped_array.hpp>
+#include <boost/filesystem.hpp>
+#include <list>
+#include <string>
 
 class Emailer
 {
@@ -30,20 +31,24 @@ public:
 	void add_bcc (std::string bcc);
 	void add_attachment (boost::filesystem::path file, std::string name, std::string mime_type);
 
+	void create_email ();
 	void send (std::string server, int port, std::string user = "", std::string password = "");
 
 	std::string notes () const {
 		return _notes;
 	}
 
-	size_t get_data (void* ptr, size_t size, size_t nmemb);
-	int debug (CURL* curl, curl_infotype type, char* data, size_t size);
-
-	/** @return full email, after send() has been called */
+	/** @return full email, after create_email() or send() has been called */
 	std::string email () const {
 		return _email;
 	}
 
+	std::string from () const {
+		return _from;
+	}
+
+	std::list<std::string> recipients () const;
+
 	static std::string address_list (std::list<std::string> addresses);
 
 private:
@@ -65,6 +70,5 @@ private:
 
 	std::list<Attachment> _attachments;
 	std::string _email;
-	size_t _offset;
 	std::string _notes;
 };
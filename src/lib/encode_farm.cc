@@ -0,0 +1,294 @@
+/*
+    Copyright (C) 2018 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/** @file  src/lib/encode_farm.cc
+ *  @brief EncodeFarm class.
+ */
+
+#include "encode_farm.h"
+#include "range_encoder.h"
+#include "dcpomatic_socket.h"
+#include "film.h"
+#include "job.h"
+#include "config.h"
+#include "log.h"
+#include "metrics.h"
+#include "compose.hpp"
+#include "exceptions.h"
+#include <dcp/raw_convert.h>
+#include <libxml++/libxml++.h>
+#include <boost/thread.hpp>
+#include <boost/foreach.hpp>
+
+#include "i18n.h"
+
+#define LOG_GENERAL(...) _film->log()->log (String::compose (__VA_ARGS__), LogEntry::TYPE_GENERAL);
+#define LOG_ERROR(...) _film->log()->log (String::compose (__VA_ARGS__), LogEntry::TYPE_ERROR);
+
+using std::string;
+using std::list;
+using std::set;
+using std::max;
+using boost::shared_ptr;
+using boost::optional;
+using dcp::raw_convert;
+
+/** Time in seconds that we will wait for a server to encode a reel */
+#define REEL_TIMEOUT (24 * 60 * 60)
+
+/** @param film Film to encode.
+ *  @param servers Servers to give reels to.
+ *  @param local_chains Number of reels to decode and encode at the same time on this machine.
+ */
+EncodeFarm::EncodeFarm (shared_ptr<const Film> film, list<EncodeServerDescription> servers, int local_chains)
+	: _film (film)
+	, _servers (servers)
+	, _local_chains (local_chains)
+	, _running (0)
+	, _stop (false)
+{
+
+}
+
+/** Encode any reels whose J2C files are not already present, blocking until
+ *  as many as possible have been done.
+ *  @return Indices of reels whose J2C files are all present.
+ */
+set<int>
+EncodeFarm::go (shared_ptr<Job> job)
+{
+	int const reels = _film->reels().size();
+
+	boost::mutex::scoped_lock lm (_mutex);
+
+	for (int i = 0; i < reels; ++i) {
+		if (RangeEncoder::done (_film, i)) {
+			_done.insert (i);
+		} else {
+			_todo.push_back (i);
+		}
+	}
+
+	if (_todo.empty() || (_servers.empty() && _local_chains < 2)) {
+		/* With only one local chain we would just be doing what the J2KEncoder would otherwise do */
+		return _done;
+	}
+
+	BOOST_FOREACH (EncodeServerDescription i, _servers) {
+		_threads.create_thread (boost::bind (&EncodeFarm::server_thread, this, i));
+		++_running;
+	}
+
+	/* Share our encoding threads between the local chains */
+	int const threads = max (1, Config::instance()->master_encoding_threads() / max (1, _local_chains));
+	for (int i = 0; i < _local_chains; ++i) {
+		_threads.create_thread (boost::bind (&EncodeFarm::local_thread, this, threads));
+		++_running;
+	}
+
+	try {
+		while (_running > 0) {
+			_condition.wait (lm);
+			float const progress = float (_done.size()) / reels;
+			lm.unlock ();
+			job->set_progress (progress);
+			lm.lock ();
+		}
+	} catch (...) {
+		if (!lm.owns_lock ()) {
+			lm.lock ();
+		}
+		_stop = true;
+		BOOST_FOREACH (shared_ptr<Socket> i, _sockets) {
+			i->cancel ();
+		}
+		lm.unlock ();
+
+		/* Wait for the threads to stop so that nothing is still writing to the
+		   film's j2c directory after we have returned.
+		*/
+		boost::this_thread::disable_interruption dis;
+		_threads.join_all ();
+		throw;
+	}
+
+	lm.unlock ();
+	_threads.join_all ();
+	return _done;
+}
+
+/** @return Next reel to encode, if there is one */
+optional<int>
+EncodeFarm::next_reel ()
+{
+	boost::mutex::scoped_lock lm (_mutex);
+	if (_stop || _todo.empty ()) {
+		return optional<int> ();
+	}
+
+	int const r = _todo.front ();
+	_todo.pop_front ();
+	return r;
+}
+
+/** @param ok true if the reel was encoded, false if it should be given to somebody else */
+void
+EncodeFarm::reel_finished (int reel, bool ok)
+{
+	boost::mutex::scoped_lock lm (_mutex);
+	if (ok) {
+		_done.insert (reel);
+	} else {
+		_todo.push_back (reel);
+	}
+	_condition.notify_all ();
+}
+
+/** @return true if our threads should stop work */
+bool
+EncodeFarm::stopped ()
+{
+	boost::mutex::scoped_lock lm (_mutex);
+	return _stop;
+}
+
+void
+EncodeFarm::thread_finished ()
+{
+	boost::mutex::scoped_lock lm (_mutex);
+	--_running;
+	_condition.notify_all ();
+}
+
+void
+EncodeFarm::server_thread (EncodeServerDescription server)
+{
+	while (optional<int> reel = next_reel ()) {
+		try {
+			encode_remotely (server, reel.get ());
+			if (stopped ()) {
+				reel_finished (reel.get(), false);
+				break;
+			}
+			if (!RangeEncoder::done (_film, reel.get ())) {
+				throw EncodeError (String::compose ("server did not write all the frames of reel %1 to %2", reel.get(), _film->directory().string()));
+			}
+			LOG_GENERAL ("Server %1 encoded reel %2", server.host_name(), reel.get());
+			reel_finished (reel.get(), true);
+		} catch (std::exception& e) {
+			if (stopped ()) {
+				/* We dropped the connection ourselves */
+				reel_finished (reel.get(), false);
+				break;
+			}
+			/* Give the reel back and stop using this server */
+			LOG_ERROR ("Server %1 could not encode reel %2 (%3); no longer sending reels to it", server.host_name(), reel.get(), e.what());
+			Metrics::instance()->increment ("dcpomatic_encoder_remote_failures_total", Metrics::label ("server", server.host_name ()));
+			reel_finished (reel.get(), false);
+			break;
+		}
+	}
+
+	thread_finished ();
+}
+
+/** @param threads Number of threads to encode with */
+void
+EncodeFarm::local_thread (int threads)
+{
+	while (optional<int> reel = next_reel ()) {
+		try {
+			RangeEncoder (_film, reel.get(), threads, boost::bind (&EncodeFarm::stopped, this)).go ();
+			if (stopped ()) {
+				/* The encoder may have stopped part-way through the reel */
+				reel_finished (reel.get(), false);
+				break;
+			}
+			reel_finished (reel.get(), true);
+		} catch (std::exception& e) {
+			LOG_ERROR ("Local encoding of reel %1 failed (%2)", reel.get(), e.what());
+			reel_finished (reel.get(), false);
+			break;
+		}
+	}
+
+	thread_finished ();
+}
+
+/** Ask a server to encode a reel, blocking until it has finished or until go() is interrupted */
+void
+EncodeFarm::encode_remotely (EncodeServerDescription server, int reel)
+{
+	boost::asio::io_service io_service;
+	boost::asio::ip::tcp::resolver resolver (io_service);
+	boost::asio::ip::tcp::resolver::query query (server.host_name(), raw_convert<string> (ENCODE_FRAME_PORT));
+	boost::asio::ip::tcp::resolver::iterator endpoint_iterator = resolver.resolve (query);
+
+	shared_ptr<Socket> socket (new Socket (REEL_TIMEOUT));
+
+	{
+		/* Note the socket so that go() can drop the connection if it is interrupted */
+		boost::mutex::scoped_lock lm (_mutex);
+		if (_stop) {
+			return;
+		}
+		_sockets.push_back (socket);
+	}
+
+	uint32_t frames = 0;
+
+	try {
+		socket->connect (*endpoint_iterator);
+
+		xmlpp::Document doc;
+		xmlpp::Element* root = doc.create_root_node ("RangeEncodingRequest");
+		root->add_child("Version")->add_child_text (raw_convert<string> (SERVER_LINK_VERSION));
+		root->add_child("Directory")->add_child_text (_film->directory().string ());
+		root->add_child("Reel")->add_child_text (raw_convert<string> (reel));
+
+		LOG_GENERAL ("Sending reel %1 to %2", reel, server.host_name());
+
+		string const xml = doc.write_to_string ("UTF-8");
+		socket->write (xml.length() + 1);
+		socket->write ((uint8_t *) xml.c_str(), xml.length() + 1);
+
+		string const metadata = _film->metadata()->write_to_string ("UTF-8");
+		socket->write (metadata.length() + 1);
+		socket->write ((uint8_t *) metadata.c_str(), metadata.length() + 1);
+
+		/* This blocks until the server has finished */
+		frames = socket->read_uint32 ();
+	} catch (...) {
+		boost::mutex::scoped_lock lm (_mutex);
+		_sockets.remove (socket);
+		throw;
+	}
+
+	{
+		boost::mutex::scoped_lock lm (_mutex);
+		_sockets.remove (socket);
+	}
+
+	LOG_GENERAL ("%1 encoded %2 frames of reel %3", server.host_name(), frames, reel);
+
+	Metrics::instance()->increment (
+		"dcpomatic_encoder_frames_total", Metrics::label ("server", server.host_name()) + "," + Metrics::label ("thread", "reel"), frames
+		);
+}
@@ -0,0 +1,97 @@
+/*
+    Copyright (C) 2018 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/** @file  src/lib/encode_farm.h
+ *  @brief EncodeFarm class.
+ */
+
+#ifndef DCPOMATIC_ENCODE_FARM_H
+#define DCPOMATIC_ENCODE_FARM_H
+
+#include "encode_server_description.h"
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition.hpp>
+#include <boost/optional.hpp>
+#include <boost/noncopyable.hpp>
+#include <list>
+#include <set>
+
+class Film;
+class Job;
+class Socket;
+
+/** @class EncodeFarm
+ *  @brief Share out the reels of a film between some encoding servers and some
+ *  local decode/encode chains, each of which decodes and encodes a whole reel.
+ *
+ *  Using servers in this way avoids sending every frame's image over the network,
+ *  at the cost of needing the film (and its content) to be at the same path on
+ *  storage which is shared between the master and the servers.  Using several local
+ *  chains means that decoding is no longer limited to one thread.
+ *
+ *  JPEG2000 data is written to the film's j2c directory, from where the Writer can
+ *  pick it up.
+ *
+ *  If go() is interrupted (because its job has been cancelled) it stops the local
+ *  chains, drops its connections to the servers and waits for all its threads to
+ *  finish before returning.
+ */
+class EncodeFarm : public boost::noncopyable
+{
+public:
+	EncodeFarm (boost::shared_ptr<const Film> film, std::list<EncodeServerDescription> servers, int local_chains);
+
+	std::set<int> go (boost::shared_ptr<Job> job);
+
+private:
+	boost::optional<int> next_reel ();
+	void reel_finished (int reel, bool ok);
+	void thread_finished ();
+	bool stopped ();
+	void server_thread (EncodeServerDescription server);
+	void local_thread (int threads);
+	void encode_remotely (EncodeServerDescription server, int reel);
+
+	boost::shared_ptr<const Film> _film;
+	std::list<EncodeServerDescription> _servers;
+	/** number of reels to decode and encode at the same time on this machine */
+	int _local_chains;
+
+	boost::thread_group _threads;
+
+	/** mutex to protect _todo, _done, _running, _stop and _sockets */
+	boost::mutex _mutex;
+	/** condition to signal that a reel has been finished, or that a thread has stopped */
+	boost::condition _condition;
+	/** reels which are waiting to be encoded */
+	std::list<int> _todo;
+	/** reels whose J2C files are all present */
+	std::set<int> _done;
+	/** number of our threads which are still running */
+	int _running;
+	/** true if our threads should stop work */
+	bool _stop;
+	/** sockets to servers which are encoding reels for us */
+	std::list<boost::shared_ptr<Socket> > _sockets;
+};
+
+#endif
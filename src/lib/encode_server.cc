@@ -35,6 +35,10 @@
 #include "log.h"
 #include "encoded_log_entry.h"
 #include "version.h"
+#include "metrics.h"
+#include "film.h"
+#include "range_encoder.h"
+#include "scoped_temporary.h"
 #include <dcp/raw_convert.h>
 #include <libcxml/cxml.h>
 #include <libxml++/libxml++.h>
@@ -58,6 +62,7 @@ using std::list;
 using std::cout;
 using std::cerr;
 using std::fixed;
+using std::runtime_error;
 using boost::shared_ptr;
 using boost::thread;
 using boost::bind;
@@ -110,25 +115,43 @@ EncodeServer::~EncodeServer ()
 	}
 }
 
-/** @param after_read Filled in with gettimeofday() after reading the input from the network.
- *  @param after_encode Filled in with gettimeofday() after encoding the image.
- */
-int
-EncodeServer::process (shared_ptr<Socket> socket, struct timeval& after_read, struct timeval& after_encode)
+/** Read a length-prefixed string from a socket */
+static string
+read_string (shared_ptr<Socket> socket)
 {
 	uint32_t length = socket->read_uint32 ();
 	scoped_array<char> buffer (new char[length]);
 	socket->read (reinterpret_cast<uint8_t*> (buffer.get()), length);
+	return string (buffer.get());
+}
 
-	string s (buffer.get());
-	shared_ptr<cxml::Document> xml (new cxml::Document ("EncodingRequest"));
-	xml->read_string (s);
+/** @return Request read from the socket, or 0 if the request was from an incompatible client */
+shared_ptr<cxml::Document>
+EncodeServer::read_request (shared_ptr<Socket> socket)
+{
+	shared_ptr<cxml::Document> xml (new cxml::Document ());
+	xml->read_string (read_string (socket));
 	/* This is a double-check; the server shouldn't even be on the candidate list
 	   if it is the wrong version, but it doesn't hurt to make sure here.
 	*/
 	if (xml->number_child<int> ("Version") != SERVER_LINK_VERSION) {
 		cerr << "Mismatched server/client versions\n";
 		LOG_ERROR_NC ("Mismatched server/client versions");
+		return shared_ptr<cxml::Document> ();
+	}
+
+	return xml;
+}
+
+/** Process a request to encode a single frame.
+ *  @param after_read Filled in with gettimeofday() after reading the input from the network.
+ *  @param after_encode Filled in with gettimeofday() after encoding the image.
+ */
+int
+EncodeServer::process (shared_ptr<Socket> socket, shared_ptr<cxml::Document> xml, struct timeval& after_read, struct timeval& after_encode)
+{
+	if (xml->root_name() != "EncodingRequest") {
+		LOG_ERROR ("Unexpected request %1", xml->root_name());
 		return -1;
 	}
 
@@ -154,9 +177,48 @@ EncodeServer::process (shared_ptr<Socket> socket, struct timeval& after_read, st
 	return dcp_video_frame.index ();
 }
 
+/** Process a request to encode all the video in one reel of a film.  The film's directory
+ *  must be on storage that this server shares with the master, as the JPEG2000 data is
+ *  written to the film's j2c directory rather than being sent back over the network.
+ *  The request is followed by the film's metadata.
+ */
 void
-EncodeServer::worker_thread ()
+EncodeServer::process_range (shared_ptr<Socket> socket, shared_ptr<cxml::Document> xml)
 {
+	boost::filesystem::path const directory = xml->string_child ("Directory");
+	int const reel = xml->number_child<int> ("Reel");
+
+	ScopedTemporary metadata;
+	string const m = read_string (socket);
+	Data (reinterpret_cast<uint8_t const *> (m.c_str()), m.length()).write (metadata.file ());
+
+	if (!boost::filesystem::is_directory (directory)) {
+		throw runtime_error (String::compose ("Film directory %1 is not visible from this server", directory.string()));
+	}
+
+	shared_ptr<Film> film (new Film (directory));
+	film->read_metadata (metadata.file ());
+
+	LOG_GENERAL ("Encoding reel %1 of %2", reel, directory.string());
+	if (_verbose) {
+		cout << "Encoding reel " << reel << " of " << directory.string() << "\n";
+	}
+
+	RangeEncoder encoder (film, reel, _num_threads);
+	Frame const frames = encoder.go ();
+
+	LOG_GENERAL ("Encoded %1 frames of reel %2 of %3", frames, reel, directory.string());
+	Metrics::instance()->increment ("dcpomatic_server_frames_total", Metrics::label ("thread", "reel"), frames);
+
+	socket->write (frames);
+}
+
+/** @param index Index of this thread, for metrics */
+void
+EncodeServer::worker_thread (int index)
+{
+	string const thread_label = Metrics::label ("thread", raw_convert<string> (index));
+
 	while (true) {
 		boost::mutex::scoped_lock lock (_mutex);
 		while (_queue.empty () && !_terminate) {
@@ -169,6 +231,7 @@ EncodeServer::worker_thread ()
 
 		shared_ptr<Socket> socket = _queue.front ();
 		_queue.pop_front ();
+		Metrics::instance()->set ("dcpomatic_server_queue_frames", "", _queue.size ());
 
 		lock.unlock ();
 
@@ -183,8 +246,16 @@ EncodeServer::worker_thread ()
 		gettimeofday (&start, 0);
 
 		try {
-			frame = process (socket, after_read, after_encode);
-			ip = socket->socket().remote_endpoint().address().to_string();
+			shared_ptr<cxml::Document> xml = read_request (socket);
+			if (xml && xml->root_name() == "RangeEncodingRequest") {
+				process_range (socket, xml);
+				lock.lock ();
+				_full_condition.notify_all ();
+				continue;
+			} else if (xml) {
+				frame = process (socket, xml, after_read, after_encode);
+				ip = socket->socket().remote_endpoint().address().to_string();
+			}
 		} catch (std::exception& e) {
 			cerr << "Error: " << e.what() << "\n";
 			LOG_ERROR ("Error: %1", e.what());
@@ -192,6 +263,15 @@ EncodeServer::worker_thread ()
 
 		gettimeofday (&end, 0);
 
+		Metrics::instance()->increment ("dcpomatic_server_received_bytes_total", "", socket->bytes_read ());
+		Metrics::instance()->increment ("dcpomatic_server_sent_bytes_total", "", socket->bytes_written ());
+		if (frame >= 0) {
+			Metrics::instance()->increment ("dcpomatic_server_frames_total", thread_label);
+			Metrics::instance()->observe ("dcpomatic_server_frame_seconds", "", seconds(after_encode) - seconds(after_read));
+		} else {
+			Metrics::instance()->increment ("dcpomatic_server_failures_total");
+		}
+
 		socket.reset ();
 
 		lock.lock ();
@@ -229,7 +309,7 @@ EncodeServer::run ()
 	}
 
 	for (int i = 0; i < _num_threads; ++i) {
-		_worker_threads.push_back (new thread (bind (&EncodeServer::worker_thread, this)));
+		_worker_threads.push_back (new thread (bind (&EncodeServer::worker_thread, this, i)));
 	}
 
 	_broadcast.thread = new thread (bind (&EncodeServer::broadcast_thread, this));
@@ -314,5 +394,6 @@ EncodeServer::handle (shared_ptr<Socket> socket)
 	}
 
 	_queue.push_back (socket);
+	Metrics::instance()->set ("dcpomatic_server_queue_frames", "", _queue.size ());
 	_empty_condition.notify_all ();
 }
@@ -35,6 +35,10 @@
 class Socket;
 class Log;
 
+namespace cxml {
+	class Document;
+}
+
 /** @class EncodeServer
  *  @brief A class to run a server which can accept requests to perform JPEG2000
  *  encoding work.
@@ -49,8 +53,10 @@ public:
 
 private:
 	void handle (boost::shared_ptr<Socket>);
-	void worker_thread ();
-	int process (boost::shared_ptr<Socket> socket, struct timeval &, struct timeval &);
+	void worker_thread (int index);
+	boost::shared_ptr<cxml::Document> read_request (boost::shared_ptr<Socket> socket);
+	int process (boost::shared_ptr<Socket> socket, boost::shared_ptr<cxml::Document> xml, struct timeval &, struct timeval &);
+	void process_range (boost::shared_ptr<Socket> socket, boost::shared_ptr<cxml::Document> xml);
 	void broadcast_thread ();
 	void broadcast_received ();
 
@@ -30,6 +30,12 @@ public:
 
 	std::string name () const;
 	std::string json_name () const;
+	Resource resource () const {
+		return RESOURCE_IO;
+	}
+	bool concurrent () const {
+		return true;
+	}
 	void run ();
 
 private:
@@ -197,6 +197,17 @@ public:
 	{}
 };
 
+/** @class EmailRejectedError
+ *  @brief An email which the mail server refused permanently, so there is no point in trying to send it again.
+ */
+class EmailRejectedError : public KDMError
+{
+public:
+	EmailRejectedError (std::string s)
+		: KDMError (s)
+	{}
+};
+
 /** @class PixelFormatError
  *  @brief A problem with an unsupported pixel format.
  */
@@ -33,6 +33,8 @@
 #include "exceptions.h"
 #include "frame_rate_change.h"
 #include "subtitle_content.h"
+#include "config.h"
+#include "metrics.h"
 #include <dcp/raw_convert.h>
 #include <libcxml/cxml.h>
 extern "C" {
@@ -41,6 +43,7 @@ extern "C" {
 }
 #include <libxml++/libxml++.h>
 #include <boost/foreach.hpp>
+#include <boost/algorithm/string.hpp>
 #include <iostream>
 
 #include "i18n.h"
@@ -65,17 +68,40 @@ int const FFmpegContentProperty::FILTERS = 102;
 
 FFmpegContent::FFmpegContent (shared_ptr<const Film> film, boost::filesystem::path p)
 	: Content (film, p)
+	, _all_keyframes (false)
 {
 
 }
 
 FFmpegContent::FFmpegContent (shared_ptr<const Film> film, cxml::ConstNodePtr node, int version, list<string>& notes)
 	: Content (film, node)
+	, _all_keyframes (false)
+{
+	read_examination (node, version);
+
+	list<cxml::NodePtr> c = node->node_children ("Filter");
+	for (list<cxml::NodePtr>::iterator i = c.begin(); i != c.end(); ++i) {
+		Filter const * f = Filter::from_id ((*i)->content ());
+		if (f) {
+			_filters.push_back (f);
+		} else {
+			notes.push_back (String::compose (_("DCP-o-matic no longer supports the `%1' filter, so it has been turned off."), (*i)->content()));
+		}
+	}
+}
+
+/** Set up the things that examine() finds out from some XML written by as_xml() */
+void
+FFmpegContent::read_examination (cxml::ConstNodePtr node, int version)
 {
 	video = VideoContent::from_xml (this, node, version);
 	audio = AudioContent::from_xml (this, node, version);
 	subtitle = SubtitleContent::from_xml (this, node, version);
 
+	boost::mutex::scoped_lock lm (_mutex);
+
+	_subtitle_streams.clear ();
+	_subtitle_stream.reset ();
 	list<cxml::NodePtr> c = node->node_children ("SubtitleStream");
 	for (list<cxml::NodePtr>::const_iterator i = c.begin(); i != c.end(); ++i) {
 		_subtitle_streams.push_back (shared_ptr<FFmpegSubtitleStream> (new FFmpegSubtitleStream (*i, version)));
@@ -94,21 +120,23 @@ FFmpegContent::FFmpegContent (shared_ptr<const Film> film, cxml::ConstNodePtr no
 		}
 	}
 
-	c = node->node_children ("Filter");
-	for (list<cxml::NodePtr>::iterator i = c.begin(); i != c.end(); ++i) {
-		Filter const * f = Filter::from_id ((*i)->content ());
-		if (f) {
-			_filters.push_back (f);
-		} else {
-			notes.push_back (String::compose (_("DCP-o-matic no longer supports the `%1' filter, so it has been turned off."), (*i)->content()));
-		}
-	}
-
+	_first_video = optional<ContentTime> ();
 	optional<ContentTime::Type> const f = node->optional_number_child<ContentTime::Type> ("FirstVideo");
 	if (f) {
 		_first_video = ContentTime (f.get ());
 	}
 
+	_keyframes.clear ();
+	optional<string> const k = node->optional_string_child ("Keyframes");
+	if (k && !k->empty ()) {
+		vector<string> bits;
+		boost::split (bits, k.get(), boost::is_any_of (" "));
+		BOOST_FOREACH (string i, bits) {
+			_keyframes.push_back (ContentTime (raw_convert<ContentTime::Type> (i)));
+		}
+	}
+	_all_keyframes = node->optional_bool_child("AllKeyframes").get_value_or (false);
+
 	_color_range = static_cast<AVColorRange> (node->optional_number_child<int>("ColorRange").get_value_or (AVCOL_RANGE_UNSPECIFIED));
 	_color_primaries = static_cast<AVColorPrimaries> (node->optional_number_child<int>("ColorPrimaries").get_value_or (AVCOL_PRI_UNSPECIFIED));
 	_color_trc = static_cast<AVColorTransferCharacteristic> (
@@ -116,11 +144,11 @@ FFmpegContent::FFmpegContent (shared_ptr<const Film> film, cxml::ConstNodePtr no
 		);
 	_colorspace = static_cast<AVColorSpace> (node->optional_number_child<int>("Colorspace").get_value_or (AVCOL_SPC_UNSPECIFIED));
 	_bits_per_pixel = node->optional_number_child<int> ("BitsPerPixel");
-
 }
 
 FFmpegContent::FFmpegContent (shared_ptr<const Film> film, vector<shared_ptr<Content> > c)
 	: Content (film, c)
+	, _all_keyframes (true)
 {
 	vector<shared_ptr<Content> >::const_iterator i = c.begin ();
 
@@ -165,6 +193,9 @@ FFmpegContent::FFmpegContent (shared_ptr<const Film> film, vector<shared_ptr<Con
 		if (fc->subtitle && fc->subtitle->use() && *(fc->_subtitle_stream.get()) != *(ref->_subtitle_stream.get())) {
 			throw JoinError (_("Content to be joined must use the same subtitle stream."));
 		}
+		if (!fc->_all_keyframes) {
+			_all_keyframes = false;
+		}
 	}
 
 	/* XXX: should probably check that more of the stuff below is the same in *this and ref */
@@ -222,6 +253,20 @@ FFmpegContent::as_xml (xmlpp::Node* node, bool with_paths) const
 		node->add_child("FirstVideo")->add_child_text (raw_convert<string> (_first_video.get().get()));
 	}
 
+	if (_all_keyframes) {
+		node->add_child("AllKeyframes")->add_child_text ("1");
+	} else if (!_keyframes.empty ()) {
+		/* There may be many thousands of these so write them all into one node */
+		string k;
+		BOOST_FOREACH (ContentTime i, _keyframes) {
+			if (!k.empty ()) {
+				k += " ";
+			}
+			k += raw_convert<string> (i.get ());
+		}
+		node->add_child("Keyframes")->add_child_text (k);
+	}
+
 	node->add_child("ColorRange")->add_child_text (raw_convert<string> (static_cast<int> (_color_range)));
 	node->add_child("ColorPrimaries")->add_child_text (raw_convert<string> (static_cast<int> (_color_primaries)));
 	node->add_child("ColorTransferCharacteristic")->add_child_text (raw_convert<string> (static_cast<int> (_color_trc)));
@@ -238,6 +283,14 @@ FFmpegContent::examine (shared_ptr<Job> job)
 
 	Content::examine (job);
 
+	boost::filesystem::path const cache = Config::instance()->examination_cache_path (digest ());
+	if (read_examination_cache (cache)) {
+		Metrics::instance()->increment ("dcpomatic_examination_cache_hits_total");
+		signal_changed (FFmpegContentProperty::SUBTITLE_STREAMS);
+		signal_changed (FFmpegContentProperty::SUBTITLE_STREAM);
+		return;
+	}
+
 	shared_ptr<FFmpegExaminer> examiner (new FFmpegExaminer (shared_from_this (), job));
 
 	if (examiner->has_video ()) {
@@ -252,6 +305,8 @@ FFmpegContent::examine (shared_ptr<Job> job)
 
 		if (examiner->has_video ()) {
 			_first_video = examiner->first_video ();
+			_keyframes = examiner->keyframes ();
+			_all_keyframes = examiner->all_keyframes ();
 			_color_range = examiner->color_range ();
 			_color_primaries = examiner->color_primaries ();
 			_color_trc = examiner->color_trc ();
@@ -284,10 +339,78 @@ FFmpegContent::examine (shared_ptr<Job> job)
 		set_default_colour_conversion ();
 	}
 
+	write_examination_cache (cache);
+
 	signal_changed (FFmpegContentProperty::SUBTITLE_STREAMS);
 	signal_changed (FFmpegContentProperty::SUBTITLE_STREAM);
 }
 
+/** Take the results of examination from a file written by write_examination_cache,
+ *  so that we do not have to look at the content again.
+ *  @return true if this was possible, otherwise false.
+ */
+bool
+FFmpegContent::read_examination_cache (boost::filesystem::path file)
+{
+	if (!boost::filesystem::exists (file)) {
+		return false;
+	}
+
+	try {
+		cxml::Document doc ("Examination");
+		doc.read_file (file);
+		if (doc.number_child<int> ("Version") != Film::current_state_version) {
+			return false;
+		}
+		read_examination (doc.node_child ("Content"), Film::current_state_version);
+	} catch (std::exception& e) {
+		return false;
+	}
+
+	/* Settings which depend on the film were written to the cache as they were for
+	   the film which was being used at the time, so set them up again.
+	*/
+	if (audio && !audio->streams().empty ()) {
+		BOOST_FOREACH (AudioStreamPtr i, audio->streams ()) {
+			i->set_mapping (AudioMapping (i->channels (), MAX_DCP_AUDIO_CHANNELS));
+		}
+		AudioStreamPtr as = audio->streams().front();
+		AudioMapping m = as->mapping ();
+		film()->make_audio_mapping_default (m, path (0));
+		as->set_mapping (m);
+	}
+
+	if (video) {
+		set_default_colour_conversion ();
+	}
+
+	return true;
+}
+
+void
+FFmpegContent::write_examination_cache (boost::filesystem::path file) const
+{
+	xmlpp::Document doc;
+	xmlpp::Element* root = doc.create_root_node ("Examination");
+	root->add_child("Version")->add_child_text (raw_convert<string> (Film::current_state_version));
+	as_xml (root->add_child ("Content"), false);
+
+	/* Write to a temporary file and rename it so that nobody sees a partial cache entry;
+	   failure here is not important as we will just examine the content again next time.
+	*/
+	boost::system::error_code ec;
+	boost::filesystem::create_directories (file.parent_path (), ec);
+	boost::filesystem::path tmp = file;
+	tmp += "." + boost::filesystem::unique_path().string();
+	try {
+		doc.write_to_file_formatted (tmp.string ());
+		boost::filesystem::rename (tmp, file, ec);
+	} catch (std::exception& e) {
+
+	}
+	boost::filesystem::remove (tmp, ec);
+}
+
 string
 FFmpegContent::summary () const
 {
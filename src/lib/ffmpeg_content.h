@@ -91,10 +91,23 @@ public:
 		return _first_video;
 	}
 
+	std::vector<ContentTime> keyframes () const {
+		boost::mutex::scoped_lock lm (_mutex);
+		return _keyframes;
+	}
+
+	bool all_keyframes () const {
+		boost::mutex::scoped_lock lm (_mutex);
+		return _all_keyframes;
+	}
+
 	void signal_subtitle_stream_changed ();
 
 private:
 	void add_properties (std::list<UserProperty> &) const;
+	void read_examination (cxml::ConstNodePtr node, int version);
+	bool read_examination_cache (boost::filesystem::path file);
+	void write_examination_cache (boost::filesystem::path file) const;
 
 	friend struct ffmpeg_pts_offset_test;
 	friend struct audio_sampling_rate_test;
@@ -102,6 +115,12 @@ private:
 	std::vector<boost::shared_ptr<FFmpegSubtitleStream> > _subtitle_streams;
 	boost::shared_ptr<FFmpegSubtitleStream> _subtitle_stream;
 	boost::optional<ContentTime> _first_video;
+	/** Presentation times of keyframes in the video stream, without any PTS offset, sorted;
+	 *  empty if we do not know them or if _all_keyframes is true.
+	 */
+	std::vector<ContentTime> _keyframes;
+	/** true if every frame in the video stream is a keyframe */
+	bool _all_keyframes;
 	/** Video filters that should be used when generating DCPs */
 	std::vector<Filter const *> _filters;
 
@@ -52,6 +52,7 @@ extern "C" {
 #include <boost/foreach.hpp>
 #include <boost/algorithm/string.hpp>
 #include <vector>
+#include <algorithm>
 #include <iomanip>
 #include <iostream>
 #include <stdint.h>
@@ -70,6 +71,7 @@ using std::list;
 using std::min;
 using std::pair;
 using std::max;
+using std::upper_bound;
 using std::map;
 using boost::shared_ptr;
 using boost::is_any_of;
@@ -81,6 +83,7 @@ using dcp::Size;
 FFmpegDecoder::FFmpegDecoder (shared_ptr<const FFmpegContent> c, shared_ptr<Log> log, bool fast)
 	: FFmpeg (c)
 	, _log (log)
+	, _all_keyframes (false)
 	, _have_current_subtitle (false)
 {
 	if (c->video) {
@@ -89,6 +92,17 @@ FFmpegDecoder::FFmpegDecoder (shared_ptr<const FFmpegContent> c, shared_ptr<Log>
 		/* It doesn't matter what size or pixel format this is, it just needs to be black */
 		_black_image.reset (new Image (AV_PIX_FMT_RGB24, dcp::Size (128, 128), true));
 		_black_image->make_black ();
+		_keyframes = c->keyframes ();
+		_all_keyframes = c->all_keyframes ();
+		if (fast) {
+			/* We are only making a preview, so trade some quality for speed: skip the loop
+			   (deblocking) filter, which is a large part of the cost of decoding H.264, and
+			   allow any other shortcuts that the decoder knows about.
+			*/
+			AVCodecContext* context = video_codec_context ();
+			context->skip_loop_filter = AVDISCARD_ALL;
+			context->flags2 |= CODEC_FLAG2_FAST;
+		}
 	} else {
 		_pts_offset = ContentTime ();
 	}
@@ -339,12 +353,26 @@ FFmpegDecoder::seek (ContentTime time, bool accurate)
 {
 	Decoder::seek (time, accurate);
 
-	/* If we are doing an `accurate' seek, we need to use pre-roll, as
-	   we don't really know what the seek will give us.
+	/* If we are doing an `accurate' seek we must start decoding from the keyframe
+	   at or before `time'.  If every frame is a keyframe we can seek straight to `time',
+	   and if examination gave us the keyframe times we can seek straight to the right
+	   one; otherwise we need to use pre-roll, as we don't really know what the seek
+	   will give us.
+
+	   The keyframe times are presentation times.  If the container's index uses
+	   decode times, asking for a keyframe's presentation time with AVSEEK_FLAG_BACKWARD
+	   still finds that keyframe, as its decode time is no later.
 	*/
 
-	ContentTime pre_roll = accurate ? ContentTime::from_seconds (2) : ContentTime (0);
-	time -= pre_roll;
+	if (accurate && !_all_keyframes) {
+		vector<ContentTime>::const_iterator i = upper_bound (_keyframes.begin(), _keyframes.end(), time - _pts_offset);
+		if (i != _keyframes.begin()) {
+			--i;
+			time = *i + _pts_offset;
+		} else {
+			time -= ContentTime::from_seconds (2);
+		}
+	}
 
 	/* XXX: it seems debatable whether PTS should be used here...
 	   http://www.mjbshaw.com/2012/04/seeking-in-ffmpeg-know-your-timestamp.html
@@ -370,7 +398,7 @@ FFmpegDecoder::seek (ContentTime time, bool accurate)
 	av_seek_frame (
 		_format_context,
 		stream.get(),
-		u.seconds() / av_q2d (_format_context->streams[stream.get()]->time_base),
+		llrint (u.seconds() / av_q2d (_format_context->streams[stream.get()]->time_base)),
 		AVSEEK_FLAG_BACKWARD
 		);
 
@@ -74,6 +74,10 @@ private:
 	boost::mutex _filter_graphs_mutex;
 
 	ContentTime _pts_offset;
+	/** Keyframe presentation times of the video stream from examination, without _pts_offset applied */
+	std::vector<ContentTime> _keyframes;
+	/** true if every frame of the video stream is a keyframe */
+	bool _all_keyframes;
 	boost::optional<ContentTime> _current_subtitle_to;
 	bool _have_current_subtitle;
 
@@ -32,12 +32,16 @@ extern "C" {
 #include "util.h"
 #include <boost/foreach.hpp>
 #include <iostream>
+#include <algorithm>
 
 #include "i18n.h"
 
 using std::string;
 using std::cout;
 using std::max;
+using std::sort;
+using std::unique;
+using std::vector;
 using boost::shared_ptr;
 using boost::optional;
 
@@ -46,6 +50,8 @@ FFmpegExaminer::FFmpegExaminer (shared_ptr<const FFmpegContent> c, shared_ptr<Jo
 	: FFmpeg (c)
 	, _video_length (0)
 	, _need_video_length (false)
+	, _all_keyframes (false)
+	, _seen_first_keyframe (false)
 {
 	/* Find audio and subtitle streams */
 
@@ -91,8 +97,28 @@ FFmpegExaminer::FFmpegExaminer (shared_ptr<const FFmpegContent> c, shared_ptr<Jo
 		}
 	}
 
-	if (job && _need_video_length) {
-		job->sub (_("Finding length"));
+	/* Keyframe timestamps from the container's index, in the video stream's timebase */
+	vector<int64_t> index;
+
+	if (has_video ()) {
+		AVStream* s = _format_context->streams[_video_stream.get()];
+		AVCodecDescriptor const * desc = avcodec_descriptor_get (s->codec->codec_id);
+		if (desc && (desc->props & AV_CODEC_PROP_INTRA_ONLY)) {
+			/* Every frame is a keyframe (ProRes, DNxHD, MJPEG and so on) so there is
+			   no point in listing them.
+			*/
+			_all_keyframes = true;
+		} else {
+			/* Use the container's index of keyframes if it has one (MP4, MOV, MKV with cues
+			   and so on).  If there is no index we do not read the whole file to make one,
+			   as that can take a long time; the decoder will use pre-roll instead.
+			*/
+			for (int i = 0; i < s->nb_index_entries; ++i) {
+				if (s->index_entries[i].flags & AVINDEX_KEYFRAME) {
+					index.push_back (s->index_entries[i].timestamp);
+				}
+			}
+		}
 	}
 
 	/* Run through until we find:
@@ -119,6 +145,8 @@ FFmpegExaminer::FFmpegExaminer (shared_ptr<const FFmpegContent> c, shared_ptr<Jo
 
 		if (_video_stream && _packet.stream_index == _video_stream.get()) {
 			video_packet (context);
+			keyframe_packet ();
+			last_video_packet ();
 		}
 
 		bool got_all_audio = true;
@@ -139,6 +167,76 @@ FFmpegExaminer::FFmpegExaminer (shared_ptr<const FFmpegContent> c, shared_ptr<Jo
 			break;
 		}
 	}
+
+	if (!index.empty() && _first_keyframe_pts) {
+		/* Some containers (e.g. MP4) index by decode timestamp, which is earlier than the
+		   presentation timestamp for keyframes when there are B-frames.  We seek by presentation
+		   time, so convert the index using the difference that we saw for the first keyframe.
+		*/
+		AVStream* s = _format_context->streams[_video_stream.get()];
+		sort (index.begin(), index.end());
+		index.erase (unique (index.begin(), index.end()), index.end());
+		int64_t const offset = _first_keyframe_pts.get() - index.front();
+		BOOST_FOREACH (int64_t i, index) {
+			_keyframes.push_back (ContentTime::from_seconds ((i + offset) * av_q2d (s->time_base)));
+		}
+	}
+
+	if (_need_video_length) {
+		/* Look at the end of the file to find the last video */
+		if (job) {
+			job->sub (_("Finding length"));
+		}
+		read_tail ();
+		if (_last_video) {
+			_video_length = _last_video->frames_round (video_frame_rate().get ());
+		}
+	}
+}
+
+/** Find the time of the last video packet by reading packets from
+ *  increasingly large sections at the end of the file.  If the format
+ *  cannot seek by bytes we have to read all the way through.
+ */
+void
+FFmpegExaminer::read_tail ()
+{
+	int64_t const len = _file_group.length ();
+
+	for (int64_t back = 4 * 1024 * 1024; !_last_video; back *= 4) {
+		int64_t const from = max (int64_t (0), len - back);
+		if (av_seek_frame (_format_context, -1, from, AVSEEK_FLAG_BYTE) < 0 && from > 0) {
+			av_seek_frame (_format_context, -1, 0, AVSEEK_FLAG_BYTE);
+			back = len;
+		}
+
+		while (av_read_frame (_format_context, &_packet) >= 0) {
+			if (_packet.stream_index == _video_stream.get()) {
+				last_video_packet ();
+			}
+			av_packet_unref (&_packet);
+		}
+
+		if (back >= len) {
+			break;
+		}
+	}
+}
+
+void
+FFmpegExaminer::last_video_packet ()
+{
+	if (!_need_video_length) {
+		return;
+	}
+
+	int64_t const t = _packet.pts != AV_NOPTS_VALUE ? _packet.pts : _packet.dts;
+	if (t != AV_NOPTS_VALUE) {
+		ContentTime const c = ContentTime::from_seconds (t * av_q2d (_format_context->streams[_video_stream.get()]->time_base));
+		if (!_last_video || c > _last_video.get()) {
+			_last_video = c;
+		}
+	}
 }
 
 void
@@ -146,20 +244,27 @@ FFmpegExaminer::video_packet (AVCodecContext* context)
 {
 	DCPOMATIC_ASSERT (_video_stream);
 
-	if (_first_video && !_need_video_length) {
+	if (_first_video) {
 		return;
 	}
 
 	int frame_finished;
 	if (avcodec_decode_video2 (context, _frame, &frame_finished, &_packet) >= 0 && frame_finished) {
-		if (!_first_video) {
-			_first_video = frame_time (_format_context->streams[_video_stream.get()]);
-		}
-		if (_need_video_length) {
-			_video_length = frame_time (
-				_format_context->streams[_video_stream.get()]
-				).get_value_or (ContentTime ()).frames_round (video_frame_rate().get ());
-		}
+		_first_video = frame_time (_format_context->streams[_video_stream.get()]);
+	}
+}
+
+/** Note the presentation timestamp of the first keyframe in the video stream */
+void
+FFmpegExaminer::keyframe_packet ()
+{
+	if (_seen_first_keyframe || !(_packet.flags & AV_PKT_FLAG_KEY)) {
+		return;
+	}
+
+	_seen_first_keyframe = true;
+	if (_packet.pts != AV_NOPTS_VALUE) {
+		_first_keyframe_pts = _packet.pts;
 	}
 }
 
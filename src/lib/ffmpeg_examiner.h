@@ -71,9 +71,25 @@ public:
 
 	boost::optional<int> bits_per_pixel () const;
 
+	/** @return presentation times of the keyframes in the video stream, in the stream's
+	 *  own timebase (i.e. without any PTS offset applied), sorted.  This will be empty
+	 *  if the container has no index, or if all_keyframes() is true.
+	 */
+	std::vector<ContentTime> keyframes () const {
+		return _keyframes;
+	}
+
+	/** @return true if every frame in the video stream is a keyframe */
+	bool all_keyframes () const {
+		return _all_keyframes;
+	}
+
 private:
 	void video_packet (AVCodecContext *);
 	void audio_packet (AVCodecContext *, boost::shared_ptr<FFmpegAudioStream>);
+	void keyframe_packet ();
+	void last_video_packet ();
+	void read_tail ();
 
 	std::string stream_name (AVStream* s) const;
 	std::string subtitle_stream_name (AVStream* s) const;
@@ -82,11 +98,21 @@ private:
 	std::vector<boost::shared_ptr<FFmpegSubtitleStream> > _subtitle_streams;
 	std::vector<boost::shared_ptr<FFmpegAudioStream> > _audio_streams;
 	boost::optional<ContentTime> _first_video;
-	/** Video length, either obtained from the header or derived by running
-	 *  through the whole file.
+	/** Video length, either obtained from the header or derived from the
+	 *  time of the last video packet in the file.
 	 */
 	Frame _video_length;
 	bool _need_video_length;
+	/** Latest video packet time that we have seen, if _need_video_length is true */
+	boost::optional<ContentTime> _last_video;
+	/** Keyframe presentation times, taken from the container's index */
+	std::vector<ContentTime> _keyframes;
+	/** true if every frame in the video stream is a keyframe */
+	bool _all_keyframes;
+	/** true if we have seen the first keyframe packet in the video stream */
+	bool _seen_first_keyframe;
+	/** PTS of the first keyframe packet in the video stream, in the stream's timebase */
+	boost::optional<int64_t> _first_keyframe_pts;
 
 	struct SubtitleStart
 	{
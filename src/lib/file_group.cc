@@ -28,16 +28,24 @@
 #include "exceptions.h"
 #include "cross.h"
 #include <iostream>
+#include <algorithm>
 
 using std::vector;
 using std::cout;
+using std::upper_bound;
+
+/** Size of the stdio buffer to use for each file; FFmpeg tends to read in
+ *  small pieces, and a larger buffer saves a lot of system calls when the
+ *  files are on network storage.
+ */
+static size_t const read_ahead = 256 * 1024;
 
 /** Construct a FileGroup with no files */
 FileGroup::FileGroup ()
 	: _current_path (0)
 	, _current_file (0)
 {
-
+	setup_offsets ();
 }
 
 /** Construct a FileGroup with a single file */
@@ -46,6 +54,7 @@ FileGroup::FileGroup (boost::filesystem::path p)
 	, _current_file (0)
 {
 	_paths.push_back (p);
+	setup_offsets ();
 	ensure_open_path (0);
 	seek (0, SEEK_SET);
 }
@@ -56,6 +65,7 @@ FileGroup::FileGroup (vector<boost::filesystem::path> const & p)
 	, _current_path (0)
 	, _current_file (0)
 {
+	setup_offsets ();
 	ensure_open_path (0);
 	seek (0, SEEK_SET);
 }
@@ -72,10 +82,23 @@ void
 FileGroup::set_paths (vector<boost::filesystem::path> const & p)
 {
 	_paths = p;
+	setup_offsets ();
 	ensure_open_path (0);
 	seek (0, SEEK_SET);
 }
 
+void
+FileGroup::setup_offsets ()
+{
+	_offsets.clear ();
+	int64_t total = 0;
+	for (size_t i = 0; i < _paths.size(); ++i) {
+		_offsets.push_back (total);
+		total += boost::filesystem::file_size (_paths[i]);
+	}
+	_offsets.push_back (total);
+}
+
 /** Ensure that the given path index in the content is the _current_file */
 void
 FileGroup::ensure_open_path (size_t p) const
@@ -94,6 +117,8 @@ FileGroup::ensure_open_path (size_t p) const
 	if (_current_file == 0) {
 		throw OpenFileError (_paths[_current_path], errno, true);
 	}
+
+	setvbuf (_current_file, 0, _IOFBF, read_ahead);
 }
 
 int64_t
@@ -108,9 +133,7 @@ FileGroup::seek (int64_t pos, int whence) const
 		full_pos = pos;
 		break;
 	case SEEK_CUR:
-		for (size_t i = 0; i < _current_path; ++i) {
-			full_pos += boost::filesystem::file_size (_paths[i]);
-		}
+		full_pos = _offsets[_current_path];
 #ifdef DCPOMATIC_WINDOWS
 		full_pos += _ftelli64 (_current_file);
 #else
@@ -123,24 +146,15 @@ FileGroup::seek (int64_t pos, int whence) const
 		break;
 	}
 
-	/* Seek to full_pos */
-	size_t i = 0;
-	int64_t sub_pos = full_pos;
-	while (i < _paths.size ()) {
-		boost::uintmax_t len = boost::filesystem::file_size (_paths[i]);
-		if (sub_pos < int64_t (len)) {
-			break;
-		}
-		sub_pos -= len;
-		++i;
-	}
-
-	if (i == _paths.size ()) {
+	if (full_pos < 0 || full_pos >= length()) {
 		return -1;
 	}
 
+	/* Find the last path which starts at or before full_pos (skipping any empty ones) */
+	size_t const i = upper_bound (_offsets.begin(), _offsets.end(), full_pos) - _offsets.begin() - 1;
+
 	ensure_open_path (i);
-	dcpomatic_fseek (_current_file, sub_pos, SEEK_SET);
+	dcpomatic_fseek (_current_file, full_pos - _offsets[i], SEEK_SET);
 	return full_pos;
 }
 
@@ -175,10 +189,5 @@ FileGroup::read (uint8_t* buffer, int amount) const
 int64_t
 FileGroup::length () const
 {
-	int64_t len = 0;
-	for (size_t i = 0; i < _paths.size(); ++i) {
-		len += boost::filesystem::file_size (_paths[i]);
-	}
-
-	return len;
+	return _offsets.back ();
 }
@@ -46,9 +46,15 @@ public:
 	int64_t length () const;
 
 private:
+	void setup_offsets ();
 	void ensure_open_path (size_t) const;
 
 	std::vector<boost::filesystem::path> _paths;
+	/** Offset of the start of each path from the start of the group, with
+	 *  the total length of the group as the last entry; i.e. a running total
+	 *  of file sizes, so that we do not have to stat every file on each seek.
+	 */
+	std::vector<int64_t> _offsets;
 	/** Index of path that we are currently reading from */
 	mutable size_t _current_path;
 	mutable FILE* _current_file;
@@ -51,6 +51,7 @@
 #include "dcp_content.h"
 #include "screen_kdm.h"
 #include "cinema.h"
+#include "exception_store.h"
 #include <libcxml/cxml.h>
 #include <dcp/cpl.h>
 #include <dcp/certificate_chain.h>
@@ -65,6 +66,9 @@
 #include <boost/algorithm/string.hpp>
 #include <boost/foreach.hpp>
 #include <boost/regex.hpp>
+#include <boost/asio.hpp>
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
 #include <unistd.h>
 #include <stdexcept>
 #include <iostream>
@@ -936,16 +940,20 @@ Film::set_isdcf_date_today ()
 	_isdcf_date = boost::gregorian::day_clock::local_day ();
 }
 
+/** @param reel Period of the reel that the frame is in; this is part of the filename so that
+ *  frames encoded for one set of reels are not used after the reels change.
+ *  @param frame Frame index within the reel.
+ */
 boost::filesystem::path
-Film::j2c_path (int reel, Frame frame, Eyes eyes, bool tmp) const
+Film::j2c_path (DCPTimePeriod reel, Frame frame, Eyes eyes, bool tmp) const
 {
 	boost::filesystem::path p;
 	p /= "j2c";
 	p /= video_identifier ();
 
 	char buffer[256];
-	snprintf(buffer, sizeof(buffer), "%08d_%08" PRId64, reel, frame);
-	string s (buffer);
+	snprintf(buffer, sizeof(buffer), "_%08" PRId64, frame);
+	string s = raw_convert<string> (reel.from.get()) + "_" + raw_convert<string> (reel.to.get()) + buffer;
 
 	if (eyes == EYES_LEFT) {
 		s += ".L";
@@ -1040,13 +1048,34 @@ Film::examine_and_add_content (shared_ptr<Content> content, bool disable_audio_a
 
 	shared_ptr<Job> j (new ExamineContentJob (shared_from_this(), content));
 
-	_job_connections.push_back (
-		j->Finished.connect (bind (&Film::maybe_add_content, this, weak_ptr<Job>(j), weak_ptr<Content>(content), disable_audio_analysis))
+	_examining.push_back (
+		make_pair (weak_ptr<Job> (j), bind (&Film::maybe_add_content, this, weak_ptr<Job>(j), weak_ptr<Content>(content), disable_audio_analysis))
 		);
 
+	_job_connections.push_back (j->Finished.connect (bind (&Film::examine_finished, this)));
+
 	JobManager::instance()->add (j);
 }
 
+/** Called when an examination started by examine_and_add_content has finished.
+ *  Examinations may run at the same time and finish in any order, but we add
+ *  their content in the order in which it was given to us.
+ */
+void
+Film::examine_finished ()
+{
+	while (!_examining.empty ()) {
+		shared_ptr<Job> j = _examining.front().first.lock ();
+		if (j && !j->finished ()) {
+			break;
+		}
+
+		boost::function<void ()> f = _examining.front().second;
+		_examining.pop_front ();
+		f ();
+	}
+}
+
 void
 Film::maybe_add_content (weak_ptr<Job> j, weak_ptr<Content> c, bool disable_audio_analysis)
 {
@@ -1199,35 +1228,13 @@ Film::frame_size () const
 	return fit_ratio_within (container()->ratio(), full_frame ());
 }
 
-/** @param recipient KDM recipient certificate.
- *  @param trusted_devices Certificates of other trusted devices (can be empty).
- *  @param cpl_file CPL filename.
- *  @param from KDM from time expressed as a local time with an offset from UTC.
- *  @param until KDM to time expressed as a local time with an offset from UTC.
- *  @param formulation KDM formulation to use.
+/** Find the keys that a KDM for a CPL should contain.
+ *  @param cpl CPL that the KDM is for.
+ *  @return Key for each encrypted asset in the CPL.
  */
-dcp::EncryptedKDM
-Film::make_kdm (
-	dcp::Certificate recipient,
-	vector<dcp::Certificate> trusted_devices,
-	boost::filesystem::path cpl_file,
-	dcp::LocalTime from,
-	dcp::LocalTime until,
-	dcp::Formulation formulation,
-	int disable_forensic_marking_picture,
-	int disable_forensic_marking_audio
-	) const
+map<shared_ptr<const dcp::ReelMXF>, dcp::Key>
+Film::kdm_keys (shared_ptr<const dcp::CPL> cpl) const
 {
-	if (!_encrypted) {
-		throw runtime_error (_("Cannot make a KDM as this project is not encrypted."));
-	}
-
-	shared_ptr<const dcp::CPL> cpl (new dcp::CPL (cpl_file));
-	shared_ptr<const dcp::CertificateChain> signer = Config::instance()->signer_chain ();
-	if (!signer->valid ()) {
-		throw InvalidSignerError ();
-	}
-
 	/* Find keys that have been added to imported, encrypted DCP content */
 	list<dcp::DecryptedKDMKey> imported_keys;
 	BOOST_FOREACH (shared_ptr<Content> i, content()) {
@@ -1264,16 +1271,129 @@ Film::make_kdm (
 		}
 	}
 
+	return keys;
+}
+
+/** Make and encrypt a KDM.  This only uses its parameters, so it can be called from any thread */
+static dcp::EncryptedKDM
+encrypt_kdm (
+	shared_ptr<const dcp::CPL> cpl,
+	map<shared_ptr<const dcp::ReelMXF>, dcp::Key> const & keys,
+	shared_ptr<const dcp::CertificateChain> signer,
+	dcp::Certificate recipient,
+	vector<dcp::Certificate> trusted_devices,
+	dcp::LocalTime from,
+	dcp::LocalTime until,
+	dcp::Formulation formulation,
+	int disable_forensic_marking_picture,
+	int disable_forensic_marking_audio
+	)
+{
 	return dcp::DecryptedKDM (
 		cpl->id(), keys, from, until, cpl->content_title_text(), cpl->content_title_text(), dcp::LocalTime().as_string()
 		).encrypt (signer, recipient, trusted_devices, formulation, disable_forensic_marking_picture, disable_forensic_marking_audio);
 }
 
+/** @param recipient KDM recipient certificate.
+ *  @param trusted_devices Certificates of other trusted devices (can be empty).
+ *  @param cpl_file CPL filename.
+ *  @param from KDM from time expressed as a local time with an offset from UTC.
+ *  @param until KDM to time expressed as a local time with an offset from UTC.
+ *  @param formulation KDM formulation to use.
+ */
+dcp::EncryptedKDM
+Film::make_kdm (
+	dcp::Certificate recipient,
+	vector<dcp::Certificate> trusted_devices,
+	boost::filesystem::path cpl_file,
+	dcp::LocalTime from,
+	dcp::LocalTime until,
+	dcp::Formulation formulation,
+	int disable_forensic_marking_picture,
+	int disable_forensic_marking_audio
+	) const
+{
+	if (!_encrypted) {
+		throw runtime_error (_("Cannot make a KDM as this project is not encrypted."));
+	}
+
+	shared_ptr<const dcp::CPL> cpl (new dcp::CPL (cpl_file));
+	shared_ptr<const dcp::CertificateChain> signer = Config::instance()->signer_chain ();
+	if (!signer->valid ()) {
+		throw InvalidSignerError ();
+	}
+
+	return encrypt_kdm (
+		cpl, kdm_keys (cpl), signer, recipient, trusted_devices, from, until,
+		formulation, disable_forensic_marking_picture, disable_forensic_marking_audio
+		);
+}
+
+/** @class ScreenKDMMaker
+ *  @brief Helper for Film::make_kdms() which makes the KDMs for a list of screens
+ *  using several threads.
+ *
+ *  Everything which is the same for every screen is set up once in the constructor;
+ *  make() then does the encryption and signing for one screen.
+ */
+class ScreenKDMMaker : public ExceptionStore
+{
+public:
+	ScreenKDMMaker (
+		shared_ptr<const dcp::CPL> cpl,
+		map<shared_ptr<const dcp::ReelMXF>, dcp::Key> keys,
+		shared_ptr<const dcp::CertificateChain> signer,
+		boost::posix_time::ptime from,
+		boost::posix_time::ptime until,
+		dcp::Formulation formulation,
+		int disable_forensic_marking_picture,
+		int disable_forensic_marking_audio
+		)
+		: _cpl (cpl)
+		, _keys (keys)
+		, _signer (signer)
+		, _from (from)
+		, _until (until)
+		, _formulation (formulation)
+		, _disable_forensic_marking_picture (disable_forensic_marking_picture)
+		, _disable_forensic_marking_audio (disable_forensic_marking_audio)
+	{}
+
+	/** Make the KDM for one screen.
+	 *  @param screen Screen; must have a recipient.
+	 *  @param kdm Filled in with the KDM.
+	 */
+	void make (shared_ptr<Screen> screen, optional<dcp::EncryptedKDM>* kdm)
+	{
+		try {
+			*kdm = encrypt_kdm (
+				_cpl, _keys, _signer, screen->recipient.get(), screen->trusted_devices,
+				dcp::LocalTime (_from, screen->cinema->utc_offset_hour(), screen->cinema->utc_offset_minute()),
+				dcp::LocalTime (_until, screen->cinema->utc_offset_hour(), screen->cinema->utc_offset_minute()),
+				_formulation, _disable_forensic_marking_picture, _disable_forensic_marking_audio
+				);
+		} catch (...) {
+			store_current ();
+		}
+	}
+
+private:
+	shared_ptr<const dcp::CPL> _cpl;
+	map<shared_ptr<const dcp::ReelMXF>, dcp::Key> _keys;
+	shared_ptr<const dcp::CertificateChain> _signer;
+	boost::posix_time::ptime _from;
+	boost::posix_time::ptime _until;
+	dcp::Formulation _formulation;
+	int _disable_forensic_marking_picture;
+	int _disable_forensic_marking_audio;
+};
+
 /** @param screens Screens to make KDMs for.
  *  @param cpl_file Path to CPL to make KDMs for.
  *  @param from KDM from time expressed as a local time in the time zone of the Screen's Cinema.
  *  @param until KDM to time expressed as a local time in the time zone of the Screen's Cinema.
  *  @param formulation KDM formulation to use.
+ *  @return KDMs, in the same order as the screens that they are for.
  */
 list<ScreenKDM>
 Film::make_kdms (
@@ -1286,26 +1406,65 @@ Film::make_kdms (
 	int disable_forensic_marking_audio
 	) const
 {
-	list<ScreenKDM> kdms;
-
+	vector<shared_ptr<Screen> > with_recipients;
 	BOOST_FOREACH (shared_ptr<Screen> i, screens) {
 		if (i->recipient) {
-			dcp::EncryptedKDM const kdm = make_kdm (
-				i->recipient.get(),
-				i->trusted_devices,
-				cpl_file,
-				dcp::LocalTime (from, i->cinema->utc_offset_hour(), i->cinema->utc_offset_minute()),
-				dcp::LocalTime (until, i->cinema->utc_offset_hour(), i->cinema->utc_offset_minute()),
-				formulation,
-				disable_forensic_marking_picture,
-				disable_forensic_marking_audio
-				);
-
-			kdms.push_back (ScreenKDM (i, kdm));
+			with_recipients.push_back (i);
 		}
 	}
 
-	return kdms;
+	if (with_recipients.empty ()) {
+		return list<ScreenKDM> ();
+	}
+
+	if (!_encrypted) {
+		throw runtime_error (_("Cannot make a KDM as this project is not encrypted."));
+	}
+
+	/* Read the CPL, find the keys and check the signer once, rather than for every screen */
+	shared_ptr<const dcp::CPL> cpl (new dcp::CPL (cpl_file));
+	shared_ptr<const dcp::CertificateChain> signer = Config::instance()->signer_chain ();
+	if (!signer->valid ()) {
+		throw InvalidSignerError ();
+	}
+
+	ScreenKDMMaker maker (
+		cpl, kdm_keys (cpl), signer, from, until, formulation, disable_forensic_marking_picture, disable_forensic_marking_audio
+		);
+
+	/* Each thread writes its KDM into its own slot of this vector, so the output order
+	   does not depend on which thread finishes first.
+	*/
+	vector<optional<dcp::EncryptedKDM> > kdms (with_recipients.size ());
+
+	boost::asio::io_service service;
+	boost::thread_group pool;
+
+	shared_ptr<boost::asio::io_service::work> work (new boost::asio::io_service::work (service));
+
+	int const threads = max (1, min (Config::instance()->master_encoding_threads (), int (with_recipients.size ())));
+
+	for (int i = 0; i < threads; ++i) {
+		pool.create_thread (boost::bind (&boost::asio::io_service::run, &service));
+	}
+
+	for (size_t i = 0; i < with_recipients.size(); ++i) {
+		service.post (boost::bind (&ScreenKDMMaker::make, &maker, with_recipients[i], &kdms[i]));
+	}
+
+	work.reset ();
+	pool.join_all ();
+	service.stop ();
+
+	maker.rethrow ();
+
+	list<ScreenKDM> screen_kdms;
+	for (size_t i = 0; i < with_recipients.size(); ++i) {
+		DCPOMATIC_ASSERT (kdms[i]);
+		screen_kdms.push_back (ScreenKDM (with_recipients[i], kdms[i].get ()));
+	}
+
+	return screen_kdms;
 }
 
 /** @return The approximate disk space required to encode a DCP of this film with the
@@ -1314,13 +1473,25 @@ Film::make_kdms (
 uint64_t
 Film::required_disk_space () const
 {
-	return _playlist->required_disk_space (j2k_bandwidth(), audio_channels(), audio_frame_rate());
+	uint64_t space = _playlist->required_disk_space (j2k_bandwidth(), audio_channels(), audio_frame_rate());
+
+	Config* config = Config::instance ();
+	if (config->servers_encode_reels() || (config->local_reel_encoders() > 1 && reels().size() > 1)) {
+		/* Reels will be encoded to J2C files before they are written to the DCP, and
+		   at worst all of those files could be on disk at once.
+		*/
+		space += _playlist->required_disk_space (j2k_bandwidth(), 0, audio_frame_rate()) - 65536;
+	}
+
+	return space;
 }
 
 /** This method checks the disk that the Film is on and tries to decide whether or not
  *  there will be enough space to make a DCP for it.  If so, true is returned; if not,
  *  false is returned and required and available are filled in with the amount of disk space
- *  required and available respectively (in Gb).
+ *  required and available respectively (in Gb).  can_hard_link is set to true if the DCP's
+ *  picture assets can share storage with our intermediate files, either by hard-linking
+ *  or by cloning them.
  *
  *  Note: the decision made by this method isn't, of course, 100% reliable.
  */
@@ -1337,7 +1508,8 @@ Film::should_be_enough_disk_space (double& required, double& available, bool& ca
 		boost::system::error_code ec;
 		boost::filesystem::create_hard_link (test, test2, ec);
 		if (ec) {
-			can_hard_link = false;
+			/* A copy-on-write clone will be used instead of a hard link if possible */
+			can_hard_link = clone_file (test, test2);
 		}
 		boost::filesystem::remove (test);
 		boost::filesystem::remove (test2);
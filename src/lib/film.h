@@ -38,12 +38,18 @@
 #include <boost/filesystem.hpp>
 #include <string>
 #include <vector>
+#include <map>
 #include <inttypes.h>
 
 namespace xmlpp {
 	class Document;
 }
 
+namespace dcp {
+	class CPL;
+	class ReelMXF;
+}
+
 class DCPContentType;
 class Log;
 class Content;
@@ -71,7 +77,7 @@ public:
 	~Film ();
 
 	boost::filesystem::path info_file (DCPTimePeriod p) const;
-	boost::filesystem::path j2c_path (int, Frame, Eyes, bool) const;
+	boost::filesystem::path j2c_path (DCPTimePeriod, Frame, Eyes, bool) const;
 	boost::filesystem::path internal_video_asset_dir () const;
 	boost::filesystem::path internal_video_asset_filename (DCPTimePeriod p) const;
 
@@ -342,7 +348,9 @@ private:
 	void playlist_order_changed ();
 	void playlist_content_changed (boost::weak_ptr<Content>, int, bool frequent);
 	void maybe_add_content (boost::weak_ptr<Job>, boost::weak_ptr<Content>, bool disable_audio_analysis);
+	void examine_finished ();
 	void audio_analysis_finished ();
+	std::map<boost::shared_ptr<const dcp::ReelMXF>, dcp::Key> kdm_keys (boost::shared_ptr<const dcp::CPL> cpl) const;
 
 	static std::string const metadata_file;
 
@@ -405,6 +413,10 @@ private:
 	boost::signals2::scoped_connection _playlist_order_changed_connection;
 	boost::signals2::scoped_connection _playlist_content_changed_connection;
 	std::list<boost::signals2::connection> _job_connections;
+	/** Examinations started by examine_and_add_content, in the order that their
+	 *  content should be added, with the thing to call when each one finishes.
+	 */
+	std::list<std::pair<boost::weak_ptr<Job>, boost::function<void ()> > > _examining;
 	std::list<boost::signals2::connection> _audio_analysis_connections;
 
 	friend struct paths_test;
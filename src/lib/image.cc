@@ -28,6 +28,7 @@
 #include "rect.h"
 #include "util.h"
 #include "dcpomatic_socket.h"
+#include "digester.h"
 #include <dcp/rgb_xyz.h>
 #include <dcp/transfer_function.h>
 extern "C" {
@@ -48,6 +49,7 @@ using std::cerr;
 using std::list;
 using std::runtime_error;
 using boost::shared_ptr;
+using boost::optional;
 using dcp::Size;
 
 int
@@ -123,11 +125,6 @@ Image::crop_scale_window (
 	Crop crop, dcp::Size inter_size, dcp::Size out_size, dcp::YUVToRGB yuv_to_rgb, AVPixelFormat out_format, bool out_aligned, bool fast
 	) const
 {
-	/* Empirical testing suggests that sws_scale() will crash if
-	   the input image is not aligned.
-	*/
-	DCPOMATIC_ASSERT (aligned ());
-
 	DCPOMATIC_ASSERT (out_size.width >= inter_size.width);
 	DCPOMATIC_ASSERT (out_size.height >= inter_size.height);
 
@@ -154,19 +151,58 @@ Image::crop_scale_window (
 	*/
 
 	shared_ptr<Image> out (new Image (out_format, out_size, out_aligned, (out_size.width - inter_size.width) / 2));
+	crop_scale_window (crop, inter_size, yuv_to_rgb, fast, out, 0);
+	return out;
+}
+
+/** Crop this image, scale it to `inter_size' and then place it in the middle of an existing
+ *  image, which is made black around the scaled image.  This is the same as the other
+ *  crop_scale_window() except that it does not allocate anything, so it can be used to
+ *  draw successive frames into the same buffer.
+ *  @param crop Amount to crop by.
+ *  @param inter_size Size to scale the cropped image to.
+ *  @param yuv_to_rgb YUV to RGB transformation to use, if required.
+ *  @param fast Try to be fast at the possible expense of quality.
+ *  @param out Image to write to; it must be at least as big as inter_size, and must have been
+ *  created with enough extra_pixels to cover the padding (see the other crop_scale_window()).
+ *  @param scale_context If this is non-0 it points to a SwsContext which is re-used if possible
+ *  (or replaced if not); the caller must sws_freeContext() it when it is finished with it.
+ *  If it is 0 a context will be created and freed here.
+ */
+void
+Image::crop_scale_window (
+	Crop crop, dcp::Size inter_size, dcp::YUVToRGB yuv_to_rgb, bool fast, shared_ptr<Image> out, struct SwsContext** scale_context
+	) const
+{
+	/* Empirical testing suggests that sws_scale() will crash if
+	   the input image is not aligned.
+	*/
+	DCPOMATIC_ASSERT (aligned ());
+
+	dcp::Size const out_size = out->size ();
+	DCPOMATIC_ASSERT (out_size.width >= inter_size.width);
+	DCPOMATIC_ASSERT (out_size.height >= inter_size.height);
+	DCPOMATIC_ASSERT (out->_extra_pixels >= (out_size.width - inter_size.width) / 2);
+
 	out->make_black ();
 
 	/* Size of the image after any crop */
 	dcp::Size const cropped_size = crop.apply (size ());
 
 	/* Scale context for a scale from cropped_size to inter_size */
-	struct SwsContext* scale_context = sws_getContext (
+	struct SwsContext* context = sws_getCachedContext (
+			scale_context ? *scale_context : 0,
 			cropped_size.width, cropped_size.height, pixel_format(),
-			inter_size.width, inter_size.height, out_format,
+			inter_size.width, inter_size.height, out->pixel_format(),
 			fast ? SWS_FAST_BILINEAR : SWS_BICUBIC, 0, 0, 0
 		);
 
-	if (!scale_context) {
+	if (scale_context) {
+		/* sws_getCachedContext frees the old context if it could not be re-used */
+		*scale_context = context;
+	}
+
+	if (!context) {
 		throw runtime_error (N_("Could not allocate SwsContext"));
 	}
 
@@ -177,7 +213,7 @@ Image::crop_scale_window (
 	};
 
 	sws_setColorspaceDetails (
-		scale_context,
+		context,
 		sws_getCoefficients (lut[yuv_to_rgb]), 0,
 		sws_getCoefficients (lut[yuv_to_rgb]), 0,
 		0, 1 << 16, 1 << 16
@@ -209,15 +245,15 @@ Image::crop_scale_window (
 	}
 
 	sws_scale (
-		scale_context,
+		context,
 		scale_in_data, stride(),
 		0, cropped_size.height,
 		scale_out_data, out->stride()
 		);
 
-	sws_freeContext (scale_context);
-
-	return out;
+	if (!scale_context) {
+		sws_freeContext (context);
+	}
 }
 
 shared_ptr<Image>
@@ -974,6 +1010,68 @@ merge (list<PositionImage> images)
 	return PositionImage (merged, all.position ());
 }
 
+/** Reduce a BGRA PositionImage to the smallest rectangle which contains all
+ *  its non-transparent pixels, so that blending it costs time in proportion
+ *  to its visible area rather than to the size of the canvas it was drawn on.
+ *  @return Trimmed image positioned so that it appears in the same place as the original,
+ *  or an empty optional if the image is entirely transparent.
+ */
+optional<PositionImage>
+trim_transparent (PositionImage image)
+{
+	shared_ptr<const Image> in = image.image;
+	DCPOMATIC_ASSERT (in->pixel_format() == AV_PIX_FMT_BGRA);
+
+	int const width = in->size().width;
+	int const height = in->size().height;
+
+	int left = width;
+	int right = -1;
+	int top = height;
+	int bottom = -1;
+
+	for (int y = 0; y < height; ++y) {
+		uint8_t const * p = in->data()[0] + y * in->stride()[0] + 3;
+		int first = -1;
+		int last = -1;
+		for (int x = 0; x < width; ++x) {
+			if (*p) {
+				if (first == -1) {
+					first = x;
+				}
+				last = x;
+			}
+			p += 4;
+		}
+
+		if (first != -1) {
+			left = min (left, first);
+			right = max (right, last);
+			top = min (top, y);
+			bottom = y;
+		}
+	}
+
+	if (right == -1) {
+		return optional<PositionImage> ();
+	}
+
+	if (left == 0 && top == 0 && right == (width - 1) && bottom == (height - 1)) {
+		return image;
+	}
+
+	shared_ptr<Image> out (new Image (AV_PIX_FMT_BGRA, dcp::Size (right - left + 1, bottom - top + 1), true));
+	for (int y = top; y <= bottom; ++y) {
+		memcpy (
+			out->data()[0] + (y - top) * out->stride()[0],
+			in->data()[0] + y * in->stride()[0] + left * 4,
+			out->line_size()[0]
+			);
+	}
+
+	return PositionImage (out, image.position + Position<int> (left, top));
+}
+
 bool
 operator== (Image const & a, Image const & b)
 {
@@ -1137,3 +1235,24 @@ Image::memory_used () const
 	}
 	return m;
 }
+
+/** @return A digest of this image's format, size and pixel data (ignoring any alignment padding) */
+string
+Image::digest () const
+{
+	Digester digester;
+	digester.add (static_cast<int> (_pixel_format));
+	digester.add (_size.width);
+	digester.add (_size.height);
+
+	for (int c = 0; c < planes(); ++c) {
+		uint8_t* p = data()[c];
+		int const lines = sample_size(c).height;
+		for (int y = 0; y < lines; ++y) {
+			digester.add (p, line_size()[c]);
+			p += stride()[c];
+		}
+	}
+
+	return digester.get ();
+}
@@ -33,8 +33,10 @@ extern "C" {
 }
 #include <dcp/colour_conversion.h>
 #include <boost/shared_ptr.hpp>
+#include <boost/optional.hpp>
 
 struct AVFrame;
+struct SwsContext;
 class Socket;
 
 class Image
@@ -64,6 +66,9 @@ public:
 	boost::shared_ptr<Image> crop_scale_window (
 		Crop crop, dcp::Size inter_size, dcp::Size out_size, dcp::YUVToRGB yuv_to_rgb, AVPixelFormat out_format, bool aligned, bool fast
 		) const;
+	void crop_scale_window (
+		Crop crop, dcp::Size inter_size, dcp::YUVToRGB yuv_to_rgb, bool fast, boost::shared_ptr<Image> out, struct SwsContext** scale_context
+		) const;
 
 	void make_black ();
 	void make_transparent ();
@@ -79,6 +84,7 @@ public:
 	}
 
 	size_t memory_used () const;
+	std::string digest () const;
 
 	static boost::shared_ptr<Image> ensure_aligned (boost::shared_ptr<Image> image);
 
@@ -100,6 +106,7 @@ private:
 };
 
 extern PositionImage merge (std::list<PositionImage> images);
+extern boost::optional<PositionImage> trim_transparent (PositionImage image);
 extern bool operator== (Image const & a, Image const & b);
 
 #endif
@@ -29,19 +29,153 @@
 #include "video_content.h"
 #include <Magick++.h>
 #include <boost/filesystem.hpp>
+#include <boost/bind.hpp>
 #include <iostream>
 
 #include "i18n.h"
 
 using std::cout;
+using std::min;
+using std::max;
 using boost::shared_ptr;
+using boost::bind;
 using dcp::Size;
 
+/** Maximum number of frames of a moving image sequence to read ahead */
+static Frame const prefetch_frames = 16;
+/** Maximum number of bytes of prefetched images to hold */
+static size_t const prefetch_bytes = 512 * 1024 * 1024;
+
 ImageDecoder::ImageDecoder (shared_ptr<const ImageContent> c, shared_ptr<Log> log)
 	: _image_content (c)
 	, _frame_video_position (0)
+	, _prefetched_bytes (0)
+	, _prefetch_next (0)
+	, _prefetch_generation (0)
 {
 	video.reset (new VideoDecoder (this, c, log));
+
+	if (!_image_content->still ()) {
+		/* Reading a sequence is often limited by the latency of the storage that it is on,
+		   so use a few threads to have several files on the way at once.
+		*/
+		_prefetch_work.reset (new boost::asio::io_service::work (_prefetch_service));
+		/* hardware_concurrency() returns 0 if it cannot find out, but we always need at least one thread */
+		for (size_t i = 0; i < min (4U, max (1U, boost::thread::hardware_concurrency())); ++i) {
+			_prefetch_pool.create_thread (bind (&boost::asio::io_service::run, &_prefetch_service));
+		}
+	}
+}
+
+ImageDecoder::~ImageDecoder ()
+{
+	{
+		boost::mutex::scoped_lock lm (_prefetch_mutex);
+		/* Make any queued prefetches give up without doing anything */
+		++_prefetch_generation;
+	}
+
+	_prefetch_work.reset ();
+	_prefetch_pool.join_all ();
+	_prefetch_service.stop ();
+}
+
+/** Load the image for a frame from disk; this may be called from any thread */
+shared_ptr<ImageProxy>
+ImageDecoder::load (Frame frame) const
+{
+	boost::filesystem::path path = _image_content->path (_image_content->still() ? 0 : frame);
+	if (valid_j2k_file (path)) {
+		AVPixelFormat pf;
+		if (_image_content->video->colour_conversion()) {
+			/* We have a specified colour conversion: assume the image is RGB */
+			pf = AV_PIX_FMT_RGB48LE;
+		} else {
+			/* No specified colour conversion: assume the image is XYZ */
+			pf = AV_PIX_FMT_XYZ12LE;
+		}
+		/* We can't extract image size from a JPEG2000 codestream without decoding it,
+		   so pass in the image content's size here.
+		*/
+		return shared_ptr<ImageProxy> (new J2KImageProxy (path, _image_content->video->size(), pf));
+	}
+
+	return shared_ptr<ImageProxy> (new MagickImageProxy (path));
+}
+
+/** Called in one of the prefetch threads to load a frame */
+void
+ImageDecoder::prefetch (Frame frame, int generation)
+{
+	{
+		boost::mutex::scoped_lock lm (_prefetch_mutex);
+		if (generation != _prefetch_generation) {
+			return;
+		}
+	}
+
+	shared_ptr<ImageProxy> image;
+	try {
+		image = load (frame);
+	} catch (...) {
+		/* Leave image empty; pass() will try again and report the error in its own thread */
+	}
+
+	boost::mutex::scoped_lock lm (_prefetch_mutex);
+	if (generation != _prefetch_generation) {
+		return;
+	}
+
+	_prefetched[frame] = image;
+	if (image) {
+		_prefetched_bytes += image->memory_used ();
+	}
+	_prefetch_condition.notify_all ();
+}
+
+/** Get the image for a frame of a moving image sequence, from the prefetch
+ *  threads if possible, and start the loading of some following frames.
+ */
+shared_ptr<ImageProxy>
+ImageDecoder::get (Frame frame)
+{
+	boost::mutex::scoped_lock lm (_prefetch_mutex);
+
+	_prefetch_next = max (_prefetch_next, frame);
+	Frame const end = min (frame + prefetch_frames, _image_content->video->length());
+	while (_prefetch_next < end && (_prefetch_next == frame || _prefetched_bytes < prefetch_bytes)) {
+		_prefetch_service.post (bind (&ImageDecoder::prefetch, this, _prefetch_next, _prefetch_generation));
+		++_prefetch_next;
+	}
+
+	std::map<Frame, shared_ptr<ImageProxy> >::iterator i = _prefetched.find (frame);
+	while (i == _prefetched.end ()) {
+		_prefetch_condition.wait (lm);
+		i = _prefetched.find (frame);
+	}
+
+	shared_ptr<ImageProxy> image = i->second;
+	_prefetched.erase (i);
+	if (image) {
+		_prefetched_bytes -= image->memory_used ();
+	}
+
+	/* Anything before this frame will never be used */
+	while (!_prefetched.empty() && _prefetched.begin()->first < frame) {
+		if (_prefetched.begin()->second) {
+			_prefetched_bytes -= _prefetched.begin()->second->memory_used ();
+		}
+		_prefetched.erase (_prefetched.begin ());
+	}
+
+	lm.unlock ();
+
+	if (!image) {
+		/* Prefetch failed; try again here so that any exception is thrown in the right place */
+		image = load (frame);
+	}
+
+	return image;
 }
 
 bool
@@ -51,25 +185,10 @@ ImageDecoder::pass ()
 		return true;
 	}
 
-	if (!_image_content->still() || !_image) {
-		/* Either we need an image or we are using moving images, so load one */
-		boost::filesystem::path path = _image_content->path (_image_content->still() ? 0 : _frame_video_position);
-		if (valid_j2k_file (path)) {
-			AVPixelFormat pf;
-			if (_image_content->video->colour_conversion()) {
-				/* We have a specified colour conversion: assume the image is RGB */
-				pf = AV_PIX_FMT_RGB48LE;
-			} else {
-				/* No specified colour conversion: assume the image is XYZ */
-				pf = AV_PIX_FMT_XYZ12LE;
-			}
-			/* We can't extract image size from a JPEG2000 codestream without decoding it,
-			   so pass in the image content's size here.
-			*/
-			_image.reset (new J2KImageProxy (path, _image_content->video->size(), pf));
-		} else {
-			_image.reset (new MagickImageProxy (path));
-		}
+	if (!_image_content->still()) {
+		_image = get (_frame_video_position);
+	} else if (!_image) {
+		_image = load (0);
 	}
 
 	video->emit (_image, _frame_video_position);
@@ -82,4 +201,10 @@ ImageDecoder::seek (ContentTime time, bool accurate)
 {
 	Decoder::seek (time, accurate);
 	_frame_video_position = time.frames_round (_image_content->active_video_frame_rate ());
+
+	boost::mutex::scoped_lock lm (_prefetch_mutex);
+	++_prefetch_generation;
+	_prefetched.clear ();
+	_prefetched_bytes = 0;
+	_prefetch_next = _frame_video_position;
 }
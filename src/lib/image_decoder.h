@@ -19,6 +19,10 @@
 */
 
 #include "decoder.h"
+#include <boost/thread.hpp>
+#include <boost/thread/condition.hpp>
+#include <boost/asio.hpp>
+#include <map>
 
 class ImageContent;
 class Log;
@@ -28,6 +32,7 @@ class ImageDecoder : public Decoder
 {
 public:
 	ImageDecoder (boost::shared_ptr<const ImageContent> c, boost::shared_ptr<Log> log);
+	~ImageDecoder ();
 
 	boost::shared_ptr<const ImageContent> content () {
 		return _image_content;
@@ -37,8 +42,30 @@ public:
 	void seek (ContentTime, bool);
 
 private:
+	boost::shared_ptr<ImageProxy> load (Frame frame) const;
+	boost::shared_ptr<ImageProxy> get (Frame frame);
+	void prefetch (Frame frame, int generation);
 
 	boost::shared_ptr<const ImageContent> _image_content;
 	boost::shared_ptr<ImageProxy> _image;
 	Frame _frame_video_position;
+
+	/** Threads used to read files from moving image sequences ahead of when we need them */
+	boost::thread_group _prefetch_pool;
+	boost::asio::io_service _prefetch_service;
+	boost::shared_ptr<boost::asio::io_service::work> _prefetch_work;
+
+	/** mutex to protect _prefetched, _prefetched_bytes, _prefetch_next and _prefetch_generation */
+	mutable boost::mutex _prefetch_mutex;
+	boost::condition _prefetch_condition;
+	/** Images that have been loaded by the prefetch threads, indexed by frame.  An
+	 *  empty pointer means that the load failed and should be tried again in pass().
+	 */
+	std::map<Frame, boost::shared_ptr<ImageProxy> > _prefetched;
+	/** Total memory used by the images in _prefetched */
+	size_t _prefetched_bytes;
+	/** Next frame that should be given to the prefetch threads */
+	Frame _prefetch_next;
+	/** Incremented on each seek so that prefetches which were started before it can be ignored */
+	int _prefetch_generation;
 };
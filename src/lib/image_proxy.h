@@ -60,20 +60,44 @@ class ImageProxy : public boost::noncopyable
 public:
 	virtual ~ImageProxy () {}
 
+	class Result
+	{
+	public:
+		Result (boost::shared_ptr<Image> image_, int log2_scaling_)
+			: image (image_)
+			, log2_scaling (log2_scaling_)
+		{}
+
+		/** Image (which will be aligned) */
+		boost::shared_ptr<Image> image;
+		/** log2 of any scaling down that has already been applied to the image;
+		 *  e.g. if the image is already half the size of the original, this value
+		 *  will be 1.
+		 */
+		int log2_scaling;
+	};
+
 	/** @param note Handler for any notes that occur.
 	 *  @param size Size that the returned image will be scaled to, in case this
-	 *  can be used as an optimisation.
-	 *  @return Image (which must be aligned)
+	 *  can be used as an optimisation; the image may be decoded at a smaller size
+	 *  than the original, but it will be no smaller than this.
+	 *  @param fast true if the image is only for a preview, so that some quality may be
+	 *  traded for speed.
 	 */
-	virtual boost::shared_ptr<Image> image (
+	virtual Result image (
 		boost::optional<dcp::NoteHandler> note = boost::optional<dcp::NoteHandler> (),
-		boost::optional<dcp::Size> size = boost::optional<dcp::Size> ()
+		boost::optional<dcp::Size> size = boost::optional<dcp::Size> (),
+		bool fast = false
 		) const = 0;
 
 	virtual void add_metadata (xmlpp::Node *) const = 0;
 	virtual void send_binary (boost::shared_ptr<Socket>) const = 0;
 	/** @return true if our image is definitely the same as another, false if it is probably not */
 	virtual bool same (boost::shared_ptr<const ImageProxy>) const = 0;
+	/** @return A digest of our source image data, so that two proxies with the same
+	 *  digest will give the same image.
+	 */
+	virtual std::string digest () const = 0;
 	/** Do any useful work that would speed up a subsequent call to ::image().
 	 *  This method may be called in a different thread to image().
 	 */
@@ -34,7 +34,10 @@
 #include "player.h"
 #include "player_video.h"
 #include "encode_server_description.h"
+#include "j2k_frame_cache.h"
 #include "compose.hpp"
+#include "metrics.h"
+#include <dcp/raw_convert.h>
 #include <libcxml/cxml.h>
 #include <boost/foreach.hpp>
 #include <iostream>
@@ -49,10 +52,24 @@
 
 using std::list;
 using std::cout;
+using std::string;
+using std::map;
+using std::pair;
+using std::make_pair;
 using boost::shared_ptr;
 using boost::weak_ptr;
 using boost::optional;
 using dcp::Data;
+using dcp::raw_convert;
+
+/** Number of recently-encoded frames that we keep so that identical frames later on
+ *  (e.g. a still image which appears several times) need not be encoded again.  Frames
+ *  which are still being encoded are kept as well as these.
+ */
+#define RECENT_FRAMES 16
+
+boost::mutex J2KEncoder::_black_frames_mutex;
+map<string, Data> J2KEncoder::_black_frames;
 
 /** @param film Film that we are encoding.
  *  @param writer Writer that we are using.
@@ -62,6 +79,15 @@ J2KEncoder::J2KEncoder (shared_ptr<const Film> film, shared_ptr<Writer> writer)
 	, _history (200)
 	, _writer (writer)
 {
+	optional<boost::filesystem::path> cache = Config::instance()->j2k_frame_cache_directory ();
+	if (cache) {
+		try {
+			_frame_cache.reset (new J2KFrameCache (cache.get(), uint64_t (Config::instance()->j2k_frame_cache_size()) * 1024 * 1024 * 1024));
+		} catch (std::exception& e) {
+			LOG_ERROR (N_("Could not open JPEG2000 frame cache in %1 (%2)"), cache->string(), e.what());
+		}
+	}
+
 	servers_list_changed ();
 }
 
@@ -133,11 +159,7 @@ J2KEncoder::end ()
 	for (list<shared_ptr<DCPVideo> >::iterator i = _queue.begin(); i != _queue.end(); ++i) {
 		LOG_GENERAL (N_("Encode left-over frame %1"), (*i)->index ());
 		try {
-			_writer->write (
-				(*i)->encode_locally (boost::bind (&Log::dcp_log, _film->log().get(), _1, _2)),
-				(*i)->index (),
-				(*i)->eyes ()
-				);
+			write (*i, (*i)->encode_locally (boost::bind (&Log::dcp_log, _film->log().get(), _1, _2)));
 			frame_done ();
 		} catch (std::exception& e) {
 			LOG_ERROR (N_("Local encode failed (%1)"), e.what ());
@@ -145,6 +167,126 @@ J2KEncoder::end ()
 	}
 }
 
+/** Give a newly-encoded frame to the writer, along with any identical frames which are waiting for it,
+ *  and keep a copy in the frame cache if we have one.
+ */
+void
+J2KEncoder::write (shared_ptr<const DCPVideo> frame, Data encoded)
+{
+	_writer->write (encoded, frame->index (), frame->eyes ());
+
+	if (frame->black ()) {
+		optional<string> digest = frame->digest ();
+		if (digest) {
+			boost::mutex::scoped_lock lm (_black_frames_mutex);
+			_black_frames[digest.get()] = encoded;
+		}
+	}
+
+	if (_frame_cache) {
+		optional<string> digest = frame->digest ();
+		if (digest) {
+			_frame_cache->put (digest.get (), encoded);
+		}
+	}
+
+	if (frame->black ()) {
+		/* Black frames never go into _recent */
+		return;
+	}
+
+	/* Keep the data for any identical frames that come later, and write it for
+	   those which came along while this one was being encoded.
+	*/
+	string const digest = frame->image_digest ();
+
+	list<pair<int, Eyes> > copies;
+	{
+		boost::mutex::scoped_lock lm (_recent_mutex);
+		list<RecentFrame>::iterator i = _recent.begin ();
+		while (i != _recent.end() && i->digest != digest) {
+			++i;
+		}
+		if (i != _recent.end () && !i->encoded) {
+			i->encoded = encoded;
+			copies.swap (i->copies);
+		}
+		trim_recent ();
+	}
+
+	for (list<pair<int, Eyes> >::const_iterator i = copies.begin(); i != copies.end(); ++i) {
+		_writer->write (encoded, i->first, i->second);
+		frame_done ();
+	}
+}
+
+/** Remove the least recently used encoded frames from _recent so that there are no more than
+ *  RECENT_FRAMES of them.  Frames which are still being encoded are kept.  _recent_mutex must be held.
+ */
+void
+J2KEncoder::trim_recent ()
+{
+	size_t encoded = 0;
+	for (list<RecentFrame>::iterator i = _recent.begin(); i != _recent.end(); ) {
+		list<RecentFrame>::iterator j = i;
+		++i;
+		if (j->encoded && ++encoded > RECENT_FRAMES) {
+			_recent.erase (j);
+		}
+	}
+}
+
+/** Deal with a frame which is the same as one that we have recently encoded, or are encoding now,
+ *  without encoding it again.  If the other frame has been encoded its data is written for this frame
+ *  straight away; otherwise this frame is written when the other one has been encoded.  If there is
+ *  no such frame, this one is noted as being encoded so that later ones can use it.
+ *
+ *  Frames are matched by DCPVideo::image_digest() rather than by DCPVideo::digest(), as the latter
+ *  includes the position of the frame in its content, so the same still image at two different
+ *  times would never match.  Working out the image digest may mean looking at every pixel, so this
+ *  is called from the encoder threads rather than from ::encode().
+ *
+ *  @return true if the frame has been dealt with, false if it must be encoded.
+ */
+bool
+J2KEncoder::reuse_recent (shared_ptr<const DCPVideo> frame)
+{
+	string const digest = frame->image_digest ();
+	optional<Data> encoded;
+
+	{
+		boost::mutex::scoped_lock lm (_recent_mutex);
+		list<RecentFrame>::iterator i = _recent.begin ();
+		while (i != _recent.end() && i->digest != digest) {
+			++i;
+		}
+
+		if (i == _recent.end ()) {
+			_recent.push_front (RecentFrame (digest, frame->index (), frame->eyes ()));
+			return false;
+		}
+
+		/* Move this one to the front so that frequently-used frames stay in the list */
+		_recent.splice (_recent.begin(), _recent, i);
+		if (!_recent.front().encoded) {
+			if (_recent.front().index == frame->index() && _recent.front().eyes == frame->eyes()) {
+				/* This is the frame that is being encoded; it must have been put back
+				   onto the queue after a failed remote encode, so encode it again.
+				*/
+				return false;
+			}
+			_recent.front().copies.push_back (make_pair (frame->index (), frame->eyes ()));
+			return true;
+		}
+
+		encoded = _recent.front().encoded;
+	}
+
+	_writer->write (encoded.get(), frame->index (), frame->eyes ());
+	frame_done ();
+	return true;
+}
+
 /** @return an estimate of the current number of frames we are encoding per second,
  *  or 0 if not known.
  */
@@ -223,25 +365,72 @@ J2KEncoder::encode (shared_ptr<PlayerVideo> pv, DCPTime time)
 	} else if (_last_player_video[pv->eyes()] && _writer->can_repeat(position) && pv->same (_last_player_video[pv->eyes()])) {
 		LOG_DEBUG_ENCODE("Frame @ %1 REPEAT", to_string(time));
 		_writer->repeat (position, pv->eyes ());
-	} else {
-		LOG_DEBUG_ENCODE("Frame @ %1 ENCODE", to_string(time));
-		/* Queue this new frame for encoding */
-		LOG_TIMING ("add-frame-to-queue queue=%1", _queue.size ());
-		_queue.push_back (shared_ptr<DCPVideo> (
-					  new DCPVideo (
-						  pv,
-						  position,
-						  _film->video_frame_rate(),
-						  _film->j2k_bandwidth(),
-						  _film->resolution(),
-						  _film->log()
-						  )
-					  ));
-
-		/* The queue might not be empty any more, so notify anything which is
-		   waiting on that.
+	} else if (
+		pv->eyes() == EYES_RIGHT && _last_player_video[EYES_LEFT] && _last_player_video_time && *_last_player_video_time == time &&
+		pv->same_image (_last_player_video[EYES_LEFT])
+		) {
+		/* This is the same as the left-eye image that we were just given, as happens when the Player
+		   fills in a missing right eye (e.g. for 3D_LEFT content) with the left-eye image.
 		*/
-		_empty_condition.notify_all ();
+		LOG_DEBUG_ENCODE("Frame @ %1 LEFT EYE", to_string(time));
+		_writer->copy_left_eye (position);
+	} else {
+		shared_ptr<DCPVideo> vf (
+			new DCPVideo (
+				pv,
+				position,
+				_film->video_frame_rate(),
+				_film->j2k_bandwidth(),
+				_film->resolution(),
+				_film->log()
+				)
+			);
+
+		optional<Data> cached;
+		/* Where cached came from, for our metrics */
+		string from;
+		if (pv->black ()) {
+			/* Black frames are very common (in leaders and gaps between content) and cheap
+			   to identify, so we keep the encoded versions of them in memory.
+			*/
+			optional<string> digest = vf->digest ();
+			if (digest) {
+				boost::mutex::scoped_lock lm (_black_frames_mutex);
+				map<string, Data>::const_iterator i = _black_frames.find (digest.get ());
+				if (i != _black_frames.end ()) {
+					cached = i->second;
+					from = "black";
+				}
+			}
+		}
+
+		if (!cached && _frame_cache) {
+			optional<string> digest = vf->digest ();
+			if (digest) {
+				cached = _frame_cache->get (digest.get ());
+				if (cached) {
+					from = "cache";
+				}
+			}
+		}
+
+		if (cached) {
+			LOG_DEBUG_ENCODE("Frame @ %1 CACHED", to_string(time));
+			Metrics::instance()->increment ("dcpomatic_encoder_reused_frames_total", Metrics::label ("from", from));
+			_writer->write (cached.get(), position, pv->eyes ());
+			frame_done ();
+		} else {
+			LOG_DEBUG_ENCODE("Frame @ %1 ENCODE", to_string(time));
+			/* Queue this new frame for encoding */
+			LOG_TIMING ("add-frame-to-queue queue=%1", _queue.size ());
+			_queue.push_back (vf);
+			Metrics::instance()->set ("dcpomatic_encoder_queue_frames", "", _queue.size ());
+
+			/* The queue might not be empty any more, so notify anything which is
+			   waiting on that.
+			*/
+			_empty_condition.notify_all ();
+		}
 	}
 
 	_last_player_video[pv->eyes()] = pv;
@@ -271,8 +460,11 @@ J2KEncoder::terminate_threads ()
 	_threads.clear ();
 }
 
+/** @param server Server to use, or none to encode locally.
+ *  @param index Index of this thread among those using the same server.
+ */
 void
-J2KEncoder::encoder_thread (optional<EncodeServerDescription> server)
+J2KEncoder::encoder_thread (optional<EncodeServerDescription> server, int index)
 try
 {
 	if (server) {
@@ -287,6 +479,9 @@ try
 	*/
 	int remote_backoff = 0;
 
+	string const server_label = Metrics::label ("server", server ? server->host_name() : "localhost");
+	string const thread_label = server_label + "," + Metrics::label ("thread", raw_convert<string> (index));
+
 	while (true) {
 
 		LOG_TIMING ("encoder-sleep thread=%1", thread_id ());
@@ -307,13 +502,22 @@ try
 
 			LOG_TIMING ("encoder-pop thread=%1 frame=%2 eyes=%3", thread_id(), vf->index(), (int) vf->eyes ());
 			_queue.pop_front ();
+			Metrics::instance()->set ("dcpomatic_encoder_queue_frames", "", _queue.size ());
 
 			lock.unlock ();
 
+			/* Frames that are the same as ones we have recently encoded are not encoded again */
+			bool const reused = !vf->black() && reuse_recent (vf);
+
 			optional<Data> encoded;
 
-			/* We need to encode this input */
-			if (server) {
+			struct timeval start;
+			gettimeofday (&start, 0);
+
+			if (reused) {
+				LOG_DEBUG_ENCODE("Frame %1 RECENT", vf->index());
+				Metrics::instance()->increment ("dcpomatic_encoder_reused_frames_total", Metrics::label ("from", "recent"));
+			} else if (server) {
 				try {
 					encoded = vf->encode_remotely (server.get ());
 
@@ -325,6 +529,7 @@ try
 					remote_backoff = 0;
 
 				} catch (std::exception& e) {
+					Metrics::instance()->increment ("dcpomatic_encoder_remote_failures_total", server_label);
 					if (remote_backoff < 60) {
 						/* back off more */
 						remote_backoff += 10;
@@ -348,12 +553,17 @@ try
 			}
 
 			if (encoded) {
-				_writer->write (encoded.get(), vf->index (), vf->eyes ());
+				struct timeval end;
+				gettimeofday (&end, 0);
+				Metrics::instance()->increment ("dcpomatic_encoder_frames_total", thread_label);
+				Metrics::instance()->observe ("dcpomatic_encoder_frame_seconds", server_label, seconds (end) - seconds (start));
+				write (vf, encoded.get ());
 				frame_done ();
-			} else {
+			} else if (!reused) {
 				lock.lock ();
 				LOG_GENERAL (N_("[%1] J2KEncoder thread pushes frame %2 back onto queue after failure"), thread_id(), vf->index());
 				_queue.push_front (vf);
+				Metrics::instance()->set ("dcpomatic_encoder_queue_frames", "", _queue.size ());
 				lock.unlock ();
 			}
 		}
@@ -399,7 +609,7 @@ J2KEncoder::servers_list_changed ()
 
 	if (!Config::instance()->only_servers_encode ()) {
 		for (int i = 0; i < Config::instance()->master_encoding_threads (); ++i) {
-			boost::thread* t = new boost::thread (boost::bind (&J2KEncoder::encoder_thread, this, optional<EncodeServerDescription> ()));
+			boost::thread* t = new boost::thread (boost::bind (&J2KEncoder::encoder_thread, this, optional<EncodeServerDescription> (), i));
 			_threads.push_back (t);
 #ifdef BOOST_THREAD_PLATFORM_WIN32
 			if (windows_xp) {
@@ -412,7 +622,7 @@ J2KEncoder::servers_list_changed ()
 	BOOST_FOREACH (EncodeServerDescription i, EncodeServerFinder::instance()->servers ()) {
 		LOG_GENERAL (N_("Adding %1 worker threads for remote %2"), i.threads(), i.host_name ());
 		for (int j = 0; j < i.threads(); ++j) {
-			_threads.push_back (new boost::thread (boost::bind (&J2KEncoder::encoder_thread, this, i)));
+			_threads.push_back (new boost::thread (boost::bind (&J2KEncoder::encoder_thread, this, i, j)));
 		}
 	}
 
@@ -36,7 +36,9 @@
 #include <boost/optional.hpp>
 #include <boost/signals2.hpp>
 #include <boost/enable_shared_from_this.hpp>
+#include <dcp/data.h>
 #include <list>
+#include <map>
 #include <stdint.h>
 
 class Film;
@@ -45,6 +47,7 @@ class DCPVideo;
 class Writer;
 class Job;
 class PlayerVideo;
+class J2KFrameCache;
 
 /** @class J2KEncoder
  *  @brief Class to manage encoding to J2K.
@@ -78,8 +81,11 @@ private:
 	static void call_servers_list_changed (boost::weak_ptr<J2KEncoder> encoder);
 
 	void frame_done ();
+	void write (boost::shared_ptr<const DCPVideo> frame, dcp::Data encoded);
+	bool reuse_recent (boost::shared_ptr<const DCPVideo> frame);
+	void trim_recent ();
 
-	void encoder_thread (boost::optional<EncodeServerDescription>);
+	void encoder_thread (boost::optional<EncodeServerDescription>, int index);
 	void terminate_threads ();
 
 	/** Film that we are encoding */
@@ -98,6 +104,43 @@ private:
 	boost::condition _full_condition;
 
 	boost::shared_ptr<Writer> _writer;
+	/** store of previously-encoded frames, or 0 */
+	boost::shared_ptr<J2KFrameCache> _frame_cache;
+
+	/** mutex to protect _recent */
+	boost::mutex _recent_mutex;
+	/** A frame that we have encoded recently, or are encoding now */
+	struct RecentFrame
+	{
+		RecentFrame (std::string digest_, int index_, Eyes eyes_)
+			: digest (digest_)
+			, index (index_)
+			, eyes (eyes_)
+		{}
+
+		/** DCPVideo::image_digest() of the frame */
+		std::string digest;
+		/** index and eyes of the frame that is being encoded */
+		int index;
+		Eyes eyes;
+		/** encoded data, or empty if the frame is still being encoded */
+		boost::optional<dcp::Data> encoded;
+		/** index and eyes of identical frames which are waiting for this one to be encoded */
+		std::list<std::pair<int, Eyes> > copies;
+	};
+
+	/** frames that we have encoded recently or are encoding now, most recently used first;
+	 *  only frames which have been taken off _queue by an encoder thread are here.
+	 */
+	std::list<RecentFrame> _recent;
+
+	/** mutex to protect _black_frames */
+	static boost::mutex _black_frames_mutex;
+	/** encoded black frames indexed by DCPVideo::digest(), which covers everything that affects
+	 *  them (resolution, bandwidth, container size, eyes and so on); these are shared by all encoders
+	 *  and kept until we exit as there are only ever a few of them.
+	 */
+	static std::map<std::string, dcp::Data> _black_frames;
 	Waker _waker;
 
 	boost::shared_ptr<PlayerVideo> _last_player_video[EYES_COUNT];
@@ -0,0 +1,183 @@
+/*
+    Copyright (C) 2018 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/** @file  src/lib/j2k_frame_cache.cc
+ *  @brief J2KFrameCache class.
+ */
+
+#include "j2k_frame_cache.h"
+#include <algorithm>
+#include <vector>
+
+using std::string;
+using std::list;
+using std::pair;
+using std::vector;
+using std::make_pair;
+using std::sort;
+using boost::optional;
+
+/** @param directory Directory to keep the cache in; it will be created if it does not exist.
+ *  @param maximum_size Size in bytes above which old frames will be removed.
+ */
+J2KFrameCache::J2KFrameCache (boost::filesystem::path directory, uint64_t maximum_size)
+	: _directory (directory)
+	, _maximum_size (maximum_size)
+	, _size (0)
+{
+	boost::filesystem::create_directories (_directory);
+
+	/* Find what is already there, using the modification times of the files
+	   to put them in order of last use.
+	*/
+	vector<pair<time_t, pair<string, uint64_t> > > found;
+	for (boost::filesystem::recursive_directory_iterator i = boost::filesystem::recursive_directory_iterator (_directory); i != boost::filesystem::recursive_directory_iterator(); ++i) {
+		boost::filesystem::path const p = i->path ();
+		if (p.extension() != ".j2c" || !boost::filesystem::is_regular_file (p)) {
+			continue;
+		}
+		found.push_back (make_pair (boost::filesystem::last_write_time (p), make_pair (p.stem().string(), boost::filesystem::file_size (p))));
+	}
+
+	sort (found.begin(), found.end());
+
+	boost::mutex::scoped_lock lm (_mutex);
+	for (vector<pair<time_t, pair<string, uint64_t> > >::const_iterator i = found.begin(); i != found.end(); ++i) {
+		add (i->second.first, i->second.second);
+	}
+
+	evict ();
+}
+
+boost::filesystem::path
+J2KFrameCache::file (string digest) const
+{
+	/* Split the files up into sub-directories so that no single directory gets too big */
+	return _directory / digest.substr (0, 2) / (digest + ".j2c");
+}
+
+/** Must be called with _mutex held */
+void
+J2KFrameCache::add (string digest, uint64_t size)
+{
+	_entries.push_back (Entry (digest, size));
+	_index[digest] = --_entries.end ();
+	_size += size;
+}
+
+/** Must be called with _mutex held */
+void
+J2KFrameCache::remove (string digest)
+{
+	std::map<string, list<Entry>::iterator>::iterator i = _index.find (digest);
+	if (i == _index.end ()) {
+		return;
+	}
+
+	_size -= i->second->size;
+	_entries.erase (i->second);
+	_index.erase (i);
+}
+
+/** Remove least-recently-used frames until we are within our maximum size.
+ *  Must be called with _mutex held.
+ */
+void
+J2KFrameCache::evict ()
+{
+	while (_size > _maximum_size && !_entries.empty ()) {
+		string const digest = _entries.front().digest;
+		boost::system::error_code ec;
+		boost::filesystem::remove (file (digest), ec);
+		remove (digest);
+	}
+}
+
+/** @return Encoded frame with the given digest, if we have one */
+optional<dcp::Data>
+J2KFrameCache::get (string digest)
+{
+	{
+		boost::mutex::scoped_lock lm (_mutex);
+		std::map<string, list<Entry>::iterator>::iterator i = _index.find (digest);
+		if (i == _index.end ()) {
+			return optional<dcp::Data> ();
+		}
+
+		/* Move this frame to the most-recently-used end */
+		_entries.splice (_entries.end(), _entries, i->second);
+	}
+
+	boost::filesystem::path const f = file (digest);
+
+	try {
+		dcp::Data data (f);
+		/* Record the use in the file so that we get the order right next time */
+		boost::system::error_code ec;
+		boost::filesystem::last_write_time (f, time (0), ec);
+		return data;
+	} catch (...) {
+		/* Something has happened to the file behind our back */
+		boost::mutex::scoped_lock lm (_mutex);
+		remove (digest);
+	}
+
+	return optional<dcp::Data> ();
+}
+
+/** Add an encoded frame to the cache, if it is not already there */
+void
+J2KFrameCache::put (string digest, dcp::Data data)
+{
+	{
+		boost::mutex::scoped_lock lm (_mutex);
+		if (_index.find (digest) != _index.end ()) {
+			return;
+		}
+	}
+
+	boost::filesystem::path const f = file (digest);
+	boost::filesystem::path const temp = f.parent_path() / boost::filesystem::unique_path ("%%%%-%%%%-%%%%-%%%%.tmp");
+
+	try {
+		boost::filesystem::create_directories (f.parent_path ());
+		/* Write via a temporary file so that a partial frame is never seen */
+		data.write_via_temp (temp, f);
+	} catch (...) {
+		/* The cache is only an optimisation, so don't let problems with it stop anything */
+		boost::system::error_code ec;
+		boost::filesystem::remove (temp, ec);
+		return;
+	}
+
+	boost::mutex::scoped_lock lm (_mutex);
+	if (_index.find (digest) == _index.end ()) {
+		add (digest, data.size ());
+		evict ();
+	}
+}
+
+/** @return Total size of the frames in the cache, in bytes */
+uint64_t
+J2KFrameCache::size () const
+{
+	boost::mutex::scoped_lock lm (_mutex);
+	return _size;
+}
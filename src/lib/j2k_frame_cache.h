@@ -0,0 +1,85 @@
+/*
+    Copyright (C) 2018 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/** @file  src/lib/j2k_frame_cache.h
+ *  @brief J2KFrameCache class.
+ */
+
+#ifndef DCPOMATIC_J2K_FRAME_CACHE_H
+#define DCPOMATIC_J2K_FRAME_CACHE_H
+
+#include <dcp/data.h>
+#include <boost/filesystem.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/optional.hpp>
+#include <boost/utility.hpp>
+#include <list>
+#include <map>
+#include <string>
+
+/** @class J2KFrameCache
+ *  @brief A size-limited store on disk of JPEG2000-encoded frames.
+ *
+ *  Frames are indexed by a digest of everything that went into their encoding
+ *  (see DCPVideo::digest), so they can be re-used by later encodes of the same
+ *  film or of other films.  When the cache gets too big the least-recently-used
+ *  frames are removed.  All methods may be called from any thread.
+ */
+class J2KFrameCache : public boost::noncopyable
+{
+public:
+	J2KFrameCache (boost::filesystem::path directory, uint64_t maximum_size);
+
+	boost::optional<dcp::Data> get (std::string digest);
+	void put (std::string digest, dcp::Data data);
+
+	uint64_t size () const;
+
+private:
+	boost::filesystem::path file (std::string digest) const;
+	void add (std::string digest, uint64_t size);
+	void remove (std::string digest);
+	void evict ();
+
+	struct Entry
+	{
+		Entry (std::string d, uint64_t s)
+			: digest (d)
+			, size (s)
+		{}
+
+		std::string digest;
+		uint64_t size;
+	};
+
+	boost::filesystem::path _directory;
+	uint64_t _maximum_size;
+
+	/** mutex to protect _size, _entries and _index */
+	mutable boost::mutex _mutex;
+	/** total size of all the frames in the cache, in bytes */
+	uint64_t _size;
+	/** frames in the cache, least-recently-used first */
+	std::list<Entry> _entries;
+	/** iterators into _entries, indexed by digest */
+	std::map<std::string, std::list<Entry>::iterator> _index;
+};
+
+#endif
@@ -21,6 +21,7 @@
 #include "j2k_image_proxy.h"
 #include "dcpomatic_socket.h"
 #include "image.h"
+#include "digester.h"
 #include <dcp/raw_convert.h>
 #include <dcp/openjpeg_image.h>
 #include <dcp/mono_picture_frame.h>
@@ -49,6 +50,7 @@ J2KImageProxy::J2KImageProxy (boost::filesystem::path path, dcp::Size size, AVPi
 	: _data (path)
 	, _size (size)
 	, _pixel_format (pixel_format)
+	, _reduce (0)
 {
 
 }
@@ -63,6 +65,7 @@ J2KImageProxy::J2KImageProxy (
 	, _size (size)
 	, _pixel_format (pixel_format)
 	, _forced_reduction (forced_reduction)
+	, _reduce (0)
 {
 	memcpy (_data.data().get(), frame->j2k_data(), _data.size ());
 }
@@ -78,6 +81,7 @@ J2KImageProxy::J2KImageProxy (
 	, _eye (eye)
 	, _pixel_format (pixel_format)
 	, _forced_reduction (forced_reduction)
+	, _reduce (0)
 {
 	switch (eye) {
 	case dcp::EYE_LEFT:
@@ -92,6 +96,7 @@ J2KImageProxy::J2KImageProxy (
 }
 
 J2KImageProxy::J2KImageProxy (shared_ptr<cxml::Node> xml, shared_ptr<Socket> socket)
+	: _reduce (0)
 {
 	_size = dcp::Size (xml->number_child<int> ("Width"), xml->number_child<int> ("Height"));
 	if (xml->optional_number_child<int> ("Eye")) {
@@ -143,10 +148,11 @@ J2KImageProxy::prepare (optional<dcp::Size> target_size) const
 	}
 
 	_target_size = target_size;
+	_reduce = reduce;
 }
 
-shared_ptr<Image>
-J2KImageProxy::image (optional<dcp::NoteHandler>, optional<dcp::Size> target_size) const
+ImageProxy::Result
+J2KImageProxy::image (optional<dcp::NoteHandler>, optional<dcp::Size> target_size, bool) const
 {
 	prepare (target_size);
 
@@ -169,7 +175,7 @@ J2KImageProxy::image (optional<dcp::NoteHandler>, optional<dcp::Size> target_siz
 		}
 	}
 
-	return image;
+	return Result (image, _reduce);
 }
 
 void
@@ -205,10 +211,23 @@ J2KImageProxy::same (shared_ptr<const ImageProxy> other) const
 	return memcmp (_data.data().get(), jp->_data.data().get(), _data.size()) == 0;
 }
 
+string
+J2KImageProxy::digest () const
+{
+	Digester digester;
+	digester.add (_data.data().get(), _data.size());
+	digester.add (_size.width);
+	digester.add (_size.height);
+	digester.add (static_cast<int> (_pixel_format));
+	digester.add (_forced_reduction.get_value_or (-1));
+	return digester.get ();
+}
+
 J2KImageProxy::J2KImageProxy (Data data, dcp::Size size, AVPixelFormat pixel_format)
 	: _data (data)
 	, _size (size)
 	, _pixel_format (pixel_format)
+	, _reduce (0)
 {
 
 }
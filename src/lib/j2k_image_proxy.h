@@ -50,15 +50,17 @@ public:
 
 	J2KImageProxy (boost::shared_ptr<cxml::Node> xml, boost::shared_ptr<Socket> socket);
 
-	boost::shared_ptr<Image> image (
+	Result image (
 		boost::optional<dcp::NoteHandler> note = boost::optional<dcp::NoteHandler> (),
-		boost::optional<dcp::Size> size = boost::optional<dcp::Size> ()
+		boost::optional<dcp::Size> size = boost::optional<dcp::Size> (),
+		bool fast = false
 		) const;
 
 	void add_metadata (xmlpp::Node *) const;
 	void send_binary (boost::shared_ptr<Socket>) const;
 	/** @return true if our image is definitely the same as another, false if it is probably not */
 	bool same (boost::shared_ptr<const ImageProxy>) const;
+	std::string digest () const;
 	void prepare (boost::optional<dcp::Size> = boost::optional<dcp::Size>()) const;
 	AVPixelFormat pixel_format () const {
 		return _pixel_format;
@@ -88,4 +90,6 @@ private:
 	AVPixelFormat _pixel_format;
 	mutable boost::mutex _mutex;
 	boost::optional<int> _forced_reduction;
+	/** reduction level used by the last prepare() */
+	mutable int _reduce;
 };
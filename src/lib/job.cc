@@ -273,6 +273,8 @@ Job::set_state (State s)
 		}
 	}
 
+	StateChanged ();
+
 	if (finished) {
 		emit (boost::bind (boost::ref (Finished)));
 	}
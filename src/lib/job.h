@@ -49,6 +49,28 @@ public:
 	/** Run this job in the current thread. */
 	virtual void run () = 0;
 
+	/** Kinds of resource that a job mostly uses; JobManager can run jobs
+	 *  which use different kinds at the same time.
+	 */
+	enum Resource {
+		RESOURCE_ENCODE, ///< lots of CPU for a long time
+		RESOURCE_IO,	 ///< mostly reading or writing files, or the network
+		RESOURCE_LIGHT,	 ///< not much of anything
+		RESOURCE_COUNT
+	};
+
+	/** @return the kind of resource that this job mostly uses */
+	virtual Resource resource () const {
+		return RESOURCE_ENCODE;
+	}
+
+	/** @return true if this job may run at the same time as other jobs for
+	 *  the same film which also return true.
+	 */
+	virtual bool concurrent () const {
+		return false;
+	}
+
 	void start ();
 	void pause_by_user ();
 	void pause_by_priority ();
@@ -87,6 +109,8 @@ public:
 	boost::signals2::signal<void()> Progress;
 	/** Emitted from the UI thread when the job is finished */
 	boost::signals2::signal<void()> Finished;
+	/** Emitted, from whatever thread made the change, when the job's state changes */
+	boost::signals2::signal<void()> StateChanged;
 
 protected:
 
@@ -27,13 +27,18 @@
 #include "cross.h"
 #include "analyse_audio_job.h"
 #include "film.h"
+#include "dcpomatic_assert.h"
+#include "config.h"
 #include <boost/thread.hpp>
 #include <boost/foreach.hpp>
 #include <iostream>
+#include <set>
 
 using std::string;
 using std::list;
 using std::cout;
+using std::set;
+using std::map;
 using boost::shared_ptr;
 using boost::weak_ptr;
 using boost::function;
@@ -44,9 +49,28 @@ JobManager* JobManager::_instance = 0;
 
 JobManager::JobManager ()
 	: _terminate (false)
+	, _schedule_needed (false)
 	, _scheduler (0)
 {
+	set_limits_from_config ();
+	_config_connection = Config::instance()->Changed.connect (boost::bind (&JobManager::config_changed, this));
+}
 
+void
+JobManager::set_limits_from_config ()
+{
+	Config* c = Config::instance ();
+	boost::mutex::scoped_lock lm (_mutex);
+	_limit[Job::RESOURCE_ENCODE] = c->maximum_encode_jobs ();
+	_limit[Job::RESOURCE_IO] = c->maximum_io_jobs ();
+	_limit[Job::RESOURCE_LIGHT] = c->maximum_light_jobs ();
+}
+
+void
+JobManager::config_changed ()
+{
+	set_limits_from_config ();
+	schedule ();
 }
 
 void
@@ -57,11 +81,19 @@ JobManager::start ()
 
 JobManager::~JobManager ()
 {
+	_config_connection.disconnect ();
+
 	{
 		boost::mutex::scoped_lock lm (_mutex);
 		_terminate = true;
+		for (map<shared_ptr<Job>, boost::signals2::connection>::iterator i = _job_connections.begin(); i != _job_connections.end(); ++i) {
+			i->second.disconnect ();
+		}
+		_job_connections.clear ();
 	}
 
+	schedule ();
+
 	if (_scheduler) {
 		/* Ideally this would be a DCPOMATIC_ASSERT(_scheduler->joinable()) but we
 		   can't throw exceptions from a destructor.
@@ -74,14 +106,23 @@ JobManager::~JobManager ()
 	delete _scheduler;
 }
 
+/** Must be called with _mutex held */
+void
+JobManager::job_added (shared_ptr<Job> job)
+{
+	_jobs.push_back (job);
+	_job_connections[job] = job->StateChanged.connect (boost::bind (&JobManager::schedule, this));
+}
+
 shared_ptr<Job>
 JobManager::add (shared_ptr<Job> j)
 {
 	{
 		boost::mutex::scoped_lock lm (_mutex);
-		_jobs.push_back (j);
+		job_added (j);
 	}
 
+	schedule ();
 	emit (boost::bind (boost::ref (JobAdded), weak_ptr<Job> (j)));
 
 	return j;
@@ -119,11 +160,44 @@ JobManager::errors () const
 	return false;
 }
 
+/** Set the maximum number of jobs using a given kind of resource that can run at once */
+void
+JobManager::set_limit (Job::Resource resource, int limit)
+{
+	DCPOMATIC_ASSERT (limit > 0);
+
+	{
+		boost::mutex::scoped_lock lm (_mutex);
+		_limit[resource] = limit;
+	}
+
+	schedule ();
+}
+
+/** Wake the scheduler thread so that it looks at the jobs again.  This can be
+ *  called from any thread, including from within the scheduler itself.
+ */
+void
+JobManager::schedule ()
+{
+	boost::mutex::scoped_lock lm (_schedule_mutex);
+	_schedule_needed = true;
+	_schedule_condition.notify_all ();
+}
+
 void
 JobManager::scheduler ()
 {
 	while (true) {
 
+		{
+			boost::mutex::scoped_lock lm (_schedule_mutex);
+			while (!_schedule_needed) {
+				_schedule_condition.wait (lm);
+			}
+			_schedule_needed = false;
+		}
+
 		optional<string> active_job;
 
 		{
@@ -132,21 +206,64 @@ JobManager::scheduler ()
 				return;
 			}
 
+			int used[Job::RESOURCE_COUNT];
+			for (int i = 0; i < Job::RESOURCE_COUNT; ++i) {
+				used[i] = 0;
+			}
+
+			/* Films which have an unfinished job that we have already looked at */
+			set<shared_ptr<const Film> > busy;
+			/* Films which have an unfinished, non-concurrent job that we have already looked at */
+			set<shared_ptr<const Film> > exclusive;
+
 			BOOST_FOREACH (shared_ptr<Job> i, _jobs) {
 
-				if (!i->finished ()) {
+				if (i->finished ()) {
+					/* We don't need to hear from this job again */
+					map<shared_ptr<Job>, boost::signals2::connection>::iterator c = _job_connections.find (i);
+					if (c != _job_connections.end ()) {
+						c->second.disconnect ();
+						_job_connections.erase (c);
+					}
+					continue;
+				}
+
+				if (!active_job) {
 					active_job = i->json_name ();
 				}
 
-				if (i->running ()) {
-					/* Something is already happening */
-					break;
+				if (i->paused_by_user ()) {
+					/* This job holds nothing up until the user resumes it */
+					continue;
 				}
 
-				if (i->is_new()) {
-					i->start ();
-					/* Only start one job at once */
-					break;
+				bool waiting = false;
+				if (i->film ()) {
+					set<shared_ptr<const Film> > const & blocking = i->concurrent() ? exclusive : busy;
+					waiting = blocking.find (i->film()) != blocking.end ();
+					busy.insert (i->film ());
+					if (!i->concurrent ()) {
+						exclusive.insert (i->film ());
+					}
+				}
+
+				Job::Resource const r = i->resource ();
+
+				if (i->running ()) {
+					if (used[r] < _limit[r]) {
+						++used[r];
+					} else {
+						/* Something earlier in the list needs this job's place */
+						i->pause_by_priority ();
+					}
+				} else if (!waiting && used[r] < _limit[r]) {
+					if (i->is_new ()) {
+						i->start ();
+						++used[r];
+					} else if (i->paused_by_priority ()) {
+						i->resume ();
+						++used[r];
+					}
 				}
 			}
 		}
@@ -155,8 +272,6 @@ JobManager::scheduler ()
 			emit (boost::bind (boost::ref (ActiveJobsChanged), _last_active_job, active_job));
 			_last_active_job = active_job;
 		}
-
-		dcpomatic_sleep (1);
 	}
 }
 
@@ -205,9 +320,10 @@ JobManager::analyse_audio (
 
 		job.reset (new AnalyseAudioJob (film, playlist));
 		connection = job->Finished.connect (ready);
-		_jobs.push_back (job);
+		job_added (job);
 	}
 
+	schedule ();
 	emit (boost::bind (boost::ref (JobAdded), weak_ptr<Job> (job)));
 }
 
@@ -237,26 +353,7 @@ JobManager::increase_priority (shared_ptr<Job> job)
 void
 JobManager::priority_changed ()
 {
-	{
-		boost::mutex::scoped_lock lm (_mutex);
-
-		bool first = true;
-		BOOST_FOREACH (shared_ptr<Job> i, _jobs) {
-			if (first) {
-				if (i->is_new ()) {
-					i->start ();
-				} else if (i->paused_by_priority ()) {
-					i->resume ();
-				}
-				first = false;
-			} else {
-				if (i->running ()) {
-					i->pause_by_priority ();
-				}
-			}
-		}
-	}
-
+	schedule ();
 	emit (boost::bind (boost::ref (JobsReordered)));
 }
 
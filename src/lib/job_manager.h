@@ -23,12 +23,14 @@
  */
 
 #include "signaller.h"
+#include "job.h"
 #include <boost/thread/mutex.hpp>
+#include <boost/thread/condition.hpp>
 #include <boost/thread.hpp>
 #include <boost/signals2.hpp>
 #include <list>
+#include <map>
 
-class Job;
 class Film;
 class Playlist;
 
@@ -36,6 +38,11 @@ extern bool wait_for_jobs ();
 
 /** @class JobManager
  *  @brief A simple scheduler for jobs.
+ *
+ *  Jobs are started in order, but jobs which use different kinds of resource
+ *  (see Job::Resource) may run at the same time, up to a limit for each kind.
+ *  A job will never start before an earlier unfinished job for the same film,
+ *  unless that job has been paused by the user.
  */
 class JobManager : public Signaller, public boost::noncopyable
 {
@@ -46,6 +53,7 @@ public:
 	bool errors () const;
 	void increase_priority (boost::shared_ptr<Job>);
 	void decrease_priority (boost::shared_ptr<Job>);
+	void set_limit (Job::Resource resource, int limit);
 
 	void analyse_audio (
 		boost::shared_ptr<const Film> film,
@@ -68,14 +76,30 @@ private:
 	JobManager ();
 	~JobManager ();
 	void scheduler ();
+	void schedule ();
 	void start ();
 	void priority_changed ();
+	void job_added (boost::shared_ptr<Job> job);
+	void set_limits_from_config ();
+	void config_changed ();
 
 	mutable boost::mutex _mutex;
 	/** List of jobs in the order that they will be executed */
 	std::list<boost::shared_ptr<Job> > _jobs;
+	/** Connections to the StateChanged signals of our unfinished jobs */
+	std::map<boost::shared_ptr<Job>, boost::signals2::connection> _job_connections;
+	/** Maximum number of jobs of each kind of resource to run at once */
+	int _limit[Job::RESOURCE_COUNT];
+	boost::signals2::scoped_connection _config_connection;
 	bool _terminate;
 
+	/** mutex to protect _schedule_needed */
+	boost::mutex _schedule_mutex;
+	/** condition to wake the scheduler thread when _schedule_needed is set */
+	boost::condition _schedule_condition;
+	/** true if something has happened which means that the scheduler should look at the jobs again */
+	bool _schedule_needed;
+
 	boost::optional<std::string> _last_active_job;
 	boost::thread* _scheduler;
 
@@ -1,5 +1,5 @@
 /*
-    Copyright (C) 2014-2015 Carl Hetherington <cth@carlh.net>
+    Copyright (C) 2014-2018 Carl Hetherington <cth@carlh.net>
 
     This file is part of DCP-o-matic.
 
@@ -24,172 +24,412 @@
 #include "util.h"
 #include "film.h"
 #include "transcode_job.h"
+#include "metrics.h"
 #include <dcp/raw_convert.h>
 #include <boost/asio.hpp>
 #include <boost/bind.hpp>
 #include <boost/thread.hpp>
-#include <iostream>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/algorithm/string.hpp>
+#include <vector>
 
 using std::string;
-using std::cout;
 using std::map;
 using std::list;
+using std::vector;
+using std::pair;
+using std::make_pair;
+using std::istream;
 using boost::thread;
 using boost::shared_ptr;
+using boost::weak_ptr;
 using boost::dynamic_pointer_cast;
 using boost::asio::ip::tcp;
 using dcp::raw_convert;
 
-#define MAX_LENGTH 512
+/** Longest request header that we will accept */
+#define MAX_LENGTH 8192
+/** Time in seconds after which we close a connection which has not made a request */
+#define IDLE_TIMEOUT 60
+/** Interval in milliseconds between checks for status changes to send to event stream subscribers */
+#define EVENT_CHECK_INTERVAL 500
+/** Number of EVENT_CHECK_INTERVALs after which we send a comment to idle event streams to keep them open */
+#define EVENT_KEEPALIVE_TICKS 30
 
-enum State {
-	AWAITING_G,
-	AWAITING_E,
-	AWAITING_T,
-	AWAITING_SPACE,
-	READING_URL,
+/** @class JSONServer::Connection
+ *  @brief One client's connection to a JSONServer.
+ *
+ *  All the methods of this class are called on the JSONServer's thread.
+ */
+class JSONServer::Connection : public boost::enable_shared_from_this<JSONServer::Connection>
+{
+public:
+	Connection (JSONServer* server)
+		: _server (server)
+		, _socket (server->_io_service)
+		, _timeout (server->_io_service)
+		, _buffer (MAX_LENGTH)
+		, _writing (false)
+		, _close_after_write (false)
+		, _streaming (false)
+	{}
+
+	tcp::socket& socket () {
+		return _socket;
+	}
+
+	void start ()
+	{
+		read ();
+	}
+
+	/** Send some data to the client if it is receiving an event stream */
+	void send_event (string data)
+	{
+		if (_streaming && _socket.is_open ()) {
+			write (data);
+		}
+	}
+
+private:
+	void read ()
+	{
+		_timeout.expires_from_now (boost::posix_time::seconds (IDLE_TIMEOUT));
+		_timeout.async_wait (boost::bind (&Connection::timeout_expired, shared_from_this(), boost::asio::placeholders::error));
+
+		boost::asio::async_read_until (
+			_socket, _buffer, "\r\n\r\n",
+			boost::bind (&Connection::handle_read, shared_from_this(), boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred)
+			);
+	}
+
+	void timeout_expired (boost::system::error_code const & error)
+	{
+		/* Event streams are meant to be quiet for long periods */
+		if (!error && !_streaming) {
+			close ();
+		}
+	}
+
+	void handle_read (boost::system::error_code const & error, size_t length)
+	{
+		_timeout.cancel ();
+
+		if (error) {
+			/* The client went away, or sent a request that was too long */
+			close ();
+			return;
+		}
+
+		if (_streaming) {
+			/* We don't expect anything more from an event stream client, so ignore what it sends */
+			_buffer.consume (length);
+			read ();
+			return;
+		}
+
+		/* Read the request line and headers; there may be data after them in _buffer (another
+		   request, if the client is pipelining) which we leave for the next read().
+		*/
+		istream stream (&_buffer);
+		string line;
+		getline (stream, line);
+		boost::algorithm::trim (line);
+
+		vector<string> request;
+		boost::algorithm::split (request, line, boost::is_any_of (" "), boost::token_compress_on);
+
+		bool keep_alive = request.size() == 3 && request[2] == "HTTP/1.1";
+		while (getline (stream, line)) {
+			boost::algorithm::trim (line);
+			if (line.empty ()) {
+				break;
+			}
+			string::size_type const colon = line.find (':');
+			if (colon != string::npos && boost::iequals (line.substr (0, colon), "Connection")) {
+				string const value = boost::algorithm::trim_copy (line.substr (colon + 1));
+				if (boost::iequals (value, "close")) {
+					keep_alive = false;
+				} else if (boost::iequals (value, "keep-alive")) {
+					keep_alive = true;
+				}
+			}
+		}
+
+		if (request.size() != 3 || request[0] != "GET") {
+			reply ("405 Method Not Allowed", "text/plain", "", false);
+			return;
+		}
+
+		map<string, string> r = split_get_request (request[1]);
+		if (r["action"] == "events") {
+			_streaming = true;
+			write (
+				"HTTP/1.1 200 OK\r\n"
+				"Content-Type: text/event-stream\r\n"
+				"Cache-Control: no-cache\r\n"
+				"\r\n"
+				"data: " + status() + "\n\n"
+				);
+			_server->subscribe (shared_from_this ());
+			/* Keep reading so that we notice when the client goes away */
+			read ();
+			return;
+		}
+
+		pair<string, string> response = respond (request[1]);
+		reply ("200 OK", response.first, response.second, keep_alive);
+		if (keep_alive) {
+			read ();
+		}
+	}
+
+	void reply (string status, string content_type, string body, bool keep_alive)
+	{
+		string r = "HTTP/1.1 " + status + "\r\n"
+			"Content-Length: " + raw_convert<string>(body.length()) + "\r\n";
+		if (!content_type.empty ()) {
+			r += "Content-Type: " + content_type + "\r\n";
+		}
+		r += keep_alive ? "Connection: keep-alive\r\n" : "Connection: close\r\n";
+		r += "\r\n" + body;
+
+		write (r);
+		if (!keep_alive) {
+			_close_after_write = true;
+		}
+	}
+
+	/** Queue some data to be written to the client; we can only have one asynchronous
+	 *  write in progress at once, so if one is already going this will be sent after it.
+	 */
+	void write (string data)
+	{
+		_outgoing.push_back (data);
+		if (!_writing) {
+			write_next ();
+		}
+	}
+
+	void write_next ()
+	{
+		if (_outgoing.empty ()) {
+			_writing = false;
+			if (_close_after_write) {
+				close ();
+			}
+			return;
+		}
+
+		_writing = true;
+		boost::asio::async_write (
+			_socket, boost::asio::buffer (_outgoing.front ()),
+			boost::bind (&Connection::handle_write, shared_from_this(), boost::asio::placeholders::error)
+			);
+	}
+
+	void handle_write (boost::system::error_code const & error)
+	{
+		_outgoing.pop_front ();
+		if (error) {
+			_outgoing.clear ();
+			_writing = false;
+			close ();
+			return;
+		}
+
+		write_next ();
+	}
+
+	void close ()
+	{
+		boost::system::error_code ec;
+		_timeout.cancel (ec);
+		_socket.shutdown (tcp::socket::shutdown_both, ec);
+		_socket.close (ec);
+	}
+
+	JSONServer* _server;
+	tcp::socket _socket;
+	boost::asio::deadline_timer _timeout;
+	boost::asio::streambuf _buffer;
+	/** data waiting to be written; the front item is being written if _writing is true */
+	list<string> _outgoing;
+	bool _writing;
+	bool _close_after_write;
+	/** true if this client is receiving an event stream */
+	bool _streaming;
 };
 
 JSONServer::JSONServer (int port)
+	: _acceptor (_io_service, tcp::endpoint (tcp::v4 (), port))
+	, _timer (_io_service)
+	, _idle_ticks (0)
 {
-	new thread (boost::bind (&JSONServer::run, this, port));
+	start_accept ();
+	start_timer ();
+	_thread = new thread (boost::bind (&JSONServer::run, this));
+}
+
+JSONServer::~JSONServer ()
+{
+	_io_service.stop ();
+	/* Ideally this would be a DCPOMATIC_ASSERT(_thread->joinable()) but we
+	   can't throw exceptions from a destructor.
+	*/
+	if (_thread->joinable ()) {
+		_thread->join ();
+	}
+	delete _thread;
 }
 
 void
-JSONServer::run (int port)
-try
+JSONServer::run ()
 {
-	boost::asio::io_service io_service;
-	tcp::acceptor a (io_service, tcp::endpoint (tcp::v4 (), port));
 	while (true) {
 		try {
-			shared_ptr<tcp::socket> s (new tcp::socket (io_service));
-			a.accept (*s);
-			handle (s);
-		}
-		catch (...) {
-
+			_io_service.run ();
+			/* run() only returns normally if we have been stopped */
+			return;
+		} catch (...) {
+			/* Something went wrong in a handler; carry on serving everybody else */
 		}
 	}
 }
-catch (...)
+
+void
+JSONServer::start_accept ()
 {
+	shared_ptr<Connection> connection (new Connection (this));
+	_acceptor.async_accept (
+		connection->socket(),
+		boost::bind (&JSONServer::handle_accept, this, connection, boost::asio::placeholders::error)
+		);
+}
 
+void
+JSONServer::handle_accept (shared_ptr<Connection> connection, boost::system::error_code const & error)
+{
+	if (error == boost::asio::error::operation_aborted) {
+		return;
+	}
+
+	if (!error) {
+		connection->start ();
+	}
+
+	start_accept ();
 }
 
 void
-JSONServer::handle (shared_ptr<tcp::socket> socket)
+JSONServer::start_timer ()
 {
-	string url;
-	State state = AWAITING_G;
+	_timer.expires_from_now (boost::posix_time::milliseconds (EVENT_CHECK_INTERVAL));
+	_timer.async_wait (boost::bind (&JSONServer::timer_expired, this, boost::asio::placeholders::error));
+}
 
-	while (true) {
-		char data[MAX_LENGTH];
-		boost::system::error_code error;
-		size_t len = socket->read_some (boost::asio::buffer (data), error);
-		if (error) {
-			cout << "error.\n";
-			break;
+/** Called periodically to send status changes to any clients which are receiving event streams */
+void
+JSONServer::timer_expired (boost::system::error_code const & error)
+{
+	if (error) {
+		return;
+	}
+
+	/* Forget about clients which have gone away */
+	list<weak_ptr<Connection> >::iterator i = _subscribers.begin ();
+	while (i != _subscribers.end ()) {
+		list<weak_ptr<Connection> >::iterator j = i;
+		++j;
+		if (i->expired ()) {
+			_subscribers.erase (i);
 		}
+		i = j;
+	}
 
-		char* p = data;
-		char* e = data + len;
-		while (p != e) {
+	if (!_subscribers.empty ()) {
+		string const s = status ();
+		string event;
+		if (s != _last_status) {
+			event = "data: " + s + "\n\n";
+			_last_status = s;
+		} else if (++_idle_ticks >= EVENT_KEEPALIVE_TICKS) {
+			/* Send a comment to stop any proxies closing the connection */
+			event = ":\n\n";
+		}
 
-			State old_state = state;
-			switch (state) {
-			case AWAITING_G:
-				if (*p == 'G') {
-					state = AWAITING_E;
+		if (!event.empty ()) {
+			_idle_ticks = 0;
+			for (list<weak_ptr<Connection> >::iterator k = _subscribers.begin(); k != _subscribers.end(); ++k) {
+				shared_ptr<Connection> c = k->lock ();
+				if (c) {
+					c->send_event (event);
 				}
-				break;
-			case AWAITING_E:
-				if (*p == 'E') {
-					state = AWAITING_T;
-				}
-				break;
-			case AWAITING_T:
-				if (*p == 'T') {
-					state = AWAITING_SPACE;
-				}
-				break;
-			case AWAITING_SPACE:
-				if (*p == ' ') {
-					state = READING_URL;
-				}
-				break;
-			case READING_URL:
-				if (*p == ' ') {
-					request (url, socket);
-					state = AWAITING_G;
-					url = "";
-				} else {
-					url += *p;
-				}
-				break;
-			}
-
-			if (state == old_state && state != READING_URL) {
-				state = AWAITING_G;
 			}
-
-			++p;
 		}
 	}
+
+	start_timer ();
 }
 
 void
-JSONServer::request (string url, shared_ptr<tcp::socket> socket)
+JSONServer::subscribe (shared_ptr<Connection> connection)
+{
+	_subscribers.push_back (connection);
+}
+
+/** @param url URL that was requested.
+ *  @return Content type and body of our response.
+ */
+pair<string, string>
+JSONServer::respond (string url)
 {
-	cout << "request: " << url << "\n";
+	if (url == "/metrics") {
+		/* Metrics for Prometheus to scrape */
+		return make_pair ("text/plain; version=0.0.4", Metrics::instance()->prometheus ());
+	}
 
 	map<string, string> r = split_get_request (url);
-	for (map<string, string>::iterator i = r.begin(); i != r.end(); ++i) {
-		cout << i->first << " => " << i->second << "\n";
-	}
 
-	string action;
-	if (r.find ("action") != r.end ()) {
-		action = r["action"];
+	string json;
+	if (r["action"] == "status") {
+		json = status ();
 	}
 
-	string json;
-	if (action == "status") {
+	return make_pair ("application/json", json);
+}
 
-		list<shared_ptr<Job> > jobs = JobManager::instance()->get ();
+/** @return JSON describing our jobs */
+string
+JSONServer::status ()
+{
+	list<shared_ptr<Job> > jobs = JobManager::instance()->get ();
 
-		json += "{ \"jobs\": [";
-		for (list<shared_ptr<Job> >::iterator i = jobs.begin(); i != jobs.end(); ++i) {
+	string json = "{ \"jobs\": [";
+	for (list<shared_ptr<Job> >::iterator i = jobs.begin(); i != jobs.end(); ++i) {
 
-			json += "{ ";
+		json += "{ ";
 
-			if ((*i)->film()) {
-				json += "\"dcp\": \"" + (*i)->film()->dcp_name() + "\", ";
-			}
+		if ((*i)->film()) {
+			json += "\"dcp\": \"" + (*i)->film()->dcp_name() + "\", ";
+		}
 
-			json += "\"name\": \"" + (*i)->json_name() + "\", ";
-			if ((*i)->progress ()) {
-				json += "\"progress\": " + raw_convert<string>((*i)->progress().get()) + ", ";
-			} else {
-				json += "\"progress\": unknown, ";
-			}
-			json += "\"status\": \"" + (*i)->json_status() + "\"";
-			json += " }";
+		json += "\"name\": \"" + (*i)->json_name() + "\", ";
+		if ((*i)->progress ()) {
+			json += "\"progress\": " + raw_convert<string>((*i)->progress().get()) + ", ";
+		} else {
+			json += "\"progress\": unknown, ";
+		}
+		json += "\"status\": \"" + (*i)->json_status() + "\"";
+		json += " }";
 
-			list<shared_ptr<Job> >::iterator j = i;
-			++j;
-			if (j != jobs.end ()) {
-				json += ", ";
-			}
+		list<shared_ptr<Job> >::iterator j = i;
+		++j;
+		if (j != jobs.end ()) {
+			json += ", ";
 		}
-		json += "] }";
 	}
+	json += "] }";
 
-	string reply = "HTTP/1.1 200 OK\r\n"
-		"Content-Length: " + raw_convert<string>(json.length()) + "\r\n"
-		"Content-Type: application/json\r\n"
-		"\r\n"
-		+ json + "\r\n";
-	cout << "reply: " << json << "\n";
-	boost::asio::write (*socket, boost::asio::buffer (reply.c_str(), reply.length()));
+	return json;
 }
@@ -1,5 +1,5 @@
 /*
-    Copyright (C) 2014 Carl Hetherington <cth@carlh.net>
+    Copyright (C) 2014-2018 Carl Hetherington <cth@carlh.net>
 
     This file is part of DCP-o-matic.
 
@@ -19,14 +19,55 @@
 */
 
 #include <boost/asio.hpp>
+#include <boost/thread.hpp>
+#include <boost/weak_ptr.hpp>
+#include <boost/noncopyable.hpp>
+#include <list>
+#include <string>
 
-class JSONServer
+/** @class JSONServer
+ *  @brief A small HTTP server giving information about our jobs.
+ *
+ *  All I/O is asynchronous on a single thread, so any number of clients can be
+ *  connected at once (and can keep their connections alive) without a slow one
+ *  holding up the others.  The following requests are understood:
+ *
+ *  - <code>/?action=status</code>: JSON describing the current jobs.
+ *  - <code>/?action=events</code>: a server-sent event stream which sends the same
+ *    JSON as <code>status</code> whenever it changes.
+ *  - <code>/metrics</code>: metrics in the Prometheus text format.
+ */
+class JSONServer : public boost::noncopyable
 {
 public:
-	JSONServer (int port);
+	explicit JSONServer (int port);
+	~JSONServer ();
+
+	class Connection;
+
+	static std::pair<std::string, std::string> respond (std::string url);
+	static std::string status ();
 
 private:
-	void run (int port);
-	void handle (boost::shared_ptr<boost::asio::ip::tcp::socket> socket);
-	void request (std::string url, boost::shared_ptr<boost::asio::ip::tcp::socket> socket);
+	friend class Connection;
+
+	void run ();
+	void start_accept ();
+	void handle_accept (boost::shared_ptr<Connection> connection, boost::system::error_code const & error);
+	void start_timer ();
+	void timer_expired (boost::system::error_code const & error);
+	void subscribe (boost::shared_ptr<Connection> connection);
+
+	boost::asio::io_service _io_service;
+	boost::asio::ip::tcp::acceptor _acceptor;
+	/** timer to check for changes which should be sent to event stream subscribers */
+	boost::asio::deadline_timer _timer;
+	boost::thread* _thread;
+
+	/** Connections which are receiving an event stream; only used by _thread */
+	std::list<boost::weak_ptr<Connection> > _subscribers;
+	/** Last status sent to subscribers; only used by _thread */
+	std::string _last_status;
+	/** Number of timer ticks since we last sent anything to subscribers; only used by _thread */
+	int _idle_ticks;
 };
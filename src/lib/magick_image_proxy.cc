@@ -23,6 +23,7 @@
 #include "exceptions.h"
 #include "dcpomatic_socket.h"
 #include "image.h"
+#include "digester.h"
 #include "compose.hpp"
 #include <Magick++.h>
 #include <libxml++/libxml++.h>
@@ -37,6 +38,7 @@ using boost::optional;
 using boost::dynamic_pointer_cast;
 
 MagickImageProxy::MagickImageProxy (boost::filesystem::path path)
+	: _log2_scaling (0)
 {
 	/* Read the file into a Blob */
 
@@ -58,6 +60,7 @@ MagickImageProxy::MagickImageProxy (boost::filesystem::path path)
 }
 
 MagickImageProxy::MagickImageProxy (shared_ptr<cxml::Node>, shared_ptr<Socket> socket)
+	: _log2_scaling (0)
 {
 	uint32_t const size = socket->read_uint32 ();
 	uint8_t* data = new uint8_t[size];
@@ -66,20 +69,108 @@ MagickImageProxy::MagickImageProxy (shared_ptr<cxml::Node>, shared_ptr<Socket> s
 	delete[] data;
 }
 
-shared_ptr<Image>
-MagickImageProxy::image (optional<dcp::NoteHandler>, optional<dcp::Size>) const
+/** @param target_size Size that the image will be scaled to.
+ *  @param full Filled in with the full size of the JPEG, if this method returns a value other than 0.
+ *  @return Amount that a JPEG in our blob can be scaled down by while it is being decoded,
+ *  as a power of 2, while remaining at least as big as target_size; 0 if the blob is not
+ *  a JPEG or cannot be scaled.
+ */
+int
+MagickImageProxy::jpeg_reduction (optional<dcp::Size> target_size, dcp::Size& full) const
+{
+	unsigned char const * data = static_cast<unsigned char const *>(_blob.data());
+	if (!target_size || _blob.length() < 2 || data[0] != 0xff || data[1] != 0xd8) {
+		return 0;
+	}
+
+	try {
+		/* This only reads the header */
+		Magick::Image ping;
+		ping.ping (_blob);
+		full = dcp::Size (ping.columns(), ping.rows());
+	} catch (...) {
+		return 0;
+	}
+
+	/* libjpeg can decode at 1/2, 1/4 or 1/8 of full size */
+	int reduce = 0;
+	while (
+		reduce < 3 &&
+		(full.width >> (reduce + 1)) >= target_size->width &&
+		(full.height >> (reduce + 1)) >= target_size->height
+		) {
+		++reduce;
+	}
+
+	return reduce;
+}
+
+/** @return log2 of the scaling that libjpeg applied to get from an image of size full
+ *  to one of size reduced, or an empty optional if it was not a power of 2.
+ */
+static optional<int>
+jpeg_scaling (dcp::Size full, dcp::Size reduced)
+{
+	for (int i = 0; i <= 3; ++i) {
+		/* libjpeg rounds scaled sizes up */
+		int const d = 1 << i;
+		if (reduced == dcp::Size ((full.width + d - 1) / d, (full.height + d - 1) / d)) {
+			return i;
+		}
+	}
+
+	return optional<int> ();
+}
+
+/** @param target_size Size that the image will be scaled to.
+ *  @param fast true if the image is for a preview; only then will a JPEG be decoded at
+ *  reduced size, as libjpeg's scaling is not as good as what we do later.
+ */
+ImageProxy::Result
+MagickImageProxy::image (optional<dcp::NoteHandler>, optional<dcp::Size> target_size, bool fast) const
 {
 	boost::mutex::scoped_lock lm (_mutex);
 
-	if (_image) {
-		return _image;
+	if (!fast) {
+		target_size = optional<dcp::Size> ();
 	}
 
+	if (_image && target_size == _target_size) {
+		return Result (_image, _log2_scaling);
+	}
+
+	dcp::Size full;
+	int const reduce = jpeg_reduction (target_size, full);
+	int scaling = 0;
+
 	Magick::Image* magick_image = 0;
 	string error;
 	try {
-		magick_image = new Magick::Image (_blob);
+		magick_image = new Magick::Image ();
+		if (reduce > 0) {
+			/* Asking for a smaller size before reading makes libjpeg scale the image down
+			   as it decodes it, which is much quicker than decoding at full size.  The
+			   image we get will be no smaller than the size that we ask for here.
+			*/
+			magick_image->size (Magick::Geometry (full.width >> reduce, full.height >> reduce));
+		}
+		magick_image->read (_blob);
+		if (reduce > 0) {
+			/* Find out how much libjpeg actually scaled by, rather than assuming it did what we asked */
+			optional<int> const s = jpeg_scaling (full, dcp::Size (magick_image->columns(), magick_image->rows()));
+			if (s) {
+				scaling = *s;
+			} else {
+				/* We can't describe the size that we got as a power-of-2 reduction, so decode at full size */
+				delete magick_image;
+				magick_image = 0;
+				magick_image = new Magick::Image ();
+				magick_image->read (_blob);
+			}
+		}
 	} catch (Magick::Exception& e) {
+		delete magick_image;
+		magick_image = 0;
 		error = e.what ();
 	}
 
@@ -137,7 +228,10 @@ MagickImageProxy::image (optional<dcp::NoteHandler>, optional<dcp::Size>) const
 
 	delete magick_image;
 
-	return _image;
+	_target_size = target_size;
+	_log2_scaling = scaling;
+
+	return Result (_image, _log2_scaling);
 }
 
 void
@@ -168,6 +262,14 @@ MagickImageProxy::same (shared_ptr<const ImageProxy> other) const
 	return memcmp (_blob.data(), mp->_blob.data(), _blob.length()) == 0;
 }
 
+string
+MagickImageProxy::digest () const
+{
+	Digester digester;
+	digester.add (_blob.data(), _blob.length());
+	return digester.get ();
+}
+
 AVPixelFormat
 MagickImageProxy::pixel_format () const
 {
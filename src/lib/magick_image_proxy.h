@@ -29,19 +29,27 @@ public:
 	MagickImageProxy (boost::filesystem::path);
 	MagickImageProxy (boost::shared_ptr<cxml::Node> xml, boost::shared_ptr<Socket> socket);
 
-	boost::shared_ptr<Image> image (
+	Result image (
 		boost::optional<dcp::NoteHandler> note = boost::optional<dcp::NoteHandler> (),
-		boost::optional<dcp::Size> size = boost::optional<dcp::Size> ()
+		boost::optional<dcp::Size> size = boost::optional<dcp::Size> (),
+		bool fast = false
 		) const;
 
 	void add_metadata (xmlpp::Node *) const;
 	void send_binary (boost::shared_ptr<Socket>) const;
 	bool same (boost::shared_ptr<const ImageProxy> other) const;
+	std::string digest () const;
 	AVPixelFormat pixel_format () const;
 	size_t memory_used () const;
 
 private:
+	int jpeg_reduction (boost::optional<dcp::Size> target_size, dcp::Size& full) const;
+
 	Magick::Blob _blob;
 	mutable boost::shared_ptr<Image> _image;
+	/** log2 of the scaling that was applied when decoding _image */
+	mutable int _log2_scaling;
+	/** target size that _image was decoded for, if it was decoded for a preview */
+	mutable boost::optional<dcp::Size> _target_size;
 	mutable boost::mutex _mutex;
 };
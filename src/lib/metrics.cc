@@ -0,0 +1,234 @@
+/*
+    Copyright (C) 2018 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/** @file  src/lib/metrics.cc
+ *  @brief Metrics class.
+ */
+
+#include "metrics.h"
+#include "dcpomatic_assert.h"
+#include <locale>
+#include <sstream>
+#include <iomanip>
+
+using std::string;
+using std::map;
+using std::make_pair;
+using std::ostringstream;
+using std::setprecision;
+
+Metrics* Metrics::_instance = 0;
+
+/** Upper bounds of the buckets used for all histograms, in seconds */
+static double const bucket_bounds[] = {
+	0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10
+};
+
+#define BUCKETS (sizeof (bucket_bounds) / sizeof (bucket_bounds[0]))
+
+/** Descriptions of the metrics that we know about, for the HELP lines of the output */
+static char const * const help[][2] = {
+	{ "dcpomatic_encoder_frames_total", "Frames encoded to JPEG2000 by the master, by server and thread" },
+	{ "dcpomatic_encoder_frame_seconds", "Time taken to encode a frame (including network transfer for remote encodes), by server" },
+	{ "dcpomatic_encoder_queue_frames", "Frames waiting in the master's queue to be encoded" },
+	{ "dcpomatic_encoder_remote_failures_total", "Failed attempts to encode a frame on a remote server" },
+	{ "dcpomatic_encoder_remote_sent_bytes_total", "Bytes sent to remote encoding servers" },
+	{ "dcpomatic_encoder_remote_received_bytes_total", "Bytes received from remote encoding servers" },
+	{ "dcpomatic_encoder_reused_frames_total", "Frames which were not encoded because we already had them, by where they came from (black, recent or cache)" },
+	{ "dcpomatic_writer_frames_total", "Video frames written to DCPs, by type (full, fake, repeat or copy-left-eye)" },
+	{ "dcpomatic_writer_pushed_to_disk_total", "Encoded frames written to temporary files because the writer's queue was full" },
+	{ "dcpomatic_writer_queue_frames", "Frames waiting in the writer's queue" },
+	{ "dcpomatic_butler_video_frames", "Video frames buffered by the butler" },
+	{ "dcpomatic_butler_audio_frames", "Audio frames buffered by the butler" },
+	{ "dcpomatic_butler_audio_underruns", "Times that the butler has not had enough audio to give to its consumer" },
+	{ "dcpomatic_server_frames_total", "Frames encoded by this encoding server, by thread" },
+	{ "dcpomatic_server_frame_seconds", "Time taken by this encoding server to encode a frame" },
+	{ "dcpomatic_server_queue_frames", "Frames waiting in this encoding server's queue" },
+	{ "dcpomatic_server_received_bytes_total", "Bytes received by this encoding server" },
+	{ "dcpomatic_server_sent_bytes_total", "Bytes sent by this encoding server" },
+	{ "dcpomatic_server_failures_total", "Frames that this encoding server failed to encode" },
+	{ "dcpomatic_examination_cache_hits_total", "Content examinations which were answered from the examination cache" }
+};
+
+/** @return A number formatted for the Prometheus text format, regardless of locale */
+static string
+format (double v)
+{
+	ostringstream s;
+	s.imbue (std::locale::classic ());
+	s << setprecision (15) << v;
+	return s.str ();
+}
+
+/** @return A label which can be used with increment(), set() or observe(), or
+ *  joined to others with commas to make a longer label.
+ */
+string
+Metrics::label (string name, string value)
+{
+	string escaped;
+	for (size_t i = 0; i < value.length(); ++i) {
+		switch (value[i]) {
+		case '\\':
+			escaped += "\\\\";
+			break;
+		case '"':
+			escaped += "\\\"";
+			break;
+		case '\n':
+			escaped += "\\n";
+			break;
+		default:
+			escaped += value[i];
+			break;
+		}
+	}
+
+	return name + "=\"" + escaped + "\"";
+}
+
+/** Caller must hold a lock on _mutex */
+Metrics::Series &
+Metrics::series (string name, string labels, Type type)
+{
+	map<string, Family>::iterator i = _families.find (name);
+	if (i == _families.end ()) {
+		i = _families.insert (make_pair (name, Family ())).first;
+		i->second.type = type;
+	}
+
+	/* We can't use one name for two different types of metric */
+	DCPOMATIC_ASSERT (i->second.type == type);
+	return i->second.series[labels];
+}
+
+/** Add to a counter */
+void
+Metrics::increment (string name, string labels, double amount)
+{
+	boost::mutex::scoped_lock lm (_mutex);
+	series(name, labels, COUNTER).value += amount;
+}
+
+/** Set the value of a gauge */
+void
+Metrics::set (string name, string labels, double value)
+{
+	boost::mutex::scoped_lock lm (_mutex);
+	series(name, labels, GAUGE).value = value;
+}
+
+/** Record an observation (e.g. a time in seconds) in a histogram */
+void
+Metrics::observe (string name, string labels, double value)
+{
+	boost::mutex::scoped_lock lm (_mutex);
+	Series& s = series (name, labels, HISTOGRAM);
+	if (s.buckets.empty ()) {
+		s.buckets.resize (BUCKETS + 1);
+	}
+
+	size_t b = 0;
+	while (b < BUCKETS && value > bucket_bounds[b]) {
+		++b;
+	}
+
+	++s.buckets[b];
+	++s.count;
+	s.value += value;
+}
+
+/** @return Value of a counter or gauge, or the number of observations in a histogram;
+ *  0 if nothing has been recorded.
+ */
+double
+Metrics::get (string name, string labels) const
+{
+	boost::mutex::scoped_lock lm (_mutex);
+	map<string, Family>::const_iterator i = _families.find (name);
+	if (i == _families.end ()) {
+		return 0;
+	}
+
+	map<string, Series>::const_iterator j = i->second.series.find (labels);
+	if (j == i->second.series.end ()) {
+		return 0;
+	}
+
+	return i->second.type == HISTOGRAM ? j->second.count : j->second.value;
+}
+
+/** @return All our metrics in the Prometheus text exposition format */
+string
+Metrics::prometheus () const
+{
+	boost::mutex::scoped_lock lm (_mutex);
+
+	string out;
+	for (map<string, Family>::const_iterator i = _families.begin(); i != _families.end(); ++i) {
+		for (size_t j = 0; j < sizeof (help) / sizeof (help[0]); ++j) {
+			if (i->first == help[j][0]) {
+				out += "# HELP " + i->first + " " + help[j][1] + "\n";
+			}
+		}
+
+		switch (i->second.type) {
+		case COUNTER:
+			out += "# TYPE " + i->first + " counter\n";
+			break;
+		case GAUGE:
+			out += "# TYPE " + i->first + " gauge\n";
+			break;
+		case HISTOGRAM:
+			out += "# TYPE " + i->first + " histogram\n";
+			break;
+		}
+
+		for (map<string, Series>::const_iterator j = i->second.series.begin(); j != i->second.series.end(); ++j) {
+			string const braced = j->first.empty() ? "" : "{" + j->first + "}";
+			if (i->second.type != HISTOGRAM) {
+				out += i->first + braced + " " + format (j->second.value) + "\n";
+				continue;
+			}
+
+			string const prefix = j->first.empty() ? "" : j->first + ",";
+			uint64_t total = 0;
+			for (size_t k = 0; k <= BUCKETS; ++k) {
+				total += j->second.buckets[k];
+				string const le = k < BUCKETS ? format (bucket_bounds[k]) : "+Inf";
+				out += i->first + "_bucket{" + prefix + "le=\"" + le + "\"} " + format (total) + "\n";
+			}
+			out += i->first + "_sum" + braced + " " + format (j->second.value) + "\n";
+			out += i->first + "_count" + braced + " " + format (j->second.count) + "\n";
+		}
+	}
+
+	return out;
+}
+
+Metrics *
+Metrics::instance ()
+{
+	if (!_instance) {
+		_instance = new Metrics ();
+	}
+
+	return _instance;
+}
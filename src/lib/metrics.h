@@ -0,0 +1,95 @@
+/*
+    Copyright (C) 2018 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/** @file  src/lib/metrics.h
+ *  @brief Metrics class.
+ */
+
+#ifndef DCPOMATIC_METRICS_H
+#define DCPOMATIC_METRICS_H
+
+#include <boost/noncopyable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <map>
+
+/** @class Metrics
+ *  @brief A set of counters, gauges and histograms describing what this process is doing,
+ *  which can be written out in the Prometheus text exposition format.
+ *
+ *  Each metric has a name and may be split into several series by a string of labels
+ *  (e.g. <code>server="localhost",thread="2"</code>) which can be made with label().
+ *  Updates take a single lock for a couple of map lookups, so they are cheap enough
+ *  to make for every frame.
+ */
+class Metrics : public boost::noncopyable
+{
+public:
+	void increment (std::string name, std::string labels = "", double amount = 1);
+	void set (std::string name, std::string labels, double value);
+	void observe (std::string name, std::string labels, double value);
+
+	double get (std::string name, std::string labels = "") const;
+	std::string prometheus () const;
+
+	static std::string label (std::string name, std::string value);
+
+	static Metrics* instance ();
+
+private:
+	Metrics () {}
+
+	enum Type {
+		COUNTER,
+		GAUGE,
+		HISTOGRAM
+	};
+
+	struct Series {
+		Series ()
+			: value (0)
+			, count (0)
+		{}
+
+		/** counter or gauge value, or the sum of observations for a histogram */
+		double value;
+		/** number of observations (histograms only) */
+		uint64_t count;
+		/** number of observations in each bucket, not cumulative (histograms only) */
+		std::vector<uint64_t> buckets;
+	};
+
+	struct Family {
+		Type type;
+		std::map<std::string, Series> series;
+	};
+
+	Series& series (std::string name, std::string labels, Type type);
+
+	/** mutex to protect _families */
+	mutable boost::mutex _mutex;
+	std::map<std::string, Family> _families;
+
+	static Metrics* _instance;
+};
+
+#endif
@@ -49,6 +49,7 @@
 #include "image_decoder.h"
 #include "compose.hpp"
 #include "shuffler.h"
+#include "filter.h"
 #include <dcp/reel.h>
 #include <dcp/reel_sound_asset.h>
 #include <dcp/reel_subtitle_asset.h>
@@ -72,12 +73,34 @@ using std::pair;
 using std::map;
 using std::make_pair;
 using std::copy;
+using std::string;
 using boost::shared_ptr;
 using boost::weak_ptr;
 using boost::dynamic_pointer_cast;
 using boost::optional;
 using boost::scoped_ptr;
 
+/** @return An identifier for the images that some content gives, which (with the index of a frame
+ *  within the content) tells us which source image a PlayerVideo was made from.  Unlike
+ *  Content::identifier() this does not change when the content is moved or trimmed, or when only
+ *  its subtitles change.  Crop, scale, fade and colour conversion are taken care of by
+ *  PlayerVideo::digest().
+ */
+static string
+video_source_identifier (shared_ptr<const Content> content)
+{
+	string s = String::compose ("%1_%2", content->digest(), static_cast<int> (content->video->frame_type ()));
+
+	shared_ptr<const FFmpegContent> ffmpeg = dynamic_pointer_cast<const FFmpegContent> (content);
+	if (ffmpeg) {
+		BOOST_FOREACH (Filter const * i, ffmpeg->filters ()) {
+			s += "_" + i->id ();
+		}
+	}
+
+	return s;
+}
+
 Player::Player (shared_ptr<const Film> film, shared_ptr<const Playlist> playlist)
 	: _film (film)
 	, _playlist (playlist)
@@ -327,7 +350,7 @@ Player::transform_image_subtitles (list<ImageSubtitle> subs) const
 shared_ptr<PlayerVideo>
 Player::black_player_video_frame (Eyes eyes) const
 {
-	return shared_ptr<PlayerVideo> (
+	shared_ptr<PlayerVideo> pv (
 		new PlayerVideo (
 			shared_ptr<const ImageProxy> (new RawImageProxy (_black_image)),
 			Crop (),
@@ -339,6 +362,9 @@ Player::black_player_video_frame (Eyes eyes) const
 			PresetColourConversion::all().front().conversion
 		)
 	);
+
+	pv->set_black ();
+	return pv;
 }
 
 Frame
@@ -424,6 +450,7 @@ void
 Player::set_ignore_video ()
 {
 	_ignore_video = true;
+	_have_valid_pieces = false;
 }
 
 void
@@ -633,12 +660,15 @@ Player::pass ()
 	list<pair<shared_ptr<AudioBuffers>, DCPTime> > audio = _audio_merger.pull (pull_to);
 	for (list<pair<shared_ptr<AudioBuffers>, DCPTime> >::iterator i = audio.begin(); i != audio.end(); ++i) {
 		if (_last_audio_time && i->second < *_last_audio_time) {
-			/* This new data comes before the last we emitted (or the last seek); discard it */
-			pair<shared_ptr<AudioBuffers>, DCPTime> cut = discard_audio (i->first, i->second, *_last_audio_time);
-			if (!cut.first) {
+			/* This new data comes before the last we emitted (or the last seek); discard it.
+			   Nobody else has this audio so we can trim it where it is.
+			*/
+			Frame const discard_frames = DCPTime(*_last_audio_time - i->second).frames_round(_film->audio_frame_rate());
+			if (discard_frames >= i->first->frames()) {
 				continue;
 			}
-			*i = cut;
+			i->first->trim_start (discard_frames);
+			i->second = *_last_audio_time;
 		} else if (_last_audio_time && i->second > *_last_audio_time) {
 			/* There's a gap between this data and the last we emitted; fill with silence */
 			fill_audio (DCPTimePeriod (*_last_audio_time, i->second));
@@ -757,6 +787,8 @@ Player::video (weak_ptr<Piece> wp, ContentVideo video)
 			)
 		);
 
+	_last_video[wp]->set_source (String::compose ("%1_%2", video_source_identifier (piece->content), video.frame));
+
 	DCPTime t = time;
 	for (int i = 0; i < frc.repeat; ++i) {
 		if (t < piece->content->end()) {
@@ -786,7 +818,7 @@ Player::audio (weak_ptr<Piece> wp, AudioStreamPtr stream, ContentAudio content_a
 
 	/* Remove anything that comes before the start or after the end of the content */
 	if (time < piece->content->position()) {
-		pair<shared_ptr<AudioBuffers>, DCPTime> cut = discard_audio (content_audio.audio, time, piece->content->position());
+		pair<shared_ptr<const AudioBuffers>, DCPTime> cut = discard_audio (content_audio.audio, time, piece->content->position());
 		if (!cut.first) {
 			/* This audio is entirely discarded */
 			return;
@@ -801,9 +833,7 @@ Player::audio (weak_ptr<Piece> wp, AudioStreamPtr stream, ContentAudio content_a
 		if (remaining_frames == 0) {
 			return;
 		}
-		shared_ptr<AudioBuffers> cut (new AudioBuffers (content_audio.audio->channels(), remaining_frames));
-		cut->copy_from (content_audio.audio.get(), remaining_frames, 0, 0);
-		content_audio.audio = cut;
+		content_audio.audio = content_audio.audio->slice (0, remaining_frames);
 	}
 
 	DCPOMATIC_ASSERT (content_audio.audio->frames() > 0);
@@ -818,7 +848,12 @@ Player::audio (weak_ptr<Piece> wp, AudioStreamPtr stream, ContentAudio content_a
 
 	/* Remap */
 
-	content_audio.audio = remap (content_audio.audio, _film->audio_channels(), stream->mapping());
+	shared_ptr<const SparseAudioMapping> mapping = stream->sparse_mapping (_film->audio_channels ());
+	if (!mapping->identity ()) {
+		shared_ptr<AudioBuffers> mapped (new AudioBuffers (mapping->output_channels(), content_audio.audio->frames()));
+		mapping->apply (content_audio.audio.get(), mapped.get());
+		content_audio.audio = mapped;
+	}
 
 	/* Process */
 
@@ -1004,13 +1039,24 @@ Player::fill_audio (DCPTimePeriod period)
 
 	DCPOMATIC_ASSERT (period.from < period.to);
 
+	int const channels = _film->audio_channels ();
+
 	DCPTime t = period.from;
 	while (t < period.to) {
 		DCPTime block = min (DCPTime::from_seconds (0.5), period.to - t);
 		Frame const samples = block.frames_round(_film->audio_frame_rate());
 		if (samples) {
-			shared_ptr<AudioBuffers> silence (new AudioBuffers (_film->audio_channels(), samples));
-			silence->make_silent ();
+			/* Most blocks are the same length, so we keep some silence of that length to use for
+			   all of them; this is safe as nothing that receives our Audio modifies it.
+			*/
+			shared_ptr<AudioBuffers> silence = _silence;
+			if (!silence || silence->channels() != channels || silence->frames() != samples) {
+				silence.reset (new AudioBuffers (channels, samples));
+				silence->make_silent ();
+				if (block == DCPTime::from_seconds (0.5)) {
+					_silence = silence;
+				}
+			}
 			emit_audio (silence, t);
 		}
 		t += block;
@@ -1023,18 +1069,16 @@ Player::one_video_frame () const
 	return DCPTime::from_frames (1, _film->video_frame_rate ());
 }
 
-pair<shared_ptr<AudioBuffers>, DCPTime>
+pair<shared_ptr<const AudioBuffers>, DCPTime>
 Player::discard_audio (shared_ptr<const AudioBuffers> audio, DCPTime time, DCPTime discard_to) const
 {
 	DCPTime const discard_time = discard_to - time;
 	Frame const discard_frames = discard_time.frames_round(_film->audio_frame_rate());
 	Frame remaining_frames = audio->frames() - discard_frames;
 	if (remaining_frames <= 0) {
-		return make_pair(shared_ptr<AudioBuffers>(), DCPTime());
+		return make_pair(shared_ptr<const AudioBuffers>(), DCPTime());
 	}
-	shared_ptr<AudioBuffers> cut (new AudioBuffers (audio->channels(), remaining_frames));
-	cut->copy_from (audio.get(), remaining_frames, discard_frames, 0);
-	return make_pair(cut, time + discard_time);
+	return make_pair(audio->slice (discard_frames, remaining_frames), time + discard_time);
 }
 
 void
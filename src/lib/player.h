@@ -115,7 +115,7 @@ private:
 	void subtitle_stop (boost::weak_ptr<Piece>, ContentTime);
 	DCPTime one_video_frame () const;
 	void fill_audio (DCPTimePeriod period);
-	std::pair<boost::shared_ptr<AudioBuffers>, DCPTime> discard_audio (
+	std::pair<boost::shared_ptr<const AudioBuffers>, DCPTime> discard_audio (
 		boost::shared_ptr<const AudioBuffers> audio, DCPTime time, DCPTime discard_to
 		) const;
 	boost::optional<PositionImage> subtitles_for_frame (DCPTime time) const;
@@ -132,6 +132,8 @@ private:
 	/** Size of the image in the DCP (e.g. 1990x1080 for flat) */
 	dcp::Size _video_container_size;
 	boost::shared_ptr<Image> _black_image;
+	/** a block of silence of the usual length used by fill_audio(), re-used while it is the right size */
+	boost::shared_ptr<AudioBuffers> _silence;
 
 	/** true if the player should ignore all video; i.e. never produce any */
 	bool _ignore_video;
@@ -23,6 +23,8 @@
 #include "image_proxy.h"
 #include "j2k_image_proxy.h"
 #include "film.h"
+#include "digester.h"
+#include "dcpomatic_assert.h"
 #include <dcp/raw_convert.h>
 extern "C" {
 #include <libavutil/pixfmt.h>
@@ -57,11 +59,13 @@ PlayerVideo::PlayerVideo (
 	, _eyes (eyes)
 	, _part (part)
 	, _colour_conversion (colour_conversion)
+	, _black (false)
 {
 
 }
 
 PlayerVideo::PlayerVideo (shared_ptr<cxml::Node> node, shared_ptr<Socket> socket)
+	: _black (false)
 {
 	_crop = Crop (node);
 	_fade = node->optional_number_child<double> ("Fade");
@@ -94,6 +98,23 @@ PlayerVideo::set_subtitle (PositionImage image)
 	_subtitle = image;
 }
 
+/** Set a description of where our image came from, which must uniquely identify it
+ *  (including any processing done on it by the decoder); this is needed by digest().
+ */
+void
+PlayerVideo::set_source (string source)
+{
+	_source = source;
+}
+
+/** Mark this frame as being black, made by the Player to fill a gap */
+void
+PlayerVideo::set_black ()
+{
+	_black = true;
+	_source = "black";
+}
+
 /** Create an image for this frame.
  *  @param note Handler for any notes that are made during the process.
  *  @param pixel_format Function which is called to decide what pixel format the output image should be;
@@ -105,9 +126,39 @@ PlayerVideo::set_subtitle (PositionImage image)
 shared_ptr<Image>
 PlayerVideo::image (dcp::NoteHandler note, function<AVPixelFormat (AVPixelFormat)> pixel_format, bool aligned, bool fast) const
 {
-	shared_ptr<Image> im = _in->image (optional<dcp::NoteHandler> (note), _inter_size);
+	shared_ptr<Image> out (
+		new Image (pixel_format (_in->pixel_format()), _out_size, aligned, (_out_size.width - _inter_size.width) / 2)
+		);
+	image (note, fast, out, 0);
+	return out;
+}
+
+/** Draw this frame into an existing image, which must be the same size as our output
+ *  (out_size()) and must have been created with enough extra pixels for
+ *  Image::crop_scale_window().
+ *  @param note Handler for any notes that are made during the process.
+ *  @param fast true to be fast at the expense of quality.
+ *  @param out Image to draw into; the image is converted to this image's pixel format.
+ *  @param scale_context Scale context to re-use, or 0; see Image::crop_scale_window().
+ */
+void
+PlayerVideo::image (dcp::NoteHandler note, bool fast, shared_ptr<Image> out, struct SwsContext** scale_context) const
+{
+	DCPOMATIC_ASSERT (out->size() == _out_size);
+
+	ImageProxy::Result prox = _in->image (optional<dcp::NoteHandler> (note), _inter_size, fast);
+	shared_ptr<Image> im = prox.image;
+
+	/* The proxy may have given us an image which is smaller than the original,
+	   in which case the crop must be scaled down to match.
+	*/
+	Crop total_crop (
+		_crop.left >> prox.log2_scaling,
+		_crop.right >> prox.log2_scaling,
+		_crop.top >> prox.log2_scaling,
+		_crop.bottom >> prox.log2_scaling
+		);
 
-	Crop total_crop = _crop;
 	switch (_part) {
 	case PART_LEFT_HALF:
 		total_crop.right += im->size().width / 2;
@@ -130,9 +181,7 @@ PlayerVideo::image (dcp::NoteHandler note, function<AVPixelFormat (AVPixelFormat
 		yuv_to_rgb = _colour_conversion.get().yuv_to_rgb();
 	}
 
-	shared_ptr<Image> out = im->crop_scale_window (
-		total_crop, _inter_size, _out_size, yuv_to_rgb, pixel_format (_in->pixel_format()), aligned, fast
-		);
+	im->crop_scale_window (total_crop, _inter_size, yuv_to_rgb, fast, out, scale_context);
 
 	if (_subtitle) {
 		out->alpha_blend (Image::ensure_aligned (_subtitle->image), _subtitle->position);
@@ -141,8 +190,6 @@ PlayerVideo::image (dcp::NoteHandler note, function<AVPixelFormat (AVPixelFormat
 	if (_fade) {
 		out->fade (_fade.get ());
 	}
-
-	return out;
 }
 
 void
@@ -209,12 +256,20 @@ PlayerVideo::inter_position () const
 /** @return true if this PlayerVideo is definitely the same as another, false if it is probably not */
 bool
 PlayerVideo::same (shared_ptr<const PlayerVideo> other) const
+{
+	return _eyes == other->_eyes && same_image (other);
+}
+
+/** @return true if this PlayerVideo will definitely give the same image as another, though possibly
+ *  for a different eye; false if it probably will not.
+ */
+bool
+PlayerVideo::same_image (shared_ptr<const PlayerVideo> other) const
 {
 	if (_crop != other->_crop ||
 	    _fade.get_value_or(0) != other->_fade.get_value_or(0) ||
 	    _inter_size != other->_inter_size ||
 	    _out_size != other->_out_size ||
-	    _eyes != other->_eyes ||
 	    _part != other->_part ||
 	    _colour_conversion != other->_colour_conversion) {
 		return false;
@@ -232,9 +287,76 @@ PlayerVideo::same (shared_ptr<const PlayerVideo> other) const
 
 	/* Now neither has subtitles */
 
+	if (_in == other->_in || (_black && other->_black)) {
+		/* Save comparing the images, which can take a while */
+		return true;
+	}
+
 	return _in->same (other->_in);
 }
 
+/** @return A digest of everything that goes into making this frame's image, so that two
+ *  PlayerVideos with the same digest will give the same image, or an empty optional if
+ *  we don't know where our image came from.
+ */
+optional<string>
+PlayerVideo::digest () const
+{
+	if (!_source) {
+		return optional<string> ();
+	}
+
+	Digester digester;
+	digester.add (_source.get ());
+	add_settings (digester);
+	return digester.get ();
+}
+
+/** @return A digest of our source image data and everything that is done to it, so that
+ *  two PlayerVideos with the same image digest will give the same image wherever they came from.
+ *  This may take a while as it may need to look at every pixel of the source image.
+ */
+string
+PlayerVideo::image_digest () const
+{
+	Digester digester;
+	digester.add (_in->digest ());
+	add_settings (digester);
+	return digester.get ();
+}
+
+/** Add everything that is done to our source image to a Digester */
+void
+PlayerVideo::add_settings (Digester& digester) const
+{
+	digester.add (_crop.left);
+	digester.add (_crop.right);
+	digester.add (_crop.top);
+	digester.add (_crop.bottom);
+	digester.add (_fade.get_value_or (1));
+	digester.add (_inter_size.width);
+	digester.add (_inter_size.height);
+	digester.add (_out_size.width);
+	digester.add (_out_size.height);
+	digester.add (static_cast<int> (_eyes));
+	digester.add (static_cast<int> (_part));
+
+	if (_colour_conversion) {
+		digester.add (_colour_conversion->identifier ());
+	}
+
+	if (_subtitle) {
+		digester.add (_subtitle->position.x);
+		digester.add (_subtitle->position.y);
+		shared_ptr<const Image> image = _subtitle->image;
+		digester.add (image->size().width);
+		digester.add (image->size().height);
+		for (int y = 0; y < image->size().height; ++y) {
+			digester.add (image->data()[0] + y * image->stride()[0], image->line_size()[0]);
+		}
+	}
+}
+
 AVPixelFormat
 PlayerVideo::always_rgb (AVPixelFormat)
 {
@@ -263,7 +385,7 @@ PlayerVideo::memory_used () const
 shared_ptr<PlayerVideo>
 PlayerVideo::shallow_copy () const
 {
-	return shared_ptr<PlayerVideo>(
+	shared_ptr<PlayerVideo> copy (
 		new PlayerVideo(
 			_in,
 			_crop,
@@ -275,4 +397,8 @@ PlayerVideo::shallow_copy () const
 			_colour_conversion
 			)
 		);
+
+	copy->_source = _source;
+	copy->_black = _black;
+	return copy;
 }
@@ -31,9 +31,11 @@ extern "C" {
 }
 #include <boost/shared_ptr.hpp>
 
+class Digester;
 class Image;
 class ImageProxy;
 class Socket;
+struct SwsContext;
 
 /** Everything needed to describe a video frame coming out of the player, but with the
  *  bits still their raw form.  We may want to combine the bits on a remote machine,
@@ -58,9 +60,12 @@ public:
 	boost::shared_ptr<PlayerVideo> shallow_copy () const;
 
 	void set_subtitle (PositionImage);
+	void set_source (std::string source);
+	void set_black ();
 
 	void prepare ();
 	boost::shared_ptr<Image> image (dcp::NoteHandler note, boost::function<AVPixelFormat (AVPixelFormat)> pixel_format, bool aligned, bool fast) const;
+	void image (dcp::NoteHandler note, bool fast, boost::shared_ptr<Image> out, struct SwsContext** scale_context) const;
 
 	static AVPixelFormat always_rgb (AVPixelFormat);
 	static AVPixelFormat keep_xyz_or_rgb (AVPixelFormat);
@@ -91,11 +96,26 @@ public:
 		return _inter_size;
 	}
 
+	/** @return Size of the overall image, including any padding */
+	dcp::Size out_size () const {
+		return _out_size;
+	}
+
+	/** @return true if this frame is just black, with no subtitle on it */
+	bool black () const {
+		return _black && !_subtitle;
+	}
+
 	bool same (boost::shared_ptr<const PlayerVideo> other) const;
+	bool same_image (boost::shared_ptr<const PlayerVideo> other) const;
+	boost::optional<std::string> digest () const;
+	std::string image_digest () const;
 
 	size_t memory_used () const;
 
 private:
+	void add_settings (Digester& digester) const;
+
 	boost::shared_ptr<const ImageProxy> _in;
 	Crop _crop;
 	boost::optional<double> _fade;
@@ -105,6 +125,10 @@ private:
 	Part _part;
 	boost::optional<ColourConversion> _colour_conversion;
 	boost::optional<PositionImage> _subtitle;
+	/** identifier of the content and frame that _in came from, if known */
+	boost::optional<std::string> _source;
+	/** true if _in is a black image made to fill a gap */
+	bool _black;
 };
 
 #endif
@@ -0,0 +1,267 @@
+/*
+    Copyright (C) 2018 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/** @file  src/lib/range_encoder.cc
+ *  @brief RangeEncoder class.
+ */
+
+#include "range_encoder.h"
+#include "film.h"
+#include "player.h"
+#include "player_video.h"
+#include "dcp_video.h"
+#include "log.h"
+#include "dcpomatic_assert.h"
+#include <dcp/data.h>
+#include <boost/foreach.hpp>
+#include <boost/bind.hpp>
+#include <iterator>
+
+using std::list;
+using std::advance;
+using boost::shared_ptr;
+using boost::bind;
+using dcp::Data;
+
+/** @return The eyes that we need to write J2C files for, given a frame with some eyes */
+static list<Eyes>
+eyes_to_write (shared_ptr<const Film> film, Eyes eyes)
+{
+	list<Eyes> e;
+	if (film->three_d() && eyes == EYES_BOTH) {
+		/* 2D material in a 3D DCP; both eyes get the same image */
+		e.push_back (EYES_LEFT);
+		e.push_back (EYES_RIGHT);
+	} else {
+		e.push_back (eyes);
+	}
+	return e;
+}
+
+static DCPTimePeriod
+reel_period (shared_ptr<const Film> film, int reel)
+{
+	list<DCPTimePeriod> const reels = film->reels ();
+	DCPOMATIC_ASSERT (reel >= 0 && reel < int (reels.size ()));
+	list<DCPTimePeriod>::const_iterator i = reels.begin ();
+	advance (i, reel);
+	return *i;
+}
+
+/** @param film Film to encode.
+ *  @param reel Index of the reel whose video should be encoded.
+ *  @param threads Number of threads to encode with.
+ *  @param cancelled Function which returns true if we should stop early, or empty.
+ */
+RangeEncoder::RangeEncoder (shared_ptr<const Film> film, int reel, int threads, boost::function<bool ()> cancelled)
+	: _film (film)
+	, _period (reel_period (film, reel))
+	, _player (new Player (film, film->playlist ()))
+	, _finished (false)
+	, _cancelled (cancelled)
+	, _maximum_queue (threads * 2 + 1)
+	, _terminate (false)
+	, _written (0)
+{
+	_player->Video.connect (bind (&RangeEncoder::video, this, _1, _2));
+
+	for (int i = 0; i < threads; ++i) {
+		_threads.create_thread (bind (&RangeEncoder::encoder_thread, this));
+	}
+}
+
+RangeEncoder::~RangeEncoder ()
+{
+	terminate_threads ();
+}
+
+void
+RangeEncoder::terminate_threads ()
+{
+	{
+		boost::mutex::scoped_lock lm (_mutex);
+		_queue.clear ();
+		_terminate = true;
+		_empty_condition.notify_all ();
+	}
+
+	_threads.join_all ();
+}
+
+bool
+RangeEncoder::cancelled () const
+{
+	return _cancelled && _cancelled ();
+}
+
+/** Encode the reel, blocking until it is done.
+ *  @return Number of frames that were encoded (which will not include any that were
+ *  already present in the j2c directory).
+ */
+Frame
+RangeEncoder::go ()
+{
+	_player->seek (_period.from, true);
+	while (!_finished && !_player->pass ()) {}
+
+	{
+		/* Let the threads finish what is in the queue and then stop */
+		boost::mutex::scoped_lock lm (_mutex);
+		_terminate = true;
+		_empty_condition.notify_all ();
+	}
+
+	_threads.join_all ();
+	rethrow ();
+
+	boost::mutex::scoped_lock lm (_mutex);
+	return _written;
+}
+
+void
+RangeEncoder::video (shared_ptr<PlayerVideo> pv, DCPTime time)
+{
+	if (_finished || time < _period.from) {
+		return;
+	}
+
+	if (cancelled ()) {
+		/* Stop the player; the encoder threads will drop what is in the queue */
+		_finished = true;
+		return;
+	}
+
+	if (time >= _period.to) {
+		_finished = true;
+		return;
+	}
+
+	if (!_film->three_d() && pv->eyes() == EYES_LEFT) {
+		/* Use left-eye images for both eyes */
+		pv->set_eyes (EYES_BOTH);
+	}
+
+	int const vfr = _film->video_frame_rate ();
+	Frame const position = time.frames_floor (vfr);
+	Frame const reel_frame = position - _period.from.frames_floor (vfr);
+
+	bool needed = false;
+	BOOST_FOREACH (Eyes i, eyes_to_write (_film, pv->eyes ())) {
+		if (!boost::filesystem::exists (_film->j2c_path (_period, reel_frame, i, false))) {
+			needed = true;
+		}
+	}
+
+	if (!needed) {
+		return;
+	}
+
+	boost::mutex::scoped_lock lm (_mutex);
+	while (int (_queue.size()) >= _maximum_queue) {
+		/* Stop if one of the encoding threads has failed */
+		rethrow ();
+		if (cancelled ()) {
+			_finished = true;
+			return;
+		}
+		_full_condition.wait (lm);
+	}
+
+	_queue.push_back (
+		shared_ptr<DCPVideo> (
+			new DCPVideo (pv, position, vfr, _film->j2k_bandwidth(), _film->resolution(), _film->log())
+			)
+		);
+
+	_empty_condition.notify_all ();
+}
+
+void
+RangeEncoder::encoder_thread ()
+try
+{
+	Frame const reel_start = _period.from.frames_floor (_film->video_frame_rate ());
+
+	while (true) {
+		boost::mutex::scoped_lock lm (_mutex);
+		while (_queue.empty () && !_terminate) {
+			_empty_condition.wait (lm);
+		}
+
+		if (_queue.empty ()) {
+			/* _terminate must be set and there is nothing more to do */
+			return;
+		}
+
+		if (cancelled ()) {
+			/* Drop the rest of the queue and wake the thread which is filling it */
+			_queue.clear ();
+			_full_condition.notify_all ();
+			return;
+		}
+
+		shared_ptr<DCPVideo> vf = _queue.front ();
+		_queue.pop_front ();
+		_full_condition.notify_all ();
+		lm.unlock ();
+
+		Data encoded = vf->encode_locally (boost::bind (&Log::dcp_log, _film->log().get(), _1, _2));
+
+		BOOST_FOREACH (Eyes i, eyes_to_write (_film, vf->eyes ())) {
+			/* Write via a temporary file so that a partial frame is never seen */
+			encoded.write_via_temp (
+				_film->j2c_path (_period, vf->index() - reel_start, i, true),
+				_film->j2c_path (_period, vf->index() - reel_start, i, false)
+				);
+		}
+
+		lm.lock ();
+		++_written;
+	}
+}
+catch (...)
+{
+	store_current ();
+	/* Wake the thread which is filling the queue so that it sees the exception */
+	boost::mutex::scoped_lock lm (_mutex);
+	_full_condition.notify_all ();
+}
+
+/** @return true if J2C files for every frame of a reel exist in a film's j2c directory */
+bool
+RangeEncoder::done (shared_ptr<const Film> film, int reel)
+{
+	DCPTimePeriod const period = reel_period (film, reel);
+	int const vfr = film->video_frame_rate ();
+	Frame const start = period.from.frames_floor (vfr);
+
+	/* This gives left and right for 3D films, otherwise both */
+	list<Eyes> const eyes = eyes_to_write (film, EYES_BOTH);
+
+	for (Frame i = start; DCPTime::from_frames (i, vfr) < period.to; ++i) {
+		BOOST_FOREACH (Eyes j, eyes) {
+			if (!boost::filesystem::exists (film->j2c_path (period, i - start, j, false))) {
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
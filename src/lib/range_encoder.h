@@ -0,0 +1,96 @@
+/*
+    Copyright (C) 2018 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/** @file  src/lib/range_encoder.h
+ *  @brief RangeEncoder class.
+ */
+
+#ifndef DCPOMATIC_RANGE_ENCODER_H
+#define DCPOMATIC_RANGE_ENCODER_H
+
+#include "dcpomatic_time.h"
+#include "exception_store.h"
+#include "types.h"
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+#include <boost/thread/condition.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/function.hpp>
+#include <list>
+
+class Film;
+class Player;
+class PlayerVideo;
+class DCPVideo;
+
+/** @class RangeEncoder
+ *  @brief Decode and encode the video of one reel of a film, writing the JPEG2000
+ *  data for each frame to the film's j2c directory.
+ *
+ *  The Writer can then write these frames into a DCP without encoding them again.
+ *  Frames which are already in the j2c directory are not encoded again, so an
+ *  interrupted RangeEncoder can be restarted.  A RangeEncoder may be given a function
+ *  which it calls to see if it should stop early; if this returns true go() returns
+ *  as soon as the frames which are being encoded have been written.
+ */
+class RangeEncoder : public boost::noncopyable, public ExceptionStore
+{
+public:
+	RangeEncoder (
+		boost::shared_ptr<const Film> film,
+		int reel,
+		int threads,
+		boost::function<bool ()> cancelled = boost::function<bool ()> ()
+		);
+	~RangeEncoder ();
+
+	Frame go ();
+
+	static bool done (boost::shared_ptr<const Film> film, int reel);
+
+private:
+	void video (boost::shared_ptr<PlayerVideo> pv, DCPTime time);
+	void encoder_thread ();
+	void terminate_threads ();
+	bool cancelled () const;
+
+	boost::shared_ptr<const Film> _film;
+	DCPTimePeriod _period;
+	boost::shared_ptr<Player> _player;
+	/** true when the player has given us all the video in _period, or we have been cancelled */
+	bool _finished;
+	/** function to say whether we should stop early, or empty */
+	boost::function<bool ()> _cancelled;
+
+	boost::thread_group _threads;
+	/** mutex to protect _queue, _terminate and _written */
+	boost::mutex _mutex;
+	/** condition to signal that _queue has something in it, or that we should terminate */
+	boost::condition _empty_condition;
+	/** condition to signal that _queue has space for more */
+	boost::condition _full_condition;
+	std::list<boost::shared_ptr<DCPVideo> > _queue;
+	int _maximum_queue;
+	bool _terminate;
+	/** number of frames that we have encoded and written */
+	Frame _written;
+};
+
+#endif
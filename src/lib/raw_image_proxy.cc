@@ -52,10 +52,10 @@ RawImageProxy::RawImageProxy (shared_ptr<cxml::Node> xml, shared_ptr<Socket> soc
 	_image->read_from_socket (socket);
 }
 
-shared_ptr<Image>
-RawImageProxy::image (optional<dcp::NoteHandler>, optional<dcp::Size>) const
+ImageProxy::Result
+RawImageProxy::image (optional<dcp::NoteHandler>, optional<dcp::Size>, bool) const
 {
-	return _image;
+	return Result (_image, 0);
 }
 
 void
@@ -81,7 +81,13 @@ RawImageProxy::same (shared_ptr<const ImageProxy> other) const
 		return false;
 	}
 
-	return (*_image.get()) == (*rp->image().get());
+	return (*_image.get()) == (*rp->image().image.get());
+}
+
+string
+RawImageProxy::digest () const
+{
+	return _image->digest ();
 }
 
 AVPixelFormat
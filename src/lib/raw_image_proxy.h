@@ -29,14 +29,16 @@ public:
 	RawImageProxy (boost::shared_ptr<Image>);
 	RawImageProxy (boost::shared_ptr<cxml::Node> xml, boost::shared_ptr<Socket> socket);
 
-	boost::shared_ptr<Image> image (
+	Result image (
 		boost::optional<dcp::NoteHandler> note = boost::optional<dcp::NoteHandler> (),
-		boost::optional<dcp::Size> size = boost::optional<dcp::Size> ()
+		boost::optional<dcp::Size> size = boost::optional<dcp::Size> (),
+		bool fast = false
 		) const;
 
 	void add_metadata (xmlpp::Node *) const;
 	void send_binary (boost::shared_ptr<Socket>) const;
 	bool same (boost::shared_ptr<const ImageProxy>) const;
+	std::string digest () const;
 	AVPixelFormat pixel_format () const;
 	size_t memory_used () const;
 
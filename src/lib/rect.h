@@ -91,10 +91,12 @@ public:
 
 	void extend (Rect<T> const & other)
 	{
+		T const right = std::max (x + width, other.x + other.width);
+		T const bottom = std::max (y + height, other.y + other.height);
 		x = std::min (x, other.x);
 		y = std::min (y, other.y);
-		width = std::max (x + width, other.x + other.width) - x;
-		height = std::max (y + height, other.y + other.height) - y;
+		width = right - x;
+		height = bottom - y;
 	}
 
 	Rect<T> extended (T amount) const {
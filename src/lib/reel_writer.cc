@@ -27,6 +27,8 @@
 #include "font.h"
 #include "compose.hpp"
 #include "audio_buffers.h"
+#include "asset_verifier.h"
+#include "config.h"
 #include <dcp/mono_picture_asset.h>
 #include <dcp/stereo_picture_asset.h>
 #include <dcp/sound_asset.h>
@@ -54,6 +56,7 @@
 using std::list;
 using std::string;
 using std::cout;
+using std::vector;
 using boost::shared_ptr;
 using boost::optional;
 using boost::dynamic_pointer_cast;
@@ -204,7 +207,12 @@ ReelWriter::check_existing_picture_asset ()
 	*/
 
 	if (boost::filesystem::exists(asset) && boost::filesystem::hard_link_count(asset) > 1) {
-		boost::filesystem::copy_file (asset, asset.string() + ".tmp");
+		/* A clone, if we can make one, costs no time or space and is still unaffected by our changes */
+		boost::system::error_code ec;
+		dcpomatic_copy_file (asset, asset.string() + ".tmp", ec);
+		if (ec) {
+			throw FileError (ec.message(), asset);
+		}
 		boost::filesystem::remove (asset);
 		boost::filesystem::rename (asset.string() + ".tmp", asset);
 	}
@@ -274,14 +282,21 @@ ReelWriter::fake_write (Frame frame, Eyes eyes, int size)
 	_last_written_eyes = eyes;
 }
 
+/** Write the last frame that we wrote for some eye again.
+ *  @param frame reel-relative frame to write.
+ *  @param eyes eyes to write.
+ *  @param from eyes of the last-written frame whose data should be used.
+ */
 void
-ReelWriter::repeat_write (Frame frame, Eyes eyes)
+ReelWriter::repeat_write (Frame frame, Eyes eyes, Eyes from)
 {
+	DCPOMATIC_ASSERT (_last_written[from]);
 	dcp::FrameInfo fin = _picture_asset_writer->write (
-		_last_written[eyes]->data().get(),
-		_last_written[eyes]->size()
+		_last_written[from]->data().get(),
+		_last_written[from]->size()
 		);
 	write_frame_info (frame, eyes, fin);
+	_last_written[eyes] = _last_written[from];
 	_last_written_video_frame = frame;
 	_last_written_eyes = eyes;
 }
@@ -311,9 +326,11 @@ ReelWriter::finish ()
 		boost::system::error_code ec;
 		boost::filesystem::create_hard_link (video_from, video_to, ec);
 		if (ec) {
-			LOG_WARNING_NC ("Hard-link failed; copying instead");
-			boost::filesystem::copy_file (video_from, video_to, ec);
-			if (ec) {
+			if (dcpomatic_copy_file (video_from, video_to, ec)) {
+				LOG_GENERAL_NC ("Hard-link failed; cloned instead");
+			} else if (!ec) {
+				LOG_WARNING_NC ("Hard-link failed; copied instead");
+			} else {
 				LOG_ERROR ("Failed to copy video file from %1 to %2 (%3)", video_from.string(), video_to.string(), ec.message ());
 				throw FileError (ec.message(), video_from);
 			}
@@ -510,7 +527,11 @@ void
 ReelWriter::calculate_digests (boost::function<void (float)> set_progress)
 {
 	if (_picture_asset) {
-		_picture_asset->hash (set_progress);
+		if (Config::instance()->verify_dcp ()) {
+			verify_picture_asset (set_progress);
+		} else {
+			_picture_asset->hash (set_progress);
+		}
 	}
 
 	if (_sound_asset) {
@@ -518,6 +539,53 @@ ReelWriter::calculate_digests (boost::function<void (float)> set_progress)
 	}
 }
 
+/** Compute the digest of our picture asset, checking each of its frames against
+ *  the hash that we recorded in the info file when it was written.
+ */
+void
+ReelWriter::verify_picture_asset (boost::function<void (float)> set_progress)
+{
+	DCPOMATIC_ASSERT (_picture_asset->file());
+	boost::filesystem::path const asset = _picture_asset->file().get();
+
+	boost::filesystem::path const info_file = _film->info_file (_period);
+	FILE* info = fopen_boost (info_file, "rb");
+	if (!info) {
+		throw OpenFileError (info_file, errno, true);
+	}
+
+	bool const three_d = _film->three_d ();
+	vector<dcp::FrameInfo> frames;
+	for (int64_t i = 0; i < _picture_asset->intrinsic_duration(); ++i) {
+		if (three_d) {
+			frames.push_back (read_frame_info (info, i, EYES_LEFT));
+			frames.push_back (read_frame_info (info, i, EYES_RIGHT));
+		} else {
+			frames.push_back (read_frame_info (info, i, EYES_BOTH));
+		}
+	}
+	fclose (info);
+
+	AssetVerifier verifier (asset, frames);
+	_picture_asset->set_hash (verifier.run (set_progress));
+
+	vector<size_t> const bad = verifier.bad_frames ();
+	if (bad.empty ()) {
+		LOG_GENERAL ("Verified %1 picture frames in %2", frames.size(), asset.string());
+		return;
+	}
+
+	BOOST_FOREACH (size_t i, bad) {
+		if (three_d) {
+			LOG_ERROR ("Frame %1 (%2 eye) of %3 failed verification", i / 2, (i % 2) ? "right" : "left", asset.string());
+		} else {
+			LOG_ERROR ("Frame %1 of %2 failed verification", i, asset.string());
+		}
+	}
+
+	throw FileError (String::compose (_("%1 picture frames failed verification"), bad.size()), asset);
+}
+
 Frame
 ReelWriter::start () const
 {
@@ -58,7 +58,7 @@ public:
 
 	void write (boost::optional<dcp::Data> encoded, Frame frame, Eyes eyes);
 	void fake_write (Frame frame, Eyes eyes, int size);
-	void repeat_write (Frame frame, Eyes eyes);
+	void repeat_write (Frame frame, Eyes eyes, Eyes from);
 	void write (boost::shared_ptr<const AudioBuffers> audio);
 	void write (PlayerSubtitles subs);
 
@@ -92,6 +92,7 @@ private:
 	long frame_info_position (Frame frame, Eyes eyes) const;
 	Frame check_existing_picture_asset ();
 	bool existing_picture_frame_ok (FILE* asset_file, FILE* info_file, Frame frame) const;
+	void verify_picture_asset (boost::function<void (float)> set_progress);
 
 	boost::shared_ptr<const Film> _film;
 
@@ -350,6 +350,19 @@ render_line (list<SubtitleString> subtitles, list<shared_ptr<Font> > fonts, dcp:
 	return PositionImage (image, Position<int> (max (0, x), max (0, y)));
 }
 
+/** Add a rendered line to a list of images, cropped to the area which has
+ *  actually been drawn on; render_line() makes an image as wide as the
+ *  target, most of which is usually transparent.
+ */
+static void
+add_line (list<PositionImage>& images, PositionImage line)
+{
+	optional<PositionImage> trimmed = trim_transparent (line);
+	if (trimmed) {
+		images.push_back (*trimmed);
+	}
+}
+
 /** @param time Time of the frame that these subtitles are going on.
  *  @param frame_rate DCP frame rate.
  */
@@ -361,14 +374,14 @@ render_subtitles (list<SubtitleString> subtitles, list<shared_ptr<Font> > fonts,
 
 	BOOST_FOREACH (SubtitleString const & i, subtitles) {
 		if (!pending.empty() && fabs (i.v_position() - pending.back().v_position()) > 1e-4) {
-			images.push_back (render_line (pending, fonts, target, time, frame_rate));
+			add_line (images, render_line (pending, fonts, target, time, frame_rate));
 			pending.clear ();
 		}
 		pending.push_back (i);
 	}
 
 	if (!pending.empty ()) {
-		images.push_back (render_line (pending, fonts, target, time, frame_rate));
+		add_line (images, render_line (pending, fonts, target, time, frame_rate));
 	}
 
 	return images;
@@ -24,16 +24,25 @@
 #include "compose.hpp"
 #include "dcpomatic_assert.h"
 #include <samplerate.h>
+#include <boost/foreach.hpp>
 #include <iostream>
 #include <cmath>
 
 #include "i18n.h"
 
 using std::cout;
+using std::min;
+using std::max;
 using std::pair;
 using std::make_pair;
 using std::runtime_error;
 using boost::shared_ptr;
+using boost::bind;
+
+/** Smallest number of channels that we will give to a group */
+#define MINIMUM_GROUP_CHANNELS 2
+/** Largest number of groups that we will resample in parallel */
+#define MAXIMUM_GROUPS 4
 
 /** @param in Input sampling rate (Hz)
  *  @param out Output sampling rate (Hz)
@@ -43,27 +52,129 @@ Resampler::Resampler (int in, int out, int channels)
 	: _in_rate (in)
 	, _out_rate (out)
 	, _channels (channels)
+	, _pending (0)
 {
-	int error;
-	_src = src_new (SRC_SINC_BEST_QUALITY, _channels, &error);
-	if (!_src) {
-		throw runtime_error (String::compose (N_("could not create sample-rate converter (%1)"), error));
+	/* Split the channels into groups which we can resample in parallel; libsamplerate's
+	   cost is roughly proportional to the number of channels, so with many channels
+	   (e.g. 16 at 96kHz) this makes a big difference.
+	*/
+	int const groups = max (1, min (min (MAXIMUM_GROUPS, int (boost::thread::hardware_concurrency ())), _channels / MINIMUM_GROUP_CHANNELS));
+	for (int i = 0; i < groups; ++i) {
+		int const first = i * _channels / groups;
+		_groups.push_back (Group (first, (i + 1) * _channels / groups - first));
+	}
+
+	make_converters (SRC_SINC_BEST_QUALITY);
+
+	if (groups > 1) {
+		/* The calling thread does the first group itself */
+		_work.reset (new boost::asio::io_service::work (_service));
+		for (int i = 1; i < groups; ++i) {
+			_pool.create_thread (bind (&boost::asio::io_service::run, &_service));
+		}
 	}
 }
 
 Resampler::~Resampler ()
 {
-	src_delete (_src);
+	_work.reset ();
+	_pool.join_all ();
+	_service.stop ();
+
+	BOOST_FOREACH (Group& i, _groups) {
+		src_delete (i.src);
+	}
+}
+
+void
+Resampler::make_converters (int type)
+{
+	BOOST_FOREACH (Group& i, _groups) {
+		if (i.src) {
+			src_delete (i.src);
+		}
+		int error;
+		i.src = src_new (type, i.channels, &error);
+		if (!i.src) {
+			throw runtime_error (String::compose (N_("could not create sample-rate converter (%1)"), error));
+		}
+	}
 }
 
 void
 Resampler::set_fast ()
 {
-	src_delete (_src);
-	int error;
-	_src = src_new (SRC_LINEAR, _channels, &error);
-	if (!_src) {
-		throw runtime_error (String::compose (N_("could not create sample-rate converter (%1)"), error));
+	make_converters (SRC_LINEAR);
+}
+
+/** Resample some channels.
+ *  @param group Group of channels to resample.
+ *  @param in Input data, or 0 if end_of_input is true.
+ *  @param in_offset Offset of the first frame to use in in.
+ *  @param in_frames Number of frames to use from in.
+ *  @param out_frames Maximum number of frames to generate.
+ *  @param end_of_input true to flush the converter.
+ */
+void
+Resampler::process (Group& group, AudioBuffers const * in, int in_offset, int in_frames, int out_frames, bool end_of_input)
+{
+	if (group.in.size() < size_t (max (1, in_frames * group.channels))) {
+		group.in.resize (max (1, in_frames * group.channels));
+	}
+	if (group.out.size() < size_t (out_frames * group.channels)) {
+		group.out.resize (out_frames * group.channels);
+	}
+
+	if (in) {
+		float* const * p = in->data ();
+		for (int j = 0; j < group.channels; ++j) {
+			float const * s = p[group.first_channel + j] + in_offset;
+			float* q = &group.in[j];
+			for (int i = 0; i < in_frames; ++i) {
+				*q = *s++;
+				q += group.channels;
+			}
+		}
+	}
+
+	SRC_DATA data;
+	data.data_in = &group.in[0];
+	data.input_frames = in_frames;
+	data.data_out = &group.out[0];
+	data.output_frames = out_frames;
+	data.end_of_input = end_of_input ? 1 : 0;
+	data.src_ratio = double (_out_rate) / _in_rate;
+
+	group.error = src_process (group.src, &data);
+	group.frames_used = data.input_frames_used;
+	group.frames_generated = data.output_frames_gen;
+}
+
+/** Called in one of the pool threads to process a group during run().  Any exception
+ *  is stored to be re-thrown by run(), and _pending is always decremented so that
+ *  run() does not wait for ever.
+ */
+void
+Resampler::process_in_pool (Group* group, AudioBuffers const * in, int in_offset, int in_frames, int out_frames)
+{
+	try {
+		process (*group, in, in_offset, in_frames, out_frames, false);
+	} catch (...) {
+		store_current ();
+	}
+
+	boost::mutex::scoped_lock lm (_pending_mutex);
+	--_pending;
+	_pending_condition.notify_all ();
+}
+
+/** Wait until the pool has finished with all the groups that run() gave it */
+void
+Resampler::wait_for_pool ()
+{
+	boost::mutex::scoped_lock lm (_pending_mutex);
+	while (_pending > 0) {
+		_pending_condition.wait (lm);
 	}
 }
 
@@ -73,123 +184,122 @@ Resampler::run (shared_ptr<const AudioBuffers> in)
 	int in_frames = in->frames ();
 	int in_offset = 0;
 	int out_offset = 0;
-	shared_ptr<AudioBuffers> resampled (new AudioBuffers (_channels, 0));
 
-	while (in_frames > 0) {
+	/* Compute the resampled frames count and add 32 for luck */
+	int const max_resampled_frames = ceil ((double) in_frames * _out_rate / _in_rate) + 32;
+	int allocated = max_resampled_frames;
+	shared_ptr<AudioBuffers> resampled (new AudioBuffers (_channels, allocated));
 
-		/* Compute the resampled frames count and add 32 for luck */
-		int const max_resampled_frames = ceil ((double) in_frames * _out_rate / _in_rate) + 32;
+	while (in_frames > 0) {
 
-		SRC_DATA data;
-		float* in_buffer = new float[in_frames * _channels];
+		int const out_frames = allocated - out_offset;
 
 		{
-			float** p = in->data ();
-			float* q = in_buffer;
-			for (int i = 0; i < in_frames; ++i) {
-				for (int j = 0; j < _channels; ++j) {
-					*q++ = p[j][in_offset + i];
-				}
+			boost::mutex::scoped_lock lm (_pending_mutex);
+			_pending = _groups.size() - 1;
+		}
+
+		for (size_t i = 1; i < _groups.size(); ++i) {
+			_service.post (bind (&Resampler::process_in_pool, this, &_groups[i], in.get(), in_offset, in_frames, out_frames));
+		}
+
+		try {
+			process (_groups.front(), in.get(), in_offset, in_frames, out_frames, false);
+		} catch (...) {
+			/* The pool is still using the groups and the input, so let it finish first */
+			wait_for_pool ();
+			throw;
+		}
+
+		wait_for_pool ();
+		rethrow ();
+
+		BOOST_FOREACH (Group const & i, _groups) {
+			if (i.error) {
+				throw EncodeError (
+					String::compose (
+						N_("could not run sample-rate converter (%1) [processing %2 to %3, %4 channels]"),
+						src_strerror (i.error),
+						in_frames,
+						out_frames,
+						_channels
+						)
+					);
 			}
 		}
 
-		data.data_in = in_buffer;
-		data.input_frames = in_frames;
-
-		data.data_out = new float[max_resampled_frames * _channels];
-		data.output_frames = max_resampled_frames;
-
-		data.end_of_input = 0;
-		data.src_ratio = double (_out_rate) / _in_rate;
-
-		int const r = src_process (_src, &data);
-		if (r) {
-			delete[] data.data_in;
-			delete[] data.data_out;
-			throw EncodeError (
-				String::compose (
-					N_("could not run sample-rate converter (%1) [processing %2 to %3, %4 channels]"),
-					src_strerror (r),
-					in_frames,
-					max_resampled_frames,
-					_channels
-					)
-				);
+		/* Every group has been given the same input so they should all behave the same way */
+		Group const & first = _groups.front ();
+		BOOST_FOREACH (Group const & i, _groups) {
+			DCPOMATIC_ASSERT (i.frames_used == first.frames_used);
+			DCPOMATIC_ASSERT (i.frames_generated == first.frames_generated);
 		}
 
-		if (data.output_frames_gen == 0) {
-			delete[] data.data_in;
-			delete[] data.data_out;
+		if (first.frames_generated == 0) {
 			break;
 		}
 
-		resampled->ensure_size (out_offset + data.output_frames_gen);
-		resampled->set_frames (out_offset + data.output_frames_gen);
-
-		{
-			float* p = data.data_out;
-			float** q = resampled->data ();
-			for (int i = 0; i < data.output_frames_gen; ++i) {
-				for (int j = 0; j < _channels; ++j) {
-					q[j][out_offset + i] = *p++;
+		float** q = resampled->data ();
+		BOOST_FOREACH (Group const & i, _groups) {
+			for (int j = 0; j < i.channels; ++j) {
+				float const * p = &i.out[j];
+				float* d = q[i.first_channel + j] + out_offset;
+				for (int k = 0; k < i.frames_generated; ++k) {
+					*d++ = *p;
+					p += i.channels;
 				}
 			}
 		}
 
-		in_frames -= data.input_frames_used;
-		in_offset += data.input_frames_used;
-		out_offset += data.output_frames_gen;
+		in_frames -= first.frames_used;
+		in_offset += first.frames_used;
+		out_offset += first.frames_generated;
 
-		delete[] data.data_in;
-		delete[] data.data_out;
+		if (in_frames > 0 && out_offset == allocated) {
+			/* Unlikely, but the converter wants more space than we gave it */
+			allocated += max_resampled_frames;
+			resampled->ensure_size (allocated);
+		}
 	}
 
+	resampled->set_frames (out_offset);
 	return resampled;
 }
 
 shared_ptr<const AudioBuffers>
 Resampler::flush ()
 {
-	shared_ptr<AudioBuffers> out (new AudioBuffers (_channels, 0));
-	int out_offset = 0;
-	int64_t const output_size = 65536;
-
-	float dummy[1];
-	float* buffer = new float[output_size];
+	int const output_size = 65536;
 
-	SRC_DATA data;
-	data.data_in = dummy;
-	data.input_frames = 0;
-	data.data_out = buffer;
-	data.output_frames = output_size;
-	data.end_of_input = 1;
-	data.src_ratio = double (_out_rate) / _in_rate;
-
-	int const r = src_process (_src, &data);
-	if (r) {
-		delete[] buffer;
-		throw EncodeError (String::compose (N_("could not run sample-rate converter (%1)"), src_strerror (r)));
+	BOOST_FOREACH (Group& i, _groups) {
+		process (i, 0, 0, 0, output_size, true);
+		if (i.error) {
+			throw EncodeError (String::compose (N_("could not run sample-rate converter (%1)"), src_strerror (i.error)));
+		}
+		DCPOMATIC_ASSERT (i.frames_generated == _groups.front().frames_generated);
 	}
 
-	out->ensure_size (out_offset + data.output_frames_gen);
+	shared_ptr<AudioBuffers> out (new AudioBuffers (_channels, _groups.front().frames_generated));
 
-	float* p = data.data_out;
 	float** q = out->data ();
-	for (int i = 0; i < data.output_frames_gen; ++i) {
-		for (int j = 0; j < _channels; ++j) {
-			q[j][out_offset + i] = *p++;
+	BOOST_FOREACH (Group const & i, _groups) {
+		for (int j = 0; j < i.channels; ++j) {
+			float const * p = &i.out[j];
+			float* d = q[i.first_channel + j];
+			for (int k = 0; k < i.frames_generated; ++k) {
+				*d++ = *p;
+				p += i.channels;
+			}
 		}
 	}
 
-	out_offset += data.output_frames_gen;
-	out->set_frames (out_offset);
-
-	delete[] buffer;
 	return out;
 }
 
 void
 Resampler::reset ()
 {
-	src_reset (_src);
+	BOOST_FOREACH (Group& i, _groups) {
+		src_reset (i.src);
+	}
 }
@@ -19,13 +19,18 @@
 */
 
 #include "types.h"
+#include "exception_store.h"
 #include <samplerate.h>
 #include <boost/shared_ptr.hpp>
 #include <boost/utility.hpp>
+#include <boost/asio.hpp>
+#include <boost/thread.hpp>
+#include <boost/thread/condition.hpp>
+#include <vector>
 
 class AudioBuffers;
 
-class Resampler : public boost::noncopyable
+class Resampler : public boost::noncopyable, public ExceptionStore
 {
 public:
 	Resampler (int, int, int);
@@ -37,8 +42,51 @@ public:
 	void set_fast ();
 
 private:
-	SRC_STATE* _src;
+	/** Some consecutive channels which are resampled together by one converter */
+	struct Group
+	{
+		Group (int first_channel_, int channels_)
+			: src (0)
+			, first_channel (first_channel_)
+			, channels (channels_)
+			, frames_used (0)
+			, frames_generated (0)
+			, error (0)
+		{}
+
+		SRC_STATE* src;
+		int first_channel;
+		int channels;
+		/** interleaved input; kept between calls to avoid re-allocation */
+		std::vector<float> in;
+		/** interleaved output; kept between calls to avoid re-allocation */
+		std::vector<float> out;
+		/** input frames used by the last call to process() */
+		int frames_used;
+		/** output frames generated by the last call to process() */
+		int frames_generated;
+		/** libsamplerate error from the last call to process(), or 0 */
+		int error;
+	};
+
+	void make_converters (int type);
+	void process (Group& group, AudioBuffers const * in, int in_offset, int in_frames, int out_frames, bool end_of_input);
+	void process_in_pool (Group* group, AudioBuffers const * in, int in_offset, int in_frames, int out_frames);
+	void wait_for_pool ();
+
 	int _in_rate;
 	int _out_rate;
 	int _channels;
+	std::vector<Group> _groups;
+
+	/** Threads to process groups other than the first at the same time as it */
+	boost::thread_group _pool;
+	boost::asio::io_service _service;
+	boost::shared_ptr<boost::asio::io_service::work> _work;
+
+	/** mutex to protect _pending */
+	boost::mutex _pending_mutex;
+	boost::condition _pending_condition;
+	/** number of groups that the pool has still to process in the current call to run() */
+	int _pending;
 };
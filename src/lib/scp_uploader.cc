@@ -1,5 +1,5 @@
 /*
-    Copyright (C) 2012-2015 Carl Hetherington <cth@carlh.net>
+    Copyright (C) 2012-2018 Carl Hetherington <cth@carlh.net>
 
     This file is part of DCP-o-matic.
 
@@ -19,111 +19,332 @@
 */
 
 #include "scp_uploader.h"
+#include "upload_source.h"
 #include "exceptions.h"
-#include "job.h"
+#include "dcpomatic_assert.h"
 #include "config.h"
-#include "cross.h"
 #include "compose.hpp"
+#include <libssh/libssh.h>
+#include <libssh/sftp.h>
+#include <libssh/callbacks.h>
+#include <boost/thread/once.hpp>
+#include <boost/algorithm/string.hpp>
 #include <sys/stat.h>
+#include <fcntl.h>
+#include <vector>
 
 #include "i18n.h"
 
 using std::string;
+using std::vector;
 using std::min;
 using boost::shared_ptr;
 using boost::function;
+using boost::optional;
 
-SCPUploader::SCPUploader (function<void (string)> set_status, function<void (float)> set_progress)
-	: Uploader (set_status, set_progress)
+/** Largest amount of data that we send in one write */
+#define WRITE_SIZE (128 * 1024)
+
+static boost::once_flag ssh_init_flag = BOOST_ONCE_INIT;
+
+/** Set libssh up for use from several threads; this must be done before any sessions
+ *  are started.
+ */
+static void
+ssh_init_threads ()
+{
+	ssh_threads_set_callbacks (ssh_threads_get_pthread ());
+	ssh_init ();
+}
+
+/** @class SSHConnection
+ *  @brief An SSH session to the TMS, with an SFTP session on it if the server supports SFTP.
+ */
+class SSHConnection : public Uploader::Connection
 {
-	_session = ssh_new ();
-	if (!_session) {
-		throw NetworkError (_("could not start SSH session"));
+public:
+	SSHConnection ()
+		: _session (ssh_new ())
+		, _sftp (0)
+	{
+		if (!_session) {
+			throw NetworkError (_("could not start SSH session"));
+		}
+
+		try {
+			start ();
+		} catch (...) {
+			ssh_disconnect (_session);
+			ssh_free (_session);
+			throw;
+		}
+	}
+
+	~SSHConnection ()
+	{
+		if (_sftp) {
+			sftp_free (_sftp);
+		}
+		ssh_disconnect (_session);
+		ssh_free (_session);
 	}
 
-	ssh_options_set (_session, SSH_OPTIONS_HOST, Config::instance()->tms_ip().c_str ());
-	ssh_options_set (_session, SSH_OPTIONS_USER, Config::instance()->tms_user().c_str ());
-	int const port = 22;
-	ssh_options_set (_session, SSH_OPTIONS_PORT, &port);
+	void create_directory (boost::filesystem::path directory)
+	{
+		if (!_sftp) {
+			ssh_scp scp = start_scp (directory.parent_path (), SSH_SCP_WRITE | SSH_SCP_RECURSIVE);
+			int const r = ssh_scp_push_directory (scp, directory.filename().string().c_str(), S_IRWXU);
+			ssh_scp_close (scp);
+			ssh_scp_free (scp);
+			if (r != SSH_OK) {
+				throw NetworkError (String::compose (_("Could not create remote directory %1 (%2)"), directory, ssh_get_error (_session)));
+			}
+			return;
+		}
+
+		sftp_attributes attributes = sftp_stat (_sftp, remote (directory).c_str ());
+		if (attributes) {
+			/* It's already there */
+			sftp_attributes_free (attributes);
+			return;
+		}
 
-	int r = ssh_connect (_session);
-	if (r != SSH_OK) {
-		throw NetworkError (String::compose (_("Could not connect to server %1 (%2)"), Config::instance()->tms_ip(), ssh_get_error (_session)));
+		if (sftp_mkdir (_sftp, remote (directory).c_str (), S_IRWXU) < 0) {
+			throw NetworkError (String::compose (_("Could not create remote directory %1 (%2)"), directory, ssh_get_error (_session)));
+		}
 	}
 
-	r = ssh_is_server_known (_session);
-	if (r == SSH_SERVER_ERROR) {
-		throw NetworkError (String::compose (_("SSH error (%1)"), ssh_get_error (_session)));
+	boost::uintmax_t remote_size (boost::filesystem::path file)
+	{
+		if (!_sftp) {
+			/* We can't resume with SCP so there's no point in finding out */
+			return 0;
+		}
+
+		sftp_attributes attributes = sftp_stat (_sftp, remote (file).c_str ());
+		if (!attributes) {
+			return 0;
+		}
+
+		boost::uintmax_t const size = attributes->size;
+		sftp_attributes_free (attributes);
+		return size;
 	}
 
-	r = ssh_userauth_password (_session, 0, Config::instance()->tms_password().c_str ());
-	if (r != SSH_AUTH_SUCCESS) {
-		throw NetworkError (String::compose (_("Failed to authenticate with server (%1)"), ssh_get_error (_session)));
+	void read (boost::filesystem::path file, boost::uintmax_t offset, uint8_t* data, size_t size)
+	{
+		DCPOMATIC_ASSERT (_sftp);
+
+		sftp_file f = sftp_open (_sftp, remote (file).c_str (), O_RDONLY, 0);
+		if (!f) {
+			throw NetworkError (String::compose (_("Could not open remote file %1 (%2)"), file, ssh_get_error (_session)));
+		}
+
+		sftp_seek64 (f, offset);
+		while (size > 0) {
+			ssize_t const r = sftp_read (f, data, size);
+			if (r <= 0) {
+				sftp_close (f);
+				throw NetworkError (String::compose (_("Could not read from remote file %1 (%2)"), file, ssh_get_error (_session)));
+			}
+			data += r;
+			size -= r;
+		}
+
+		sftp_close (f);
 	}
 
-	_scp = ssh_scp_new (_session, SSH_SCP_WRITE | SSH_SCP_RECURSIVE, Config::instance()->tms_path().c_str ());
-	if (!_scp) {
-		throw NetworkError (String::compose (_("could not start SCP session (%1)"), ssh_get_error (_session)));
+	/** Ask the server to run md5sum on a file */
+	optional<string> remote_md5 (boost::filesystem::path file)
+	{
+		ssh_channel channel = ssh_channel_new (_session);
+		if (!channel) {
+			return optional<string> ();
+		}
+
+		if (ssh_channel_open_session (channel) != SSH_OK) {
+			ssh_channel_free (channel);
+			return optional<string> ();
+		}
+
+		/* Quote the path for the shell, as it may contain spaces */
+		string path = remote (file);
+		boost::algorithm::replace_all (path, "'", "'\\''");
+		string const command = "md5sum '" + path + "'";
+
+		string output;
+		if (ssh_channel_request_exec (channel, command.c_str ()) == SSH_OK) {
+			char buffer[256];
+			int n;
+			while (output.length() < 4096 && (n = ssh_channel_read (channel, buffer, sizeof (buffer), 0)) > 0) {
+				output.append (buffer, n);
+			}
+			ssh_channel_send_eof (channel);
+		}
+
+		int const status = ssh_channel_get_exit_status (channel);
+		ssh_channel_close (channel);
+		ssh_channel_free (channel);
+
+		/* The output should be the digest, then a space and the filename */
+		string const digest = output.substr (0, output.find (' '));
+		if (status != 0 || digest.length() != 32 || !boost::algorithm::all (digest, boost::algorithm::is_xdigit ())) {
+			/* The server has no md5sum, or something else went wrong */
+			return optional<string> ();
+		}
+
+		return digest;
 	}
 
-	r = ssh_scp_init (_scp);
-	if (r != SSH_OK) {
-		throw NetworkError (String::compose (_("Could not start SCP session (%1)"), ssh_get_error (_session)));
+	void upload_file (UploadSource& source, boost::filesystem::path to)
+	{
+		if (_sftp) {
+			upload_file_sftp (source, to);
+		} else {
+			upload_file_scp (source, to);
+		}
 	}
-}
 
-SCPUploader::~SCPUploader ()
-{
-	ssh_scp_free (_scp);
-	ssh_disconnect (_session);
-	ssh_free (_session);
-}
+private:
+	void start ()
+	{
+		ssh_options_set (_session, SSH_OPTIONS_HOST, Config::instance()->tms_ip().c_str ());
+		ssh_options_set (_session, SSH_OPTIONS_USER, Config::instance()->tms_user().c_str ());
+		int const port = 22;
+		ssh_options_set (_session, SSH_OPTIONS_PORT, &port);
 
-void
-SCPUploader::create_directory (boost::filesystem::path directory)
-{
-	/* Use generic_string so that we get forward-slashes in the path, even on Windows */
-	int const r = ssh_scp_push_directory (_scp, directory.generic_string().c_str(), S_IRWXU);
-	if (r != SSH_OK) {
-		throw NetworkError (String::compose (_("Could not create remote directory %1 (%2)"), directory, ssh_get_error (_session)));
+		int r = ssh_connect (_session);
+		if (r != SSH_OK) {
+			throw NetworkError (String::compose (_("Could not connect to server %1 (%2)"), Config::instance()->tms_ip(), ssh_get_error (_session)));
+		}
+
+		r = ssh_is_server_known (_session);
+		if (r == SSH_SERVER_ERROR) {
+			throw NetworkError (String::compose (_("SSH error (%1)"), ssh_get_error (_session)));
+		}
+
+		r = ssh_userauth_password (_session, 0, Config::instance()->tms_password().c_str ());
+		if (r != SSH_AUTH_SUCCESS) {
+			throw NetworkError (String::compose (_("Failed to authenticate with server (%1)"), ssh_get_error (_session)));
+		}
+
+		_sftp = sftp_new (_session);
+		if (_sftp && sftp_init (_sftp) != SSH_OK) {
+			/* No SFTP on this server; we will use SCP instead */
+			sftp_free (_sftp);
+			_sftp = 0;
+		}
 	}
-}
 
-void
-SCPUploader::upload_file (boost::filesystem::path from, boost::filesystem::path to, boost::uintmax_t& transferred, boost::uintmax_t total_size)
-{
-	boost::uintmax_t to_do = boost::filesystem::file_size (from);
-	/* Use generic_string so that we get forward-slashes in the path, even on Windows */
-	ssh_scp_push_file (_scp, to.generic_string().c_str(), to_do, S_IRUSR | S_IWUSR);
+	/** @return Path on the server of a path relative to the TMS path */
+	string remote (boost::filesystem::path path) const
+	{
+		string r = Config::instance()->tms_path ();
+		if (!path.empty ()) {
+			if (!r.empty ()) {
+				r += "/";
+			}
+			/* Use generic_string so that we get forward-slashes in the path, even on Windows */
+			r += path.generic_string ();
+		}
+		return r.empty() ? "." : r;
+	}
+
+	ssh_scp start_scp (boost::filesystem::path directory, int mode)
+	{
+		ssh_scp scp = ssh_scp_new (_session, mode, remote (directory).c_str ());
+		if (!scp) {
+			throw NetworkError (String::compose (_("could not start SCP session (%1)"), ssh_get_error (_session)));
+		}
 
-	FILE* f = fopen_boost (from, "rb");
-	if (f == 0) {
-		throw NetworkError (String::compose (_("Could not open %1 to send"), from));
+		if (ssh_scp_init (scp) != SSH_OK) {
+			ssh_scp_free (scp);
+			throw NetworkError (String::compose (_("Could not start SCP session (%1)"), ssh_get_error (_session)));
+		}
+
+		return scp;
 	}
 
-	boost::uintmax_t buffer_size = 64 * 1024;
-	char buffer[buffer_size];
+	void upload_file_sftp (UploadSource& source, boost::filesystem::path to)
+	{
+		int flags = O_WRONLY | O_CREAT;
+		if (source.offset() == 0) {
+			flags |= O_TRUNC;
+		}
 
-	while (to_do > 0) {
-		int const t = min (to_do, buffer_size);
-		size_t const read = fread (buffer, 1, t, f);
-		if (read != size_t (t)) {
-			fclose (f);
-			throw ReadFileError (from);
+		sftp_file f = sftp_open (_sftp, remote (to).c_str (), flags, S_IRUSR | S_IWUSR);
+		if (!f) {
+			throw NetworkError (String::compose (_("Could not open remote file %1 (%2)"), to, ssh_get_error (_session)));
 		}
 
-		int const r = ssh_scp_write (_scp, buffer, t);
-		if (r != SSH_OK) {
-			fclose (f);
+		try {
+			if (sftp_seek64 (f, source.offset ()) < 0) {
+				throw NetworkError (String::compose (_("Could not write to remote file (%1)"), ssh_get_error (_session)));
+			}
+
+			vector<uint8_t> buffer (WRITE_SIZE);
+			while (size_t n = source.read (&buffer[0], buffer.size ())) {
+				uint8_t* p = &buffer[0];
+				while (n > 0) {
+					ssize_t const r = sftp_write (f, p, n);
+					if (r <= 0) {
+						throw NetworkError (String::compose (_("Could not write to remote file (%1)"), ssh_get_error (_session)));
+					}
+					p += r;
+					n -= r;
+				}
+			}
+		} catch (...) {
+			sftp_close (f);
+			throw;
+		}
+
+		if (sftp_close (f) != SSH_OK) {
 			throw NetworkError (String::compose (_("Could not write to remote file (%1)"), ssh_get_error (_session)));
 		}
-		to_do -= t;
-		transferred += t;
+	}
+
+	void upload_file_scp (UploadSource& source, boost::filesystem::path to)
+	{
+		DCPOMATIC_ASSERT (source.offset () == 0);
 
-		if (total_size > 0) {
-			_set_progress ((double) transferred / total_size);
+		ssh_scp scp = start_scp (to.parent_path (), SSH_SCP_WRITE);
+
+		try {
+			if (ssh_scp_push_file64 (scp, to.filename().string().c_str(), source.length (), S_IRUSR | S_IWUSR) != SSH_OK) {
+				throw NetworkError (String::compose (_("Could not write to remote file (%1)"), ssh_get_error (_session)));
+			}
+
+			vector<uint8_t> buffer (WRITE_SIZE);
+			while (size_t n = source.read (&buffer[0], buffer.size ())) {
+				if (ssh_scp_write (scp, &buffer[0], n) != SSH_OK) {
+					throw NetworkError (String::compose (_("Could not write to remote file (%1)"), ssh_get_error (_session)));
+				}
+			}
+		} catch (...) {
+			ssh_scp_close (scp);
+			ssh_scp_free (scp);
+			throw;
 		}
+
+		ssh_scp_close (scp);
+		ssh_scp_free (scp);
 	}
 
-	fclose (f);
+	ssh_session _session;
+	/** SFTP session, or 0 if the server does not support SFTP */
+	sftp_session _sftp;
+};
+
+SCPUploader::SCPUploader (function<void (string)> set_status, function<void (float)> set_progress, int connections)
+	: Uploader (set_status, set_progress, connections)
+{
+	/* Our connections are made and used on several threads at once */
+	boost::call_once (&ssh_init_threads, ssh_init_flag);
+}
+
+shared_ptr<Uploader::Connection>
+SCPUploader::connect ()
+{
+	return shared_ptr<Connection> (new SSHConnection ());
 }
@@ -1,5 +1,5 @@
 /*
-    Copyright (C) 2012-2015 Carl Hetherington <cth@carlh.net>
+    Copyright (C) 2012-2018 Carl Hetherington <cth@carlh.net>
 
     This file is part of DCP-o-matic.
 
@@ -19,19 +19,18 @@
 */
 
 #include "uploader.h"
-#include <libssh/libssh.h>
 
+/** @class SCPUploader
+ *  @brief Uploader which copies files to a server over SSH.
+ *
+ *  SFTP is used if the server supports it, as it allows us to resume uploads; otherwise
+ *  each file is sent with SCP.
+ */
 class SCPUploader : public Uploader
 {
 public:
-	SCPUploader (boost::function<void (std::string)> set_status, boost::function<void (float)> set_progress);
-	~SCPUploader ();
+	SCPUploader (boost::function<void (std::string)> set_status, boost::function<void (float)> set_progress, int connections);
 
 protected:
-	virtual void create_directory (boost::filesystem::path directory);
-	virtual void upload_file (boost::filesystem::path from, boost::filesystem::path to, boost::uintmax_t& transferred, boost::uintmax_t total_size);
-
-private:
-	ssh_session _session;
-	ssh_scp _scp;
+	boost::shared_ptr<Connection> connect ();
 };
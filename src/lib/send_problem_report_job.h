@@ -33,6 +33,9 @@ public:
 
 	std::string name () const;
 	std::string json_name () const;
+	Resource resource () const {
+		return RESOURCE_LIGHT;
+	}
 	void run ();
 
 private:
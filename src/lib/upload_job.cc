@@ -1,5 +1,5 @@
 /*
-    Copyright (C) 2012-2015 Carl Hetherington <cth@carlh.net>
+    Copyright (C) 2012-2018 Carl Hetherington <cth@carlh.net>
 
     This file is part of DCP-o-matic.
 
@@ -38,7 +38,7 @@
 using std::string;
 using std::min;
 using boost::shared_ptr;
-using boost::scoped_ptr;
+using boost::optional;
 
 UploadJob::UploadJob (shared_ptr<const Film> film)
 	: Job (film)
@@ -64,16 +64,23 @@ UploadJob::run ()
 {
 	LOG_GENERAL_NC (N_("Upload job starting"));
 
-	scoped_ptr<Uploader> uploader;
+	int const connections = Config::instance()->tms_connections ();
+
+	shared_ptr<Uploader> uploader;
 	switch (Config::instance()->tms_protocol ()) {
 	case PROTOCOL_SCP:
-		uploader.reset (new SCPUploader (bind (&UploadJob::set_status, this, _1), bind (&UploadJob::set_progress, this, _1, false)));
+		uploader.reset (new SCPUploader (bind (&UploadJob::set_status, this, _1), bind (&UploadJob::set_progress, this, _1, false), connections));
 		break;
 	case PROTOCOL_FTP:
-		uploader.reset (new CurlUploader (bind (&UploadJob::set_status, this, _1), bind (&UploadJob::set_progress, this, _1, false)));
+		uploader.reset (new CurlUploader (bind (&UploadJob::set_status, this, _1), bind (&UploadJob::set_progress, this, _1, false), connections));
 		break;
 	}
 
+	{
+		boost::mutex::scoped_lock lm (_status_mutex);
+		_uploader = uploader;
+	}
+
 	uploader->upload (_film->dir (_film->dcp_name ()));
 
 	set_progress (1);
@@ -84,14 +91,33 @@ UploadJob::run ()
 string
 UploadJob::status () const
 {
-	boost::mutex::scoped_lock lm (_status_mutex);
+	/* Job::status calls remaining_time, which takes _status_mutex */
 	string s = Job::status ();
+	boost::mutex::scoped_lock lm (_status_mutex);
 	if (!_status.empty () && !finished_in_error ()) {
 		s += N_("; ") + _status;
 	}
 	return s;
 }
 
+/** @return Estimate of the remaining time based on the rate at which the uploader is
+ *  actually sending data; this is better than Job's estimate as some of the DCP may
+ *  already have been on the server.
+ */
+int
+UploadJob::remaining_time () const
+{
+	boost::mutex::scoped_lock lm (_status_mutex);
+	if (_uploader) {
+		optional<int> r = _uploader->remaining_time ();
+		if (r) {
+			return r.get ();
+		}
+	}
+
+	return Job::remaining_time ();
+}
+
 void
 UploadJob::set_status (string s)
 {
@@ -24,6 +24,8 @@
 
 #include "job.h"
 
+class Uploader;
+
 class UploadJob : public Job
 {
 public:
@@ -31,12 +33,19 @@ public:
 
 	std::string name () const;
 	std::string json_name () const;
+	Resource resource () const {
+		return RESOURCE_IO;
+	}
 	void run ();
 	std::string status () const;
+	int remaining_time () const;
 
 private:
 	void set_status (std::string);
 
+	/** mutex to protect _status and _uploader */
 	mutable boost::mutex _status_mutex;
 	std::string _status;
+	/** uploader that is running, if any */
+	boost::shared_ptr<Uploader> _uploader;
 };
@@ -0,0 +1,156 @@
+/*
+    Copyright (C) 2018 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/** @file  src/lib/upload_source.cc
+ *  @brief UploadSource class.
+ */
+
+#include "upload_source.h"
+#include "exceptions.h"
+#include "cross.h"
+#include <boost/bind.hpp>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+using std::min;
+using std::vector;
+
+/** Size of the chunks that we read the file in */
+#define CHUNK_SIZE (4 * 1024 * 1024)
+/** Number of chunks that we will read ahead of the caller of read() */
+#define READ_AHEAD_CHUNKS 4
+
+/** @param file File to read.
+ *  @param offset Offset in the file to start from.
+ *  @param sent Function which will be called with the number of bytes given out by each read().
+ */
+UploadSource::UploadSource (boost::filesystem::path file, boost::uintmax_t offset, boost::function<void (boost::uintmax_t)> sent)
+	: _file (file)
+	, _offset (offset)
+	, _length (boost::filesystem::file_size (file) - offset)
+	, _sent (sent)
+	, _position (0)
+	, _finished (false)
+	, _terminate (false)
+{
+	_thread = new boost::thread (boost::bind (&UploadSource::thread, this));
+}
+
+UploadSource::~UploadSource ()
+{
+	{
+		boost::mutex::scoped_lock lm (_mutex);
+		_terminate = true;
+		_space_condition.notify_all ();
+	}
+
+	if (_thread->joinable ()) {
+		_thread->join ();
+	}
+	delete _thread;
+}
+
+void
+UploadSource::thread ()
+try
+{
+	FILE* f = fopen_boost (_file, "rb");
+	if (!f) {
+		throw OpenFileError (_file, errno, true);
+	}
+
+	dcpomatic_fseek (f, _offset, SEEK_SET);
+
+	boost::uintmax_t to_do = _length;
+	while (to_do > 0) {
+		{
+			boost::mutex::scoped_lock lm (_mutex);
+			while (_chunks.size() >= READ_AHEAD_CHUNKS && !_terminate) {
+				_space_condition.wait (lm);
+			}
+			if (_terminate) {
+				break;
+			}
+		}
+
+		vector<uint8_t> chunk (min (to_do, boost::uintmax_t (CHUNK_SIZE)));
+		if (fread (&chunk[0], 1, chunk.size(), f) != chunk.size()) {
+			fclose (f);
+			throw ReadFileError (_file, errno);
+		}
+
+		to_do -= chunk.size ();
+
+		boost::mutex::scoped_lock lm (_mutex);
+		_chunks.push_back (vector<uint8_t> ());
+		_chunks.back().swap (chunk);
+		_ready_condition.notify_all ();
+	}
+
+	fclose (f);
+
+	boost::mutex::scoped_lock lm (_mutex);
+	_finished = true;
+	_ready_condition.notify_all ();
+}
+catch (...)
+{
+	store_current ();
+	boost::mutex::scoped_lock lm (_mutex);
+	_finished = true;
+	_ready_condition.notify_all ();
+}
+
+/** Get some data, blocking until it has been read from the file.
+ *  @param data Buffer to copy the data into.
+ *  @param size Maximum number of bytes to copy.
+ *  @return Number of bytes copied; this will be 0 only at the end of the file.
+ */
+size_t
+UploadSource::read (uint8_t* data, size_t size)
+{
+	boost::mutex::scoped_lock lm (_mutex);
+	while (_chunks.empty () && !_finished) {
+		_ready_condition.wait (lm);
+	}
+
+	if (_chunks.empty ()) {
+		/* Either we have reached the end of the file or the thread has failed */
+		lm.unlock ();
+		rethrow ();
+		return 0;
+	}
+
+	vector<uint8_t>& front = _chunks.front ();
+	size_t const n = min (size, front.size() - _position);
+	memcpy (data, &front[_position], n);
+	_position += n;
+	if (_position == front.size ()) {
+		_chunks.pop_front ();
+		_position = 0;
+		_space_condition.notify_all ();
+	}
+
+	lm.unlock ();
+
+	_sent (n);
+	return n;
+}
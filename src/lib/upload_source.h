@@ -0,0 +1,87 @@
+/*
+    Copyright (C) 2018 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/** @file  src/lib/upload_source.h
+ *  @brief UploadSource class.
+ */
+
+#ifndef DCPOMATIC_UPLOAD_SOURCE_H
+#define DCPOMATIC_UPLOAD_SOURCE_H
+
+#include "exception_store.h"
+#include <boost/filesystem.hpp>
+#include <boost/function.hpp>
+#include <boost/thread.hpp>
+#include <boost/thread/condition.hpp>
+#include <boost/noncopyable.hpp>
+#include <list>
+#include <vector>
+
+/** @class UploadSource
+ *  @brief The part of a local file that is to be uploaded, from some offset to the end.
+ *
+ *  The file is read in large chunks by a thread of our own, a few chunks ahead of
+ *  whoever is calling read(), so that reading the disk happens while the previous
+ *  chunks are being sent.
+ */
+class UploadSource : public boost::noncopyable, public ExceptionStore
+{
+public:
+	UploadSource (boost::filesystem::path file, boost::uintmax_t offset, boost::function<void (boost::uintmax_t)> sent);
+	~UploadSource ();
+
+	/** @return Offset in the file of the first byte that read() will give */
+	boost::uintmax_t offset () const {
+		return _offset;
+	}
+
+	/** @return Number of bytes that read() will give in total */
+	boost::uintmax_t length () const {
+		return _length;
+	}
+
+	size_t read (uint8_t* data, size_t size);
+
+private:
+	void thread ();
+
+	boost::filesystem::path _file;
+	boost::uintmax_t _offset;
+	boost::uintmax_t _length;
+	/** function to call with the number of bytes given out by each read() */
+	boost::function<void (boost::uintmax_t)> _sent;
+	boost::thread* _thread;
+
+	/** mutex to protect _chunks, _position, _finished and _terminate */
+	boost::mutex _mutex;
+	/** condition to signal that there is a chunk to read, or that we have reached the end */
+	boost::condition _ready_condition;
+	/** condition to signal that there is space for another chunk */
+	boost::condition _space_condition;
+	/** chunks of the file which have been read but not yet given out by read() */
+	std::list<std::vector<uint8_t> > _chunks;
+	/** position within the front chunk of the next byte to give out */
+	size_t _position;
+	/** true if the reading thread has finished, either at the end of the file or because of an error */
+	bool _finished;
+	bool _terminate;
+};
+
+#endif
@@ -1,5 +1,5 @@
 /*
-    Copyright (C) 2015 Carl Hetherington <cth@carlh.net>
+    Copyright (C) 2015-2018 Carl Hetherington <cth@carlh.net>
 
     This file is part of DCP-o-matic.
 
@@ -19,61 +19,320 @@
 */
 
 #include "uploader.h"
+#include "upload_source.h"
+#include "exceptions.h"
 #include "dcpomatic_assert.h"
+#include "cross.h"
 #include "compose.hpp"
+#include "digester.h"
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include <boost/foreach.hpp>
+#include <boost/algorithm/string.hpp>
+#include <cerrno>
+#include <cstring>
+#include <vector>
 
 #include "i18n.h"
 
 using std::string;
+using std::list;
+using std::vector;
+using std::min;
+using std::pair;
+using std::make_pair;
 using boost::shared_ptr;
+using boost::optional;
 using boost::function;
 
-Uploader::Uploader (function<void (string)> set_status, function<void (float)> set_progress)
-	: _set_progress (set_progress)
-	, _set_status (set_status)
+/** Size of the pieces in which we read the start of a local file to find its digest */
+#define RESUME_CHECK_SIZE (4 * 1024 * 1024)
+/** Number of pieces of a partly-uploaded file that we compare with our file, when the
+ *  server cannot give us a digest.
+ */
+#define RESUME_SAMPLES 8
+/** Size of each of those pieces */
+#define RESUME_SAMPLE_SIZE (64 * 1024)
+
+/** @param set_status Function to set a status message; it will be called from several threads.
+ *  @param set_progress Function to set our progress, from 0 to 1; it will be called from several threads.
+ *  @param connections Maximum number of connections to make to the server.
+ */
+Uploader::Uploader (function<void (string)> set_status, function<void (float)> set_progress, int connections)
+	: _set_status (set_status)
+	, _set_progress (set_progress)
+	, _connections (connections)
+	, _total (0)
+	, _done (0)
+	, _sent (0)
 {
 	_set_status (_("connecting"));
 }
 
-boost::uintmax_t
-Uploader::count_file_sizes (boost::filesystem::path directory) const
+void
+Uploader::find (boost::filesystem::path base, boost::filesystem::path directory, list<boost::filesystem::path>& directories, list<File>& files) const
 {
 	using namespace boost::filesystem;
 
-	boost::uintmax_t size = 0;
-
+	directories.push_back (remove_prefix (base, directory));
 	for (directory_iterator i = directory_iterator (directory); i != directory_iterator (); ++i) {
 		if (is_directory (i->path ())) {
-			size += count_file_sizes (i->path ());
+			find (base, i->path (), directories, files);
 		} else {
-			size += file_size (*i);
+			files.push_back (File (i->path (), remove_prefix (base, i->path ()), file_size (i->path ())));
 		}
 	}
+}
 
-	return size;
+static bool
+bigger_first (boost::uintmax_t a, boost::uintmax_t b)
+{
+	return a > b;
 }
 
 void
 Uploader::upload (boost::filesystem::path directory)
 {
-	boost::uintmax_t transferred = 0;
-	upload_directory (directory.parent_path (), directory, transferred, count_file_sizes (directory));
+	list<boost::filesystem::path> directories;
+	list<File> files;
+	find (directory.parent_path (), directory, directories, files);
+
+	/* Start the biggest files first so that the connections are likely to finish at about the same time */
+	files.sort (boost::bind (&bigger_first, boost::bind (&File::size, _1), boost::bind (&File::size, _2)));
+
+	{
+		boost::mutex::scoped_lock lm (_mutex);
+		_files = files;
+		_total = 0;
+		BOOST_FOREACH (File const & i, files) {
+			_total += i.size;
+		}
+		_done = 0;
+		_sent = 0;
+		_start = _last_status = boost::posix_time::microsec_clock::universal_time ();
+	}
+
+	shared_ptr<Connection> first = connect ();
+	BOOST_FOREACH (boost::filesystem::path i, directories) {
+		first->create_directory (i);
+	}
+
+	boost::thread_group threads;
+	threads.create_thread (boost::bind (&Uploader::upload_thread, this, first));
+	for (int i = 1; i < min (_connections, int (files.size ())); ++i) {
+		threads.create_thread (boost::bind (&Uploader::upload_thread, this, shared_ptr<Connection> ()));
+	}
+
+	threads.join_all ();
+	rethrow ();
 }
 
+/** Thread to upload files from _files until there are none left.
+ *  @param connection Connection to use, or 0 to make a new one.
+ */
 void
-Uploader::upload_directory (boost::filesystem::path base, boost::filesystem::path directory, boost::uintmax_t& transferred, boost::uintmax_t total_size)
+Uploader::upload_thread (shared_ptr<Connection> connection)
+try
 {
-	using namespace boost::filesystem;
+	if (!connection) {
+		try {
+			connection = connect ();
+		} catch (...) {
+			/* The server may limit the number of connections that we can make;
+			   if so, leave the files to the threads that did connect.
+			*/
+			return;
+		}
+	}
 
-	create_directory (remove_prefix (base, directory));
-	for (directory_iterator i = directory_iterator (directory); i != directory_iterator (); ++i) {
-		if (is_directory (i->path ())) {
-			upload_directory (base, i->path (), transferred, total_size);
-		} else {
-			_set_status (String::compose (_("copying %1"), i->path().leaf ()));
-			upload_file (i->path (), remove_prefix (base, i->path ()), transferred, total_size);
+	while (true) {
+		optional<File> file;
+		{
+			boost::mutex::scoped_lock lm (_mutex);
+			if (_files.empty ()) {
+				return;
+			}
+			file = _files.front ();
+			_files.pop_front ();
+			_current = file->from.filename().string ();
 		}
+
+		_set_status (String::compose (_("copying %1"), file->from.filename ()));
+		upload_file (connection, file.get ());
+	}
+}
+catch (...)
+{
+	store_current ();
+	/* Stop the other threads starting any more files */
+	boost::mutex::scoped_lock lm (_mutex);
+	_files.clear ();
+}
+
+void
+Uploader::upload_file (shared_ptr<Connection> connection, File const & file)
+{
+	boost::uintmax_t offset = 0;
+	boost::uintmax_t const remote = connection->remote_size (file.to);
+	if (remote > 0 && remote <= file.size && can_resume (connection, file, remote)) {
+		offset = remote;
 	}
+
+	done (offset, false);
+
+	if (file.size > 0 && offset == file.size) {
+		/* It's already there */
+		return;
+	}
+
+	UploadSource source (file.from, offset, boost::bind (&Uploader::done, this, _1, true));
+	connection->upload_file (source, file.to);
+}
+
+/** @return true if a partial copy of a file on the server is the same as the start of
+ *  the local file, so that we can just send the rest of it.
+ */
+bool
+Uploader::can_resume (shared_ptr<Connection> connection, File const & file, boost::uintmax_t remote_size) const
+{
+	optional<string> const md5 = connection->remote_md5 (file.to);
+	if (md5) {
+		return same_md5 (md5.get(), file, remote_size);
+	}
+
+	return same_samples (connection, file, remote_size);
+}
+
+/** @return true if an MD5 digest from the server is the same as that of the first
+ *  remote_size bytes of the local file.
+ */
+bool
+Uploader::same_md5 (string remote_md5, File const & file, boost::uintmax_t remote_size) const
+{
+	FILE* f = fopen_boost (file.from, "rb");
+	if (!f) {
+		throw OpenFileError (file.from, errno, true);
+	}
+
+	Digester digester;
+	vector<uint8_t> buffer (min (remote_size, boost::uintmax_t (RESUME_CHECK_SIZE)));
+	boost::uintmax_t offset = 0;
+	while (offset < remote_size) {
+		size_t const N = min (remote_size - offset, boost::uintmax_t (RESUME_CHECK_SIZE));
+		if (fread (&buffer[0], 1, N, f) != N) {
+			fclose (f);
+			throw ReadFileError (file.from);
+		}
+		digester.add (&buffer[0], N);
+		offset += N;
+	}
+
+	fclose (f);
+	return boost::algorithm::to_lower_copy (remote_md5) == digester.get ();
+}
+
+/** @return true if some pieces of a partial copy of a file on the server, spread from its
+ *  start to its end, are the same as the same parts of the local file.  Small files are
+ *  compared completely.
+ */
+bool
+Uploader::same_samples (shared_ptr<Connection> connection, File const & file, boost::uintmax_t remote_size) const
+{
+	/* Offsets and sizes of the pieces to compare */
+	vector<pair<boost::uintmax_t, size_t> > samples;
+	if (remote_size <= boost::uintmax_t (RESUME_SAMPLES * RESUME_SAMPLE_SIZE)) {
+		samples.push_back (make_pair (boost::uintmax_t (0), size_t (remote_size)));
+	} else {
+		/* The first piece is at the start and the last at the end, where an interrupted
+		   upload is most likely to have gone wrong.
+		*/
+		boost::uintmax_t const last = remote_size - RESUME_SAMPLE_SIZE;
+		for (int i = 0; i < RESUME_SAMPLES; ++i) {
+			samples.push_back (make_pair (last * i / (RESUME_SAMPLES - 1), size_t (RESUME_SAMPLE_SIZE)));
+		}
+	}
+
+	FILE* f = fopen_boost (file.from, "rb");
+	if (!f) {
+		throw OpenFileError (file.from, errno, true);
+	}
+
+	vector<uint8_t> remote (samples.front().second);
+	vector<uint8_t> local (samples.front().second);
+
+	try {
+		for (vector<pair<boost::uintmax_t, size_t> >::const_iterator i = samples.begin(); i != samples.end(); ++i) {
+			connection->read (file.to, i->first, &remote[0], i->second);
+			dcpomatic_fseek (f, i->first, SEEK_SET);
+			if (fread (&local[0], 1, i->second, f) != i->second) {
+				throw ReadFileError (file.from);
+			}
+			if (memcmp (&remote[0], &local[0], i->second) != 0) {
+				fclose (f);
+				return false;
+			}
+		}
+	} catch (...) {
+		fclose (f);
+		throw;
+	}
+
+	fclose (f);
+	return true;
+}
+
+/** Called when some bytes of a file have been dealt with.
+ *  @param bytes Number of bytes.
+ *  @param sent true if the bytes were sent, false if they were already on the server.
+ */
+void
+Uploader::done (boost::uintmax_t bytes, bool sent)
+{
+	boost::posix_time::ptime const now = boost::posix_time::microsec_clock::universal_time ();
+
+	boost::mutex::scoped_lock lm (_mutex);
+	_done += bytes;
+	if (sent) {
+		_sent += bytes;
+	}
+
+	float const progress = _total > 0 ? double (_done) / _total : 0;
+
+	string status;
+	if ((now - _last_status).total_milliseconds() >= 1000 && _sent > 0) {
+		char rate[64];
+		snprintf (rate, sizeof (rate), "%.1f", _sent / ((now - _start).total_milliseconds() * 1000.0));
+		/// TRANSLATORS: %1 is a filename and %2 is a number of megabytes per second
+		status = String::compose (_("copying %1 at %2MB/s"), _current, rate);
+		_last_status = now;
+	}
+
+	lm.unlock ();
+
+	_set_progress (progress);
+	if (!status.empty ()) {
+		_set_status (status);
+	}
+}
+
+/** @return Estimate of the number of seconds left before the upload finishes, based on the
+ *  rate that we have sent data so far, or an empty optional if there is no estimate yet.
+ */
+optional<int>
+Uploader::remaining_time () const
+{
+	boost::mutex::scoped_lock lm (_mutex);
+
+	if (_sent == 0) {
+		return optional<int> ();
+	}
+
+	double const elapsed = (boost::posix_time::microsec_clock::universal_time() - _start).total_milliseconds() / 1000.0;
+	if (elapsed < 5) {
+		return optional<int> ();
+	}
+
+	return int ((_total - _done) / (_sent / elapsed));
 }
 
 boost::filesystem::path
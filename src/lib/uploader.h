@@ -1,5 +1,5 @@
 /*
-    Copyright (C) 2015 Carl Hetherington <cth@carlh.net>
+    Copyright (C) 2015-2018 Carl Hetherington <cth@carlh.net>
 
     This file is part of DCP-o-matic.
 
@@ -21,33 +21,107 @@
 #ifndef DCPOMATIC_UPLOADER_H
 #define DCPOMATIC_UPLOADER_H
 
+#include "exception_store.h"
 #include <boost/shared_ptr.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/function.hpp>
-
-class Job;
-
-class Uploader
+#include <boost/optional.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/noncopyable.hpp>
+#include <list>
+#include <string>
+
+class UploadSource;
+
+/** @class Uploader
+ *  @brief Parent for classes which copy a directory to a server.
+ *
+ *  Files are sent over several connections at once, each used by its own thread.
+ *  If a file is already on the server (from an earlier upload which was interrupted,
+ *  for example) and it looks the same as the start of the local file, only the rest of
+ *  the file is sent.  If the server can give us an MD5 digest of its copy we compare
+ *  that with the same part of the local file; otherwise we compare some samples of the
+ *  remote copy, so that we do not have to read all of it back from the server.
+ */
+class Uploader : public boost::noncopyable, public ExceptionStore
 {
 public:
-	Uploader (boost::function<void (std::string)> set_status, boost::function<void (float)> set_progress);
+	Uploader (boost::function<void (std::string)> set_status, boost::function<void (float)> set_progress, int connections = 1);
 	virtual ~Uploader () {}
 
 	void upload (boost::filesystem::path directory);
 
-protected:
-
-	virtual void create_directory (boost::filesystem::path directory) = 0;
-	virtual void upload_file (boost::filesystem::path from, boost::filesystem::path to, boost::uintmax_t& transferred, boost::uintmax_t total_size) = 0;
+	boost::optional<int> remaining_time () const;
+
+	/** @class Connection
+	 *  @brief A connection to the server; each is only used by one thread at a time.
+	 */
+	class Connection
+	{
+	public:
+		virtual ~Connection () {}
+
+		virtual void create_directory (boost::filesystem::path directory) = 0;
+		/** @return Size of a file on the server, or 0 if it does not exist or we cannot find its size */
+		virtual boost::uintmax_t remote_size (boost::filesystem::path file) = 0;
+		/** Read part of a file on the server */
+		virtual void read (boost::filesystem::path file, boost::uintmax_t offset, uint8_t* data, size_t size) = 0;
+		/** @return MD5 digest of the whole of a file on the server, as a hex string, or an empty
+		 *  optional if the server cannot tell us.
+		 */
+		virtual boost::optional<std::string> remote_md5 (boost::filesystem::path) {
+			return boost::optional<std::string> ();
+		}
+		/** Write everything from source to a file on the server, starting at source.offset() */
+		virtual void upload_file (UploadSource& source, boost::filesystem::path to) = 0;
+	};
 
-	boost::function<void (float)> _set_progress;
+protected:
+	virtual boost::shared_ptr<Connection> connect () = 0;
 
 private:
-	void upload_directory (boost::filesystem::path base, boost::filesystem::path directory, boost::uintmax_t& transferred, boost::uintmax_t total_size);
-	boost::uintmax_t count_file_sizes (boost::filesystem::path) const;
+	struct File
+	{
+		File (boost::filesystem::path from_, boost::filesystem::path to_, boost::uintmax_t size_)
+			: from (from_)
+			, to (to_)
+			, size (size_)
+		{}
+
+		boost::filesystem::path from;
+		boost::filesystem::path to;
+		boost::uintmax_t size;
+	};
+
+	void find (boost::filesystem::path base, boost::filesystem::path directory, std::list<boost::filesystem::path>& directories, std::list<File>& files) const;
 	boost::filesystem::path remove_prefix (boost::filesystem::path prefix, boost::filesystem::path target) const;
+	void upload_thread (boost::shared_ptr<Connection> connection);
+	void upload_file (boost::shared_ptr<Connection> connection, File const & file);
+	bool can_resume (boost::shared_ptr<Connection> connection, File const & file, boost::uintmax_t remote_size) const;
+	bool same_md5 (std::string remote_md5, File const & file, boost::uintmax_t remote_size) const;
+	bool same_samples (boost::shared_ptr<Connection> connection, File const & file, boost::uintmax_t remote_size) const;
+	void done (boost::uintmax_t bytes, bool sent);
 
 	boost::function<void (std::string)> _set_status;
+	boost::function<void (float)> _set_progress;
+	int _connections;
+
+	/** mutex to protect everything below */
+	mutable boost::mutex _mutex;
+	/** files which have not yet been given to an upload thread */
+	std::list<File> _files;
+	/** total size of the files that we are uploading */
+	boost::uintmax_t _total;
+	/** number of bytes which have either been sent or were found to be on the server already */
+	boost::uintmax_t _done;
+	/** number of bytes which have been sent */
+	boost::uintmax_t _sent;
+	/** time that we started sending, or that the last status update was made */
+	boost::posix_time::ptime _start;
+	boost::posix_time::ptime _last_status;
+	/** name of the file which was most recently started */
+	std::string _current;
 };
 
 #endif
@@ -37,6 +37,7 @@
 #include "audio_processor.h"
 #include "compose.hpp"
 #include "audio_buffers.h"
+#include "metrics.h"
 #include <dcp/locale_convert.h>
 #include <dcp/util.h>
 #include <dcp/raw_convert.h>
@@ -369,6 +370,9 @@ dcpomatic_setup ()
 
 	curl_global_init (CURL_GLOBAL_ALL);
 
+	/* Make this now, before there are threads which might race to do it */
+	Metrics::instance ();
+
 #ifdef DCPOMATIC_GRAPHICS_MAGICK
 	Magick::InitializeMagick (0);
 #endif
@@ -758,21 +762,7 @@ shared_ptr<AudioBuffers>
 remap (shared_ptr<const AudioBuffers> input, int output_channels, AudioMapping map)
 {
 	shared_ptr<AudioBuffers> mapped (new AudioBuffers (output_channels, input->frames()));
-	mapped->make_silent ();
-
-	for (int i = 0; i < map.input_channels(); ++i) {
-		for (int j = 0; j < mapped->channels(); ++j) {
-			if (map.get (i, static_cast<dcp::Channel> (j)) > 0) {
-				mapped->accumulate_channel (
-					input.get(),
-					i,
-					static_cast<dcp::Channel> (j),
-					map.get (i, static_cast<dcp::Channel> (j))
-					);
-			}
-		}
-	}
-
+	SparseAudioMapping (map, output_channels).apply (input.get(), mapped.get());
 	return mapped;
 }
 
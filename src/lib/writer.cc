@@ -34,6 +34,7 @@
 #include "font.h"
 #include "util.h"
 #include "reel_writer.h"
+#include "metrics.h"
 #include <dcp/cpl.h>
 #include <dcp/locale_convert.h>
 #include <boost/foreach.hpp>
@@ -149,6 +150,8 @@ Writer::write (Data encoded, Frame frame, Eyes eyes)
 		++_queued_full_in_memory;
 	}
 
+	Metrics::instance()->set ("dcpomatic_writer_queue_frames", "", _queue.size ());
+
 	/* Now there's something to do: wake anything wait()ing on _empty_condition */
 	_empty_condition.notify_all ();
 }
@@ -187,6 +190,34 @@ Writer::repeat (Frame frame, Eyes eyes)
 		_queue.push_back (qi);
 	}
 
+	Metrics::instance()->set ("dcpomatic_writer_queue_frames", "", _queue.size ());
+
+	/* Now there's something to do: wake anything wait()ing on _empty_condition */
+	_empty_condition.notify_all ();
+}
+
+/** Write the right-eye image of a 3D frame as a copy of its left-eye image.
+ *  @param frame Frame index within the DCP.
+ */
+void
+Writer::copy_left_eye (Frame frame)
+{
+	boost::mutex::scoped_lock lock (_state_mutex);
+
+	while (_queued_full_in_memory > _maximum_frames_in_memory) {
+		/* The queue is too big; wait until that is sorted out */
+		_full_condition.wait (lock);
+	}
+
+	QueueItem qi;
+	qi.type = QueueItem::COPY_LEFT_EYE;
+	qi.reel = video_reel (frame);
+	qi.frame = frame - _reels[qi.reel].start ();
+	qi.eyes = EYES_RIGHT;
+	_queue.push_back (qi);
+
+	Metrics::instance()->set ("dcpomatic_writer_queue_frames", "", _queue.size ());
+
 	/* Now there's something to do: wake anything wait()ing on _empty_condition */
 	_empty_condition.notify_all ();
 }
@@ -226,6 +257,44 @@ Writer::fake_write (Frame frame, Eyes eyes)
 		_queue.push_back (qi);
 	}
 
+	Metrics::instance()->set ("dcpomatic_writer_queue_frames", "", _queue.size ());
+
+	/* Now there's something to do: wake anything wait()ing on _empty_condition */
+	_empty_condition.notify_all ();
+}
+
+/** Write a video frame whose JPEG2000 data is already in the film's j2c directory.
+ *  @param frame Frame index within the DCP.
+ *  @param eyes Eyes that this frame image is for.
+ */
+void
+Writer::write_from_disk (Frame frame, Eyes eyes)
+{
+	boost::mutex::scoped_lock lock (_state_mutex);
+
+	/* These frames take up no memory, but have_sequenced_image_at_queue_head() sorts
+	   the queue so we still don't want it to get too long.
+	*/
+	while (int (_queue.size()) > _maximum_frames_in_memory) {
+		_full_condition.wait (lock);
+	}
+
+	QueueItem qi;
+	qi.type = QueueItem::FULL;
+	qi.reel = video_reel (frame);
+	qi.frame = frame - _reels[qi.reel].start ();
+	if (_film->three_d() && eyes == EYES_BOTH) {
+		qi.eyes = EYES_LEFT;
+		_queue.push_back (qi);
+		qi.eyes = EYES_RIGHT;
+		_queue.push_back (qi);
+	} else {
+		qi.eyes = eyes;
+		_queue.push_back (qi);
+	}
+
+	Metrics::instance()->set ("dcpomatic_writer_queue_frames", "", _queue.size ());
+
 	/* Now there's something to do: wake anything wait()ing on _empty_condition */
 	_empty_condition.notify_all ();
 }
@@ -375,6 +444,7 @@ try
 			if (qi.type == QueueItem::FULL && qi.encoded) {
 				--_queued_full_in_memory;
 			}
+			Metrics::instance()->set ("dcpomatic_writer_queue_frames", "", _queue.size ());
 
 			lock.unlock ();
 
@@ -383,21 +453,36 @@ try
 			switch (qi.type) {
 			case QueueItem::FULL:
 				LOG_DEBUG_ENCODE (N_("Writer FULL-writes %1 (%2)"), qi.frame, (int) qi.eyes);
-				if (!qi.encoded) {
-					qi.encoded = Data (_film->j2c_path (qi.reel, qi.frame, qi.eyes, false));
+				if (qi.encoded) {
+					reel.write (qi.encoded, qi.frame, qi.eyes);
+				} else {
+					boost::filesystem::path const j2c = _film->j2c_path (reel.period(), qi.frame, qi.eyes, false);
+					qi.encoded = Data (j2c);
+					reel.write (qi.encoded, qi.frame, qi.eyes);
+					/* The frame is now in the reel's picture asset so we no longer need its J2C file */
+					boost::system::error_code ec;
+					boost::filesystem::remove (j2c, ec);
 				}
-				reel.write (qi.encoded, qi.frame, qi.eyes);
 				++_full_written;
+				Metrics::instance()->increment ("dcpomatic_writer_frames_total", Metrics::label ("type", "full"));
 				break;
 			case QueueItem::FAKE:
 				LOG_DEBUG_ENCODE (N_("Writer FAKE-writes %1"), qi.frame);
 				reel.fake_write (qi.frame, qi.eyes, qi.size);
 				++_fake_written;
+				Metrics::instance()->increment ("dcpomatic_writer_frames_total", Metrics::label ("type", "fake"));
 				break;
 			case QueueItem::REPEAT:
 				LOG_DEBUG_ENCODE (N_("Writer REPEAT-writes %1"), qi.frame);
-				reel.repeat_write (qi.frame, qi.eyes);
+				reel.repeat_write (qi.frame, qi.eyes, qi.eyes);
+				++_repeat_written;
+				Metrics::instance()->increment ("dcpomatic_writer_frames_total", Metrics::label ("type", "repeat"));
+				break;
+			case QueueItem::COPY_LEFT_EYE:
+				LOG_DEBUG_ENCODE (N_("Writer REPEAT-writes %1 from left eye"), qi.frame);
+				reel.repeat_write (qi.frame, EYES_RIGHT, EYES_LEFT);
 				++_repeat_written;
+				Metrics::instance()->increment ("dcpomatic_writer_frames_total", Metrics::label ("type", "copy-left-eye"));
 				break;
 			}
 
@@ -418,6 +503,7 @@ try
 
 			DCPOMATIC_ASSERT (i != _queue.rend());
 			++_pushed_to_disk;
+			Metrics::instance()->increment ("dcpomatic_writer_pushed_to_disk_total");
 			/* For the log message below */
 			int const awaiting = _reels[_queue.front().reel].last_written_video_frame();
 			lock.unlock ();
@@ -430,8 +516,8 @@ try
 			LOG_GENERAL ("Writer full; pushes %1 to disk while awaiting %2", i->frame, awaiting);
 
 			i->encoded->write_via_temp (
-				_film->j2c_path (i->reel, i->frame, i->eyes, true),
-				_film->j2c_path (i->reel, i->frame, i->eyes, false)
+				_film->j2c_path (_reels[i->reel].period(), i->frame, i->eyes, true),
+				_film->j2c_path (_reels[i->reel].period(), i->frame, i->eyes, false)
 				);
 
 			lock.lock ();
@@ -503,10 +589,14 @@ Writer::finish ()
 
 	dcp.add (cpl);
 
-	/* Calculate digests for each reel in parallel */
+	/* Calculate digests for each reel in parallel, verifying the picture frames as we go if required */
 
 	shared_ptr<Job> job = _job.lock ();
-	job->sub (_("Computing digests"));
+	if (Config::instance()->verify_dcp ()) {
+		job->sub (_("Verifying and computing digests"));
+	} else {
+		job->sub (_("Computing digests"));
+	}
 
 	boost::asio::io_service service;
 	boost::thread_group pool;
@@ -521,13 +611,16 @@ Writer::finish ()
 
 	BOOST_FOREACH (ReelWriter& i, _reels) {
 		boost::function<void (float)> set_progress = boost::bind (&Writer::set_digest_progress, this, job.get(), _1);
-		service.post (boost::bind (&ReelWriter::calculate_digests, &i, set_progress));
+		service.post (boost::bind (&Writer::calculate_digests, this, &i, set_progress));
 	}
 
 	work.reset ();
 	pool.join_all ();
 	service.stop ();
 
+	/* Throw any verification (or other) failure */
+	rethrow ();
+
 	/* Add reels to CPL */
 
 	BOOST_FOREACH (ReelWriter& i, _reels) {
@@ -723,6 +816,18 @@ Writer::video_reel (int frame) const
 	return i;
 }
 
+/** Calculate the digests of one reel's assets; called on a thread from the pool in finish() */
+void
+Writer::calculate_digests (ReelWriter* reel, boost::function<void (float)> set_progress)
+try
+{
+	reel->calculate_digests (set_progress);
+}
+catch (...)
+{
+	store_current ();
+}
+
 void
 Writer::set_digest_progress (Job* job, float progress)
 {
@@ -29,6 +29,7 @@
 #include <boost/weak_ptr.hpp>
 #include <boost/thread.hpp>
 #include <boost/thread/condition.hpp>
+#include <boost/function.hpp>
 #include <list>
 
 namespace dcp {
@@ -60,7 +61,10 @@ public:
 		    state but we use the data that is already on disk.
 		*/
 		FAKE,
+		/** a repeat of the last frame that was written for the same eye */
 		REPEAT,
+		/** a right-eye frame which is the same as the left-eye frame before it */
+		COPY_LEFT_EYE,
 	} type;
 
 	/** encoded data for FULL */
@@ -101,8 +105,10 @@ public:
 
 	void write (dcp::Data, Frame, Eyes);
 	void fake_write (Frame, Eyes);
+	void write_from_disk (Frame, Eyes);
 	bool can_repeat (Frame) const;
 	void repeat (Frame, Eyes);
+	void copy_left_eye (Frame);
 	void write (boost::shared_ptr<const AudioBuffers>, DCPTime time);
 	void write (PlayerSubtitles subs, DCPTimePeriod period);
 	void write (std::list<boost::shared_ptr<Font> > fonts);
@@ -116,6 +122,7 @@ private:
 	void terminate_thread (bool);
 	bool have_sequenced_image_at_queue_head ();
 	size_t video_reel (int frame) const;
+	void calculate_digests (ReelWriter* reel, boost::function<void (float)> set_progress);
 	void set_digest_progress (Job* job, float progress);
 	void write_cover_sheet ();
 
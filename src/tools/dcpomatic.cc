@@ -236,6 +236,7 @@ public:
 		, _history_position (0)
 		, _history_separator (0)
 		, _update_news_requested (false)
+		, _cinemas_changed (false)
 	{
 #if defined(DCPOMATIC_WINDOWS)
 		if (Config::instance()->win32_console ()) {
@@ -935,6 +936,23 @@ private:
 		*/
 		_config_changed_connection.disconnect ();
 
+		if (_cinemas_changed) {
+			/* Export the cinemas once, so that the cinemas file is up to date for
+			   anything else which reads it.
+			*/
+			try {
+				Config::instance()->write_cinemas ();
+			} catch (exception& e) {
+				error_dialog (
+					this,
+					wxString::Format (
+						_("Could not write to cinemas file at %s."),
+						std_to_wx (Config::instance()->cinemas_file().string()).data()
+						)
+					);
+			}
+		}
+
 		ev.Skip ();
 	}
 
@@ -1110,19 +1128,12 @@ private:
 
 	void config_changed (Config::Property what)
 	{
-		/* Instantly save any config changes when using the DCP-o-matic GUI */
+		/* Instantly save any config changes when using the DCP-o-matic GUI; changes to
+		   cinemas have already been saved by Config, and are exported to the cinemas
+		   file when we close.
+		*/
 		if (what == Config::CINEMAS) {
-			try {
-				Config::instance()->write_cinemas();
-			} catch (exception& e) {
-				error_dialog (
-					this,
-					wxString::Format (
-						_("Could not write to cinemas file at %s.  Your changes have not been saved."),
-						std_to_wx (Config::instance()->cinemas_file().string()).data()
-						)
-					);
-			}
+			_cinemas_changed = true;
 		} else {
 			try {
 				Config::instance()->write_config();
@@ -1211,6 +1222,8 @@ private:
 	wxMenuItem* _history_separator;
 	boost::signals2::scoped_connection _config_changed_connection;
 	bool _update_news_requested;
+	/** true if the cinemas have been changed since we started */
+	bool _cinemas_changed;
 	shared_ptr<Content> _clipboard;
 };
 
@@ -38,6 +38,8 @@
 #include <getopt.h>
 #include <iostream>
 #include <iomanip>
+#include <climits>
+#include <cstdlib>
 
 using std::string;
 using std::cerr;
@@ -66,6 +68,8 @@ help (string n)
 	     << "  -l, --list-servers   just display a list of encoding servers that DCP-o-matic is configured to use; don't encode\n"
 	     << "  -d, --dcp-path       echo DCP's path to stdout on successful completion (implies -n)\n"
 	     << "      --dump           just dump a summary of the film's settings; don't encode\n"
+	     << "      --farm           send whole reels to the encoding servers, which must share storage with this machine\n"
+	     << "      --reels <n>      decode and encode <n> reels at the same time on this machine\n"
 	     << "\n"
 	     << "<FILM> is the film directory.\n";
 }
@@ -188,6 +192,8 @@ main (int argc, char* argv[])
 	optional<int> json_port;
 	bool keep_going = false;
 	bool dump = false;
+	bool farm = false;
+	optional<int> reels;
 	optional<boost::filesystem::path> servers;
 	bool list_servers_ = false;
 	bool dcp_path = false;
@@ -208,10 +214,12 @@ main (int argc, char* argv[])
 			{ "dcp-path", no_argument, 0, 'd' },
 			/* Just using A, B, C ... from here on */
 			{ "dump", no_argument, 0, 'A' },
+			{ "farm", no_argument, 0, 'B' },
+			{ "reels", required_argument, 0, 'C' },
 			{ 0, 0, 0, 0 }
 		};
 
-		int c = getopt_long (argc, argv, "vhfnrt:j:kAs:ld", long_options, &option_index);
+		int c = getopt_long (argc, argv, "vhfnrt:j:kABC:s:ld", long_options, &option_index);
 
 		if (c == -1) {
 			break;
@@ -245,6 +253,20 @@ main (int argc, char* argv[])
 		case 'A':
 			dump = true;
 			break;
+		case 'B':
+			farm = true;
+			break;
+		case 'C':
+		{
+			char* end = 0;
+			long const r = strtol (optarg, &end, 10);
+			if (end == optarg || *end != '\0' || r <= 0 || r > INT_MAX) {
+				cerr << argv[0] << ": --reels must be given a positive whole number of reels\n";
+				exit (EXIT_FAILURE);
+			}
+			reels = r;
+			break;
+		}
 		case 's':
 			servers = optarg;
 			break;
@@ -296,13 +318,25 @@ main (int argc, char* argv[])
 	}
 
 	if (json_port) {
-		new JSONServer (json_port.get ());
+		try {
+			new JSONServer (json_port.get ());
+		} catch (std::exception& e) {
+			cerr << argv[0] << ": could not start JSON server on port " << json_port.get() << " (" << e.what() << ")\n";
+		}
 	}
 
 	if (threads) {
 		Config::instance()->set_master_encoding_threads (threads.get ());
 	}
 
+	if (farm) {
+		Config::instance()->set_servers_encode_reels (true);
+	}
+
+	if (reels) {
+		Config::instance()->set_local_reel_encoders (reels.get ());
+	}
+
 	shared_ptr<Film> film;
 	try {
 		film.reset (new Film (film_dir));
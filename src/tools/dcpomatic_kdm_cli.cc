@@ -24,6 +24,7 @@
 
 #include "lib/film.h"
 #include "lib/cinema.h"
+#include "lib/cinema_list.h"
 #include "lib/screen_kdm.h"
 #include "lib/cinema_kdms.h"
 #include "lib/config.h"
@@ -68,7 +69,8 @@ help ()
 		"  -C, --certificate                        file containing projector certificate\n"
 		"  -T, --trusted-device                     file containing a trusted device's certificate\n"
 		"      --list-cinemas                       list known cinemas from the DCP-o-matic settings\n"
-		"      --list-dkdm-cpls                     list CPLs for which DCP-o-matic has DKDMs\n\n"
+		"      --list-dkdm-cpls                     list CPLs for which DCP-o-matic has DKDMs\n"
+		"      --send-outbox                        send KDM emails which could not be sent earlier\n\n"
 		"CPL-ID must be the ID of a CPL that is mentioned in DCP-o-matic's DKDM list.\n\n"
 		"For example:\n\n"
 		"Create KDMs for my_great_movie to play in all of Fred's Cinema's screens for the next two weeks and zip them up.\n"
@@ -165,22 +167,13 @@ write_files (
 shared_ptr<Cinema>
 find_cinema (string cinema_name)
 {
-	list<shared_ptr<Cinema> > cinemas = Config::instance()->cinemas ();
-	list<shared_ptr<Cinema> >::const_iterator i = cinemas.begin();
-	while (
-		i != cinemas.end() &&
-		(*i)->name != cinema_name &&
-		find ((*i)->emails.begin(), (*i)->emails.end(), cinema_name) == (*i)->emails.end()) {
-
-		++i;
-	}
-
-	if (i == cinemas.end ()) {
+	shared_ptr<Cinema> cinema = Config::instance()->cinema_list()->find_by_name_or_email (cinema_name);
+	if (!cinema) {
 		cerr << program_name << ": could not find cinema \"" << cinema_name << "\"\n";
 		exit (EXIT_FAILURE);
 	}
 
-	return *i;
+	return cinema;
 }
 
 void
@@ -397,6 +390,7 @@ int main (int argc, char* argv[])
 	bool zip = false;
 	bool list_cinemas = false;
 	bool list_dkdm_cpls = false;
+	bool send_outbox = false;
 	optional<string> duration_string;
 	bool verbose = false;
 	dcp::Formulation formulation = dcp::MODIFIED_TRANSITIONAL_1;
@@ -426,10 +420,11 @@ int main (int argc, char* argv[])
 			{ "trusted-device", required_argument, 0, 'T' },
 			{ "list-cinemas", no_argument, 0, 'B' },
 			{ "list-dkdm-cpls", no_argument, 0, 'D' },
+			{ "send-outbox", no_argument, 0, 'E' },
 			{ 0, 0, 0, 0 }
 		};
 
-		int c = getopt_long (argc, argv, "ho:K:Z:f:t:d:F:pa::zvc:S:C:T:BD", long_options, &option_index);
+		int c = getopt_long (argc, argv, "ho:K:Z:f:t:d:F:pa::zvc:S:C:T:BDE", long_options, &option_index);
 
 		if (c == -1) {
 			break;
@@ -513,6 +508,9 @@ int main (int argc, char* argv[])
 		case 'D':
 			list_dkdm_cpls = true;
 			break;
+		case 'E':
+			send_outbox = true;
+			break;
 		}
 	}
 
@@ -529,6 +527,20 @@ int main (int argc, char* argv[])
 		exit (EXIT_SUCCESS);
 	}
 
+	if (send_outbox) {
+		dcpomatic_setup_path_encoding ();
+		dcpomatic_setup ();
+		try {
+			int const N = CinemaKDMs::send_outbox (shared_ptr<Log> ());
+			if (verbose) {
+				cout << "Sent " << N << " emails.\n";
+			}
+		} catch (std::exception& e) {
+			error (e.what ());
+		}
+		exit (EXIT_SUCCESS);
+	}
+
 	if (!duration_string && !valid_to) {
 		error ("you must specify a --valid-duration or --valid-to");
 	}
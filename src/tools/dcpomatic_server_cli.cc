@@ -28,6 +28,7 @@
 #include "lib/null_log.h"
 #include "lib/version.h"
 #include "lib/encode_server.h"
+#include "lib/json_server.h"
 #include <boost/array.hpp>
 #include <boost/asio.hpp>
 #include <boost/algorithm/string.hpp>
@@ -46,6 +47,7 @@ using std::cerr;
 using std::string;
 using std::cout;
 using boost::shared_ptr;
+using boost::optional;
 
 static void
 help (string n)
@@ -55,7 +57,8 @@ help (string n)
 	     << "  -h, --help         show this help\n"
 	     << "  -t, --threads      number of parallel encoding threads to use\n"
 	     << "  --verbose          be verbose to stdout\n"
-	     << "  --log              write a log file of activity\n";
+	     << "  --log              write a log file of activity\n"
+	     << "  -j, --json <port>  run a JSON server (which also serves /metrics) on the specified port\n";
 }
 
 int
@@ -67,6 +70,7 @@ main (int argc, char* argv[])
 	int num_threads = Config::instance()->server_encoding_threads ();
 	bool verbose = false;
 	bool write_log = false;
+	optional<int> json_port;
 
 	int option_index = 0;
 	while (true) {
@@ -76,10 +80,11 @@ main (int argc, char* argv[])
 			{ "threads", required_argument, 0, 't'},
 			{ "verbose", no_argument, 0, 'A'},
 			{ "log", no_argument, 0, 'B'},
+			{ "json", required_argument, 0, 'j'},
 			{ 0, 0, 0, 0 }
 		};
 
-		int c = getopt_long (argc, argv, "vht:AB", long_options, &option_index);
+		int c = getopt_long (argc, argv, "vht:ABj:", long_options, &option_index);
 
 		if (c == -1) {
 			break;
@@ -101,6 +106,9 @@ main (int argc, char* argv[])
 		case 'B':
 			write_log = true;
 			break;
+		case 'j':
+			json_port = atoi (optarg);
+			break;
 		}
 	}
 
@@ -111,6 +119,14 @@ main (int argc, char* argv[])
 		log.reset (new NullLog);
 	}
 
+	if (json_port) {
+		try {
+			new JSONServer (json_port.get ());
+		} catch (std::exception& e) {
+			cerr << argv[0] << ": could not start JSON server on port " << json_port.get() << " (" << e.what() << ")\n";
+		}
+	}
+
 	EncodeServer server (log, verbose, num_threads);
 
 	try {
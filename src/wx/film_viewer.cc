@@ -44,6 +44,7 @@
 #include "lib/config.h"
 extern "C" {
 #include <libavutil/pixfmt.h>
+#include <libswscale/swscale.h>
 }
 #include <dcp/exceptions.h>
 #include <wx/tglbtn.h>
@@ -96,6 +97,7 @@ FilmViewer::FilmViewer (wxWindow* p, bool outline_content, bool jump_to_selected
 	, _playing (false)
 	, _latency_history_count (0)
 	, _dropped (0)
+	, _scale_context (0)
 {
 #ifndef __WXOSX__
 	_panel->SetDoubleBuffered (true);
@@ -179,6 +181,7 @@ FilmViewer::FilmViewer (wxWindow* p, bool outline_content, bool jump_to_selected
 FilmViewer::~FilmViewer ()
 {
 	stop ();
+	sws_freeContext (_scale_context);
 }
 
 void
@@ -322,15 +325,20 @@ FilmViewer::get ()
 	 * The content's specified colour conversion indicates the colourspace
 	 * which the content is in (according to the user).
 	 *
-	 * PlayerVideo::image (bound to PlayerVideo::always_rgb) will take the source
-	 * image and convert it (from whatever the user has said it is) to RGB.
+	 * PlayerVideo::image will take the source image and convert it (from
+	 * whatever the user has said it is) to the RGB of _buffer.
 	 */
 
-	_frame = video.first->image (
-		bind (&Log::dcp_log, _film->log().get(), _1, _2),
-		bind (&PlayerVideo::always_rgb, _1),
-		false, true
-		);
+	dcp::Size const out_size = video.first->out_size ();
+	if (!_buffer || _buffer->size() != out_size) {
+		/* This is unaligned so that paint_panel() can give it straight to wxImage, and has
+		   enough extra pixels for any padding that Image::crop_scale_window() might add.
+		*/
+		_buffer.reset (new Image (AV_PIX_FMT_RGB24, out_size, false, out_size.width));
+	}
+
+	video.first->image (bind (&Log::dcp_log, _film->log().get(), _1, _2), true, _buffer, &_scale_context);
+	_frame = _buffer;
 
 	ImageChanged (video.first);
 
@@ -374,7 +382,7 @@ FilmViewer::paint_panel ()
 		return;
 	}
 
-	wxImage frame (_out_size.width, _out_size.height, _frame->data()[0], true);
+	wxImage frame (_frame->size().width, _frame->size().height, _frame->data()[0], true);
 	wxBitmap frame_bitmap (frame);
 	dc.DrawBitmap (frame_bitmap, 0, 0);
 
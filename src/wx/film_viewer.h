@@ -34,6 +34,7 @@ class RGBPlusAlphaImage;
 class PlayerVideo;
 class Player;
 class Butler;
+struct SwsContext;
 
 /** @class FilmViewer
  *  @brief A wx widget to view a preview of a Film.
@@ -148,6 +149,12 @@ private:
 	int _latency_history_count;
 
 	int _dropped;
+
+	/** Image that frames are drawn into for display; it is re-used for each frame of the same size */
+	boost::shared_ptr<Image> _buffer;
+	/** Scale context that is re-used when drawing frames into _buffer */
+	struct SwsContext* _scale_context;
+
 	boost::optional<int> _dcp_decode_reduction;
 
 	boost::signals2::scoped_connection _config_changed_connection;
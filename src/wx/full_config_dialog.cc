@@ -934,6 +934,7 @@ public:
 		, _maximum_j2k_bandwidth (0)
 		, _allow_any_dcp_frame_rate (0)
 		, _only_servers_encode (0)
+		, _verify_dcp (0)
 		, _log_general (0)
 		, _log_warning (0)
 		, _log_error (0)
@@ -978,6 +979,10 @@ private:
 		table->Add (_only_servers_encode, 1, wxEXPAND | wxALL);
 		table->AddSpacer (0);
 
+		_verify_dcp = new wxCheckBox (_panel, wxID_ANY, _("Verify picture frames after making a DCP"));
+		table->Add (_verify_dcp, 1, wxEXPAND | wxALL);
+		table->AddSpacer (0);
+
 		{
 			add_label_to_sizer (table, _panel, _("Maximum number of frames to store per thread"), true);
 			wxBoxSizer* s = new wxBoxSizer (wxHORIZONTAL);
@@ -986,6 +991,18 @@ private:
 			table->Add (s, 1);
 		}
 
+		add_label_to_sizer (table, _panel, _("Maximum number of encoding jobs to run at once"), true);
+		_maximum_encode_jobs = new wxSpinCtrl (_panel);
+		table->Add (_maximum_encode_jobs, 1);
+
+		add_label_to_sizer (table, _panel, _("Maximum number of file and network jobs to run at once"), true);
+		_maximum_io_jobs = new wxSpinCtrl (_panel);
+		table->Add (_maximum_io_jobs, 1);
+
+		add_label_to_sizer (table, _panel, _("Maximum number of other jobs to run at once"), true);
+		_maximum_light_jobs = new wxSpinCtrl (_panel);
+		table->Add (_maximum_light_jobs, 1);
+
 		{
 			add_top_aligned_label_to_sizer (table, _panel, _("DCP metadata filename format"));
 			dcp::NameFormat::Map titles;
@@ -1047,7 +1064,14 @@ private:
 		_maximum_j2k_bandwidth->Bind (wxEVT_SPINCTRL, boost::bind (&AdvancedPage::maximum_j2k_bandwidth_changed, this));
 		_allow_any_dcp_frame_rate->Bind (wxEVT_CHECKBOX, boost::bind (&AdvancedPage::allow_any_dcp_frame_rate_changed, this));
 		_only_servers_encode->Bind (wxEVT_CHECKBOX, boost::bind (&AdvancedPage::only_servers_encode_changed, this));
+		_verify_dcp->Bind (wxEVT_CHECKBOX, boost::bind (&AdvancedPage::verify_dcp_changed, this));
 		_frames_in_memory_multiplier->Bind (wxEVT_SPINCTRL, boost::bind(&AdvancedPage::frames_in_memory_multiplier_changed, this));
+		_maximum_encode_jobs->SetRange (1, 16);
+		_maximum_encode_jobs->Bind (wxEVT_SPINCTRL, boost::bind (&AdvancedPage::maximum_encode_jobs_changed, this));
+		_maximum_io_jobs->SetRange (1, 16);
+		_maximum_io_jobs->Bind (wxEVT_SPINCTRL, boost::bind (&AdvancedPage::maximum_io_jobs_changed, this));
+		_maximum_light_jobs->SetRange (1, 16);
+		_maximum_light_jobs->Bind (wxEVT_SPINCTRL, boost::bind (&AdvancedPage::maximum_light_jobs_changed, this));
 		_dcp_metadata_filename_format->Changed.connect (boost::bind (&AdvancedPage::dcp_metadata_filename_format_changed, this));
 		_dcp_asset_filename_format->Changed.connect (boost::bind (&AdvancedPage::dcp_asset_filename_format_changed, this));
 		_log_general->Bind (wxEVT_CHECKBOX, boost::bind (&AdvancedPage::log_changed, this));
@@ -1069,6 +1093,7 @@ private:
 		checked_set (_maximum_j2k_bandwidth, config->maximum_j2k_bandwidth() / 1000000);
 		checked_set (_allow_any_dcp_frame_rate, config->allow_any_dcp_frame_rate ());
 		checked_set (_only_servers_encode, config->only_servers_encode ());
+		checked_set (_verify_dcp, config->verify_dcp ());
 		checked_set (_log_general, config->log_types() & LogEntry::TYPE_GENERAL);
 		checked_set (_log_warning, config->log_types() & LogEntry::TYPE_WARNING);
 		checked_set (_log_error, config->log_types() & LogEntry::TYPE_ERROR);
@@ -1077,6 +1102,9 @@ private:
 		checked_set (_log_debug_encode, config->log_types() & LogEntry::TYPE_DEBUG_ENCODE);
 		checked_set (_log_debug_email, config->log_types() & LogEntry::TYPE_DEBUG_EMAIL);
 		checked_set (_frames_in_memory_multiplier, config->frames_in_memory_multiplier());
+		checked_set (_maximum_encode_jobs, config->maximum_encode_jobs ());
+		checked_set (_maximum_io_jobs, config->maximum_io_jobs ());
+		checked_set (_maximum_light_jobs, config->maximum_light_jobs ());
 #ifdef DCPOMATIC_WINDOWS
 		checked_set (_win32_console, config->win32_console());
 #endif
@@ -1092,6 +1120,21 @@ private:
 		Config::instance()->set_frames_in_memory_multiplier (_frames_in_memory_multiplier->GetValue());
 	}
 
+	void maximum_encode_jobs_changed ()
+	{
+		Config::instance()->set_maximum_encode_jobs (_maximum_encode_jobs->GetValue ());
+	}
+
+	void maximum_io_jobs_changed ()
+	{
+		Config::instance()->set_maximum_io_jobs (_maximum_io_jobs->GetValue ());
+	}
+
+	void maximum_light_jobs_changed ()
+	{
+		Config::instance()->set_maximum_light_jobs (_maximum_light_jobs->GetValue ());
+	}
+
 	void allow_any_dcp_frame_rate_changed ()
 	{
 		Config::instance()->set_allow_any_dcp_frame_rate (_allow_any_dcp_frame_rate->GetValue ());
@@ -1102,6 +1145,11 @@ private:
 		Config::instance()->set_only_servers_encode (_only_servers_encode->GetValue ());
 	}
 
+	void verify_dcp_changed ()
+	{
+		Config::instance()->set_verify_dcp (_verify_dcp->GetValue ());
+	}
+
 	void dcp_metadata_filename_format_changed ()
 	{
 		Config::instance()->set_dcp_metadata_filename_format (_dcp_metadata_filename_format->get ());
@@ -1148,8 +1196,12 @@ private:
 
 	wxSpinCtrl* _maximum_j2k_bandwidth;
 	wxSpinCtrl* _frames_in_memory_multiplier;
+	wxSpinCtrl* _maximum_encode_jobs;
+	wxSpinCtrl* _maximum_io_jobs;
+	wxSpinCtrl* _maximum_light_jobs;
 	wxCheckBox* _allow_any_dcp_frame_rate;
 	wxCheckBox* _only_servers_encode;
+	wxCheckBox* _verify_dcp;
 	NameFormatEditor* _dcp_metadata_filename_format;
 	NameFormatEditor* _dcp_asset_filename_format;
 	wxCheckBox* _log_general;
@@ -20,12 +20,14 @@
 
 #include "lib/config.h"
 #include "lib/cinema.h"
+#include "lib/cinema_list.h"
 #include "lib/screen.h"
 #include "screens_panel.h"
 #include "wx_util.h"
 #include "cinema_dialog.h"
 #include "screen_dialog.h"
 #include <boost/foreach.hpp>
+#include <set>
 
 using std::list;
 using std::pair;
@@ -33,8 +35,8 @@ using std::cout;
 using std::map;
 using std::string;
 using std::make_pair;
+using std::set;
 using boost::shared_ptr;
-using boost::optional;
 
 ScreensPanel::ScreensPanel (wxWindow* parent)
 	: wxPanel (parent, wxID_ANY)
@@ -104,44 +106,23 @@ ScreensPanel::setup_sensitivity ()
 	_remove_screen->Enable (_selected_screens.size() >= 1);
 }
 
+/** Add a cinema and its screens to the tree; the caller must sort the tree afterwards */
 void
 ScreensPanel::add_cinema (shared_ptr<Cinema> c)
 {
-	string search = wx_to_std (_search->GetValue ());
-	transform (search.begin(), search.end(), search.begin(), ::tolower);
-
-	if (!search.empty ()) {
-		string name = c->name;
-		transform (name.begin(), name.end(), name.begin(), ::tolower);
-		if (name.find (search) == string::npos) {
-			return;
-		}
-	}
-
-	_cinemas[_targets->AppendItem (_root, std_to_wx (c->name))] = c;
+	wxTreeItemId const id = _targets->AppendItem (_root, std_to_wx (c->name));
+	_cinemas[id] = c;
 
 	list<shared_ptr<Screen> > sc = c->screens ();
 	for (list<shared_ptr<Screen> >::iterator i = sc.begin(); i != sc.end(); ++i) {
-		add_screen (c, *i);
+		add_screen (id, *i);
 	}
-
-	_targets->SortChildren (_root);
 }
 
-optional<wxTreeItemId>
-ScreensPanel::add_screen (shared_ptr<Cinema> c, shared_ptr<Screen> s)
+void
+ScreensPanel::add_screen (wxTreeItemId cinema, shared_ptr<Screen> s)
 {
-	CinemaMap::const_iterator i = _cinemas.begin();
-	while (i != _cinemas.end() && i->second != c) {
-		++i;
-	}
-
-	if (i == _cinemas.end()) {
-		return optional<wxTreeItemId> ();
-	}
-
-	_screens[_targets->AppendItem (i->first, std_to_wx (s->name))] = s;
-	return i->first;
+	_screens[_targets->AppendItem (cinema, std_to_wx (s->name))] = s;
 }
 
 void
@@ -152,6 +133,7 @@ ScreensPanel::add_cinema_clicked ()
 		shared_ptr<Cinema> c (new Cinema (d->name(), d->emails(), d->notes(), d->utc_offset_hour(), d->utc_offset_minute()));
 		Config::instance()->add_cinema (c);
 		add_cinema (c);
+		_targets->SortChildren (_root);
 	}
 
 	d->Destroy ();
@@ -177,7 +159,7 @@ ScreensPanel::edit_cinema_clicked ()
 		c.second->set_utc_offset_hour (d->utc_offset_hour ());
 		c.second->set_utc_offset_minute (d->utc_offset_minute ());
 		_targets->SetItemText (c.first, std_to_wx (d->name()));
-		Config::instance()->changed (Config::CINEMAS);
+		Config::instance()->update_cinema (c.second);
 	}
 
 	d->Destroy ();
@@ -201,7 +183,7 @@ ScreensPanel::add_screen_clicked ()
 		return;
 	}
 
-	shared_ptr<Cinema> c = _selected_cinemas.begin()->second;
+	pair<wxTreeItemId, shared_ptr<Cinema> > c = *_selected_cinemas.begin();
 
 	ScreenDialog* d = new ScreenDialog (GetParent(), _("Add Screen"));
 	if (d->ShowModal () != wxID_OK) {
@@ -209,7 +191,7 @@ ScreensPanel::add_screen_clicked ()
 		return;
 	}
 
-	BOOST_FOREACH (shared_ptr<Screen> i, c->screens ()) {
+	BOOST_FOREACH (shared_ptr<Screen> i, c.second->screens ()) {
 		if (i->name == d->name()) {
 			error_dialog (
 				GetParent(),
@@ -223,13 +205,11 @@ ScreensPanel::add_screen_clicked ()
 	}
 
 	shared_ptr<Screen> s (new Screen (d->name(), d->recipient(), d->trusted_devices()));
-	c->add_screen (s);
-	optional<wxTreeItemId> id = add_screen (c, s);
-	if (id) {
-		_targets->Expand (id.get ());
-	}
+	c.second->add_screen (s);
+	add_screen (c.first, s);
+	_targets->Expand (c.first);
 
-	Config::instance()->changed (Config::CINEMAS);
+	Config::instance()->update_cinema (c.second);
 
 	d->Destroy ();
 }
@@ -268,7 +248,7 @@ ScreensPanel::edit_screen_clicked ()
 	s.second->recipient = d->recipient ();
 	s.second->trusted_devices = d->trusted_devices ();
 	_targets->SetItemText (s.first, std_to_wx (d->name()));
-	Config::instance()->changed (Config::CINEMAS);
+	Config::instance()->update_cinema (c);
 
 	d->Destroy ();
 }
@@ -276,26 +256,18 @@ ScreensPanel::edit_screen_clicked ()
 void
 ScreensPanel::remove_screen_clicked ()
 {
-	for (ScreenMap::iterator i = _selected_screens.begin(); i != _selected_screens.end(); ++i) {
-		CinemaMap::iterator j = _cinemas.begin ();
-		while (j != _cinemas.end ()) {
-			list<shared_ptr<Screen> > sc = j->second->screens ();
-			if (find (sc.begin(), sc.end(), i->second) != sc.end ()) {
-				break;
-			}
-
-			++j;
-		}
+	set<shared_ptr<Cinema> > changed;
 
-		if (j == _cinemas.end()) {
-			continue;
-		}
-
-		j->second->remove_screen (i->second);
+	for (ScreenMap::iterator i = _selected_screens.begin(); i != _selected_screens.end(); ++i) {
+		shared_ptr<Cinema> c = i->second->cinema;
+		c->remove_screen (i->second);
 		_targets->Delete (i->first);
+		changed.insert (c);
 	}
 
-	Config::instance()->changed (Config::CINEMAS);
+	BOOST_FOREACH (shared_ptr<Cinema> i, changed) {
+		Config::instance()->update_cinema (i);
+	}
 }
 
 list<shared_ptr<Screen> >
@@ -359,9 +331,11 @@ ScreensPanel::add_cinemas ()
 {
 	_root = _targets->AddRoot ("Foo");
 
-	BOOST_FOREACH (shared_ptr<Cinema> i, Config::instance()->cinemas ()) {
+	BOOST_FOREACH (shared_ptr<Cinema> i, Config::instance()->cinema_list()->search (wx_to_std (_search->GetValue ()))) {
 		add_cinema (i);
 	}
+
+	_targets->SortChildren (_root);
 }
 
 void
@@ -42,7 +42,7 @@ public:
 private:
 	void add_cinemas ();
 	void add_cinema (boost::shared_ptr<Cinema>);
-	boost::optional<wxTreeItemId> add_screen (boost::shared_ptr<Cinema>, boost::shared_ptr<Screen>);
+	void add_screen (wxTreeItemId, boost::shared_ptr<Screen>);
 	void add_cinema_clicked ();
 	void edit_cinema_clicked ();
 	void remove_cinema_clicked ();
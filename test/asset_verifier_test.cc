@@ -0,0 +1,105 @@
+/*
+    Copyright (C) 2018 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/** @file  test/asset_verifier_test.cc
+ *  @brief Test AssetVerifier.
+ *  @ingroup selfcontained
+ */
+
+#include "lib/asset_verifier.h"
+#include "lib/digester.h"
+#include <dcp/util.h>
+#include <boost/test/unit_test.hpp>
+#include <cstdio>
+#include <cstring>
+
+using std::vector;
+
+/** Write a file of some frames separated by headers, returning the details of the frames */
+static vector<dcp::FrameInfo>
+write_asset (boost::filesystem::path file)
+{
+	FILE* f = fopen (file.string().c_str(), "wb");
+	BOOST_REQUIRE (f);
+
+	vector<dcp::FrameInfo> frames;
+	uint64_t offset = 0;
+	for (int i = 0; i < 24; ++i) {
+		/* A header which is not part of any frame */
+		uint8_t header[64];
+		memset (header, i, sizeof (header));
+		fwrite (header, 1, sizeof (header), f);
+		offset += sizeof (header);
+
+		/* Frames of different sizes, some bigger than AssetVerifier's read block */
+		vector<uint8_t> data ((i % 4) * 400000 + 1234);
+		for (size_t j = 0; j < data.size(); ++j) {
+			data[j] = (i * 7 + j * 13) & 0xff;
+		}
+		fwrite (&data[0], 1, data.size(), f);
+
+		Digester digester;
+		digester.add (&data[0], data.size());
+		frames.push_back (dcp::FrameInfo (offset, data.size(), digester.get()));
+		offset += data.size();
+	}
+
+	fclose (f);
+	return frames;
+}
+
+/** Check that a good asset verifies and that we get the same digest as libdcp */
+BOOST_AUTO_TEST_CASE (asset_verifier_test1)
+{
+	boost::filesystem::path const file = "build/test/asset_verifier_test1.mxf";
+	vector<dcp::FrameInfo> const frames = write_asset (file);
+
+	AssetVerifier verifier (file, frames);
+	BOOST_CHECK_EQUAL (verifier.run (boost::function<void (float)> ()), dcp::make_digest (file, 0));
+	BOOST_CHECK (verifier.bad_frames().empty ());
+}
+
+/** Check that corrupted and missing frames are found */
+BOOST_AUTO_TEST_CASE (asset_verifier_test2)
+{
+	boost::filesystem::path const file = "build/test/asset_verifier_test2.mxf";
+	vector<dcp::FrameInfo> const frames = write_asset (file);
+
+	/* Corrupt a byte in the middle of frame 5 */
+	FILE* f = fopen (file.string().c_str(), "r+b");
+	BOOST_REQUIRE (f);
+	long const corrupt = frames[5].offset + frames[5].size / 2;
+	fseek (f, corrupt, SEEK_SET);
+	int const c = fgetc (f);
+	fseek (f, corrupt, SEEK_SET);
+	fputc (c ^ 0xff, f);
+	fclose (f);
+
+	/* and lose the end of the file, so that frame 22 is incomplete and frame 23 is missing */
+	boost::filesystem::resize_file (file, frames[22].offset + 100);
+
+	AssetVerifier verifier (file, frames);
+	verifier.run (boost::function<void (float)> ());
+	vector<size_t> const bad = verifier.bad_frames ();
+	BOOST_REQUIRE_EQUAL (bad.size(), 3);
+	BOOST_CHECK_EQUAL (bad[0], 5);
+	BOOST_CHECK_EQUAL (bad[1], 22);
+	BOOST_CHECK_EQUAL (bad[2], 23);
+}
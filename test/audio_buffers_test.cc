@@ -28,6 +28,7 @@
 #include "lib/audio_buffers.h"
 
 using std::pow;
+using boost::shared_ptr;
 
 static float tolerance = 1e-3;
 
@@ -303,3 +304,66 @@ BOOST_AUTO_TEST_CASE (audio_buffers_accumulate_frames)
 		}
 	}
 }
+
+/** trim_start(), split() and slice() */
+BOOST_AUTO_TEST_CASE (audio_buffers_split_slice)
+{
+	shared_ptr<AudioBuffers> a (new AudioBuffers (3, 1000));
+	srand (84);
+	random_fill (*a);
+
+	a->trim_start (100);
+	BOOST_CHECK_EQUAL (a->frames(), 900);
+
+	shared_ptr<AudioBuffers> b = a->split (300);
+	BOOST_CHECK_EQUAL (a->frames(), 600);
+	BOOST_CHECK_EQUAL (b->frames(), 300);
+
+	shared_ptr<const AudioBuffers> c = a->slice (200, 50);
+	BOOST_CHECK_EQUAL (c->frames(), 50);
+
+	/* Check the data that each one sees */
+	srand (84);
+	for (int i = 0; i < 1000; ++i) {
+		for (int j = 0; j < 3; ++j) {
+			float const A = random_float ();
+			if (i >= 100 && i < 400) {
+				BOOST_CHECK_CLOSE (b->data(j)[i - 100], A, tolerance);
+			} else if (i >= 400) {
+				BOOST_CHECK_CLOSE (a->data(j)[i - 400], A, tolerance);
+			}
+			if (i >= 600 && i < 650) {
+				BOOST_CHECK_CLOSE (c->data(j)[i - 600], A, tolerance);
+			}
+		}
+	}
+
+	/* Extending the start of a split must not touch the rest */
+	b->append (b->clone ());
+	BOOST_CHECK_EQUAL (b->frames(), 600);
+	srand (84);
+	for (int i = 0; i < 1000; ++i) {
+		for (int j = 0; j < 3; ++j) {
+			float const A = random_float ();
+			if (i >= 100 && i < 400) {
+				BOOST_CHECK_CLOSE (b->data(j)[i - 100], A, tolerance);
+				BOOST_CHECK_CLOSE (b->data(j)[i + 200], A, tolerance);
+			} else if (i >= 400) {
+				BOOST_CHECK_CLOSE (a->data(j)[i - 400], A, tolerance);
+			}
+		}
+	}
+
+	/* Slices outlive the buffers that they came from */
+	a.reset ();
+	b.reset ();
+	srand (84);
+	for (int i = 0; i < 650; ++i) {
+		for (int j = 0; j < 3; ++j) {
+			float const A = random_float ();
+			if (i >= 600) {
+				BOOST_CHECK_CLOSE (c->data(j)[i - 600], A, tolerance);
+			}
+		}
+	}
+}
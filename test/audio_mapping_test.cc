@@ -26,6 +26,7 @@
 #include <boost/test/unit_test.hpp>
 #include "lib/audio_mapping.h"
 #include "lib/util.h"
+#include "lib/audio_buffers.h"
 
 using std::list;
 
@@ -57,3 +58,52 @@ BOOST_AUTO_TEST_CASE (audio_mapping_test)
 		}
 	}
 }
+
+/** Check that SparseAudioMapping gives the same results as mixing by hand */
+BOOST_AUTO_TEST_CASE (sparse_audio_mapping_test)
+{
+	int const N = 64;
+	AudioBuffers in (4, N);
+	for (int i = 0; i < 4; ++i) {
+		for (int j = 0; j < N; ++j) {
+			in.data(i)[j] = i * 100 + j;
+		}
+	}
+
+	/* Identity */
+	AudioMapping identity (4, 4);
+	for (int i = 0; i < 4; ++i) {
+		identity.set (i, i, 1);
+	}
+	BOOST_CHECK (SparseAudioMapping(identity, 4).identity());
+	BOOST_CHECK (!SparseAudioMapping(identity, 6).identity());
+
+	/* Permutation, a mix and an unmapped output channel */
+	AudioMapping map (4, 6);
+	map.set (0, 1, 1);
+	map.set (1, 0, 1);
+	map.set (2, 2, 0.5);
+	map.set (3, 2, 0.25);
+
+	SparseAudioMapping sparse (map, 6);
+	BOOST_CHECK (!sparse.identity());
+
+	/* Output buffer with some rubbish in it and the wrong size */
+	AudioBuffers out (6, 16);
+	for (int i = 0; i < 6; ++i) {
+		for (int j = 0; j < 16; ++j) {
+			out.data(i)[j] = 42;
+		}
+	}
+
+	sparse.apply (&in, &out);
+	BOOST_REQUIRE_EQUAL (out.frames(), N);
+	for (int j = 0; j < N; ++j) {
+		BOOST_CHECK_EQUAL (out.data(0)[j], in.data(1)[j]);
+		BOOST_CHECK_EQUAL (out.data(1)[j], in.data(0)[j]);
+		BOOST_CHECK_CLOSE (out.data(2)[j], in.data(2)[j] * 0.5 + in.data(3)[j] * 0.25, 1e-4);
+		for (int i = 3; i < 6; ++i) {
+			BOOST_CHECK_EQUAL (out.data(i)[j], 0);
+		}
+	}
+}
@@ -25,15 +25,19 @@
 
 #include "lib/audio_merger.h"
 #include "lib/audio_buffers.h"
+#include "lib/util.h"
 #include <boost/test/unit_test.hpp>
 #include <boost/bind.hpp>
 #include <boost/function.hpp>
 #include <boost/signals2.hpp>
+#include <sys/time.h>
 #include <iostream>
+#include <vector>
 
 using std::pair;
 using std::list;
 using std::cout;
+using std::vector;
 using boost::shared_ptr;
 using boost::bind;
 
@@ -134,3 +138,86 @@ BOOST_AUTO_TEST_CASE (audio_merger_test3)
 		BOOST_CHECK_EQUAL (tb.front().first->data()[0][i], i);
 	}
 }
+
+/* Push a block which overlaps the start of an existing one */
+BOOST_AUTO_TEST_CASE (audio_merger_test4)
+{
+	AudioMerger merger (sampling_rate);
+
+	push (merger, 0, 64, 22);
+	push (merger, 0, 64, 0);
+
+	list<pair<shared_ptr<AudioBuffers>, DCPTime> > tb = merger.pull (DCPTime::from_frames (22 + 64, sampling_rate));
+	BOOST_REQUIRE (tb.size() == 1);
+	BOOST_CHECK_EQUAL (tb.front().first->frames(), 22 + 64);
+	BOOST_CHECK_EQUAL (tb.front().second.get(), 0);
+
+	for (int i = 0; i < 22 + 64; ++i) {
+		int correct = 0;
+		if (i < 64) {
+			correct += i;
+		}
+		if (i >= 22) {
+			correct += i - 22;
+		}
+		BOOST_CHECK_EQUAL (tb.front().first->data()[0][i], correct);
+	}
+}
+
+/* Push lots of overlapping streams, pulling as we go like Player does, and check
+ * that the result is the same as mixing by hand.
+ */
+BOOST_AUTO_TEST_CASE (audio_merger_stress_test)
+{
+	AudioMerger merger (sampling_rate);
+
+	int const streams = 200;
+	int const block = 1000;
+	int const blocks = 200;
+	int const length = block * blocks + block;
+
+	vector<float> reference (length, 0);
+	vector<float> merged (length, 0);
+
+	struct timeval start;
+	gettimeofday (&start, 0);
+
+	srand (1);
+	for (int i = 0; i < blocks; ++i) {
+		for (int j = 0; j < streams; ++j) {
+			/* Each stream is offset a little from the others so that they all overlap */
+			int const at = i * block + j;
+			shared_ptr<AudioBuffers> buffers (new AudioBuffers (1, block));
+			for (int k = 0; k < block; ++k) {
+				buffers->data()[0][k] = rand() % 16;
+				reference[at + k] += buffers->data()[0][k];
+			}
+			merger.push (buffers, DCPTime::from_frames (at, sampling_rate));
+		}
+
+		list<pair<shared_ptr<AudioBuffers>, DCPTime> > tb = merger.pull (DCPTime::from_frames (i * block, sampling_rate));
+		for (list<pair<shared_ptr<AudioBuffers>, DCPTime> >::const_iterator j = tb.begin(); j != tb.end(); ++j) {
+			Frame const from = j->second.frames_round (sampling_rate);
+			for (int k = 0; k < j->first->frames(); ++k) {
+				merged[from + k] = j->first->data()[0][k];
+			}
+		}
+	}
+
+	list<pair<shared_ptr<AudioBuffers>, DCPTime> > tb = merger.pull (DCPTime::from_frames (length, sampling_rate));
+	for (list<pair<shared_ptr<AudioBuffers>, DCPTime> >::const_iterator j = tb.begin(); j != tb.end(); ++j) {
+		Frame const from = j->second.frames_round (sampling_rate);
+		for (int k = 0; k < j->first->frames(); ++k) {
+			merged[from + k] = j->first->data()[0][k];
+		}
+	}
+
+	struct timeval stop;
+	gettimeofday (&stop, 0);
+
+	for (int i = 0; i < length; ++i) {
+		BOOST_REQUIRE_EQUAL (merged[i], reference[i]);
+	}
+
+	cout << "Merged " << (streams * blocks) << " blocks from " << streams << " streams in " << (seconds (stop) - seconds (start)) << "s\n";
+}
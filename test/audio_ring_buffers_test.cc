@@ -19,7 +19,9 @@
 */
 
 #include "lib/audio_ring_buffers.h"
+#include "lib/audio_mapping.h"
 #include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
 #include <iostream>
 
 using std::cout;
@@ -189,3 +191,127 @@ BOOST_AUTO_TEST_CASE (audio_ring_buffers_test3)
 	BOOST_CHECK_EQUAL (rb.get (buffer, 2, 240), true);
 	BOOST_CHECK_EQUAL (buffer[240 * 2], CANARY);
 }
+
+/** Check wrapping around the end of the buffer, filling it up, clear() and the underrun count */
+BOOST_AUTO_TEST_CASE (audio_ring_buffers_test4)
+{
+	AudioRingBuffers rb (2, 100);
+	BOOST_CHECK_EQUAL (rb.capacity(), 100);
+
+	shared_ptr<AudioBuffers> data (new AudioBuffers (2, 70));
+	int value = 0;
+	for (int i = 0; i < 70; ++i) {
+		for (int j = 0; j < 2; ++j) {
+			data->data(j)[i] = value++;
+		}
+	}
+
+	BOOST_CHECK_EQUAL (rb.put (data), 70);
+	float buffer[100 * 2];
+	BOOST_CHECK (!rb.get (buffer, 2, 60));
+
+	/* This will wrap around the end of the buffer */
+	BOOST_CHECK_EQUAL (rb.put (data), 70);
+	BOOST_CHECK_EQUAL (rb.size(), 80);
+
+	/* Only 20 more frames will fit */
+	BOOST_CHECK_EQUAL (rb.put (data.get(), 0), 20);
+	BOOST_CHECK_EQUAL (rb.size(), 100);
+	BOOST_CHECK_EQUAL (rb.put (data.get(), 20), 0);
+
+	BOOST_CHECK (!rb.get (buffer, 2, 100));
+	int check = 60 * 2;
+	for (int i = 0; i < 10 * 2; ++i) {
+		BOOST_REQUIRE_EQUAL (buffer[i], check++);
+	}
+	check = 0;
+	for (int i = 10 * 2; i < 80 * 2; ++i) {
+		BOOST_REQUIRE_EQUAL (buffer[i], check++);
+	}
+	check = 0;
+	for (int i = 80 * 2; i < 100 * 2; ++i) {
+		BOOST_REQUIRE_EQUAL (buffer[i], check++);
+	}
+
+	BOOST_CHECK_EQUAL (rb.underruns(), 0);
+	BOOST_CHECK (rb.get (buffer, 2, 1));
+	BOOST_CHECK_EQUAL (rb.underruns(), 1);
+
+	rb.put (data);
+	rb.clear ();
+	BOOST_CHECK_EQUAL (rb.size(), 0);
+	/* clear() makes space even though nothing has been read */
+	BOOST_CHECK_EQUAL (rb.put (data), 70);
+	BOOST_CHECK (!rb.get (buffer, 2, 70));
+	BOOST_CHECK_EQUAL (buffer[0], 0);
+	BOOST_CHECK_EQUAL (buffer[139], 139);
+}
+
+/** Check that a mapping is applied as audio is put in */
+BOOST_AUTO_TEST_CASE (audio_ring_buffers_test5)
+{
+	AudioMapping mapping (2, 3);
+	mapping.set (0, 1, 1);
+	mapping.set (1, 1, 0.5);
+	mapping.set (1, 2, 1);
+	SparseAudioMapping sparse (mapping, 3);
+
+	AudioRingBuffers rb (3, 100);
+
+	shared_ptr<AudioBuffers> data (new AudioBuffers (2, 10));
+	for (int i = 0; i < 10; ++i) {
+		data->data(0)[i] = i;
+		data->data(1)[i] = i * 2;
+	}
+
+	BOOST_CHECK_EQUAL (rb.put (data.get(), 4, &sparse), 6);
+
+	float buffer[6 * 3];
+	BOOST_CHECK (!rb.get (buffer, 3, 6));
+	for (int i = 0; i < 6; ++i) {
+		BOOST_CHECK_EQUAL (buffer[i * 3], 0);
+		BOOST_CHECK_EQUAL (buffer[i * 3 + 1], (i + 4) * 2);
+		BOOST_CHECK_EQUAL (buffer[i * 3 + 2], (i + 4) * 2);
+	}
+}
+
+static void
+produce (AudioRingBuffers* rb, int frames)
+{
+	shared_ptr<AudioBuffers> data (new AudioBuffers (1, 37));
+	int value = 0;
+	while (value < frames) {
+		/* Start at 1 so that we can tell audio from the silence of an underrun */
+		for (int i = 0; i < 37; ++i) {
+			data->data(0)[i] = value + i + 1;
+		}
+		Frame done = 0;
+		while (done < 37) {
+			done += rb->put (data.get(), done);
+		}
+		value += 37;
+	}
+}
+
+/** Check that audio arrives intact when put() and get() are called on different threads */
+BOOST_AUTO_TEST_CASE (audio_ring_buffers_test6)
+{
+	AudioRingBuffers rb (1, 64);
+	int const frames = 37 * 10000;
+
+	boost::thread producer (boost::bind (&produce, &rb, frames));
+
+	float buffer[29];
+	int check = 0;
+	while (check < frames) {
+		rb.get (buffer, 1, 29);
+		for (int i = 0; i < 29; ++i) {
+			if (buffer[i] != 0) {
+				BOOST_REQUIRE_EQUAL (buffer[i], check + 1);
+				++check;
+			}
+		}
+	}
+
+	producer.join ();
+}
@@ -27,6 +27,7 @@
 #include "lib/player.h"
 #include "test.h"
 #include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
 
 using boost::shared_ptr;
 
@@ -69,3 +70,43 @@ BOOST_AUTO_TEST_CASE (butler_test1)
 		BOOST_REQUIRE_EQUAL (buffer[i * 6 + 5], 0);
 	}
 }
+
+/** Check that audio from before a seek is not returned after it */
+BOOST_AUTO_TEST_CASE (butler_test2)
+{
+	shared_ptr<Film> film = new_test_film ("butler_test2");
+	film->set_dcp_content_type (DCPContentType::from_isdcf_name ("FTR"));
+	film->set_name ("butler_test2");
+	film->set_container (Ratio::from_id ("185"));
+
+	shared_ptr<Content> video = content_factory(film, "test/data/flat_red.png").front ();
+	film->examine_and_add_content (video);
+	shared_ptr<Content> audio = content_factory(film, "test/data/staircase.wav").front ();
+	film->examine_and_add_content (audio);
+	BOOST_REQUIRE (!wait_for_jobs ());
+
+	film->set_audio_channels (6);
+
+	AudioMapping map = AudioMapping (6, 6);
+	for (int i = 0; i < 6; ++i) {
+		map.set (i, i, 1);
+	}
+
+	Butler butler (shared_ptr<Player>(new Player(film, film->playlist())), film->log(), map, 6);
+
+	/* Let the butler fill up with audio from the start */
+	BOOST_CHECK (butler.get_video().second == DCPTime());
+
+	/* Seek to the second video frame, which is 2000 samples into the staircase */
+	butler.seek (DCPTime::from_frames(1, 24), true);
+	BOOST_CHECK (butler.get_video().second == DCPTime::from_frames(1, 24));
+
+	float buffer[256 * 6];
+	int tries = 0;
+	while (butler.get_audio (buffer, 1) && tries < 1000) {
+		boost::this_thread::sleep (boost::posix_time::milliseconds (1));
+		++tries;
+	}
+	BOOST_REQUIRE (tries < 1000);
+	BOOST_CHECK_CLOSE (buffer[2], 2000 / 32768.0f, 0.1);
+}
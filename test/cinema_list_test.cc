@@ -0,0 +1,217 @@
+/*
+    Copyright (C) 2018 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/** @file  test/cinema_list_test.cc
+ *  @brief Test CinemaList.
+ *  @ingroup selfcontained
+ */
+
+#include "lib/cinema_list.h"
+#include "lib/cinema.h"
+#include "lib/screen.h"
+#include "lib/config.h"
+#include <dcp/certificate_chain.h>
+#include <libcxml/cxml.h>
+#include <boost/test/unit_test.hpp>
+
+using std::list;
+using std::string;
+using std::vector;
+using boost::shared_ptr;
+
+static int
+files_in (boost::filesystem::path dir)
+{
+	int n = 0;
+	for (boost::filesystem::directory_iterator i = boost::filesystem::directory_iterator (dir); i != boost::filesystem::directory_iterator(); ++i) {
+		++n;
+	}
+	return n;
+}
+
+static list<string>
+names (list<shared_ptr<Cinema> > cinemas)
+{
+	list<string> n;
+	for (list<shared_ptr<Cinema> >::const_iterator i = cinemas.begin(); i != cinemas.end(); ++i) {
+		n.push_back ((*i)->name);
+	}
+	return n;
+}
+
+static shared_ptr<Cinema>
+make_cinema (string name, string email)
+{
+	list<string> emails;
+	emails.push_back (email);
+	return shared_ptr<Cinema> (new Cinema (name, emails, "", 0, 0));
+}
+
+/** Check that cinemas can be found by name, email and thumbprint, and that each change
+ *  only touches its own cinema's file.
+ */
+BOOST_AUTO_TEST_CASE (cinema_list_test1)
+{
+	boost::filesystem::path const dir = "build/test/cinema_list_test1";
+	boost::filesystem::remove_all (dir);
+
+	dcp::Certificate const cert = Config::instance()->decryption_chain()->leaf ();
+
+	CinemaList list1 (dir);
+	BOOST_CHECK (list1.cinemas().empty ());
+	BOOST_CHECK (!boost::filesystem::exists (dir));
+
+	shared_ptr<Cinema> odeon = make_cinema ("Odeon Leicester Square", "projection@odeon.example");
+	list1.add (odeon);
+	shared_ptr<Cinema> curzon = make_cinema ("Curzon Soho", "booth@curzon.example");
+	list1.add (curzon);
+	shared_ptr<Cinema> picturehouse = make_cinema ("Picturehouse Central", "pc@picturehouse.example");
+	list1.add (picturehouse);
+	BOOST_CHECK_EQUAL (files_in (dir), 3);
+
+	shared_ptr<Screen> screen (new Screen ("Screen 1", cert, vector<dcp::Certificate> ()));
+	curzon->add_screen (screen);
+	list1.update (curzon);
+	BOOST_CHECK_EQUAL (files_in (dir), 3);
+
+	list<string> all;
+	all.push_back ("Curzon Soho");
+	all.push_back ("Odeon Leicester Square");
+	all.push_back ("Picturehouse Central");
+	BOOST_CHECK (names (list1.cinemas ()) == all);
+	BOOST_CHECK (names (list1.search ("")) == all);
+
+	BOOST_CHECK (names (list1.search ("LEIC")) == list<string> (1, "Odeon Leicester Square"));
+	BOOST_CHECK (names (list1.search ("odeon leic")) == list<string> (1, "Odeon Leicester Square"));
+	BOOST_CHECK (names (list1.search ("booth@")) == list<string> (1, "Curzon Soho"));
+	BOOST_CHECK (names (list1.search (cert.thumbprint().substr (0, 8))) == list<string> (1, "Curzon Soho"));
+	BOOST_CHECK (list1.search("eicester").empty ());
+
+	BOOST_CHECK (list1.find_by_name_or_email ("Picturehouse Central") == picturehouse);
+	BOOST_CHECK (list1.find_by_name_or_email ("projection@odeon.example") == odeon);
+	BOOST_CHECK (!list1.find_by_name_or_email ("Picturehouse"));
+	BOOST_CHECK (list1.find_by_thumbprint (cert.thumbprint ()) == screen);
+
+	/* Changes must be re-indexed */
+	odeon->name = "Odeon Marble Arch";
+	list1.update (odeon);
+	BOOST_CHECK (list1.search("leic").empty ());
+	BOOST_CHECK (names (list1.search ("marble")) == list<string> (1, "Odeon Marble Arch"));
+
+	curzon->remove_screen (screen);
+	list1.update (curzon);
+	BOOST_CHECK (!list1.find_by_thumbprint (cert.thumbprint ()));
+
+	list1.remove (picturehouse);
+	BOOST_CHECK_EQUAL (files_in (dir), 2);
+	BOOST_CHECK (list1.search("central").empty ());
+
+	/* Another list on the same directory should see the same cinemas */
+	CinemaList list2 (dir);
+	list<string> remaining;
+	remaining.push_back ("Curzon Soho");
+	remaining.push_back ("Odeon Marble Arch");
+	BOOST_CHECK (names (list2.cinemas ()) == remaining);
+	BOOST_CHECK_EQUAL (list2.find_by_name_or_email("booth@curzon.example")->name, "Curzon Soho");
+}
+
+/** Check import and export of a cinemas XML file */
+BOOST_AUTO_TEST_CASE (cinema_list_test2)
+{
+	boost::filesystem::path const dir = "build/test/cinema_list_test2";
+	boost::filesystem::remove_all (dir);
+	boost::filesystem::create_directories (dir);
+
+	dcp::Certificate const cert = Config::instance()->decryption_chain()->leaf ();
+
+	CinemaList list1 (dir / "a");
+	list1.add (make_cinema ("Prince Charles", "pcc@example"));
+	shared_ptr<Cinema> barbican = make_cinema ("Barbican", "barbican@example");
+	barbican->add_screen (shared_ptr<Screen> (new Screen ("Cinema 1", cert, vector<dcp::Certificate> ())));
+	list1.add (barbican);
+	list1.write_xml (dir / "cinemas.xml");
+
+	cxml::Document doc ("Cinemas");
+	doc.read_file (dir / "cinemas.xml");
+
+	CinemaList list2 (dir / "b");
+	list2.add (make_cinema ("Replaced", "replaced@example"));
+	list2.read_xml (doc);
+	BOOST_CHECK_EQUAL (files_in (dir / "b"), 2);
+
+	list<string> all;
+	all.push_back ("Barbican");
+	all.push_back ("Prince Charles");
+	BOOST_CHECK (names (list2.cinemas ()) == all);
+
+	shared_ptr<Screen> screen = list2.find_by_thumbprint (cert.thumbprint ());
+	BOOST_REQUIRE (screen);
+	BOOST_CHECK_EQUAL (screen->name, "Cinema 1");
+	BOOST_CHECK_EQUAL (screen->cinema->name, "Barbican");
+}
+
+/** Check that Config imports the cinemas file only when there is no cinemas directory,
+ *  and writes it only when asked to export.
+ */
+BOOST_AUTO_TEST_CASE (cinema_list_test3)
+{
+	boost::filesystem::path const dir = "build/test/cinema_list_test3";
+	boost::filesystem::remove_all (dir);
+	boost::filesystem::create_directories (dir);
+
+	Config* config = Config::instance ();
+	boost::filesystem::path const old_file = config->cinemas_file ();
+
+	CinemaList first (dir / "first");
+	first.add (make_cinema ("Ritzy", "ritzy@example"));
+	first.write_xml (dir / "cinemas.xml");
+	std::time_t const written = boost::filesystem::last_write_time (dir / "cinemas.xml");
+
+	/* This should import the file, as there is no directory yet */
+	config->set_cinemas_file (dir / "cinemas.xml");
+	BOOST_REQUIRE_EQUAL (config->cinemas().size(), 1);
+
+	/* Changing the cinemas should not touch the file */
+	boost::filesystem::last_write_time (dir / "cinemas.xml", written - 10);
+	config->add_cinema (make_cinema ("Curzon", "curzon@example"));
+	BOOST_CHECK_EQUAL (boost::filesystem::last_write_time (dir / "cinemas.xml"), written - 10);
+	BOOST_CHECK_EQUAL (files_in (dir / "cinemas.d"), 2);
+
+	/* Someone else changes the cinemas file; as the directory exists it should not be imported again */
+	CinemaList other (dir / "other");
+	other.add (make_cinema ("Rio", "rio@example"));
+	other.write_xml (dir / "cinemas.xml");
+
+	config->set_cinemas_file (dir / "cinemas.xml");
+	list<string> all;
+	all.push_back ("Curzon");
+	all.push_back ("Ritzy");
+	BOOST_CHECK (names (config->cinemas ()) == all);
+
+	/* Exporting writes everything to the file */
+	config->write_cinemas ();
+	cxml::Document doc ("Cinemas");
+	doc.read_file (dir / "cinemas.xml");
+	CinemaList exported (dir / "exported");
+	exported.read_xml (doc);
+	BOOST_CHECK (names (exported.cinemas ()) == all);
+
+	config->set_cinemas_file (old_file);
+}
@@ -0,0 +1,251 @@
+/*
+    Copyright (C) 2018 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/** @file  test/email_outbox_test.cc
+ *  @brief Test EmailOutbox against a small local SMTP server.
+ *  @ingroup selfcontained
+ */
+
+#include "lib/email_outbox.h"
+#include "lib/exceptions.h"
+#include <boost/test/unit_test.hpp>
+#include <boost/asio.hpp>
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
+#include <boost/algorithm/string.hpp>
+
+using std::string;
+using std::list;
+using boost::shared_ptr;
+using boost::asio::ip::tcp;
+
+#define EMAIL_OUTBOX_TEST_PORT 6250
+
+/** @class FakeSMTPServer
+ *  @brief A very simple SMTP server which accepts emails and counts them, and can be
+ *  asked to reject some of them.
+ */
+class FakeSMTPServer
+{
+public:
+	/** @param port Port to listen on.
+	 *  @param rejections Number of emails to reject before accepting any; -1 to reject all.
+	 *  @param permanent true to reject emails permanently (with a 5xx reply), otherwise temporarily.
+	 */
+	FakeSMTPServer (int port, int rejections, bool permanent = false)
+		: _port (port)
+		, _acceptor (_io_service, tcp::endpoint (tcp::v4 (), port))
+		, _rejections (rejections)
+		, _permanent (permanent)
+		, _connections (0)
+		, _emails (0)
+		, _stop (false)
+	{
+		_threads.create_thread (boost::bind (&FakeSMTPServer::accept_thread, this));
+	}
+
+	~FakeSMTPServer ()
+	{
+		{
+			boost::mutex::scoped_lock lm (_mutex);
+			_stop = true;
+		}
+
+		/* Wake up accept() */
+		try {
+			tcp::socket socket (_io_service);
+			socket.connect (tcp::endpoint (boost::asio::ip::address::from_string ("127.0.0.1"), _port));
+		} catch (...) {
+
+		}
+
+		_threads.join_all ();
+	}
+
+	int connections () const {
+		boost::mutex::scoped_lock lm (_mutex);
+		return _connections;
+	}
+
+	int emails () const {
+		boost::mutex::scoped_lock lm (_mutex);
+		return _emails;
+	}
+
+private:
+	void accept_thread ()
+	{
+		while (true) {
+			shared_ptr<tcp::socket> socket (new tcp::socket (_io_service));
+			_acceptor.accept (*socket);
+			boost::mutex::scoped_lock lm (_mutex);
+			if (_stop) {
+				return;
+			}
+			++_connections;
+			_threads.create_thread (boost::bind (&FakeSMTPServer::connection_thread, this, socket));
+		}
+	}
+
+	void connection_thread (shared_ptr<tcp::socket> socket)
+	try
+	{
+		boost::asio::streambuf buffer;
+		std::istream stream (&buffer);
+		boost::asio::write (*socket, boost::asio::buffer (string ("220 localhost ESMTP\r\n")));
+
+		while (true) {
+			boost::asio::read_until (*socket, buffer, "\r\n");
+			string line;
+			getline (stream, line);
+			boost::algorithm::trim (line);
+			string const command = boost::algorithm::to_upper_copy (line.substr (0, 4));
+
+			string reply = "250 OK\r\n";
+			if (command == "EHLO" || command == "HELO") {
+				reply = "250 localhost\r\n";
+			} else if (command == "DATA") {
+				boost::asio::write (*socket, boost::asio::buffer (string ("354 Go ahead\r\n")));
+				size_t const n = boost::asio::read_until (*socket, buffer, "\r\n.\r\n");
+				buffer.consume (n);
+				boost::mutex::scoped_lock lm (_mutex);
+				if (_rejections != 0) {
+					if (_rejections > 0) {
+						--_rejections;
+					}
+					reply = _permanent ? "554 Rejected\r\n" : "451 Try again later\r\n";
+				} else {
+					++_emails;
+				}
+			} else if (command == "QUIT") {
+				boost::asio::write (*socket, boost::asio::buffer (string ("221 Bye\r\n")));
+				return;
+			}
+
+			boost::asio::write (*socket, boost::asio::buffer (reply));
+		}
+	}
+	catch (...)
+	{
+		/* The client went away */
+	}
+
+	int _port;
+	boost::asio::io_service _io_service;
+	tcp::acceptor _acceptor;
+	boost::thread_group _threads;
+	mutable boost::mutex _mutex;
+	int _rejections;
+	bool _permanent;
+	int _connections;
+	int _emails;
+	bool _stop;
+};
+
+static list<string>
+add_emails (EmailOutbox& outbox, int N)
+{
+	list<string> ids;
+	for (int i = 0; i < N; ++i) {
+		list<string> to;
+		to.push_back ("cinema@example.com");
+		ids.push_back (outbox.add ("us@example.com", to, "Subject: Test\r\n\r\nHello\r\n"));
+	}
+	return ids;
+}
+
+/** Check that a few connections are used to send lots of emails */
+BOOST_AUTO_TEST_CASE (email_outbox_test1)
+{
+	boost::filesystem::remove_all ("build/test/email_outbox_test1");
+	EmailOutbox outbox ("build/test/email_outbox_test1");
+	list<string> ids = add_emails (outbox, 20);
+	BOOST_CHECK_EQUAL (outbox.pending().size(), 20);
+
+	FakeSMTPServer server (EMAIL_OUTBOX_TEST_PORT, 0);
+	BOOST_CHECK_EQUAL (outbox.send (ids, "127.0.0.1", EMAIL_OUTBOX_TEST_PORT, "", "", 3, shared_ptr<Log> ()), 20);
+	BOOST_CHECK_EQUAL (server.emails(), 20);
+	BOOST_CHECK (server.connections() <= 3);
+	BOOST_CHECK (outbox.pending().empty ());
+}
+
+/** Check that emails which are rejected are tried again */
+BOOST_AUTO_TEST_CASE (email_outbox_test2)
+{
+	boost::filesystem::remove_all ("build/test/email_outbox_test2");
+	EmailOutbox outbox ("build/test/email_outbox_test2", 3, 10);
+	list<string> ids = add_emails (outbox, 5);
+
+	FakeSMTPServer server (EMAIL_OUTBOX_TEST_PORT + 1, 2);
+	BOOST_CHECK_EQUAL (outbox.send (ids, "127.0.0.1", EMAIL_OUTBOX_TEST_PORT + 1, "", "", 1, shared_ptr<Log> ()), 5);
+	BOOST_CHECK_EQUAL (server.emails(), 5);
+	BOOST_CHECK (outbox.pending().empty ());
+}
+
+/** Check that emails which cannot be sent are kept, and can be sent by a later outbox in the same directory */
+BOOST_AUTO_TEST_CASE (email_outbox_test3)
+{
+	boost::filesystem::remove_all ("build/test/email_outbox_test3");
+
+	{
+		EmailOutbox outbox ("build/test/email_outbox_test3", 2, 10);
+		list<string> ids = add_emails (outbox, 4);
+
+		FakeSMTPServer server (EMAIL_OUTBOX_TEST_PORT + 2, -1);
+		BOOST_CHECK_THROW (outbox.send (ids, "127.0.0.1", EMAIL_OUTBOX_TEST_PORT + 2, "", "", 2, shared_ptr<Log> ()), KDMError);
+		BOOST_CHECK_EQUAL (server.emails(), 0);
+		BOOST_CHECK_EQUAL (outbox.pending().size(), 4);
+	}
+
+	EmailOutbox outbox ("build/test/email_outbox_test3");
+	FakeSMTPServer server (EMAIL_OUTBOX_TEST_PORT + 3, 0);
+	BOOST_CHECK_EQUAL (outbox.send (outbox.pending(), "127.0.0.1", EMAIL_OUTBOX_TEST_PORT + 3, "", "", 2, shared_ptr<Log> ()), 4);
+	BOOST_CHECK_EQUAL (server.emails(), 4);
+	BOOST_CHECK (outbox.pending().empty ());
+}
+
+/** Check that send() only sends the emails it is asked to, leaving others in the outbox */
+BOOST_AUTO_TEST_CASE (email_outbox_test4)
+{
+	boost::filesystem::remove_all ("build/test/email_outbox_test4");
+	EmailOutbox outbox ("build/test/email_outbox_test4");
+	list<string> earlier = add_emails (outbox, 3);
+	list<string> ids = add_emails (outbox, 2);
+
+	FakeSMTPServer server (EMAIL_OUTBOX_TEST_PORT + 4, 0);
+	BOOST_CHECK_EQUAL (outbox.send (ids, "127.0.0.1", EMAIL_OUTBOX_TEST_PORT + 4, "", "", 2, shared_ptr<Log> ()), 2);
+	BOOST_CHECK_EQUAL (server.emails(), 2);
+	earlier.sort ();
+	BOOST_CHECK (outbox.pending() == earlier);
+}
+
+/** Check that emails which the server rejects permanently are not retried, and are removed from the outbox */
+BOOST_AUTO_TEST_CASE (email_outbox_test5)
+{
+	boost::filesystem::remove_all ("build/test/email_outbox_test5");
+	EmailOutbox outbox ("build/test/email_outbox_test5", 3, 10);
+	list<string> ids = add_emails (outbox, 4);
+
+	FakeSMTPServer server (EMAIL_OUTBOX_TEST_PORT + 5, 1, true);
+	BOOST_CHECK_THROW (outbox.send (ids, "127.0.0.1", EMAIL_OUTBOX_TEST_PORT + 5, "", "", 1, shared_ptr<Log> ()), KDMError);
+	/* The rejected email was not tried again, so all the others got through */
+	BOOST_CHECK_EQUAL (server.emails(), 3);
+	BOOST_CHECK (outbox.pending().empty ());
+}
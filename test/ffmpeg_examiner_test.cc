@@ -20,7 +20,7 @@
 
 /** @file  test/ffmpeg_examiner_test.cc
  *  @brief Check that the FFmpegExaminer can extract the first video and audio time
- *  correctly from data/count300bd24.m2ts.
+ *  correctly from data/count300bd24.m2ts, and that it finds keyframes from indexed containers.
  *  @ingroup specific
  */
 
@@ -28,8 +28,14 @@
 #include "lib/ffmpeg_examiner.h"
 #include "lib/ffmpeg_content.h"
 #include "lib/ffmpeg_audio_stream.h"
+#include "lib/video_content.h"
+#include "lib/audio_content.h"
+#include "lib/config.h"
+#include "lib/film.h"
+#include "lib/metrics.h"
 #include "test.h"
 
+using std::vector;
 using boost::shared_ptr;
 
 BOOST_AUTO_TEST_CASE (ffmpeg_examiner_test)
@@ -41,4 +47,63 @@ BOOST_AUTO_TEST_CASE (ffmpeg_examiner_test)
 	BOOST_CHECK_EQUAL (examiner->first_video().get().get(), ContentTime::from_seconds(600).get());
 	BOOST_CHECK_EQUAL (examiner->audio_streams().size(), 1U);
 	BOOST_CHECK_EQUAL (examiner->audio_streams()[0]->first_audio.get().get(), ContentTime::from_seconds(600).get());
+
+	/* M2TS has no index, and we don't read the whole file to make one */
+	BOOST_CHECK (examiner->keyframes().empty ());
+}
+
+/** Check that keyframes are taken from an MP4's index and given as presentation times */
+BOOST_AUTO_TEST_CASE (ffmpeg_examiner_keyframes_test)
+{
+	shared_ptr<Film> film = new_test_film ("ffmpeg_examiner_keyframes_test");
+	shared_ptr<FFmpegContent> content (new FFmpegContent (film, "test/data/test.mp4"));
+	shared_ptr<FFmpegExaminer> examiner (new FFmpegExaminer (content));
+
+	/* H.264 has frames which are not keyframes, so we need the list */
+	BOOST_CHECK (!examiner->all_keyframes ());
+	vector<ContentTime> k = examiner->keyframes ();
+	BOOST_REQUIRE (!k.empty ());
+	/* The first frame is a keyframe, so the first keyframe's time should be the first video's */
+	BOOST_REQUIRE (examiner->first_video ());
+	BOOST_CHECK_EQUAL (k.front().get(), examiner->first_video().get().get());
+	for (size_t i = 1; i < k.size(); ++i) {
+		BOOST_CHECK (k[i - 1] < k[i]);
+	}
+}
+
+/** Check that a second examination of the same file is taken from the cache
+ *  and gives the same answers as the first.
+ */
+BOOST_AUTO_TEST_CASE (ffmpeg_examiner_cache_test)
+{
+	shared_ptr<Film> film = new_test_film ("ffmpeg_examiner_cache_test");
+
+	shared_ptr<FFmpegContent> a (new FFmpegContent (film, "test/data/test.mp4"));
+	film->examine_and_add_content (a);
+	wait_for_jobs ();
+	BOOST_CHECK (boost::filesystem::exists (Config::instance()->examination_cache_path (a->digest ())));
+
+	double const hits = Metrics::instance()->get ("dcpomatic_examination_cache_hits_total");
+
+	shared_ptr<FFmpegContent> b (new FFmpegContent (film, "test/data/test.mp4"));
+	film->examine_and_add_content (b);
+	wait_for_jobs ();
+
+	/* The second examination should not have looked at the file */
+	BOOST_CHECK_EQUAL (Metrics::instance()->get ("dcpomatic_examination_cache_hits_total"), hits + 1);
+
+	BOOST_REQUIRE (b->video);
+	BOOST_REQUIRE (b->audio);
+	BOOST_CHECK_EQUAL (a->digest(), b->digest());
+	BOOST_CHECK_EQUAL (a->video->length(), b->video->length());
+	BOOST_CHECK (a->video->size() == b->video->size());
+	BOOST_CHECK_EQUAL (a->audio->streams().size(), b->audio->streams().size());
+	BOOST_CHECK (a->first_video() == b->first_video());
+	BOOST_CHECK (a->keyframes() == b->keyframes());
+	BOOST_CHECK_EQUAL (a->all_keyframes(), b->all_keyframes());
+
+	/* Content should have been added in the order that it was given */
+	BOOST_REQUIRE_EQUAL (film->content().size(), 2U);
+	BOOST_CHECK (film->content().front() == a);
+	BOOST_CHECK (film->content().back() == b);
 }
@@ -110,3 +110,38 @@ BOOST_AUTO_TEST_CASE (file_group_test)
 	BOOST_CHECK_EQUAL (fg.read (test, 256), 256);
 	BOOST_CHECK_EQUAL (memcmp (data + total_length - 1077, test, 256), 0);
 }
+
+/** Check that empty files in the middle of a group are skipped over */
+BOOST_AUTO_TEST_CASE (file_group_test2)
+{
+	vector<boost::filesystem::path> name;
+	boost::filesystem::create_directories ("build/test/file_group_test2");
+	name.push_back ("build/test/file_group_test2/A");
+	name.push_back ("build/test/file_group_test2/B");
+	name.push_back ("build/test/file_group_test2/C");
+
+	uint8_t data[] = { 1, 2, 3, 4, 5, 6 };
+
+	FILE* f = fopen (name[0].string().c_str(), "wb");
+	fwrite (data, 1, 3, f);
+	fclose (f);
+	f = fopen (name[1].string().c_str(), "wb");
+	fclose (f);
+	f = fopen (name[2].string().c_str(), "wb");
+	fwrite (data + 3, 1, 3, f);
+	fclose (f);
+
+	FileGroup fg (name);
+	BOOST_CHECK_EQUAL (fg.length(), 6);
+
+	uint8_t test[6];
+	BOOST_CHECK_EQUAL (fg.seek (3, SEEK_SET), 3);
+	BOOST_CHECK_EQUAL (fg.read (test, 3), 3);
+	BOOST_CHECK_EQUAL (memcmp (data + 3, test, 3), 0);
+
+	BOOST_CHECK_EQUAL (fg.seek (-4, SEEK_CUR), 2);
+	BOOST_CHECK_EQUAL (fg.read (test, 4), 4);
+	BOOST_CHECK_EQUAL (memcmp (data + 2, test, 4), 0);
+
+	BOOST_CHECK_EQUAL (fg.seek (6, SEEK_SET), -1);
+}
@@ -0,0 +1,121 @@
+/*
+    Copyright (C) 2018 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/** @file  test/image_decoder_test.cc
+ *  @brief Check that ImageDecoder produces the frames of an image sequence in order,
+ *  including after seeks, and report how quickly it does so.
+ *  @ingroup specific
+ */
+
+#include "lib/image_content.h"
+#include "lib/image_decoder.h"
+#include "lib/image_proxy.h"
+#include "lib/image.h"
+#include "lib/content_video.h"
+#include "lib/video_decoder.h"
+#include "lib/video_content.h"
+#include "lib/film.h"
+#include "lib/util.h"
+#include "test.h"
+#include <boost/filesystem.hpp>
+#include <boost/test/unit_test.hpp>
+#include <sys/time.h>
+#include <iostream>
+
+using std::cout;
+using boost::shared_ptr;
+using boost::bind;
+
+static Frame next;
+
+/** Check that we have been given the next frame, and that its image is the one which
+ *  make_frame() made for that frame.
+ */
+static void
+check (ContentVideo video)
+{
+	BOOST_REQUIRE (video.image);
+	BOOST_REQUIRE_EQUAL (video.frame, next);
+	shared_ptr<Image> image = video.image->image().image;
+	BOOST_REQUIRE_EQUAL (image->pixel_format(), AV_PIX_FMT_RGB24);
+	BOOST_REQUIRE_EQUAL (image->data()[0][0], next % 256);
+	BOOST_REQUIRE_EQUAL (image->data()[0][1], next / 256);
+	++next;
+}
+
+/** Write a small image whose first pixel encodes the frame index in its red and green components */
+static void
+make_frame (boost::filesystem::path file, int index)
+{
+	shared_ptr<Image> image (new Image (AV_PIX_FMT_RGB24, dcp::Size (16, 16), false));
+	uint8_t* p = image->data()[0];
+	for (int i = 0; i < 16 * 16; ++i) {
+		*p++ = index % 256;
+		*p++ = index / 256;
+		*p++ = 0;
+	}
+	write_image (image, file, "RGB");
+}
+
+BOOST_AUTO_TEST_CASE (image_decoder_sequence_test)
+{
+	int const N = 480;
+
+	boost::filesystem::path dir = "build/test/image_decoder_sequence_test_frames";
+	boost::filesystem::remove_all (dir);
+	boost::filesystem::create_directories (dir);
+	for (int i = 0; i < N; ++i) {
+		char buffer[64];
+		snprintf (buffer, sizeof (buffer), "%06d.png", i);
+		make_frame (dir / buffer, i);
+	}
+
+	shared_ptr<Film> film = new_test_film ("image_decoder_sequence_test");
+	shared_ptr<ImageContent> content (new ImageContent (film, dir));
+	film->examine_and_add_content (content);
+	wait_for_jobs ();
+	BOOST_REQUIRE_EQUAL (content->video->length(), N);
+
+	ImageDecoder decoder (content, film->log());
+	decoder.video->Data.connect (bind (&check, _1));
+
+	struct timeval start;
+	gettimeofday (&start, 0);
+	next = 0;
+	while (!decoder.pass()) {}
+	struct timeval stop;
+	gettimeofday (&stop, 0);
+	BOOST_CHECK_EQUAL (next, N);
+
+	cout << "Read " << N << " frames at " << (N / (seconds (stop) - seconds (start))) << " frames per second.\n";
+
+	/* Seek into the middle, read a little, then seek back */
+	decoder.seek (ContentTime::from_frames (100, content->active_video_frame_rate ()), true);
+	next = 100;
+	for (int i = 0; i < 10; ++i) {
+		BOOST_REQUIRE (!decoder.pass ());
+	}
+	BOOST_CHECK_EQUAL (next, 110);
+
+	decoder.seek (ContentTime::from_frames (20, content->active_video_frame_rate ()), true);
+	next = 20;
+	while (!decoder.pass()) {}
+	BOOST_CHECK_EQUAL (next, N);
+}
@@ -28,6 +28,9 @@
 #include "lib/magick_image_proxy.h"
 #include "test.h"
 #include <Magick++.h>
+extern "C" {
+#include <libswscale/swscale.h>
+}
 #include <boost/test/unit_test.hpp>
 #include <iostream>
 
@@ -139,7 +142,7 @@ void
 alpha_blend_test_one (AVPixelFormat format, string suffix)
 {
 	shared_ptr<MagickImageProxy> proxy (new MagickImageProxy (private_data / "prophet_frame.tiff"));
-	shared_ptr<Image> raw = proxy->image();
+	shared_ptr<Image> raw = proxy->image().image;
 	shared_ptr<Image> background = raw->convert_pixel_format (dcp::YUV_TO_RGB_REC709, format, true, false);
 
 	shared_ptr<Image> overlay (new Image (AV_PIX_FMT_BGRA, dcp::Size(431, 891), true));
@@ -257,13 +260,110 @@ BOOST_AUTO_TEST_CASE (merge_test2)
 	}
 }
 
+/** Test trim_transparent() */
+BOOST_AUTO_TEST_CASE (trim_transparent_test)
+{
+	shared_ptr<Image> A (new Image (AV_PIX_FMT_BGRA, dcp::Size (64, 32), true));
+	A->make_transparent ();
+
+	BOOST_CHECK (!trim_transparent (PositionImage (A, Position<int> (0, 0))));
+
+	for (int y = 10; y < 14; ++y) {
+		uint8_t* p = A->data()[0] + y * A->stride()[0];
+		for (int x = 20; x < 30; ++x) {
+			/* green */
+			p[x * 4 + 1] = 255;
+			/* opaque */
+			p[x * 4 + 3] = 255;
+		}
+	}
+
+	boost::optional<PositionImage> trimmed = trim_transparent (PositionImage (A, Position<int> (5, 7)));
+	BOOST_REQUIRE (trimmed);
+	BOOST_CHECK (trimmed->position == Position<int> (25, 17));
+	BOOST_CHECK_EQUAL (trimmed->image->size().width, 10);
+	BOOST_CHECK_EQUAL (trimmed->image->size().height, 4);
+	for (int y = 0; y < 4; ++y) {
+		uint8_t* p = trimmed->image->data()[0] + y * trimmed->image->stride()[0];
+		for (int x = 0; x < 10; ++x) {
+			BOOST_CHECK_EQUAL (p[x * 4 + 1], 255);
+			BOOST_CHECK_EQUAL (p[x * 4 + 3], 255);
+		}
+	}
+}
+
 /** Test Image::crop_scale_window with YUV420P and some windowing */
 BOOST_AUTO_TEST_CASE (crop_scale_window_test)
 {
 	shared_ptr<MagickImageProxy> proxy(new MagickImageProxy("test/data/flat_red.png"));
-	shared_ptr<Image> raw = proxy->image();
+	shared_ptr<Image> raw = proxy->image().image;
 	shared_ptr<Image> out = raw->crop_scale_window(Crop(), dcp::Size(1998, 836), dcp::Size(1998, 1080), dcp::YUV_TO_RGB_REC709, AV_PIX_FMT_YUV420P, true, false);
 	shared_ptr<Image> save = out->scale(dcp::Size(1998, 1080), dcp::YUV_TO_RGB_REC709, AV_PIX_FMT_RGB24, false, false);
 	write_image(save, "build/test/crop_scale_window_test.png", "RGB");
 	check_image("test/data/crop_scale_window_test.png", "build/test/crop_scale_window_test.png");
 }
+
+/** Test that drawing into an existing image (re-using a scale context) gives the same
+ *  result as the crop_scale_window which makes a new image.
+ */
+BOOST_AUTO_TEST_CASE (crop_scale_window_test2)
+{
+	shared_ptr<MagickImageProxy> proxy(new MagickImageProxy("test/data/flat_red.png"));
+	shared_ptr<Image> raw = proxy->image().image;
+	shared_ptr<Image> ref = raw->crop_scale_window(Crop(4, 8, 2, 6), dcp::Size(640, 268), dcp::Size(640, 360), dcp::YUV_TO_RGB_REC709, AV_PIX_FMT_RGB24, false, true);
+
+	shared_ptr<Image> out (new Image (AV_PIX_FMT_RGB24, dcp::Size(640, 360), false, 640));
+	struct SwsContext* context = 0;
+	for (int i = 0; i < 2; ++i) {
+		raw->crop_scale_window(Crop(4, 8, 2, 6), dcp::Size(640, 268), dcp::YUV_TO_RGB_REC709, true, out, &context);
+		BOOST_REQUIRE (context);
+		for (int y = 0; y < 360; ++y) {
+			BOOST_REQUIRE_EQUAL (memcmp (ref->data()[0] + y * ref->stride()[0], out->data()[0] + y * out->stride()[0], 640 * 3), 0);
+		}
+	}
+
+	sws_freeContext (context);
+}
+
+/** Test that MagickImageProxy decodes a JPEG at a reduced size when it can */
+BOOST_AUTO_TEST_CASE (magick_image_proxy_jpeg_reduction_test)
+{
+	Magick::Image image (Magick::Geometry (2000, 1000), Magick::Color ("blue"));
+	image.magick ("JPEG");
+	image.write ("build/test/magick_image_proxy_jpeg_reduction_test.jpg");
+
+	shared_ptr<MagickImageProxy> proxy (new MagickImageProxy ("build/test/magick_image_proxy_jpeg_reduction_test.jpg"));
+
+	ImageProxy::Result full = proxy->image ();
+	BOOST_CHECK_EQUAL (full.log2_scaling, 0);
+	BOOST_CHECK_EQUAL (full.image->size().width, 2000);
+	BOOST_CHECK_EQUAL (full.image->size().height, 1000);
+
+	ImageProxy::Result reduced = proxy->image (boost::optional<dcp::NoteHandler> (), dcp::Size (400, 200), true);
+	BOOST_CHECK_EQUAL (reduced.log2_scaling, 2);
+	BOOST_CHECK_EQUAL (reduced.image->size().width, 500);
+	BOOST_CHECK_EQUAL (reduced.image->size().height, 250);
+
+	/* Images which are not for previews should never be reduced */
+	ImageProxy::Result encode = proxy->image (boost::optional<dcp::NoteHandler> (), dcp::Size (400, 200), false);
+	BOOST_CHECK_EQUAL (encode.log2_scaling, 0);
+	BOOST_CHECK_EQUAL (encode.image->size().width, 2000);
+	BOOST_CHECK_EQUAL (encode.image->size().height, 1000);
+}
+
+/** Test that Image::digest() depends on the pixels but not on any alignment padding */
+BOOST_AUTO_TEST_CASE (image_digest_test)
+{
+	shared_ptr<Image> a (new Image (AV_PIX_FMT_RGB24, dcp::Size (431, 891), true));
+	a->make_black ();
+	shared_ptr<Image> b (new Image (AV_PIX_FMT_RGB24, dcp::Size (431, 891), false));
+	b->make_black ();
+	BOOST_CHECK_EQUAL (a->digest(), b->digest());
+
+	b->data()[0][b->stride()[0] * 12 + 7] = 42;
+	BOOST_CHECK (a->digest() != b->digest());
+
+	shared_ptr<Image> c (new Image (AV_PIX_FMT_RGB24, dcp::Size (891, 431), false));
+	c->make_black ();
+	BOOST_CHECK (a->digest() != c->digest());
+}
@@ -0,0 +1,120 @@
+/*
+    Copyright (C) 2018 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/** @file  test/j2k_frame_cache_test.cc
+ *  @brief Test J2KFrameCache and its use when making DCPs.
+ *  @ingroup completedcp
+ */
+
+#include "lib/j2k_frame_cache.h"
+#include "lib/film.h"
+#include "lib/ffmpeg_content.h"
+#include "lib/video_content.h"
+#include "lib/config.h"
+#include "lib/metrics.h"
+#include "test.h"
+#include <dcp/data.h>
+#include <boost/test/unit_test.hpp>
+
+using boost::optional;
+using boost::shared_ptr;
+
+static dcp::Data
+make_data (int size, uint8_t value)
+{
+	dcp::Data data (size);
+	memset (data.data().get(), value, size);
+	return data;
+}
+
+BOOST_AUTO_TEST_CASE (j2k_frame_cache_test)
+{
+	boost::filesystem::path dir = "build/test/j2k_frame_cache_test";
+	boost::filesystem::remove_all (dir);
+
+	{
+		J2KFrameCache cache (dir, 3000);
+
+		BOOST_CHECK (!cache.get ("aaaa"));
+
+		cache.put ("aaaa", make_data (1000, 1));
+		cache.put ("bbbb", make_data (1000, 2));
+		cache.put ("cccc", make_data (1000, 3));
+		BOOST_CHECK_EQUAL (cache.size(), 3000);
+
+		optional<dcp::Data> a = cache.get ("aaaa");
+		BOOST_REQUIRE (a);
+		BOOST_CHECK_EQUAL (a->size(), 1000);
+		BOOST_CHECK_EQUAL (a->data().get()[0], 1);
+		BOOST_CHECK_EQUAL (a->data().get()[999], 1);
+
+		/* This should evict bbbb, as aaaa has been used more recently */
+		cache.put ("dddd", make_data (1000, 4));
+		BOOST_CHECK_EQUAL (cache.size(), 3000);
+		BOOST_CHECK (cache.get ("aaaa"));
+		BOOST_CHECK (!cache.get ("bbbb"));
+		BOOST_CHECK (cache.get ("cccc"));
+		BOOST_CHECK (cache.get ("dddd"));
+	}
+
+	/* A new cache in the same place should find what was left behind */
+	J2KFrameCache cache (dir, 3000);
+	BOOST_CHECK_EQUAL (cache.size(), 3000);
+	optional<dcp::Data> d = cache.get ("dddd");
+	BOOST_REQUIRE (d);
+	BOOST_CHECK_EQUAL (d->data().get()[0], 4);
+	BOOST_CHECK (!cache.get ("bbbb"));
+}
+
+/** Check that moving and trimming content does not stop its frames being found in the cache */
+BOOST_AUTO_TEST_CASE (j2k_frame_cache_move_test)
+{
+	boost::filesystem::path dir = "build/test/j2k_frame_cache_move_test_cache";
+	boost::filesystem::remove_all (dir);
+
+	Config* config = Config::instance ();
+	optional<boost::filesystem::path> const old_directory = config->j2k_frame_cache_directory ();
+	config->set_j2k_frame_cache_directory (dir);
+
+	shared_ptr<Film> film = new_test_film2 ("j2k_frame_cache_move_test");
+	shared_ptr<FFmpegContent> content (new FFmpegContent (film, "test/data/test.mp4"));
+	film->examine_and_add_content (content);
+	BOOST_REQUIRE (!wait_for_jobs ());
+
+	film->make_dcp ();
+	BOOST_REQUIRE (!wait_for_jobs ());
+
+	content->set_position (DCPTime::from_seconds (1));
+	content->set_trim_start (ContentTime::from_frames (2, content->active_video_frame_rate ()));
+
+	double const hits = Metrics::instance()->get ("dcpomatic_encoder_reused_frames_total", "from=\"cache\"");
+	film->make_dcp ();
+	BOOST_REQUIRE (!wait_for_jobs ());
+
+	/* Every frame of the content should have come from the cache */
+	Frame const frames = content->length_after_trim().frames_round (film->video_frame_rate ());
+	BOOST_CHECK (Metrics::instance()->get ("dcpomatic_encoder_reused_frames_total", "from=\"cache\"") >= hits + frames - 1);
+
+	if (old_directory) {
+		config->set_j2k_frame_cache_directory (*old_directory);
+	} else {
+		config->unset_j2k_frame_cache_directory ();
+	}
+}
@@ -27,6 +27,7 @@
 #include "lib/job.h"
 #include "lib/job_manager.h"
 #include "lib/cross.h"
+#include "test.h"
 
 using std::string;
 using boost::shared_ptr;
@@ -34,8 +35,9 @@ using boost::shared_ptr;
 class TestJob : public Job
 {
 public:
-	TestJob (shared_ptr<Film> film)
+	TestJob (shared_ptr<Film> film, Resource resource = RESOURCE_ENCODE)
 		: Job (film)
+		, _resource (resource)
 	{
 
 	}
@@ -64,6 +66,13 @@ public:
 	string json_name () const {
 		return "";
 	}
+
+	Resource resource () const {
+		return _resource;
+	}
+
+private:
+	Resource _resource;
 };
 
 BOOST_AUTO_TEST_CASE (job_manager_test)
@@ -80,3 +89,58 @@ BOOST_AUTO_TEST_CASE (job_manager_test)
 	dcpomatic_sleep (2);
 	BOOST_CHECK_EQUAL (a->finished_ok(), true);
 }
+
+/** Check that jobs using different resources run at the same time, and that
+ *  jobs using the same resource wait for each other.
+ */
+BOOST_AUTO_TEST_CASE (job_manager_resource_test)
+{
+	shared_ptr<Film> film;
+
+	shared_ptr<TestJob> a (new TestJob (film, Job::RESOURCE_ENCODE));
+	shared_ptr<TestJob> b (new TestJob (film, Job::RESOURCE_ENCODE));
+	shared_ptr<TestJob> c (new TestJob (film, Job::RESOURCE_IO));
+
+	JobManager::instance()->add (a);
+	JobManager::instance()->add (b);
+	JobManager::instance()->add (c);
+	dcpomatic_sleep (1);
+	BOOST_CHECK_EQUAL (a->running (), true);
+	BOOST_CHECK_EQUAL (b->is_new (), true);
+	BOOST_CHECK_EQUAL (c->running (), true);
+
+	a->set_finished_ok ();
+	dcpomatic_sleep (1);
+	BOOST_CHECK_EQUAL (b->running (), true);
+
+	b->set_finished_ok ();
+	c->set_finished_ok ();
+	dcpomatic_sleep (1);
+	BOOST_CHECK_EQUAL (b->finished_ok (), true);
+	BOOST_CHECK_EQUAL (c->finished_ok (), true);
+}
+
+/** Check that a job which the user has paused does not stop later jobs for the same film from starting */
+BOOST_AUTO_TEST_CASE (job_manager_pause_test)
+{
+	shared_ptr<Film> film = new_test_film ("job_manager_pause_test");
+
+	shared_ptr<TestJob> a (new TestJob (film, Job::RESOURCE_ENCODE));
+	shared_ptr<TestJob> b (new TestJob (film, Job::RESOURCE_ENCODE));
+
+	JobManager::instance()->add (a);
+	JobManager::instance()->add (b);
+	dcpomatic_sleep (1);
+	BOOST_CHECK_EQUAL (a->running (), true);
+	BOOST_CHECK_EQUAL (b->is_new (), true);
+
+	a->pause_by_user ();
+	dcpomatic_sleep (1);
+	BOOST_CHECK_EQUAL (b->running (), true);
+
+	a->set_finished_ok ();
+	b->set_finished_ok ();
+	dcpomatic_sleep (1);
+	BOOST_CHECK_EQUAL (a->finished_ok (), true);
+	BOOST_CHECK_EQUAL (b->finished_ok (), true);
+}
@@ -0,0 +1,111 @@
+/*
+    Copyright (C) 2018 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/** @file  test/json_server_test.cc
+ *  @brief Test JSONServer.
+ *  @ingroup selfcontained
+ */
+
+#include "lib/json_server.h"
+#include <boost/test/unit_test.hpp>
+#include <boost/asio.hpp>
+
+using std::string;
+using boost::asio::ip::tcp;
+
+#define JSON_SERVER_TEST_PORT 6198
+
+/** Read one HTTP response with a Content-Length from a socket */
+static string
+read_response (tcp::socket& socket, boost::asio::streambuf& buffer)
+{
+	boost::asio::read_until (socket, buffer, "\r\n\r\n");
+	std::istream stream (&buffer);
+	string header;
+	string line;
+	size_t length = 0;
+	while (getline (stream, line) && line != "\r") {
+		header += line + "\n";
+		if (line.find ("Content-Length: ") == 0) {
+			length = atoi (line.substr (16).c_str ());
+		}
+	}
+
+	if (buffer.size() < length) {
+		boost::asio::read (socket, buffer, boost::asio::transfer_exactly (length - buffer.size()));
+	}
+
+	string body (length, '\0');
+	stream.read (&body[0], length);
+	return header + body;
+}
+
+/** Check that a stalled client does not hold up others, and that several requests
+ *  can be made on one connection.
+ */
+BOOST_AUTO_TEST_CASE (json_server_keep_alive_test)
+{
+	JSONServer server (JSON_SERVER_TEST_PORT);
+
+	boost::asio::io_service io_service;
+	tcp::endpoint endpoint (boost::asio::ip::address::from_string ("127.0.0.1"), JSON_SERVER_TEST_PORT);
+
+	/* This one never says anything */
+	tcp::socket stalled (io_service);
+	stalled.connect (endpoint);
+
+	tcp::socket client (io_service);
+	client.connect (endpoint);
+	boost::asio::streambuf buffer;
+
+	string const request = "GET /?action=status HTTP/1.1\r\n\r\n";
+	for (int i = 0; i < 3; ++i) {
+		boost::asio::write (client, boost::asio::buffer (request));
+		string const response = read_response (client, buffer);
+		BOOST_CHECK (response.find ("HTTP/1.1 200 OK") == 0);
+		BOOST_CHECK (response.find ("Connection: keep-alive") != string::npos);
+		BOOST_CHECK (response.find ("{ \"jobs\": [") != string::npos);
+	}
+
+	string const metrics = "GET /metrics HTTP/1.1\r\nConnection: close\r\n\r\n";
+	boost::asio::write (client, boost::asio::buffer (metrics));
+	string const response = read_response (client, buffer);
+	BOOST_CHECK (response.find ("Content-Type: text/plain; version=0.0.4") != string::npos);
+	BOOST_CHECK (response.find ("Connection: close") != string::npos);
+}
+
+/** Check that an event stream client is sent the current status straight away */
+BOOST_AUTO_TEST_CASE (json_server_events_test)
+{
+	JSONServer server (JSON_SERVER_TEST_PORT + 1);
+
+	boost::asio::io_service io_service;
+	tcp::socket client (io_service);
+	client.connect (tcp::endpoint (boost::asio::ip::address::from_string ("127.0.0.1"), JSON_SERVER_TEST_PORT + 1));
+
+	string const request = "GET /?action=events HTTP/1.1\r\n\r\n";
+	boost::asio::write (client, boost::asio::buffer (request));
+
+	boost::asio::streambuf buffer;
+	boost::asio::read_until (client, buffer, "}\n\n");
+	string const response ((std::istreambuf_iterator<char> (&buffer)), std::istreambuf_iterator<char> ());
+	BOOST_CHECK (response.find ("Content-Type: text/event-stream") != string::npos);
+	BOOST_CHECK (response.find ("data: { \"jobs\": [") != string::npos);
+}
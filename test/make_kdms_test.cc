@@ -0,0 +1,142 @@
+/*
+    Copyright (C) 2018 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/** @file  test/make_kdms_test.cc
+ *  @brief Test Film::make_kdms with lots of screens.
+ *  @ingroup specific
+ */
+
+#include "test.h"
+#include "lib/film.h"
+#include "lib/image_content.h"
+#include "lib/dcp_content_type.h"
+#include "lib/config.h"
+#include "lib/cinema.h"
+#include "lib/screen.h"
+#include "lib/screen_kdm.h"
+#include "lib/cross.h"
+#include "lib/util.h"
+#include <dcp/dcp.h>
+#include <dcp/cpl.h>
+#include <dcp/certificate_chain.h>
+#include <dcp/decrypted_kdm.h>
+#include <dcp/decrypted_kdm_key.h>
+#include <boost/test/unit_test.hpp>
+#include <boost/foreach.hpp>
+#include <sys/time.h>
+#include <iostream>
+
+using std::list;
+using std::vector;
+using std::string;
+using std::cout;
+using boost::shared_ptr;
+using boost::optional;
+
+/** Make KDMs for lots of screens, checking that they come back in the right order
+ *  and can be decrypted, and time how long it takes.
+ */
+BOOST_AUTO_TEST_CASE (make_kdms_test)
+{
+	int const N = 500;
+
+	shared_ptr<Film> film = new_test_film ("make_kdms_test");
+	film->set_dcp_content_type (DCPContentType::from_isdcf_name ("TST"));
+	film->set_name ("make_kdms_test");
+	shared_ptr<ImageContent> content (new ImageContent (film, "test/data/flat_red.png"));
+	film->examine_and_add_content (content);
+	film->set_encrypted (true);
+	wait_for_jobs ();
+	film->make_dcp ();
+	wait_for_jobs ();
+
+	dcp::DCP dcp (film->dir (film->dcp_name ()));
+	dcp.read ();
+	BOOST_REQUIRE_EQUAL (dcp.cpls().size(), 1);
+
+	/* Make KDMs for a new chain, putting the config back as it was once we have them */
+	Config* config = Config::instance ();
+	shared_ptr<const dcp::CertificateChain> const old_chain = config->decryption_chain ();
+	int const old_threads = config->master_encoding_threads ();
+
+	shared_ptr<const dcp::CertificateChain> chain (new dcp::CertificateChain (openssl_path ()));
+	config->set_decryption_chain (chain);
+	dcp::Certificate const recipient = chain->leaf ();
+
+	/* Some screens in some cinemas in different time zones; every seventh screen has no
+	   recipient certificate, so it should not get a KDM.
+	*/
+	list<shared_ptr<Screen> > screens;
+	vector<shared_ptr<Screen> > expected;
+	for (int i = 0; i < N; ++i) {
+		shared_ptr<Cinema> cinema (new Cinema ("Cinema", list<string> (), "", (i % 25) - 12, (i % 2) * 30));
+		optional<dcp::Certificate> cert;
+		if (i % 7) {
+			cert = recipient;
+		}
+		shared_ptr<Screen> screen (new Screen ("Screen", cert, vector<dcp::Certificate> ()));
+		cinema->add_screen (screen);
+		screens.push_back (screen);
+		if (cert) {
+			expected.push_back (screen);
+		}
+	}
+
+	config->set_master_encoding_threads (4);
+
+	struct timeval start;
+	gettimeofday (&start, 0);
+
+	list<ScreenKDM> kdms = film->make_kdms (
+		screens,
+		dcp.cpls().front()->file().get(),
+		boost::posix_time::time_from_string ("2018-01-01 00:00:00"),
+		boost::posix_time::time_from_string ("2028-01-01 00:00:00"),
+		dcp::MODIFIED_TRANSITIONAL_1,
+		0,
+		0
+		);
+
+	struct timeval stop;
+	gettimeofday (&stop, 0);
+
+	config->set_master_encoding_threads (old_threads);
+	config->set_decryption_chain (old_chain);
+
+	double const t = seconds (stop) - seconds (start);
+	cout << "Made " << kdms.size() << " KDMs in " << t << "s (" << (kdms.size() / t) << " per second)\n";
+
+	BOOST_REQUIRE_EQUAL (kdms.size(), expected.size());
+
+	vector<shared_ptr<Screen> >::const_iterator j = expected.begin ();
+	BOOST_FOREACH (ScreenKDM const & i, kdms) {
+		BOOST_CHECK (i.screen == *j);
+		++j;
+	}
+
+	/* Check that a couple of them contain the right key */
+	dcp::DecryptedKDM first (kdms.front().kdm, chain->key().get());
+	BOOST_REQUIRE (!first.keys().empty ());
+	BOOST_CHECK (first.keys().front().key() == film->key ());
+
+	dcp::DecryptedKDM last (kdms.back().kdm, chain->key().get());
+	BOOST_REQUIRE (!last.keys().empty ());
+	BOOST_CHECK (last.keys().front().key() == film->key ());
+}
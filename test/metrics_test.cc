@@ -0,0 +1,90 @@
+/*
+    Copyright (C) 2018 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/** @file  test/metrics_test.cc
+ *  @brief Test Metrics and its Prometheus output.
+ *  @ingroup selfcontained
+ */
+
+#include "lib/metrics.h"
+#include <boost/test/unit_test.hpp>
+
+using std::string;
+
+static bool
+contains (string haystack, string needle)
+{
+	return haystack.find (needle) != string::npos;
+}
+
+BOOST_AUTO_TEST_CASE (metrics_counter_gauge_test)
+{
+	Metrics* m = Metrics::instance ();
+
+	m->increment ("metrics_test_frames_total", Metrics::label ("type", "full"));
+	m->increment ("metrics_test_frames_total", Metrics::label ("type", "full"), 2);
+	m->increment ("metrics_test_frames_total", Metrics::label ("type", "fake"));
+	m->set ("metrics_test_queue", "", 42);
+	m->set ("metrics_test_queue", "", 7);
+
+	BOOST_CHECK_EQUAL (m->get ("metrics_test_frames_total", "type=\"full\""), 3);
+	BOOST_CHECK_EQUAL (m->get ("metrics_test_frames_total", "type=\"fake\""), 1);
+	BOOST_CHECK_EQUAL (m->get ("metrics_test_frames_total", "type=\"repeat\""), 0);
+	BOOST_CHECK_EQUAL (m->get ("metrics_test_queue"), 7);
+
+	string const p = m->prometheus ();
+	BOOST_CHECK (contains (p, "# TYPE metrics_test_frames_total counter\n"));
+	BOOST_CHECK (contains (p, "metrics_test_frames_total{type=\"full\"} 3\n"));
+	BOOST_CHECK (contains (p, "metrics_test_frames_total{type=\"fake\"} 1\n"));
+	BOOST_CHECK (contains (p, "# TYPE metrics_test_queue gauge\n"));
+	BOOST_CHECK (contains (p, "metrics_test_queue 7\n"));
+
+	/* Large counts must not lose precision */
+	m->increment ("metrics_test_bytes_total", "", 12345678901.0);
+	BOOST_CHECK (contains (m->prometheus (), "metrics_test_bytes_total 12345678901\n"));
+}
+
+BOOST_AUTO_TEST_CASE (metrics_histogram_test)
+{
+	Metrics* m = Metrics::instance ();
+
+	m->observe ("metrics_test_seconds", Metrics::label ("server", "a"), 0.003);
+	m->observe ("metrics_test_seconds", Metrics::label ("server", "a"), 0.2);
+	m->observe ("metrics_test_seconds", Metrics::label ("server", "a"), 0.25);
+	m->observe ("metrics_test_seconds", Metrics::label ("server", "a"), 60);
+
+	BOOST_CHECK_EQUAL (m->get ("metrics_test_seconds", "server=\"a\""), 4);
+
+	string const p = m->prometheus ();
+	BOOST_CHECK (contains (p, "# TYPE metrics_test_seconds histogram\n"));
+	BOOST_CHECK (contains (p, "metrics_test_seconds_bucket{server=\"a\",le=\"0.005\"} 1\n"));
+	BOOST_CHECK (contains (p, "metrics_test_seconds_bucket{server=\"a\",le=\"0.1\"} 1\n"));
+	BOOST_CHECK (contains (p, "metrics_test_seconds_bucket{server=\"a\",le=\"0.25\"} 3\n"));
+	BOOST_CHECK (contains (p, "metrics_test_seconds_bucket{server=\"a\",le=\"10\"} 3\n"));
+	BOOST_CHECK (contains (p, "metrics_test_seconds_bucket{server=\"a\",le=\"+Inf\"} 4\n"));
+	BOOST_CHECK (contains (p, "metrics_test_seconds_sum{server=\"a\"} 60.453\n"));
+	BOOST_CHECK (contains (p, "metrics_test_seconds_count{server=\"a\"} 4\n"));
+}
+
+BOOST_AUTO_TEST_CASE (metrics_label_test)
+{
+	BOOST_CHECK_EQUAL (Metrics::label ("server", "localhost"), "server=\"localhost\"");
+	BOOST_CHECK_EQUAL (Metrics::label ("name", "a \"b\"\\c\nd"), "name=\"a \\\"b\\\"\\\\c\\nd\"");
+}
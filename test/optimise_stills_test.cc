@@ -28,6 +28,7 @@
 #include "lib/dcp_content_type.h"
 #include "lib/content.h"
 #include "lib/video_content.h"
+#include "lib/metrics.h"
 #include "test.h"
 #include <boost/test/unit_test.hpp>
 #include <boost/algorithm/string.hpp>
@@ -101,3 +102,31 @@ BOOST_AUTO_TEST_CASE (optimise_stills_test2)
 
 	check ("optimise_stills_test2", 2, 10 * 48 - 2);
 }
+
+/** Make a DCP with a still, then a different still, then the first still again and check
+ *  that the second appearance of the first still is not encoded again.
+ */
+BOOST_AUTO_TEST_CASE (optimise_stills_test3)
+{
+	shared_ptr<Film> film = new_test_film ("optimise_stills_test3");
+	film->set_container (Ratio::from_id ("185"));
+	film->set_dcp_content_type (DCPContentType::from_isdcf_name ("TLR"));
+	film->set_name ("frobozz");
+
+	char const * files[] = { "test/data/flat_red.png", "test/data/flat_green.png", "test/data/flat_red.png" };
+	for (int i = 0; i < 3; ++i) {
+		shared_ptr<Content> content = content_factory(film, files[i]).front ();
+		film->examine_and_add_content (content);
+		BOOST_REQUIRE (!wait_for_jobs ());
+		content->video->set_length (24);
+	}
+
+	double const reused = Metrics::instance()->get ("dcpomatic_encoder_reused_frames_total", "from=\"recent\"");
+
+	film->make_dcp ();
+	BOOST_REQUIRE (!wait_for_jobs ());
+
+	BOOST_CHECK_EQUAL (Metrics::instance()->get ("dcpomatic_encoder_reused_frames_total", "from=\"recent\""), reused + 1);
+	/* The reused frame is still written in full, but all the others are repeats */
+	check ("optimise_stills_test3", 3, 3 * 24 - 3);
+}
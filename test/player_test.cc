@@ -29,6 +29,7 @@
 #include "lib/ratio.h"
 #include "lib/audio_buffers.h"
 #include "lib/player.h"
+#include "lib/player_video.h"
 #include "lib/video_content.h"
 #include "lib/image_content.h"
 #include "lib/text_subtitle_content.h"
@@ -125,6 +126,48 @@ BOOST_AUTO_TEST_CASE (player_black_fill_test)
 	check_dcp (ref.string(), check.string());
 }
 
+static list<shared_ptr<PlayerVideo> > black_frames_video;
+
+static void
+black_frames_video_handler (shared_ptr<PlayerVideo> pv, DCPTime)
+{
+	black_frames_video.push_back (pv);
+}
+
+/** Check that the frames that the Player makes to fill gaps are marked as black, so that
+ *  the encoder can take them from its cache of encoded black frames.
+ */
+BOOST_AUTO_TEST_CASE (player_black_frames_test)
+{
+	shared_ptr<Film> film = new_test_film ("player_black_frames_test");
+	film->set_container (Ratio::from_id ("185"));
+	film->set_sequence (false);
+	shared_ptr<ImageContent> content (new ImageContent (film, "test/data/simple_testcard_640x480.png"));
+	film->examine_and_add_content (content);
+	wait_for_jobs ();
+
+	content->video->set_length (3);
+	content->set_position (DCPTime::from_frames (2, film->video_frame_rate ()));
+
+	black_frames_video.clear ();
+	shared_ptr<Player> player (new Player (film, film->playlist ()));
+	player->Video.connect (bind (&black_frames_video_handler, _1, _2));
+	while (!player->pass ()) {}
+
+	BOOST_REQUIRE_EQUAL (black_frames_video.size(), 5);
+	list<shared_ptr<PlayerVideo> >::const_iterator i = black_frames_video.begin ();
+	shared_ptr<PlayerVideo> first = *i++;
+	BOOST_CHECK (first->black ());
+	BOOST_CHECK (first->digest ());
+	shared_ptr<PlayerVideo> second = *i++;
+	BOOST_CHECK (second->black ());
+	BOOST_CHECK (second->same (first));
+	for (; i != black_frames_video.end(); ++i) {
+		BOOST_CHECK (!(*i)->black ());
+		BOOST_CHECK (!(*i)->same (first));
+	}
+}
+
 /** Check behaviour with an awkward playlist whose data does not end on a video frame start */
 BOOST_AUTO_TEST_CASE (player_subframe_test)
 {
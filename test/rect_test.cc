@@ -36,3 +36,13 @@ BOOST_AUTO_TEST_CASE (rect_test)
 	optional<dcpomatic::Rect<int> > c = a.intersection (b);
 	BOOST_CHECK (!c);
 }
+
+BOOST_AUTO_TEST_CASE (rect_extend_test)
+{
+	dcpomatic::Rect<int> a (100, 50, 10, 10);
+	a.extend (dcpomatic::Rect<int> (0, 0, 10, 10));
+	BOOST_CHECK_EQUAL (a.x, 0);
+	BOOST_CHECK_EQUAL (a.y, 0);
+	BOOST_CHECK_EQUAL (a.width, 110);
+	BOOST_CHECK_EQUAL (a.height, 60);
+}
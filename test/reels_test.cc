@@ -32,6 +32,9 @@
 #include "lib/video_content.h"
 #include "lib/text_subtitle_content.h"
 #include "lib/content_factory.h"
+#include "lib/range_encoder.h"
+#include "lib/config.h"
+#include "lib/compose.hpp"
 #include "test.h"
 #include <boost/test/unit_test.hpp>
 #include <boost/foreach.hpp>
@@ -371,3 +374,106 @@ BOOST_AUTO_TEST_CASE (reels_test9)
 	film2->make_dcp();
 	BOOST_REQUIRE(!wait_for_jobs());
 }
+
+/** Check that a DCP made from reels which have already been encoded to the j2c
+ *  directory (as encoding servers do when they are given whole reels) is the same
+ *  as one made in the normal way.
+ */
+BOOST_AUTO_TEST_CASE (reels_test10)
+{
+	shared_ptr<Film> film[3];
+	for (int i = 0; i < 3; ++i) {
+		film[i] = new_test_film2 (String::compose ("reels_test10%1", char ('a' + i)));
+		film[i]->set_reel_type (REELTYPE_BY_VIDEO_CONTENT);
+		for (int j = 0; j < 3; ++j) {
+			shared_ptr<Content> c = content_factory(film[i], "test/data/flat_green.png").front();
+			film[i]->examine_and_add_content (c);
+			BOOST_REQUIRE (!wait_for_jobs ());
+			c->video->set_length (24);
+		}
+	}
+
+	film[0]->make_dcp ();
+	BOOST_REQUIRE (!wait_for_jobs ());
+
+	BOOST_REQUIRE_EQUAL (film[1]->reels().size(), 3);
+	for (int i = 0; i < 3; ++i) {
+		BOOST_CHECK (!RangeEncoder::done (film[1], i));
+		BOOST_CHECK_EQUAL (RangeEncoder (film[1], i, 2).go (), 24);
+		BOOST_CHECK (RangeEncoder::done (film[1], i));
+	}
+
+	Config::instance()->set_servers_encode_reels (true);
+	film[1]->make_dcp ();
+	BOOST_REQUIRE (!wait_for_jobs ());
+	Config::instance()->set_servers_encode_reels (false);
+
+	check_dcp (film[0]->dir (film[0]->dcp_name ()), film[1]->dir (film[1]->dcp_name ()));
+
+	/* Decode and encode the reels in parallel on this machine */
+	Config::instance()->set_local_reel_encoders (3);
+	film[2]->make_dcp ();
+	BOOST_REQUIRE (!wait_for_jobs ());
+	Config::instance()->set_local_reel_encoders (1);
+
+	/* The J2C files should have been removed as they were written to the DCP */
+	for (int i = 0; i < 3; ++i) {
+		BOOST_CHECK (!RangeEncoder::done (film[2], i));
+	}
+	BOOST_CHECK (boost::filesystem::is_empty (film[2]->dir ("j2c") / film[2]->video_identifier ()));
+
+	check_dcp (film[0]->dir (film[0]->dcp_name ()), film[2]->dir (film[2]->dcp_name ()));
+}
+
+/** Check that J2C files encoded for one set of reels are not used after the
+ *  reels have changed.
+ */
+BOOST_AUTO_TEST_CASE (reels_test11)
+{
+	shared_ptr<Film> film[2];
+	for (int i = 0; i < 2; ++i) {
+		film[i] = new_test_film2 (String::compose ("reels_test11%1", char ('a' + i)));
+		film[i]->set_reel_type (REELTYPE_BY_LENGTH);
+		shared_ptr<Content> red = content_factory(film[i], "test/data/flat_red.png").front();
+		shared_ptr<Content> green = content_factory(film[i], "test/data/flat_green.png").front();
+		shared_ptr<Content> blue = content_factory(film[i], "test/data/flat_blue.png").front();
+		film[i]->examine_and_add_content (red);
+		film[i]->examine_and_add_content (green);
+		film[i]->examine_and_add_content (blue);
+		BOOST_REQUIRE (!wait_for_jobs ());
+		red->video->set_length (24);
+		green->video->set_length (24);
+		blue->video->set_length (48);
+	}
+
+	/* Size of one frame in bytes, as Film::reels() calculates it */
+	int64_t const frame = (film[0]->j2k_bandwidth() / film[0]->video_frame_rate()) / 8;
+
+	film[0]->set_reel_length (frame * 24);
+	BOOST_REQUIRE_EQUAL (film[0]->reels().size(), 4);
+	film[0]->make_dcp ();
+	BOOST_REQUIRE (!wait_for_jobs ());
+
+	/* Encode film[1] with two 48-frame reels: red/green then blue */
+	film[1]->set_reel_length (frame * 48);
+	BOOST_REQUIRE_EQUAL (film[1]->reels().size(), 2);
+	for (int i = 0; i < 2; ++i) {
+		BOOST_CHECK_EQUAL (RangeEncoder (film[1], i, 2).go (), 48);
+	}
+
+	/* Then change to 24-frame reels; the second reel is now green and must not
+	   be taken from the blue frames that were encoded for the old second reel.
+	*/
+	film[1]->set_reel_length (frame * 24);
+	BOOST_REQUIRE_EQUAL (film[1]->reels().size(), 4);
+	for (int i = 0; i < 4; ++i) {
+		BOOST_CHECK (!RangeEncoder::done (film[1], i));
+	}
+
+	Config::instance()->set_servers_encode_reels (true);
+	film[1]->make_dcp ();
+	BOOST_REQUIRE (!wait_for_jobs ());
+	Config::instance()->set_servers_encode_reels (false);
+
+	check_dcp (film[0]->dir (film[0]->dcp_name ()), film[1]->dir (film[1]->dcp_name ()));
+}
@@ -26,6 +26,7 @@
 #include "lib/content_factory.h"
 #include "lib/film.h"
 #include "lib/dcp_content.h"
+#include "lib/config.h"
 #include "test.h"
 #include <boost/test/unit_test.hpp>
 
@@ -78,4 +79,18 @@ BOOST_AUTO_TEST_CASE (required_disk_space_test)
 		65536,                          // extra
 		16
 		);
+
+	/* Reels encoded by servers go to J2C files before they are written to the DCP */
+	Config::instance()->set_servers_encode_reels (true);
+
+	check_within_n (
+		film->required_disk_space(),
+		240LL * (100000000 / 8) / 24 +  // video
+		240LL * (100000000 / 8) / 24 +  // J2C files
+		240LL * 48000 * 6 * 3 / 24 +    // audio
+		65536,                          // extra
+		16
+		);
+
+	Config::instance()->set_servers_encode_reels (false);
 }
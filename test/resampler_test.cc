@@ -19,39 +19,82 @@
 */
 
 /** @file  test/resampler_test.cc
- *  @brief Check that the timings that come back from Resampler correspond
- *  to the number of samples it generates.
+ *  @brief Check that Resampler generates the right number of samples, and
+ *  report how quickly it does so with many channels.
  *  @ingroup selfcontained
  */
 
 #include <boost/test/unit_test.hpp>
 #include "lib/audio_buffers.h"
 #include "lib/resampler.h"
+#include "lib/util.h"
+#include <sys/time.h>
 #include <iostream>
+#include <cmath>
+#include <cstdlib>
 
-using std::pair;
 using std::cout;
 using boost::shared_ptr;
 
 static void
-resampler_test_one (int from, int to)
+resampler_test_one (int from, int to, int channels)
 {
-	Resampler resamp (from, to, 1);
+	Resampler resamp (from, to, channels);
 
-	/* 3 hours */
-	int64_t const N = int64_t (from) * 60 * 60 * 3;
+	/* 1 minute */
+	int64_t const N = int64_t (from) * 60;
 
-	/* XXX: no longer checks anything */
+	int64_t out = 0;
 	for (int64_t i = 0; i < N; i += 1000) {
-		shared_ptr<AudioBuffers> a (new AudioBuffers (1, 1000));
+		shared_ptr<AudioBuffers> a (new AudioBuffers (channels, 1000));
 		a->make_silent ();
-		pair<shared_ptr<const AudioBuffers>, Frame> r = resamp.run (a, 0);
+		shared_ptr<const AudioBuffers> r = resamp.run (a);
+		BOOST_REQUIRE_EQUAL (r->channels(), channels);
+		out += r->frames ();
 	}
+
+	out += resamp.flush()->frames ();
+
+	/* We should have got very close to the expected number of output samples */
+	int64_t const expected = N * to / from;
+	BOOST_CHECK (llabs (out - expected) < 32);
 }
 
 BOOST_AUTO_TEST_CASE (resampler_test)
 {
-	resampler_test_one (44100, 48000);
-	resampler_test_one (44100, 46080);
-	resampler_test_one (44100, 50000);
+	resampler_test_one (44100, 48000, 1);
+	resampler_test_one (44100, 46080, 2);
+	resampler_test_one (44100, 50000, 6);
+	resampler_test_one (48000, 50000, 16);
+}
+
+/** Time the resampling of 16-channel 96kHz audio as happens for a 25fps to 24fps conversion */
+BOOST_AUTO_TEST_CASE (resampler_benchmark_test)
+{
+	int const channels = 16;
+	int const block = 4000;
+	int const N = 96000 * 30;
+
+	Resampler resamp (96000, 100000, channels);
+
+	shared_ptr<AudioBuffers> a (new AudioBuffers (channels, block));
+	for (int i = 0; i < channels; ++i) {
+		for (int j = 0; j < block; ++j) {
+			a->data(i)[j] = sin (j * (i + 1) * 0.01);
+		}
+	}
+
+	struct timeval start;
+	gettimeofday (&start, 0);
+
+	for (int i = 0; i < N; i += block) {
+		resamp.run (a);
+	}
+
+	struct timeval stop;
+	gettimeofday (&stop, 0);
+
+	double const t = seconds (stop) - seconds (start);
+	cout << "Resampled " << (N / 96000) << "s of " << channels << "-channel 96kHz audio in " << t << "s "
+	     << "(" << (N / 96000 / t) << "x real-time)\n";
 }
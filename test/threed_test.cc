@@ -30,6 +30,7 @@
 #include "lib/dcp_content_type.h"
 #include "lib/ffmpeg_content.h"
 #include "lib/video_content.h"
+#include "lib/metrics.h"
 #include <iostream>
 
 using std::cout;
@@ -100,3 +101,28 @@ BOOST_AUTO_TEST_CASE (threed_test3)
 
 	BOOST_REQUIRE (!wait_for_jobs ());
 }
+
+/** Check that when only left-eye content is used in a 3D DCP, the right-eye frames
+ *  (which the Player fills in with the left-eye images) are copied rather than encoded.
+ */
+BOOST_AUTO_TEST_CASE (threed_test4)
+{
+	shared_ptr<Film> film = new_test_film2 ("threed_test4");
+	shared_ptr<FFmpegContent> L (new FFmpegContent (film, "test/data/test.mp4"));
+	film->examine_and_add_content (L);
+	wait_for_jobs ();
+
+	L->video->set_frame_type (VIDEO_FRAME_TYPE_3D_LEFT);
+
+	double const copies = Metrics::instance()->get ("dcpomatic_writer_frames_total", "type=\"copy-left-eye\"");
+
+	film->set_three_d (true);
+	film->make_dcp ();
+	film->write_metadata ();
+
+	BOOST_REQUIRE (!wait_for_jobs ());
+
+	/* Nearly all the right-eye frames should have been copied from the left */
+	Frame const frames = film->length().frames_round (film->video_frame_rate ());
+	BOOST_CHECK (Metrics::instance()->get ("dcpomatic_writer_frames_total", "type=\"copy-left-eye\"") >= copies + frames / 2);
+}
@@ -0,0 +1,320 @@
+/*
+    Copyright (C) 2018 Carl Hetherington <cth@carlh.net>
+
+    This file is part of DCP-o-matic.
+
+    DCP-o-matic is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    DCP-o-matic is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with DCP-o-matic.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/** @file  test/upload_test.cc
+ *  @brief Test Uploader using a stand-in for a server which writes to a local directory.
+ *  @ingroup selfcontained
+ */
+
+#include "lib/uploader.h"
+#include "lib/upload_source.h"
+#include "lib/exceptions.h"
+#include "lib/digester.h"
+#include <dcp/data.h>
+#include <boost/test/unit_test.hpp>
+#include <boost/bind.hpp>
+#include <boost/thread/mutex.hpp>
+#include <cstdio>
+
+using std::string;
+using std::vector;
+using boost::shared_ptr;
+
+static void
+ignore_status (string)
+{
+
+}
+
+/** An Uploader which `uploads' to a local directory, and which can be told to fail
+ *  part of the way through sending a file, or to give digests of the files that it has.
+ */
+class LocalUploader : public Uploader
+{
+public:
+	LocalUploader (boost::filesystem::path directory, int connections)
+		: Uploader (boost::bind (&ignore_status, _1), boost::bind (&LocalUploader::set_progress, this, _1), connections)
+		, directory (directory)
+		, connects (0)
+		, sent (0)
+		, read_bytes (0)
+		, fail_after (0)
+		, hash (false)
+		, progress (0)
+	{}
+
+	class LocalConnection : public Uploader::Connection
+	{
+	public:
+		explicit LocalConnection (LocalUploader* uploader)
+			: _uploader (uploader)
+		{}
+
+		void create_directory (boost::filesystem::path directory)
+		{
+			boost::filesystem::create_directories (_uploader->directory / directory);
+		}
+
+		boost::uintmax_t remote_size (boost::filesystem::path file)
+		{
+			boost::system::error_code ec;
+			boost::uintmax_t const s = boost::filesystem::file_size (_uploader->directory / file, ec);
+			return ec ? 0 : s;
+		}
+
+		void read (boost::filesystem::path file, boost::uintmax_t offset, uint8_t* data, size_t size)
+		{
+			/* This is called from the uploader's threads, so we can't use BOOST_CHECK and friends */
+			FILE* f = fopen ((_uploader->directory / file).string().c_str(), "rb");
+			if (!f) {
+				throw NetworkError ("could not open remote file");
+			}
+			fseek (f, offset, SEEK_SET);
+			size_t const r = fread (data, 1, size, f);
+			fclose (f);
+			if (r != size) {
+				throw NetworkError ("could not read remote file");
+			}
+			boost::mutex::scoped_lock lm (_uploader->mutex);
+			_uploader->read_bytes += size;
+		}
+
+		boost::optional<string> remote_md5 (boost::filesystem::path file)
+		{
+			if (!_uploader->hash) {
+				return boost::optional<string> ();
+			}
+			dcp::Data data (_uploader->directory / file);
+			Digester digester;
+			digester.add (data.data().get(), data.size());
+			return digester.get ();
+		}
+
+		void upload_file (UploadSource& source, boost::filesystem::path to)
+		{
+			FILE* f = fopen ((_uploader->directory / to).string().c_str(), source.offset() > 0 ? "r+b" : "wb");
+			if (!f) {
+				throw NetworkError ("could not open remote file");
+			}
+			fseek (f, source.offset(), SEEK_SET);
+
+			vector<uint8_t> buffer (100000);
+			boost::uintmax_t written = 0;
+			while (size_t n = source.read (&buffer[0], buffer.size ())) {
+				fwrite (&buffer[0], 1, n, f);
+				written += n;
+				boost::mutex::scoped_lock lm (_uploader->mutex);
+				_uploader->sent += n;
+				if (_uploader->fail_after && to.filename() == _uploader->fail_file && written >= _uploader->fail_after) {
+					fclose (f);
+					throw NetworkError ("connection lost");
+				}
+			}
+
+			fclose (f);
+		}
+
+	private:
+		LocalUploader* _uploader;
+	};
+
+	boost::filesystem::path directory;
+	boost::mutex mutex;
+	int connects;
+	boost::uintmax_t sent;
+	/** number of bytes read back from the `server' */
+	boost::uintmax_t read_bytes;
+	/** if non-zero, fail when at least this many bytes of fail_file have been sent */
+	boost::uintmax_t fail_after;
+	boost::filesystem::path fail_file;
+	/** true to give digests of files from remote_md5() */
+	bool hash;
+	float progress;
+
+protected:
+	shared_ptr<Connection> connect ()
+	{
+		boost::mutex::scoped_lock lm (mutex);
+		++connects;
+		return shared_ptr<Connection> (new LocalConnection (this));
+	}
+
+private:
+	void set_progress (float p)
+	{
+		boost::mutex::scoped_lock lm (mutex);
+		progress = p;
+	}
+};
+
+static void
+write_file (boost::filesystem::path path, int size, int seed)
+{
+	vector<uint8_t> data (size);
+	srand (seed);
+	for (int i = 0; i < size; ++i) {
+		data[i] = rand ();
+	}
+	dcp::Data (size > 0 ? &data[0] : 0, size).write (path);
+}
+
+static bool
+same (boost::filesystem::path a, boost::filesystem::path b)
+{
+	dcp::Data da (a);
+	dcp::Data db (b);
+	return da.size() == db.size() && memcmp (da.data().get(), db.data().get(), da.size()) == 0;
+}
+
+static boost::filesystem::path
+make_source ()
+{
+	boost::filesystem::path const dir = "build/test/upload_test/source/DCP";
+	boost::filesystem::remove_all (dir);
+	boost::filesystem::create_directories (dir / "sub");
+	write_file (dir / "video.mxf", 11 * 1024 * 1024, 1);
+	write_file (dir / "audio.mxf", 3 * 1024 * 1024 + 17, 2);
+	write_file (dir / "ASSETMAP", 4000, 3);
+	write_file (dir / "empty", 0, 4);
+	write_file (dir / "sub" / "subtitle.xml", 70000, 5);
+	return dir;
+}
+
+static void
+check_same (boost::filesystem::path dir, boost::filesystem::path dest)
+{
+	BOOST_CHECK (same (dir / "video.mxf", dest / "DCP" / "video.mxf"));
+	BOOST_CHECK (same (dir / "audio.mxf", dest / "DCP" / "audio.mxf"));
+	BOOST_CHECK (same (dir / "ASSETMAP", dest / "DCP" / "ASSETMAP"));
+	BOOST_CHECK (boost::filesystem::exists (dest / "DCP" / "empty"));
+	BOOST_CHECK (same (dir / "sub" / "subtitle.xml", dest / "DCP" / "sub" / "subtitle.xml"));
+}
+
+/** Upload a DCP over several connections */
+BOOST_AUTO_TEST_CASE (upload_test1)
+{
+	boost::filesystem::path const dir = make_source ();
+	boost::filesystem::path const dest = "build/test/upload_test/dest1";
+	boost::filesystem::remove_all (dest);
+	boost::filesystem::create_directories (dest);
+
+	LocalUploader uploader (dest, 3);
+	uploader.upload (dir);
+
+	check_same (dir, dest);
+	BOOST_CHECK_EQUAL (uploader.connects, 3);
+	BOOST_CHECK_EQUAL (uploader.sent, 11 * 1024 * 1024 + 3 * 1024 * 1024 + 17 + 4000 + 70000);
+	BOOST_CHECK_CLOSE (uploader.progress, 1, 0.001);
+}
+
+/** Check that an interrupted upload is resumed, only sending what is not already there,
+ *  and that files on the server which are different to ours are replaced.
+ */
+BOOST_AUTO_TEST_CASE (upload_test2)
+{
+	boost::filesystem::path const dir = make_source ();
+	boost::filesystem::path const dest = "build/test/upload_test/dest2";
+	boost::filesystem::remove_all (dest);
+	boost::filesystem::create_directories (dest);
+
+	{
+		LocalUploader uploader (dest, 1);
+		uploader.fail_file = "video.mxf";
+		uploader.fail_after = 5 * 1024 * 1024;
+		BOOST_CHECK_THROW (uploader.upload (dir), std::exception);
+	}
+
+	/* video.mxf is sent first as it is the biggest, so it will be partly there and nothing else will */
+	boost::uintmax_t const partial = boost::filesystem::file_size (dest / "DCP" / "video.mxf");
+	BOOST_CHECK (partial >= 5 * 1024 * 1024);
+	BOOST_CHECK (partial < 11 * 1024 * 1024);
+	BOOST_CHECK (!boost::filesystem::exists (dest / "DCP" / "audio.mxf"));
+
+	/* Put a different ASSETMAP of the same size on the server */
+	write_file (dest / "DCP" / "ASSETMAP", 4000, 42);
+
+	LocalUploader uploader (dest, 2);
+	uploader.upload (dir);
+
+	check_same (dir, dest);
+	BOOST_CHECK_EQUAL (uploader.sent, 11 * 1024 * 1024 - partial + 3 * 1024 * 1024 + 17 + 4000 + 70000);
+	/* The partial video.mxf should have been checked by sampling, not by reading it all back */
+	BOOST_CHECK (uploader.read_bytes < 1024 * 1024);
+
+	/* Now everything is there, so nothing should be sent */
+	LocalUploader again (dest, 2);
+	again.upload (dir);
+	BOOST_CHECK_EQUAL (again.sent, 0);
+	BOOST_CHECK_CLOSE (again.progress, 1, 0.001);
+}
+
+/** Check that a partial file on the server is not resumed if it differs from ours near
+ *  its start, when the server cannot give us a digest.
+ */
+BOOST_AUTO_TEST_CASE (upload_test3)
+{
+	boost::filesystem::path const dir = make_source ();
+	boost::filesystem::path const dest = "build/test/upload_test/dest3";
+	boost::filesystem::remove_all (dest);
+	boost::filesystem::create_directories (dest / "DCP");
+
+	/* Put the first 6MB of video.mxf on the server, with one byte near the start changed */
+	dcp::Data video (dir / "video.mxf");
+	dcp::Data partial (video.data().get(), 6 * 1024 * 1024);
+	partial.data().get()[1000] ^= 0xff;
+	partial.write (dest / "DCP" / "video.mxf");
+
+	LocalUploader uploader (dest, 1);
+	uploader.upload (dir);
+
+	check_same (dir, dest);
+	BOOST_CHECK_EQUAL (uploader.sent, 11 * 1024 * 1024 + 3 * 1024 * 1024 + 17 + 4000 + 70000);
+}
+
+/** Check that a server's digest of a partial file is used when it can give one, so that
+ *  a difference anywhere in the file is found without reading any of it back.
+ */
+BOOST_AUTO_TEST_CASE (upload_test4)
+{
+	boost::filesystem::path const dir = make_source ();
+	boost::filesystem::path const dest = "build/test/upload_test/dest4";
+	boost::filesystem::remove_all (dest);
+	boost::filesystem::create_directories (dest / "DCP");
+
+	/* Put the first 6MB of video.mxf on the server with a byte in the middle changed,
+	   where sampling would not see it, and the first 2MB of audio.mxf unchanged.
+	*/
+	dcp::Data video (dir / "video.mxf");
+	dcp::Data partial_video (video.data().get(), 6 * 1024 * 1024);
+	partial_video.data().get()[3 * 1024 * 1024 + 1000] ^= 0xff;
+	partial_video.write (dest / "DCP" / "video.mxf");
+
+	dcp::Data audio (dir / "audio.mxf");
+	dcp::Data partial_audio (audio.data().get(), 2 * 1024 * 1024);
+	partial_audio.write (dest / "DCP" / "audio.mxf");
+
+	LocalUploader uploader (dest, 1);
+	uploader.hash = true;
+	uploader.upload (dir);
+
+	check_same (dir, dest);
+	BOOST_CHECK_EQUAL (uploader.sent, 11 * 1024 * 1024 + 1024 * 1024 + 17 + 4000 + 70000);
+	BOOST_CHECK_EQUAL (uploader.read_bytes, 0);
+}
@@ -25,6 +25,7 @@
 
 #include "lib/util.h"
 #include "lib/exceptions.h"
+#include "lib/cross.h"
 #include <boost/test/unit_test.hpp>
 
 using std::string;
@@ -87,3 +88,46 @@ BOOST_AUTO_TEST_CASE (tidy_for_filename_test)
 	BOOST_CHECK_EQUAL (tidy_for_filename ("fish/chips\\"), "fish_chips_");
 	BOOST_CHECK_EQUAL (tidy_for_filename ("abcdefghï"), "abcdefghï");
 }
+
+/** Check that dcpomatic_copy_file makes an exact copy, however it does it, and that
+ *  the copy is not affected by later changes to the original.
+ */
+BOOST_AUTO_TEST_CASE (dcpomatic_copy_file_test)
+{
+	boost::filesystem::path const from = "build/test/dcpomatic_copy_file_test.from";
+	boost::filesystem::path const to = "build/test/dcpomatic_copy_file_test.to";
+	boost::filesystem::remove (from);
+	boost::filesystem::remove (to);
+
+	FILE* f = fopen_boost (from, "wb");
+	BOOST_REQUIRE (f);
+	for (int i = 0; i < 3 * 1024 * 1024; ++i) {
+		fputc (i % 251, f);
+	}
+	fclose (f);
+
+	boost::system::error_code ec;
+	dcpomatic_copy_file (from, to, ec);
+	BOOST_REQUIRE (!ec);
+
+	f = fopen_boost (from, "r+b");
+	BOOST_REQUIRE (f);
+	fputc (42, f);
+	fclose (f);
+
+	f = fopen_boost (to, "rb");
+	BOOST_REQUIRE (f);
+	bool same = true;
+	for (int i = 0; i < 3 * 1024 * 1024; ++i) {
+		if (fgetc (f) != i % 251) {
+			same = false;
+		}
+	}
+	BOOST_CHECK (same);
+	BOOST_CHECK_EQUAL (fgetc (f), EOF);
+	fclose (f);
+
+	/* Copying onto an existing file is an error */
+	dcpomatic_copy_file (from, to, ec);
+	BOOST_CHECK (ec);
+}